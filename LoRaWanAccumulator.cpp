@@ -0,0 +1,173 @@
+/*
+  LoRaWanAccumulator.cpp
+  Running statistics of one measured channel in fixed point
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanAccumulator.h"
+
+
+// Division rounded half away from zero, divisor positive
+static long divideRounded(long value, long divisor)
+{
+    return value >= 0 ? (value + divisor / 2) / divisor : -((-value + divisor / 2) / divisor);
+}
+
+
+static unsigned long squareRoot(unsigned long value)
+{
+    unsigned long root = 0;
+    unsigned long bit = 1UL << 30;
+
+    while(bit > value)bit >>= 2;
+
+    while(bit)
+    {
+        if(value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else root >>= 1;
+        bit >>= 2;
+    }
+
+    // Round to the nearest integer
+    return value > root ? root + 1 : root;
+}
+
+
+static void writeShort(uint8_t *buffer, long value, long minimum, long maximum)
+{
+    if(value < minimum)value = minimum;
+    if(value > maximum)value = maximum;
+
+    buffer[0] = (value >> 8) & 0xFF;
+    buffer[1] = value & 0xFF;
+}
+
+
+LoRaWanAccumulator::LoRaWanAccumulator(unsigned char decimation, _decimation_t policy)
+{
+    _decimation = decimation ? decimation : 1;
+    _policy = policy;
+    clear();
+}
+
+
+void LoRaWanAccumulator::add(long value)
+{
+    if(!_samples || value < _min)_min = value;
+    if(!_samples || value > _max)_max = value;
+    _samples ++;
+
+    if(_decimation == 1)
+    {
+        update(value);
+        return;
+    }
+
+    if(_policy == DECIMATE_PICK)
+    {
+        if(!_waiting)update(value);
+    }
+    else _pending += value;
+
+    if(++ _waiting < _decimation)return;
+
+    if(_policy == DECIMATE_AVERAGE)update(divideRounded(_pending, _decimation));
+    _pending = 0;
+    _waiting = 0;
+}
+
+
+void LoRaWanAccumulator::clear(void)
+{
+    _m2 = 0;
+    _mean = 0;
+    _min = 0;
+    _max = 0;
+    _pending = 0;
+    _count = 0;
+    _samples = 0;
+    _waiting = 0;
+}
+
+
+unsigned long LoRaWanAccumulator::getSamples(void)
+{
+    return _samples;
+}
+
+
+unsigned long LoRaWanAccumulator::getCount(void)
+{
+    return _count;
+}
+
+
+long LoRaWanAccumulator::getMin(void)
+{
+    return _min;
+}
+
+
+long LoRaWanAccumulator::getMax(void)
+{
+    return _max;
+}
+
+
+long LoRaWanAccumulator::getMean(void)
+{
+    return divideRounded(_mean, 1L << ACCUMULATOR_FRACTION);
+}
+
+
+unsigned long LoRaWanAccumulator::getVariance(void)
+{
+    if(_count < 2)return 0;
+
+    uint64_t variance = (uint64_t)_m2 / (_count - 1);
+    return (variance + (1UL << (2 * ACCUMULATOR_FRACTION - 1))) >> (2 * ACCUMULATOR_FRACTION);
+}
+
+
+unsigned long LoRaWanAccumulator::getStdDev(void)
+{
+    if(_count < 2)return 0;
+
+    // Root taken with 4 fraction bits left, then rounded
+    uint64_t variance = ((uint64_t)_m2 / (_count - 1)) >> (2 * ACCUMULATOR_FRACTION - 8);
+    if(variance > 0xFFFFFFFFUL)variance = 0xFFFFFFFFUL;
+
+    return (squareRoot(variance) + 8) >> 4;
+}
+
+
+unsigned char LoRaWanAccumulator::encode(uint8_t *buffer)
+{
+    writeShort(buffer, _count, 0, 0xFFFF);
+    writeShort(buffer + 2, getMin(), -32768, 32767);
+    writeShort(buffer + 4, getMax(), -32768, 32767);
+    writeShort(buffer + 6, getMean(), -32768, 32767);
+    writeShort(buffer + 8, getStdDev(), 0, 0xFFFF);
+
+    return ACCUMULATOR_RECORD_LENGTH;
+}
+
+
+void LoRaWanAccumulator::update(long value)
+{
+    long scaled = value * (1L << ACCUMULATOR_FRACTION);
+
+    _count ++;
+
+    // Welford: the deviation from the old and from the new mean
+    long delta = scaled - _mean;
+    _mean += divideRounded(delta, _count);
+    _m2 += (int64_t)delta * (scaled - _mean);
+}
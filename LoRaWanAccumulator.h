@@ -0,0 +1,140 @@
+/*
+  LoRaWanAccumulator.h
+  Running statistics of one measured channel in fixed point
+
+  Count, minimum, maximum, mean and variance over any number of samples in
+  constant memory, by Welford's update. Samples are integers in the
+  caller's unit, millivolt or tenth degree for example. The mean is kept
+  with 8 fraction bits and the sum of squares in 64 bits, so a tick costs
+  a division and a multiplication, no float.
+
+  Decimation feeds only every n-th sample, or the mean of n samples, to
+  the statistics. Minimum and maximum always see every raw sample, so a
+  spike is never decimated away.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANACCUMULATOR_H_
+#define _LORAWANACCUMULATOR_H_
+
+
+#include <stdint.h>
+
+
+#define ACCUMULATOR_RECORD_LENGTH   10      // bytes written by encode()
+#define ACCUMULATOR_FRACTION        8       // fraction bits of the mean
+
+
+enum _decimation_t { DECIMATE_PICK = 0, DECIMATE_AVERAGE };
+
+
+class LoRaWanAccumulator
+{
+    public:
+
+        /**
+         *  \brief Create an accumulator
+         *
+         *  \param [in] decimation The raw samples per statistics sample, 1 keeps all
+         *  \param [in] policy DECIMATE_PICK keeps the first of them, DECIMATE_AVERAGE their mean
+         */
+        LoRaWanAccumulator(unsigned char decimation = 1, _decimation_t policy = DECIMATE_AVERAGE);
+
+        /**
+         *  \brief Add a raw sample
+         *
+         *  \param [in] value The sample in the channel unit, -4194304 to 4194303
+         *
+         *  \return Return null
+         */
+        void add(long value);
+
+        /**
+         *  \brief Forget all samples, after an uplink for example
+         *
+         *  \return Return null
+         */
+        void clear(void);
+
+        /**
+         *  \brief Raw samples added
+         *
+         *  \return Return sample count
+         */
+        unsigned long getSamples(void);
+
+        /**
+         *  \brief Samples in the statistics, after decimation
+         *
+         *  \return Return sample count
+         */
+        unsigned long getCount(void);
+
+        /**
+         *  \brief Lowest raw sample
+         *
+         *  \return Return value, 0 without samples
+         */
+        long getMin(void);
+
+        /**
+         *  \brief Highest raw sample
+         *
+         *  \return Return value, 0 without samples
+         */
+        long getMax(void);
+
+        /**
+         *  \brief Mean, rounded
+         *
+         *  \return Return value, 0 without statistics samples
+         */
+        long getMean(void);
+
+        /**
+         *  \brief Sample variance, rounded
+         *
+         *  \return Return value in the channel unit squared, 0 below two statistics samples
+         */
+        unsigned long getVariance(void);
+
+        /**
+         *  \brief Sample standard deviation, rounded
+         *
+         *  \return Return value, 0 below two statistics samples
+         */
+        unsigned long getStdDev(void);
+
+        /**
+         *  \brief Write the statistics as an uplink record
+         *
+         *  Big endian: statistics sample count, minimum, maximum, mean and
+         *  standard deviation, two bytes each. Values saturate at the 16 bit
+         *  range, signed except count and deviation.
+         *
+         *  \param [out] *buffer The output cache, ACCUMULATOR_RECORD_LENGTH bytes
+         *
+         *  \return Return record length
+         */
+        unsigned char encode(uint8_t *buffer);
+
+    private:
+        void update(long value);
+
+        int64_t _m2;            // sum of squared deviations, 2 * ACCUMULATOR_FRACTION fraction bits
+        long _mean;             // ACCUMULATOR_FRACTION fraction bits
+        long _min;
+        long _max;
+        long _pending;          // sum of the raw samples waiting for decimation
+        unsigned long _count;
+        unsigned long _samples;
+        unsigned char _decimation;
+        unsigned char _waiting;
+        _decimation_t _policy;
+};
+
+
+#endif
@@ -0,0 +1,339 @@
+/*
+  LoRaWanCapture.cpp
+  Record and replay of modem UART traffic
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "SeeeduinoLoRaWan.h"
+
+
+static const char CAPTURE_MAGIC[4] = {'L', 'W', 'R', '1'};
+
+
+LoRaWanCapture::LoRaWanCapture(Print *sink)
+{
+    _sink = sink;
+    _pendingLength = 0;
+    _pendingReceived = false;
+    _pendingTime = 0;
+    _lastTime = millis();
+}
+
+
+void LoRaWanCapture::begin(void)
+{
+    _sink->write((const uint8_t *)CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    _lastTime = millis();
+}
+
+
+void LoRaWanCapture::tx(const char *data, size_t length)
+{
+    while(length --)add(false, *data ++);
+}
+
+
+void LoRaWanCapture::rx(char c)
+{
+    add(true, c);
+}
+
+
+void LoRaWanCapture::flush(void)
+{
+    if(!_pendingLength)return;
+
+    unsigned long delta = _pendingTime - _lastTime;
+
+    _sink->write((uint8_t)((_pendingReceived ? 0x80 : 0x00) | _pendingLength));
+    do
+    {
+        uint8_t c = delta & 0x7F;
+        delta >>= 7;
+        _sink->write((uint8_t)(delta ? c | 0x80 : c));
+    } while(delta);
+    _sink->write((const uint8_t *)_pending, _pendingLength);
+
+    _lastTime = _pendingTime;
+    _pendingLength = 0;
+}
+
+
+void LoRaWanCapture::add(bool received, char c)
+{
+    unsigned long now = millis();
+
+    if(_pendingLength && (received != _pendingReceived || _pendingLength == CAPTURE_CHUNK_MAX || now - _pendingTime >= CAPTURE_GAP))
+    {
+        flush();
+    }
+
+    _pending[_pendingLength ++] = c;
+    _pendingReceived = received;
+    _pendingTime = now;
+}
+
+
+LoRaWanReplay::LoRaWanReplay(const uint8_t *log, size_t length)
+{
+    _log = log;
+    _length = length;
+    _pos = sizeof(CAPTURE_MAGIC);
+    _received = false;
+    _data = NULL;
+    _recordTime = 0;
+    _logNow = 0;
+    _anchorLog = 0;
+    _anchorReplay = millis();
+    _scale = 1;
+    _mismatches = 0;
+
+    _commandCount = 0;
+    _command = -1;
+    _lineStart = true;
+    _nameLength = 0;
+    _commandLog = 0;
+    _commandReplay = 0;
+    _commandReceived = 0;
+
+    if(valid())next();
+    else _remaining = 0;
+}
+
+
+void LoRaWanReplay::setSpeed(unsigned short scale)
+{
+    _scale = scale ? scale : 1;
+}
+
+
+bool LoRaWanReplay::valid(void)
+{
+    return _length >= sizeof(CAPTURE_MAGIC) && !memcmp(_log, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+}
+
+
+bool LoRaWanReplay::finished(void)
+{
+    return !_remaining;
+}
+
+
+unsigned long LoRaWanReplay::getMismatches(void)
+{
+    return _mismatches;
+}
+
+
+int LoRaWanReplay::available(void)
+{
+    return due() ? _remaining : 0;
+}
+
+
+int LoRaWanReplay::read(void)
+{
+    if(!due())return -1;
+
+    uint8_t c = *_data ++;
+
+    _commandReceived ++;
+    if(!-- _remaining)
+    {
+        _logNow = _recordTime;
+        next();
+    }
+
+    return c;
+}
+
+
+int LoRaWanReplay::peek(void)
+{
+    return due() ? *_data : -1;
+}
+
+
+size_t LoRaWanReplay::write(uint8_t c)
+{
+    // Answers the library never read were flushed or came after its timeout
+    while(_remaining && _received)
+    {
+        _logNow = _recordTime;
+        next();
+    }
+
+    if(_lineStart)
+    {
+        _logNow = _recordTime;
+        endCommand();
+        startCommand();
+    }
+
+    if(_command < 0)
+    {
+        if(c == '=' || c == '?' || c == '\r' || c == '\n' || _nameLength == REPLAY_NAME_LENGTH - 1)
+        {
+            _name[_nameLength] = '\0';
+            findCommand();
+        }
+        else _name[_nameLength ++] = c;
+    }
+    _lineStart = c == '\n';
+
+    if(!_remaining)
+    {
+        _mismatches ++;
+        return 1;
+    }
+
+    if(*_data != c)_mismatches ++;
+    _data ++;
+
+    if(!-- _remaining)
+    {
+        // The modem answer is timed from the end of the command that caused it
+        _logNow = _recordTime;
+        _anchorLog = _recordTime;
+        _anchorReplay = millis();
+        next();
+    }
+
+    return 1;
+}
+
+
+void LoRaWanReplay::report(Print &out)
+{
+    endCommand();
+
+    out.println("command      count  recorded ms  replayed ms  max ms  change %  rx B/s");
+    for(unsigned char i = 0; i < _commandCount; i ++)
+    {
+        command_t *command = &_commands[i];
+        unsigned long recorded = command->recorded / command->count;
+        unsigned long replayed = command->replayed / command->count;
+
+        printColumn(out, command->name, 0, 13);
+        printColumn(out, NULL, command->count, 5);
+        printColumn(out, NULL, recorded, 13);
+        printColumn(out, NULL, replayed, 13);
+        printColumn(out, NULL, command->replayedMax, 8);
+        printColumn(out, NULL, recorded ? replayed * 100 / recorded : 0, 10);
+        printColumn(out, NULL, command->replayed ? command->received * 1000 / command->replayed : 0, 8);
+        out.println();
+    }
+
+    out.print("mismatches: ");
+    out.println(_mismatches);
+}
+
+
+bool LoRaWanReplay::next(void)
+{
+    _remaining = 0;
+    if(_pos + 2 > _length)return false;
+
+    uint8_t header = _log[_pos ++];
+    unsigned long delta = 0;
+    unsigned char shift = 0;
+
+    while(_pos < _length)
+    {
+        uint8_t c = _log[_pos ++];
+        delta |= (unsigned long)(c & 0x7F) << shift;
+        shift += 7;
+        if(!(c & 0x80))break;
+    }
+
+    unsigned char length = header & 0x7F;
+    if(_pos + length > _length)return false;
+
+    _received = header & 0x80;
+    _recordTime += delta;
+    _data = &_log[_pos];
+    _remaining = length;
+    _pos += length;
+
+    return true;
+}
+
+
+bool LoRaWanReplay::due(void)
+{
+    if(!_remaining || !_received)return false;
+    return (millis() - _anchorReplay) * _scale >= _recordTime - _anchorLog;
+}
+
+
+void LoRaWanReplay::startCommand(void)
+{
+    _command = -1;
+    _nameLength = 0;
+    _commandLog = _logNow;
+    _commandReplay = millis();
+    _commandReceived = 0;
+}
+
+
+void LoRaWanReplay::endCommand(void)
+{
+    if(_command < 0)return;
+
+    command_t *command = &_commands[_command];
+    unsigned long replayed = millis() - _commandReplay;
+
+    command->count ++;
+    command->recorded += _logNow - _commandLog;
+    command->replayed += replayed;
+    if(replayed > command->replayedMax)command->replayedMax = replayed;
+    command->received += _commandReceived;
+
+    _command = -1;
+}
+
+
+void LoRaWanReplay::findCommand(void)
+{
+    for(unsigned char i = 0; i < _commandCount; i ++)
+    {
+        if(!strcmp(_commands[i].name, _name))
+        {
+            _command = i;
+            return;
+        }
+    }
+
+    if(_commandCount == REPLAY_COMMANDS_MAX)return;
+
+    command_t *command = &_commands[_commandCount];
+    strcpy(command->name, _name);
+    command->count = 0;
+    command->recorded = 0;
+    command->replayed = 0;
+    command->replayedMax = 0;
+    command->received = 0;
+    _command = _commandCount ++;
+}
+
+
+void LoRaWanReplay::printColumn(Print &out, const char *text, unsigned long value, unsigned char width)
+{
+    char number[NUMBER_TEXT_MAX];
+
+    if(!text)
+    {
+        LoRaWanClass::formatNumber(number, value);
+        text = number;
+        for(unsigned char i = strlen(text); i < width; i ++)out.print(' ');
+        out.print(text);
+    }
+    else
+    {
+        out.print(text);
+        for(unsigned char i = strlen(text); i < width; i ++)out.print(' ');
+    }
+}
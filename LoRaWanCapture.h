@@ -0,0 +1,192 @@
+/*
+  LoRaWanCapture.h
+  Record and replay of modem UART traffic
+
+  LoRaWanCapture writes every byte exchanged with the modem, both directions,
+  to a compact timestamped log. LoRaWanReplay plays such a log back as the
+  modem stream, with the original or scaled timing, and reports how long
+  each AT command took compared to the recording.
+
+  Log format, after the 4 byte magic "LWR1", a sequence of records:
+    header   bit 7 direction (0 to modem, 1 from modem), bits 0-6 length
+    delta    time since the previous record in millisecond, LEB128
+    data     length bytes
+  A record is stamped with the time its last byte was seen.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANCAPTURE_H_
+#define _LORAWANCAPTURE_H_
+
+
+#include <Arduino.h>
+
+
+#define CAPTURE_CHUNK_MAX       32      // bytes merged into one record
+#define CAPTURE_GAP             2       // millisecond of silence that ends a record
+#define REPLAY_COMMANDS_MAX     16      // distinct AT commands in a report
+#define REPLAY_NAME_LENGTH      12
+
+
+class LoRaWanCapture
+{
+    public:
+
+        /**
+         *  \brief Create a capture writing to a sink, e.g. a file or SerialUSB
+         *
+         *  \param [in] *sink The log output
+         */
+        LoRaWanCapture(Print *sink);
+
+        /**
+         *  \brief Write the log magic, call once before the first command
+         *
+         *  \return Return null
+         */
+        void begin(void);
+
+        /**
+         *  \brief Record bytes sent to the modem
+         *
+         *  \param [in] *data The sent bytes
+         *  \param [in] length The number of bytes
+         *
+         *  \return Return null
+         */
+        void tx(const char *data, size_t length);
+
+        /**
+         *  \brief Record a byte received from the modem
+         *
+         *  \param [in] c The received byte
+         *
+         *  \return Return null
+         */
+        void rx(char c);
+
+        /**
+         *  \brief Write out the pending record
+         *
+         *  \return Return null
+         */
+        void flush(void);
+
+    private:
+        void add(bool received, char c);
+
+        Print *_sink;
+        char _pending[CAPTURE_CHUNK_MAX];
+        unsigned char _pendingLength;
+        bool _pendingReceived;
+        unsigned long _pendingTime;
+        unsigned long _lastTime;
+};
+
+
+class LoRaWanReplay : public Stream
+{
+    public:
+
+        /**
+         *  \brief Play back a captured log
+         *
+         *  \param [in] *log The log bytes, must outlive the replay
+         *  \param [in] length The log length
+         */
+        LoRaWanReplay(const uint8_t *log, size_t length);
+
+        /**
+         *  \brief Speed up the modem answers
+         *
+         *  \param [in] scale 1 : original timing, 10 : ten times faster
+         *
+         *  \return Return null
+         */
+        void setSpeed(unsigned short scale);
+
+        /**
+         *  \brief Check the log header
+         *
+         *  \return Return bool. True : valid log
+         */
+        bool valid(void);
+
+        /**
+         *  \brief Check if the whole log has been played
+         *
+         *  \return Return bool. True : finished
+         */
+        bool finished(void);
+
+        /**
+         *  \brief Bytes the library sent that differ from the recording
+         *
+         *  \return Return mismatch count
+         */
+        unsigned long getMismatches(void);
+
+        /**
+         *  \brief Print recorded vs replayed duration of every AT command
+         *
+         *  \param [in] &out The report output
+         *
+         *  \return Return null
+         */
+        void report(Print &out);
+
+        virtual int available(void);
+        virtual int read(void);
+        virtual int peek(void);
+        virtual size_t write(uint8_t c);
+        using Print::write;
+
+    private:
+        struct command_t
+        {
+            char name[REPLAY_NAME_LENGTH];
+            unsigned long count;
+            unsigned long recorded;     // millisecond
+            unsigned long replayed;
+            unsigned long replayedMax;
+            unsigned long received;     // bytes
+        };
+
+        bool next(void);
+        bool due(void);
+        void startCommand(void);
+        void endCommand(void);
+        void findCommand(void);
+        static void printColumn(Print &out, const char *text, unsigned long value, unsigned char width);
+
+        const uint8_t *_log;
+        size_t _length;
+        size_t _pos;
+
+        bool _received;
+        const uint8_t *_data;
+        unsigned char _remaining;
+        unsigned long _recordTime;
+        unsigned long _logNow;
+
+        unsigned long _anchorLog;
+        unsigned long _anchorReplay;
+        unsigned short _scale;
+        unsigned long _mismatches;
+
+        command_t _commands[REPLAY_COMMANDS_MAX];
+        unsigned char _commandCount;
+        short _command;
+        bool _lineStart;
+        unsigned char _nameLength;
+        char _name[REPLAY_NAME_LENGTH];
+        unsigned long _commandLog;
+        unsigned long _commandReplay;
+        unsigned long _commandReceived;
+};
+
+
+#endif
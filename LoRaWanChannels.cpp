@@ -0,0 +1,172 @@
+/*
+  LoRaWanChannels.cpp
+  Per channel uplink statistics and masking policy
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanChannels.h"
+
+
+LoRaWanChannels::LoRaWanChannels(unsigned long cooldown, unsigned char failLimit)
+{
+    memset(_channels, 0, sizeof(_channels));
+    _cooldown = cooldown;
+    _failLimit = failLimit;
+    _last = CHANNELS_MAX - 1;
+}
+
+
+void LoRaWanChannels::setChannel(unsigned char channel, unsigned long frequency, unsigned char dataRateMin, unsigned char dataRateMax)
+{
+    if(channel >= CHANNELS_MAX)return;
+
+    channel_t *ptr = &_channels[channel];
+
+    // A new frequency is a new channel, its history does not apply
+    if(ptr->frequency != frequency)memset(ptr, 0, sizeof(channel_t));
+
+    ptr->frequency = frequency;
+    ptr->dataRateMin = dataRateMin;
+    ptr->dataRateMax = dataRateMax;
+}
+
+
+void LoRaWanChannels::addResult(unsigned char channel, _channel_result_t result, short rssi)
+{
+    if(channel >= CHANNELS_MAX)return;
+
+    channel_t *ptr = &_channels[channel];
+
+    ptr->sent ++;
+    if(rssi)ptr->rssi = ptr->rssi ? (ptr->rssi * 3 + rssi) / 4 : rssi;
+
+    if(result == CHANNEL_ACKED)
+    {
+        ptr->acked ++;
+        ptr->failures = 0;
+    }
+    else if(result == CHANNEL_FAILED)
+    {
+        ptr->failed ++;
+        if(ptr->failures < 0xFF)ptr->failures ++;
+        if(_failLimit && ptr->failures >= _failLimit)mask(channel);
+    }
+}
+
+
+short LoRaWanChannels::next(void)
+{
+    unsigned long now = millis();
+
+    for(unsigned char i = 0; i < CHANNELS_MAX; i ++)
+    {
+        channel_t *ptr = &_channels[i];
+
+        // Back on probation, one more failure masks it again
+        if(ptr->masked && now - ptr->maskedAt >= _cooldown)
+        {
+            ptr->masked = false;
+            if(_failLimit)ptr->failures = _failLimit - 1;
+        }
+    }
+
+    for(unsigned char i = 1; i <= CHANNELS_MAX; i ++)
+    {
+        unsigned char channel = (_last + i) % CHANNELS_MAX;
+
+        if(_channels[channel].frequency && !_channels[channel].masked)
+        {
+            _last = channel;
+            return channel;
+        }
+    }
+
+    return -1;
+}
+
+
+bool LoRaWanChannels::mask(unsigned char channel)
+{
+    if(channel >= CHANNELS_MAX || !_channels[channel].frequency)return false;
+    if(_channels[channel].masked)return true;
+    if(enabled() <= CHANNEL_ENABLED_MIN)return false;
+
+    _channels[channel].masked = true;
+    _channels[channel].maskedAt = millis();
+
+    return true;
+}
+
+
+bool LoRaWanChannels::isMasked(unsigned char channel)
+{
+    return channel < CHANNELS_MAX && _channels[channel].masked;
+}
+
+
+unsigned long LoRaWanChannels::getFrequency(unsigned char channel)
+{
+    return channel < CHANNELS_MAX ? _channels[channel].frequency : 0;
+}
+
+
+unsigned char LoRaWanChannels::getDataRateMin(unsigned char channel)
+{
+    return channel < CHANNELS_MAX ? _channels[channel].dataRateMin : 0;
+}
+
+
+unsigned char LoRaWanChannels::getDataRateMax(unsigned char channel)
+{
+    return channel < CHANNELS_MAX ? _channels[channel].dataRateMax : 0;
+}
+
+
+unsigned short LoRaWanChannels::getSent(unsigned char channel)
+{
+    return channel < CHANNELS_MAX ? _channels[channel].sent : 0;
+}
+
+
+unsigned short LoRaWanChannels::getAcked(unsigned char channel)
+{
+    return channel < CHANNELS_MAX ? _channels[channel].acked : 0;
+}
+
+
+unsigned short LoRaWanChannels::getFailed(unsigned char channel)
+{
+    return channel < CHANNELS_MAX ? _channels[channel].failed : 0;
+}
+
+
+unsigned char LoRaWanChannels::getDeliveryRate(unsigned char channel)
+{
+    if(channel >= CHANNELS_MAX)return 0;
+
+    unsigned long known = (unsigned long)_channels[channel].acked + _channels[channel].failed;
+    if(!known)return 100;
+
+    return _channels[channel].acked * 100UL / known;
+}
+
+
+short LoRaWanChannels::getRssi(unsigned char channel)
+{
+    return channel < CHANNELS_MAX ? _channels[channel].rssi : 0;
+}
+
+
+unsigned char LoRaWanChannels::enabled(void)
+{
+    unsigned char count = 0;
+
+    for(unsigned char i = 0; i < CHANNELS_MAX; i ++)
+    {
+        if(_channels[i].frequency && !_channels[i].masked)count ++;
+    }
+    return count;
+}
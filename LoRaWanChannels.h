@@ -0,0 +1,196 @@
+/*
+  LoRaWanChannels.h
+  Per channel uplink statistics and masking policy
+
+  The modem does not tell which channel an uplink went out on, so the
+  library steers every confirmed uplink to one channel, leaving only that
+  channel enabled, and books the outcome against it. A channel whose uplinks
+  keep failing is skipped for a cool-down time and then tried again.
+  Unconfirmed uplinks carry no outcome and are not steered.
+
+  Outcome of an uplink:
+    acked       confirmed uplink acknowledged
+    failed      confirmed uplink without acknowledge
+    sent        delivery unknown, booked only by addResult() callers
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANCHANNELS_H_
+#define _LORAWANCHANNELS_H_
+
+
+#include <Arduino.h>
+
+
+#define CHANNELS_MAX            8
+#define CHANNEL_FAIL_LIMIT      3           // failures in a row that mask a channel
+#define CHANNEL_COOLDOWN        600000UL    // millisecond a masked channel rests
+#define CHANNEL_ENABLED_MIN     3           // never mask below this many channels
+
+
+enum _channel_result_t { CHANNEL_SENT = 0, CHANNEL_ACKED, CHANNEL_FAILED };
+
+
+class LoRaWanChannels
+{
+    public:
+
+        /**
+         *  \brief Create the statistics with a masking policy
+         *
+         *  \param [in] cooldown The time a masked channel rests in millisecond
+         *  \param [in] failLimit The failures in a row that mask a channel, 0 never masks
+         */
+        LoRaWanChannels(unsigned long cooldown = CHANNEL_COOLDOWN, unsigned char failLimit = CHANNEL_FAIL_LIMIT);
+
+        /**
+         *  \brief Remember a channel, called by the library from setChannelHz()
+         *
+         *  \param [in] channel The channel number
+         *  \param [in] frequency The frequency in Hz, 0 removes the channel
+         *  \param [in] dataRateMin The lowest data rate
+         *  \param [in] dataRateMax The highest data rate
+         *
+         *  \return Return null
+         */
+        void setChannel(unsigned char channel, unsigned long frequency, unsigned char dataRateMin, unsigned char dataRateMax);
+
+        /**
+         *  \brief Book an uplink outcome, called by the library
+         *
+         *  \param [in] channel The channel the uplink was steered to
+         *  \param [in] result The outcome
+         *  \param [in] rssi The downlink RSSI, 0 when nothing was heard
+         *
+         *  \return Return null
+         */
+        void addResult(unsigned char channel, _channel_result_t result, short rssi);
+
+        /**
+         *  \brief Pick the channel for the next uplink, round robin over unmasked ones
+         *
+         *  Masked channels whose cool-down has passed are unmasked and wait for
+         *  their turn in the rotation, one more failure masks them again.
+         *
+         *  \return Return channel number, -1 without channels
+         */
+        short next(void);
+
+        /**
+         *  \brief Mask a channel by hand, it returns after the cool-down
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return bool. False : unknown channel or too few left
+         */
+        bool mask(unsigned char channel);
+
+        /**
+         *  \brief Check if a channel is masked
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return bool. True : masked
+         */
+        bool isMasked(unsigned char channel);
+
+        /**
+         *  \brief Frequency of a channel
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return frequency in Hz, 0 for an unknown channel
+         */
+        unsigned long getFrequency(unsigned char channel);
+
+        /**
+         *  \brief Lowest data rate of a channel
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return data rate
+         */
+        unsigned char getDataRateMin(unsigned char channel);
+
+        /**
+         *  \brief Highest data rate of a channel
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return data rate
+         */
+        unsigned char getDataRateMax(unsigned char channel);
+
+        /**
+         *  \brief Uplinks steered to a channel
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return uplink count
+         */
+        unsigned short getSent(unsigned char channel);
+
+        /**
+         *  \brief Uplinks on a channel that were acknowledged
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return uplink count
+         */
+        unsigned short getAcked(unsigned char channel);
+
+        /**
+         *  \brief Confirmed uplinks on a channel without acknowledge
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return uplink count
+         */
+        unsigned short getFailed(unsigned char channel);
+
+        /**
+         *  \brief Acknowledged share of the uplinks with a known outcome
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return percent, 100 without known outcomes
+         */
+        unsigned char getDeliveryRate(unsigned char channel);
+
+        /**
+         *  \brief Smoothed RSSI of the downlinks heard after uplinks on a channel
+         *
+         *  \param [in] channel The channel number
+         *
+         *  \return Return RSSI in dBm, 0 when nothing was heard
+         */
+        short getRssi(unsigned char channel);
+
+    private:
+        struct channel_t
+        {
+            unsigned long frequency;
+            unsigned long maskedAt;
+            unsigned short sent;
+            unsigned short acked;
+            unsigned short failed;
+            short rssi;
+            unsigned char dataRateMin;
+            unsigned char dataRateMax;
+            unsigned char failures;
+            bool masked;
+        };
+
+        unsigned char enabled(void);
+
+        channel_t _channels[CHANNELS_MAX];
+        unsigned long _cooldown;
+        unsigned char _failLimit;
+        unsigned char _last;
+};
+
+
+#endif
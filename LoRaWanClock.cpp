@@ -0,0 +1,187 @@
+/*
+  LoRaWanClock.cpp
+  GPS time from the network, disciplined against the local timebase
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanClock.h"
+
+
+LoRaWanClock::LoRaWanClock(void)
+{
+    _base = 0;
+    _local = 0;
+    _rateBase = 0;
+    _rateLocal = 0;
+    _drift = 0;
+    _driftRejects = 0;
+    _lastError = 0;
+    _syncs = 0;
+    _rx1Delay = CLOCK_RX1_DELAY;
+    _rx2Delay = CLOCK_RX2_DELAY;
+    _synced = false;
+}
+
+
+void LoRaWanClock::setReceiveDelays(unsigned short rx1, unsigned short rx2)
+{
+    _rx1Delay = rx1;
+    _rx2Delay = rx2;
+}
+
+
+bool LoRaWanClock::sync(const LoRaWanDeviceTime *answer, unsigned long now)
+{
+    if(!answer->gpsSeconds)return false;
+
+    // The answer is read after the receive window, the downlink and the
+    // modem lines behind it. An unreported window is taken as RX1.
+    bool rx2 = answer->window == 2;
+    unsigned long delay = rx2 ? _rx2Delay : _rx1Delay;
+
+    delay += LoRaWanEnergy::getAirtime(answer->downlinkLength, rx2 ? CLOCK_RX2_DATA_RATE : answer->dataRate);
+    delay += (unsigned long)answer->tailBytes * CLOCK_UART_BYTE / 1000;
+
+    unsigned long local = now - delay;
+    uint64_t gps = answer->gpsSeconds * 1000ULL + answer->milliseconds;
+
+    if(!_synced)
+    {
+        _rateBase = gps;
+        _rateLocal = local;
+    }
+    else
+    {
+        _lastError = (long)((int64_t)gps - (int64_t)toGps(local));
+
+        // The rate is measured over an hour at least, the network time is good to some 10 ms
+        unsigned long span = local - _rateLocal;
+        if(span >= CLOCK_DRIFT_SPAN)
+        {
+            int64_t ppm = ((int64_t)(gps - _rateBase) - (int64_t)span) * 1000000 / (int64_t)span;
+
+            if(ppm >= -CLOCK_DRIFT_MAX && ppm <= CLOCK_DRIFT_MAX)_drift = ppm;
+            else _driftRejects ++;
+            _rateBase = gps;
+            _rateLocal = local;
+        }
+    }
+
+    pin(gps, local);
+    return true;
+}
+
+
+bool LoRaWanClock::syncBeacon(unsigned long now)
+{
+    if(!_synced)return false;
+
+    unsigned long local = now - CLOCK_BEACON_DELAY;
+    uint64_t gps = toGps(local);
+    uint64_t phase = gps % CLOCK_BEACON_PERIOD;
+
+    // The nearest beacon start, the clock is trusted to half a period
+    if(phase < CLOCK_BEACON_PERIOD / 2)
+    {
+        _lastError = -(long)phase;
+        gps -= phase;
+    }
+    else
+    {
+        _lastError = CLOCK_BEACON_PERIOD - phase;
+        gps += CLOCK_BEACON_PERIOD - phase;
+    }
+
+    pin(gps, local);
+    return true;
+}
+
+
+bool LoRaWanClock::isSynced(void)
+{
+    return _synced;
+}
+
+
+unsigned long LoRaWanClock::getGpsTime(unsigned long now)
+{
+    return _synced ? toGps(now) / 1000 : 0;
+}
+
+
+unsigned long LoRaWanClock::getUnixTime(unsigned long now)
+{
+    return _synced ? getGpsTime(now) + CLOCK_GPS_UNIX - CLOCK_LEAP_SECONDS : 0;
+}
+
+
+unsigned long LoRaWanClock::getSlotDelay(unsigned long now, unsigned long period, unsigned short slot, unsigned short slots)
+{
+    if(!period || slot >= slots)return 0;
+
+    unsigned long start = (uint64_t)period * slot / slots;
+    if(!_synced)return start;
+
+    unsigned long phase = toGps(now) % period;
+    return phase <= start ? start - phase : period - phase + start;
+}
+
+
+unsigned short LoRaWanClock::getSlot(const char *id, unsigned short slots)
+{
+    // FNV-1a, DevEUIs that differ in one digit land in different slots
+    uint32_t hash = 2166136261UL;
+
+    while(*id)
+    {
+        hash ^= (uint8_t)*id ++;
+        hash *= 16777619UL;
+    }
+
+    return slots ? hash % slots : 0;
+}
+
+
+unsigned long LoRaWanClock::getSyncs(void)
+{
+    return _syncs;
+}
+
+
+long LoRaWanClock::getLastError(void)
+{
+    return _lastError;
+}
+
+
+long LoRaWanClock::getDrift(void)
+{
+    return _drift;
+}
+
+
+unsigned long LoRaWanClock::getDriftRejects(void)
+{
+    return _driftRejects;
+}
+
+
+uint64_t LoRaWanClock::toGps(unsigned long local)
+{
+    // Signed, the end of an uplink can lie before the last beacon
+    long elapsed = (long)(local - _local);
+
+    return _base + elapsed + (int64_t)elapsed * _drift / 1000000;
+}
+
+
+void LoRaWanClock::pin(uint64_t gps, unsigned long local)
+{
+    _base = gps;
+    _local = local;
+    _synced = true;
+    _syncs ++;
+}
@@ -0,0 +1,181 @@
+/*
+  LoRaWanClock.h
+  GPS time from the network, disciplined against the local timebase
+
+  The node asks for the time with a DeviceTimeReq on an uplink, see
+  LoRaWanClass::requestDeviceTime(). The answer holds the GPS time at the
+  end of that uplink, the modem reports it after the receive window. The
+  clock takes off the receive delay, the downlink airtime and the modem
+  output behind the answer, and pins the GPS time to the local time of
+  the end of the uplink.
+
+  The local timebase is any millisecond clock that keeps running through
+  sleep, LoRaWanScheduler::now() or the RTC. Two syncs an hour or more
+  apart give its rate error, later readings are corrected by it.
+
+  A Class B beacon starts on a multiple of 128 s of GPS time. Once the
+  clock is within a minute, the moment a beacon was heard pins the
+  phase again without an uplink.
+
+  Uplinks of a fleet spread over slots of a common period, each node
+  sends at the start of its own slot instead of at a random time.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANCLOCK_H_
+#define _LORAWANCLOCK_H_
+
+
+#include "SeeeduinoLoRaWan.h"
+
+
+#define CLOCK_RX1_DELAY         1000    // millisecond, RECEIVE_DELAY1 as the region setup sets it
+#define CLOCK_RX2_DELAY         2000    // millisecond, RECEIVE_DELAY2
+#define CLOCK_RX2_DATA_RATE     0       // EU433 and EU868 RX2 as the region setup sets it
+#define CLOCK_UART_BYTE         1042    // microsecond per byte at 9600 baud
+#define CLOCK_GPS_UNIX          315964800UL     // Unix time of the GPS epoch, 6. 1. 1980
+#define CLOCK_LEAP_SECONDS      18      // GPS ahead of UTC since 2017
+#define CLOCK_BEACON_PERIOD     128000UL        // millisecond, beacons start on multiples of it
+#define CLOCK_BEACON_DELAY      155     // millisecond, beacon airtime at SF9 and its 1.5 ms delay
+#define CLOCK_DRIFT_SPAN        3600000UL       // millisecond between syncs to measure the rate
+#define CLOCK_DRIFT_MAX         500     // ppm, a larger rate error is taken as a step
+
+
+class LoRaWanClock
+{
+    public:
+
+        LoRaWanClock(void);
+
+        /**
+         *  \brief Set the receive delays the modem uses, if changed with setReceiveWindowDelay()
+         *
+         *  \param [in] rx1 The RX1 delay in millisecond
+         *  \param [in] rx2 The RX2 delay in millisecond
+         *
+         *  \return Return null
+         */
+        void setReceiveDelays(unsigned short rx1, unsigned short rx2);
+
+        /**
+         *  \brief Set the clock from a DeviceTimeAns
+         *
+         *  \param [in] *answer The answer from LoRaWanClass::getDeviceTime()
+         *  \param [in] now The local time in millisecond when the uplink call returned
+         *
+         *  \return Return bool. True : set
+         */
+        bool sync(const LoRaWanDeviceTime *answer, unsigned long now);
+
+        /**
+         *  \brief Pin the phase to a Class B beacon
+         *
+         *  \param [in] now The local time in millisecond the beacon was reported
+         *
+         *  \return Return bool. True : set, false : never synced by an answer
+         */
+        bool syncBeacon(unsigned long now);
+
+        /**
+         *  \brief Check whether the clock was set
+         *
+         *  \return Return bool. True : set
+         */
+        bool isSynced(void);
+
+        /**
+         *  \brief GPS time
+         *
+         *  \param [in] now The local time in millisecond
+         *
+         *  \return Return second since the GPS epoch, 0 : not synced
+         */
+        unsigned long getGpsTime(unsigned long now);
+
+        /**
+         *  \brief Unix time, UTC
+         *
+         *  \param [in] now The local time in millisecond
+         *
+         *  \return Return second since 1. 1. 1970, 0 : not synced
+         */
+        unsigned long getUnixTime(unsigned long now);
+
+        /**
+         *  \brief Time to the start of a slot
+         *
+         *  The period is cut into slots from the GPS epoch on. Before the
+         *  first sync, slots are counted from now and do not line up across nodes.
+         *
+         *  \param [in] now The local time in millisecond
+         *  \param [in] period The period in millisecond, the same on every node
+         *  \param [in] slot The slot of this node, below slots
+         *  \param [in] slots The slot count
+         *
+         *  \return Return time in millisecond, 0 : the slot starts now
+         */
+        unsigned long getSlotDelay(unsigned long now, unsigned long period, unsigned short slot, unsigned short slots);
+
+        /**
+         *  \brief Slot of a node from its identity, spreads a fleet without a slot plan
+         *
+         *  \param [in] *id The identity, e.g. the DevEUI
+         *  \param [in] slots The slot count
+         *
+         *  \return Return slot number
+         */
+        static unsigned short getSlot(const char *id, unsigned short slots);
+
+        /**
+         *  \brief Syncs so far, answers and beacons
+         *
+         *  \return Return sync count
+         */
+        unsigned long getSyncs(void);
+
+        /**
+         *  \brief How far the clock was off at the last sync, after the rate correction
+         *
+         *  \return Return time in millisecond, positive : the clock was behind
+         */
+        long getLastError(void);
+
+        /**
+         *  \brief Rate error of the local timebase
+         *
+         *  \return Return ppm, positive : the local clock runs slow
+         */
+        long getDrift(void);
+
+        /**
+         *  \brief Rate measurements beyond CLOCK_DRIFT_MAX, left out of the correction
+         *
+         *  A crystal is good to some 50 ppm, more points at the timebase, e.g.
+         *  a sleep callback that reports more or less than it slept.
+         *
+         *  \return Return measurement count
+         */
+        unsigned long getDriftRejects(void);
+
+    private:
+        uint64_t toGps(unsigned long local);
+        void pin(uint64_t gps, unsigned long local);
+
+        uint64_t _base;                 // GPS time in millisecond at _local
+        unsigned long _local;           // local time of the last sync
+        uint64_t _rateBase;             // GPS time and local time the rate is measured from
+        unsigned long _rateLocal;
+        long _drift;
+        unsigned long _driftRejects;
+        long _lastError;
+        unsigned long _syncs;
+        unsigned short _rx1Delay;
+        unsigned short _rx2Delay;
+        bool _synced;
+};
+
+
+#endif
@@ -0,0 +1,470 @@
+/*
+  LoRaWanCommandQueue.cpp
+  One owner task for the modem, a bounded command queue in front of it
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanCommandQueue.h"
+
+
+LoRaWanCommandQueue *LoRaWanCommandQueue::_active = NULL;
+
+
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+static TickType_t toTicks(unsigned long ms)
+{
+    return ms == QUEUE_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(ms);
+}
+#endif
+
+
+LoRaWanCommandQueue::LoRaWanCommandQueue(LoRaWanClass &lora)
+{
+    _lora = &lora;
+    memset(_slots, 0, sizeof(_slots));
+    memset(_subscribers, 0, sizeof(_subscribers));
+    _head = 0;
+    _count = 0;
+    _depthMax = 0;
+    _served = 0;
+    _rejected = 0;
+    _queueWait = 0;
+    _queueWaitMax = 0;
+    _locks = 0;
+    _lockWait = 0;
+    _lockWaitMax = 0;
+
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    _mutex = NULL;
+    _free = NULL;
+    _owner = NULL;
+#endif
+}
+
+
+bool LoRaWanCommandQueue::begin(void)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    if(!_mutex)_mutex = xSemaphoreCreateMutex();
+    if(!_free)_free = xSemaphoreCreateCounting(LORAWAN_QUEUE_DEPTH, LORAWAN_QUEUE_DEPTH);
+    if(!_mutex || !_free)return false;
+#endif
+
+    _active = this;
+    _lora->setDownlinkHandler(fanOut);
+
+    return true;
+}
+
+
+bool LoRaWanCommandQueue::submit(LoRaWanTicket *ticket, _modem_job_t job, void *context, unsigned long timeout)
+{
+    ticket->job = job;
+    ticket->context = context;
+    ticket->result = 0;
+    ticket->waiter = NULL;
+    ticket->queued = millis();
+
+#if LORAWAN_RTOS == LORAWAN_RTOS_NONE
+    // The caller is the owner, nothing to queue behind
+    (void)timeout;
+    ticket->state = TICKET_RUNNING;
+    run(ticket);
+    ticket->state = TICKET_DONE;
+    _served ++;
+
+    return true;
+#else
+    if(!waitSlot(timeout))return false;
+
+    _slots[(_head + _count) % LORAWAN_QUEUE_DEPTH] = ticket;
+    _count ++;
+    if(_count > _depthMax)_depthMax = _count;
+    ticket->state = TICKET_QUEUED;
+    unlock();
+
+    wakeOwner();
+
+    return true;
+#endif
+}
+
+
+bool LoRaWanCommandQueue::await(LoRaWanTicket *ticket, unsigned long timeout)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_NONE
+    (void)timeout;
+    return ticket->state == TICKET_DONE;
+#else
+    unsigned long timerStart = millis();
+    unsigned long elapsed;
+    bool done;
+
+    lock();
+    while(ticket->state != TICKET_DONE)
+    {
+        elapsed = millis() - timerStart;
+        if(timeout != QUEUE_FOREVER && elapsed >= timeout)break;
+
+        waitDone(ticket, timeout == QUEUE_FOREVER ? QUEUE_FOREVER : timeout - elapsed);
+    }
+    ticket->waiter = NULL;
+    done = ticket->state == TICKET_DONE;
+    unlock();
+
+    return done;
+#endif
+}
+
+
+bool LoRaWanCommandQueue::isDone(LoRaWanTicket *ticket)
+{
+    return ticket->state == TICKET_DONE;
+}
+
+
+bool LoRaWanCommandQueue::cancel(LoRaWanTicket *ticket)
+{
+    bool freed = true;
+
+    lock();
+    if(ticket->state == TICKET_QUEUED)
+    {
+        // Close the gap, the jobs behind it keep their order
+        for(unsigned char i = 0; i < _count; i ++)
+        {
+            if(_slots[(_head + i) % LORAWAN_QUEUE_DEPTH] != ticket)continue;
+
+            for(; i + 1 < _count; i ++)
+            {
+                _slots[(_head + i) % LORAWAN_QUEUE_DEPTH] = _slots[(_head + i + 1) % LORAWAN_QUEUE_DEPTH];
+            }
+            _count --;
+            break;
+        }
+        ticket->state = TICKET_IDLE;
+        releaseSlot();
+    }
+    else if(ticket->state == TICKET_RUNNING)freed = false;
+    unlock();
+
+    return freed;
+}
+
+
+bool LoRaWanCommandQueue::call(_modem_job_t job, void *context, long *result, unsigned long timeout)
+{
+    LoRaWanTicket ticket;
+
+    if(!submit(&ticket, job, context, timeout))return false;
+
+    // Once started the job writes into this frame, so it is waited for
+    if(!await(&ticket, timeout) && !cancel(&ticket))await(&ticket, QUEUE_FOREVER);
+
+    if(ticket.state != TICKET_DONE)return false;
+    if(result)*result = ticket.result;
+
+    return true;
+}
+
+
+unsigned char LoRaWanCommandQueue::serve(unsigned long wait)
+{
+    unsigned char served = 0;
+
+#if LORAWAN_RTOS != LORAWAN_RTOS_NONE
+    LoRaWanTicket *ticket;
+    unsigned long waited;
+
+    lock();
+    if(!_count && wait)waitWork(wait);
+
+    while(_count)
+    {
+        ticket = _slots[_head];
+        _head = (_head + 1) % LORAWAN_QUEUE_DEPTH;
+        _count --;
+        releaseSlot();
+
+        waited = millis() - ticket->queued;
+        _queueWait += waited;
+        if(waited > _queueWaitMax)_queueWaitMax = waited;
+
+        ticket->state = TICKET_RUNNING;
+        unlock();
+
+        run(ticket);
+
+        lock();
+        ticket->state = TICKET_DONE;
+        _served ++;
+        served ++;
+        wakeWaiters(ticket);
+    }
+    unlock();
+#else
+    (void)wait;
+#endif
+
+    _lora->poll();
+
+    return served;
+}
+
+
+bool LoRaWanCommandQueue::subscribe(_downlink_handler_t handler)
+{
+    bool added = false;
+
+    lock();
+    for(unsigned char i = 0; i < QUEUE_SUBSCRIBERS; i ++)
+    {
+        if(_subscribers[i] == handler)added = true;
+    }
+    for(unsigned char i = 0; i < QUEUE_SUBSCRIBERS && !added; i ++)
+    {
+        if(_subscribers[i])continue;
+
+        _subscribers[i] = handler;
+        added = true;
+    }
+    unlock();
+
+    return added;
+}
+
+
+bool LoRaWanCommandQueue::unsubscribe(_downlink_handler_t handler)
+{
+    bool removed = false;
+
+    lock();
+    for(unsigned char i = 0; i < QUEUE_SUBSCRIBERS; i ++)
+    {
+        if(_subscribers[i] != handler)continue;
+
+        _subscribers[i] = NULL;
+        removed = true;
+    }
+    unlock();
+
+    return removed;
+}
+
+
+unsigned char LoRaWanCommandQueue::getDepth(void)
+{
+    return _count;
+}
+
+
+unsigned char LoRaWanCommandQueue::getDepthMax(void)
+{
+    return _depthMax;
+}
+
+
+unsigned long LoRaWanCommandQueue::getServed(void)
+{
+    return _served;
+}
+
+
+unsigned long LoRaWanCommandQueue::getRejected(void)
+{
+    return _rejected;
+}
+
+
+unsigned long LoRaWanCommandQueue::getQueueWaitMean(void)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_NONE
+    return 0;
+#else
+    return _served ? _queueWait / _served : 0;
+#endif
+}
+
+
+unsigned long LoRaWanCommandQueue::getQueueWaitMax(void)
+{
+    return _queueWaitMax;
+}
+
+
+unsigned long LoRaWanCommandQueue::getLockWaitMean(void)
+{
+    return _locks ? _lockWait / _locks : 0;
+}
+
+
+unsigned long LoRaWanCommandQueue::getLockWaitMax(void)
+{
+    return _lockWaitMax;
+}
+
+
+void LoRaWanCommandQueue::fanOut(const LoRaWanPayload *payload)
+{
+    _downlink_handler_t subscribers[QUEUE_SUBSCRIBERS];
+
+    if(!_active)return;
+
+    // A copy, so a subscriber may unsubscribe itself
+    _active->lock();
+    memcpy(subscribers, _active->_subscribers, sizeof(subscribers));
+    _active->unlock();
+
+    for(unsigned char i = 0; i < QUEUE_SUBSCRIBERS; i ++)
+    {
+        if(subscribers[i])subscribers[i](payload);
+    }
+}
+
+
+void LoRaWanCommandQueue::lock(void)
+{
+#if LORAWAN_RTOS != LORAWAN_RTOS_NONE
+    unsigned long timerStart = micros();
+
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+#else
+    _mutex.lock();
+#endif
+
+    unsigned long waited = micros() - timerStart;
+
+    _locks ++;
+    _lockWait += waited;
+    if(waited > _lockWaitMax)_lockWaitMax = waited;
+#endif
+}
+
+
+void LoRaWanCommandQueue::unlock(void)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    xSemaphoreGive(_mutex);
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+    _mutex.unlock();
+#endif
+}
+
+
+// Takes a slot and returns with the lock held, counted as rejected when none frees in time
+bool LoRaWanCommandQueue::waitSlot(unsigned long timeout)
+{
+    bool taken = true;
+
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    taken = xSemaphoreTake(_free, toTicks(timeout)) == pdTRUE;
+    lock();
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+    lock();
+    {
+        std::unique_lock<std::mutex> guard(_mutex, std::adopt_lock);
+        auto room = [this]{ return _count < LORAWAN_QUEUE_DEPTH; };
+
+        if(timeout == QUEUE_FOREVER)_changed.wait(guard, room);
+        else taken = _changed.wait_for(guard, std::chrono::milliseconds(timeout), room);
+        guard.release();
+    }
+#else
+    (void)timeout;
+    lock();
+#endif
+
+    if(taken)return true;
+
+    _rejected ++;
+    unlock();
+
+    return false;
+}
+
+
+// Called with the lock held
+void LoRaWanCommandQueue::releaseSlot(void)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    xSemaphoreGive(_free);
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+    _changed.notify_all();
+#endif
+}
+
+
+void LoRaWanCommandQueue::wakeOwner(void)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    if(_owner)xTaskNotifyGive(_owner);
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+    _work.notify_one();
+#endif
+}
+
+
+// Called with the lock held, returns with it held
+void LoRaWanCommandQueue::waitWork(unsigned long timeout)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    _owner = xTaskGetCurrentTaskHandle();
+    unlock();
+    ulTaskNotifyTake(pdTRUE, toTicks(timeout));
+    lock();
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+    std::unique_lock<std::mutex> guard(_mutex, std::adopt_lock);
+
+    if(timeout == QUEUE_FOREVER)_work.wait(guard, [this]{ return _count > 0; });
+    else _work.wait_for(guard, std::chrono::milliseconds(timeout), [this]{ return _count > 0; });
+    guard.release();
+#else
+    (void)timeout;
+#endif
+}
+
+
+// Called with the lock held
+void LoRaWanCommandQueue::wakeWaiters(LoRaWanTicket *ticket)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    if(ticket->waiter)xTaskNotifyGive((TaskHandle_t)ticket->waiter);
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+    (void)ticket;
+    _changed.notify_all();
+#else
+    (void)ticket;
+#endif
+}
+
+
+// Called with the lock held, returns with it held
+void LoRaWanCommandQueue::waitDone(LoRaWanTicket *ticket, unsigned long timeout)
+{
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+    ticket->waiter = xTaskGetCurrentTaskHandle();
+    unlock();
+    ulTaskNotifyTake(pdTRUE, toTicks(timeout));
+    lock();
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+    std::unique_lock<std::mutex> guard(_mutex, std::adopt_lock);
+
+    (void)ticket;
+    if(timeout == QUEUE_FOREVER)_changed.wait(guard);
+    else _changed.wait_for(guard, std::chrono::milliseconds(timeout));
+    guard.release();
+#else
+    (void)ticket;
+    (void)timeout;
+#endif
+}
+
+
+void LoRaWanCommandQueue::run(LoRaWanTicket *ticket)
+{
+    ticket->result = ticket->job(_lora, ticket->context);
+}
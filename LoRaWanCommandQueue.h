@@ -0,0 +1,279 @@
+/*
+  LoRaWanCommandQueue.h
+  One owner task for the modem, a bounded command queue in front of it
+
+  LoRaWanClass keeps one response buffer and one UART and does not lock
+  them. With several tasks, only the owner task talks to the modem: it
+  calls serve() in its loop, runs the queued jobs one after another and
+  polls the modem in between. Other tasks put a job and a ticket in the
+  queue and block on the ticket, or go on and check it later. Downlinks
+  the modem reports on its own are handed to every subscriber, in the
+  owner task.
+
+  The ticket is owned by the caller and has to stay valid until it is
+  done or cancelled, nothing is allocated.
+
+  Backends, LORAWAN_RTOS in the build flags:
+    LORAWAN_RTOS_NONE       no tasks, submit() runs the job at once
+    LORAWAN_RTOS_FREERTOS   FreeRTOS mutex, counting semaphore, task notifications
+    LORAWAN_RTOS_STD        std::mutex and std::condition_variable, Linux hosts
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANCOMMANDQUEUE_H_
+#define _LORAWANCOMMANDQUEUE_H_
+
+
+#include "SeeeduinoLoRaWan.h"
+
+
+#define LORAWAN_RTOS_NONE       0
+#define LORAWAN_RTOS_FREERTOS   1
+#define LORAWAN_RTOS_STD        2
+
+#ifndef LORAWAN_RTOS
+#define LORAWAN_RTOS            LORAWAN_RTOS_NONE
+#endif
+
+// Jobs waiting at most, a full queue makes submit() wait or fail
+#ifndef LORAWAN_QUEUE_DEPTH
+#define LORAWAN_QUEUE_DEPTH     8
+#endif
+
+#define QUEUE_SUBSCRIBERS       4
+#define QUEUE_FOREVER           0xFFFFFFFFUL    // timeout that never runs out
+
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+#include <FreeRTOS_SAMD21.h>
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+#include <mutex>
+#include <condition_variable>
+#endif
+
+
+// Runs in the owner task with the modem to itself, the return value ends up in
+// the ticket. A job must not wait on the queue, the owner would wait on itself.
+typedef long (*_modem_job_t)(LoRaWanClass *lora, void *context);
+
+enum _ticket_state_t { TICKET_IDLE = 0, TICKET_QUEUED, TICKET_RUNNING, TICKET_DONE };
+
+// Completion token of one job, owned by the caller
+struct LoRaWanTicket
+{
+    _modem_job_t job;
+    void *context;
+    long result;
+    unsigned long queued;               // millis() at submit
+    void *waiter;                       // task blocked on it, FreeRTOS only
+    volatile _ticket_state_t state;
+};
+
+
+class LoRaWanCommandQueue
+{
+    public:
+
+        /**
+         *  \brief Create a queue in front of a modem
+         *
+         *  \param [in] &lora The modem, only the owner task may use it directly afterwards
+         */
+        LoRaWanCommandQueue(LoRaWanClass &lora);
+
+        /**
+         *  \brief Create the locks and take over the modem downlink handler
+         *
+         *  Call it once before the tasks start.
+         *
+         *  \return Return bool. True : ready, false : a lock could not be created
+         */
+        bool begin(void);
+
+        /**
+         *  \brief Put a job in the queue
+         *
+         *  \param [in] *ticket The completion token, valid until done or cancelled
+         *  \param [in] job The job
+         *  \param [in] *context Handed to the job
+         *  \param [in] timeout The time to wait for a free slot in millisecond, 0 fails at once
+         *
+         *  \return Return bool. True : queued, or run already without tasks
+         */
+        bool submit(LoRaWanTicket *ticket, _modem_job_t job, void *context, unsigned long timeout = 0);
+
+        /**
+         *  \brief Block until a job is done
+         *
+         *  \param [in] *ticket The completion token
+         *  \param [in] timeout The time to wait in millisecond, QUEUE_FOREVER to wait
+         *
+         *  \return Return bool. True : done, the result is in the ticket
+         */
+        bool await(LoRaWanTicket *ticket, unsigned long timeout = QUEUE_FOREVER);
+
+        /**
+         *  \brief Check a job without blocking
+         *
+         *  \param [in] *ticket The completion token
+         *
+         *  \return Return bool. True : done
+         */
+        bool isDone(LoRaWanTicket *ticket);
+
+        /**
+         *  \brief Take a job out of the queue
+         *
+         *  \param [in] *ticket The completion token
+         *
+         *  \return Return bool. True : the ticket is free again, false : the job is running
+         */
+        bool cancel(LoRaWanTicket *ticket);
+
+        /**
+         *  \brief Run a job and wait for it
+         *
+         *  A job that did not start within the timeout is cancelled. One that
+         *  started is waited for, the ticket lives on this stack.
+         *
+         *  \param [in] job The job
+         *  \param [in] *context Handed to the job
+         *  \param [out] *result The value the job returned, may be NULL
+         *  \param [in] timeout The time to wait for the job to start in millisecond
+         *
+         *  \return Return bool. True : the job ran
+         */
+        bool call(_modem_job_t job, void *context, long *result, unsigned long timeout = QUEUE_FOREVER);
+
+        /**
+         *  \brief Serve the queue, call it in a loop from the owner task only
+         *
+         *  Runs every queued job, waits up to the given time for one when the
+         *  queue is empty, then polls the modem for downlinks.
+         *
+         *  \param [in] wait The time to wait for a job in millisecond
+         *
+         *  \return Return number of jobs run
+         */
+        unsigned char serve(unsigned long wait);
+
+        /**
+         *  \brief Hand downlinks to a function, in the owner task
+         *
+         *  The payload points into the modem buffer and is valid during the call only.
+         *
+         *  \param [in] handler The downlink function
+         *
+         *  \return Return bool. True : subscribed, false : QUEUE_SUBSCRIBERS reached
+         */
+        bool subscribe(_downlink_handler_t handler);
+
+        /**
+         *  \brief Stop handing downlinks to a function
+         *
+         *  \param [in] handler The downlink function
+         *
+         *  \return Return bool. True : it was subscribed
+         */
+        bool unsubscribe(_downlink_handler_t handler);
+
+        /**
+         *  \brief Jobs waiting now
+         *
+         *  \return Return job count
+         */
+        unsigned char getDepth(void);
+
+        /**
+         *  \brief Most jobs that waited at once
+         *
+         *  \return Return job count
+         */
+        unsigned char getDepthMax(void);
+
+        /**
+         *  \brief Jobs run so far
+         *
+         *  \return Return job count
+         */
+        unsigned long getServed(void);
+
+        /**
+         *  \brief Jobs refused because the queue stayed full
+         *
+         *  \return Return job count
+         */
+        unsigned long getRejected(void);
+
+        /**
+         *  \brief Mean time from submit() to the start of the job
+         *
+         *  \return Return time in millisecond, 0 without jobs
+         */
+        unsigned long getQueueWaitMean(void);
+
+        /**
+         *  \brief Longest time from submit() to the start of a job
+         *
+         *  \return Return time in millisecond
+         */
+        unsigned long getQueueWaitMax(void);
+
+        /**
+         *  \brief Mean time a task waited for the queue lock
+         *
+         *  \return Return time in microsecond, 0 without locking
+         */
+        unsigned long getLockWaitMean(void);
+
+        /**
+         *  \brief Longest time a task waited for the queue lock
+         *
+         *  \return Return time in microsecond
+         */
+        unsigned long getLockWaitMax(void);
+
+    private:
+        static void fanOut(const LoRaWanPayload *payload);
+
+        void lock(void);
+        void unlock(void);
+        bool waitSlot(unsigned long timeout);
+        void releaseSlot(void);
+        void wakeOwner(void);
+        void waitWork(unsigned long timeout);
+        void wakeWaiters(LoRaWanTicket *ticket);
+        void waitDone(LoRaWanTicket *ticket, unsigned long timeout);
+        void run(LoRaWanTicket *ticket);
+
+        static LoRaWanCommandQueue *_active;
+
+        LoRaWanClass *_lora;
+        LoRaWanTicket *_slots[LORAWAN_QUEUE_DEPTH];
+        _downlink_handler_t _subscribers[QUEUE_SUBSCRIBERS];
+        unsigned char _head;
+        unsigned char _count;
+        unsigned char _depthMax;
+        unsigned long _served;
+        unsigned long _rejected;
+        unsigned long _queueWait;           // millisecond, all jobs run
+        unsigned long _queueWaitMax;
+        unsigned long _locks;
+        unsigned long _lockWait;            // microsecond, all locks taken
+        unsigned long _lockWaitMax;
+
+#if LORAWAN_RTOS == LORAWAN_RTOS_FREERTOS
+        SemaphoreHandle_t _mutex;
+        SemaphoreHandle_t _free;            // counts the free slots
+        TaskHandle_t _owner;
+#elif LORAWAN_RTOS == LORAWAN_RTOS_STD
+        std::mutex _mutex;
+        std::condition_variable _work;      // a job was queued
+        std::condition_variable _changed;   // a job finished or a slot freed
+#endif
+};
+
+
+#endif
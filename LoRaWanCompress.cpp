@@ -0,0 +1,159 @@
+/*
+  LoRaWanCompress.cpp
+  Small window LZSS compression of uplink payloads
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanCompress.h"
+#include <string.h>
+
+
+#define COMPRESS_HASH_BITS      6
+#define COMPRESS_HASH_SIZE      (1 << COMPRESS_HASH_BITS)
+#define COMPRESS_NONE           0xFF    // empty hash slot, above any position
+
+
+static unsigned char hash(const uint8_t *data)
+{
+    return ((data[0] << 4) ^ (data[1] << 2) ^ data[2]) & (COMPRESS_HASH_SIZE - 1);
+}
+
+
+unsigned char LoRaWanCompress::compress(const uint8_t *data, unsigned char length, uint8_t *output, unsigned char size)
+{
+    if(length > COMPRESS_INPUT_MAX || !size)return 0;
+
+    // Chains of earlier positions with the same three byte hash
+    unsigned char head[COMPRESS_HASH_SIZE];
+    unsigned char chain[COMPRESS_INPUT_MAX];
+    memset(head, COMPRESS_NONE, sizeof(head));
+
+    // Stop as soon as the coded stream is no shorter than the stored one
+    unsigned char limit = size < length + 1 ? size : length;
+    unsigned char out = 1;
+    unsigned char flags = 0;
+    unsigned char item = 8;
+    unsigned char i = 0;
+
+    while(i < length)
+    {
+        if(item == 8)
+        {
+            if(out >= limit)break;
+            flags = out ++;
+            output[flags] = 0;
+            item = 0;
+        }
+
+        unsigned char best = 0;
+        unsigned char distance = 0;
+
+        if(i + COMPRESS_MATCH_MIN <= length)
+        {
+            unsigned char slot = hash(data + i);
+            unsigned char rest = length - i;
+            unsigned char tries = COMPRESS_CHAIN_MAX;
+
+            for(unsigned char j = head[slot]; j != COMPRESS_NONE && tries; j = chain[j], tries --)
+            {
+                unsigned char run = 0;
+                while(run < rest && data[j + run] == data[i + run])run ++;
+
+                if(run > best)
+                {
+                    best = run;
+                    distance = i - j;
+                    if(run == rest)break;
+                }
+            }
+
+            chain[i] = head[slot];
+            head[slot] = i;
+        }
+
+        if(best >= COMPRESS_MATCH_MIN)
+        {
+            if(out + 2 > limit)break;
+            output[flags] |= 1 << item;
+            output[out ++] = distance - 1;
+            output[out ++] = best - COMPRESS_MATCH_MIN;
+
+            // Positions inside the run are references for later runs
+            for(unsigned char end = i + best; ++ i < end;)
+            {
+                if(i + COMPRESS_MATCH_MIN > length)continue;
+                unsigned char slot = hash(data + i);
+                chain[i] = head[slot];
+                head[slot] = i;
+            }
+        }
+        else
+        {
+            if(out >= limit)break;
+            output[out ++] = data[i ++];
+        }
+
+        item ++;
+    }
+
+    if(i == length)
+    {
+        output[0] = COMPRESS_LZSS;
+        return out;
+    }
+
+    if(size < length + 1)return 0;
+
+    output[0] = COMPRESS_STORED;
+    memcpy(output + 1, data, length);
+
+    return length + 1;
+}
+
+
+short LoRaWanCompress::decompress(const uint8_t *data, unsigned char length, uint8_t *output, unsigned char size)
+{
+    if(!length)return -1;
+
+    if(data[0] == COMPRESS_STORED)
+    {
+        if(length - 1 > size)return -1;
+        memcpy(output, data + 1, length - 1);
+        return length - 1;
+    }
+    if(data[0] != COMPRESS_LZSS)return -1;
+
+    unsigned char in = 1;
+    short out = 0;
+
+    while(in < length)
+    {
+        unsigned char flags = data[in ++];
+
+        for(unsigned char item = 0; item < 8 && in < length; item ++, flags >>= 1)
+        {
+            if(!(flags & 0x01))
+            {
+                if(out >= size)return -1;
+                output[out ++] = data[in ++];
+                continue;
+            }
+
+            if(in + 2 > length)return -1;
+
+            short distance = data[in] + 1;
+            short run = data[in + 1] + COMPRESS_MATCH_MIN;
+            in += 2;
+
+            if(distance > out || out + run > size)return -1;
+
+            // Byte by byte, a run may overlap its own output
+            for(short k = 0; k < run; k ++, out ++)output[out] = output[out - distance];
+        }
+    }
+
+    return out;
+}
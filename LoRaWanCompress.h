@@ -0,0 +1,72 @@
+/*
+  LoRaWanCompress.h
+  Small window LZSS compression of uplink payloads
+
+  Text uplinks and CayenneLPP frames repeat short byte runs, channel and
+  type headers, digits, key names. Those are replaced by back references
+  into the payload itself, so no dictionary has to be shared with the
+  server. The first byte tells the receiver how the rest is coded:
+    COMPRESS_STORED     payload follows unchanged
+    COMPRESS_LZSS       flag byte, then eight items, repeated
+  Every flag bit, lowest first, tells the kind of the next item:
+    0                   literal byte
+    1                   back reference, distance - 1, length - COMPRESS_MATCH_MIN
+  A payload that does not get shorter is stored, one byte longer than sent
+  plain. The compressor needs about 300 bytes of stack, the decompressor
+  none. Neither uses Arduino, the same files build on the server side.
+
+  The transmit calls send what they are given. Compress before
+  transmitPacket() on a port the server knows to decode, as the
+  *_Temp_Voltage_Low_Power examples do with their log batches.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANCOMPRESS_H_
+#define _LORAWANCOMPRESS_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define COMPRESS_STORED         0x00    // header, payload not compressed
+#define COMPRESS_LZSS           0x01    // header, payload LZSS coded
+#define COMPRESS_INPUT_MAX      242     // longest payload, the largest LoRaWAN application payload
+#define COMPRESS_MATCH_MIN      3       // shorter runs cost more as a reference than as literals
+#define COMPRESS_CHAIN_MAX      16      // earlier positions tried per byte
+
+
+class LoRaWanCompress
+{
+    public:
+
+        /**
+         *  \brief Compress a payload, or store it when compression does not pay
+         *
+         *  \param [in] *data The payload
+         *  \param [in] length The payload length, up to COMPRESS_INPUT_MAX
+         *  \param [out] *output The coded payload, header included
+         *  \param [in] size The size of output, length + 1 always fits
+         *
+         *  \return Return coded length, 0 : payload too long or output too small
+         */
+        static unsigned char compress(const uint8_t *data, unsigned char length, uint8_t *output, unsigned char size);
+
+        /**
+         *  \brief Restore a payload coded by compress()
+         *
+         *  \param [in] *data The coded payload, header included
+         *  \param [in] length The coded length
+         *  \param [out] *output The payload
+         *  \param [in] size The size of output
+         *
+         *  \return Return payload length, -1 : unknown header, broken stream or output too small
+         */
+        static short decompress(const uint8_t *data, unsigned char length, uint8_t *output, unsigned char size);
+};
+
+
+#endif
@@ -0,0 +1,227 @@
+/*
+  LoRaWanConfig.cpp
+  Remote configuration by downlink, compact binary commands
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanConfig.h"
+
+
+LoRaWanConfig::LoRaWanConfig(LoRaWanClass &lora, LoRaWanIntervalPolicy *policy)
+{
+    _lora = &lora;
+    _policy = policy;
+    _count = 0;
+    _id = 0;
+    _known = false;
+    _ackDue = false;
+    _interval = 0;
+    _downlinks = 0;
+    _rejected = 0;
+}
+
+
+bool LoRaWanConfig::handle(const LoRaWanPayload *payload)
+{
+    const uint8_t *data = payload->data;
+    short length = payload->length;
+
+    if(payload->port != CONFIG_PORT)return false;
+    if(length < 1)return true;
+
+    _downlinks ++;
+    _ackDue = true;
+
+    // A resend of the last downlink, the answer got lost
+    if(_known && data[0] == _id)return true;
+
+    _id = data[0];
+    _known = true;
+    _count = 0;
+
+    for(short i = 1; i < length && _count < CONFIG_COMMANDS_MAX; )
+    {
+        command_t *command = &_commands[_count ++];
+
+        command->type = data[i];
+        command->value = 0;
+
+        if(i + 2 > length || i + 2 + data[i + 1] > length)
+        {
+            command->status = CONFIG_BAD_LENGTH;
+            _rejected ++;
+            break;
+        }
+
+        uint8_t size = data[i + 1];
+        for(uint8_t j = 0; j < size && j < 4; j ++)command->value = command->value << 8 | data[i + 2 + j];
+
+        command->status = check(command->type, size, command->value);
+        if(command->status != CONFIG_PENDING)_rejected ++;
+
+        i += 2 + size;
+    }
+
+    return true;
+}
+
+
+unsigned char LoRaWanConfig::apply(void)
+{
+    unsigned char applied = 0;
+
+    for(unsigned char i = 0; i < _count; i ++)
+    {
+        command_t *command = &_commands[i];
+        if(command->status != CONFIG_PENDING)continue;
+
+        command->status = run(command);
+        if(command->status == CONFIG_OK)applied ++;
+        else _rejected ++;
+    }
+
+    return applied;
+}
+
+
+bool LoRaWanConfig::isAckDue(void)
+{
+    return _ackDue;
+}
+
+
+unsigned char LoRaWanConfig::getAck(uint8_t *buffer, unsigned char size)
+{
+    unsigned char length = 0;
+
+    if(!_ackDue || size < 1)return 0;
+
+    buffer[length ++] = _id;
+    for(unsigned char i = 0; i < _count && length + 2 <= size; i ++)
+    {
+        buffer[length ++] = _commands[i].type;
+        buffer[length ++] = _commands[i].status;
+    }
+
+    return length;
+}
+
+
+void LoRaWanConfig::ackSent(bool sent)
+{
+    if(sent)_ackDue = false;
+}
+
+
+unsigned long LoRaWanConfig::getInterval(void)
+{
+    return _interval;
+}
+
+
+unsigned long LoRaWanConfig::getDownlinks(void)
+{
+    return _downlinks;
+}
+
+
+unsigned long LoRaWanConfig::getRejected(void)
+{
+    return _rejected;
+}
+
+
+uint8_t LoRaWanConfig::check(uint8_t type, uint8_t length, uint32_t value)
+{
+    uint8_t expected = type == CONFIG_INTERVAL ? 2 : type == CONFIG_LIMITS ? 4 : 1;
+    const LoRaWanCapabilities *capabilities = _lora->getCapabilities();
+    bool classB = capabilities->major != 0 && capabilities->classB;
+    bool valid;
+
+    if(type < CONFIG_INTERVAL || type > CONFIG_REPEAT)return CONFIG_UNKNOWN;
+    if(length != expected)return CONFIG_BAD_LENGTH;
+
+    // The policy checks intervals against the limits it holds when they are applied
+    switch(type)
+    {
+        case CONFIG_INTERVAL:
+            valid = _policy || (value >= INTERVAL_MIN && value <= INTERVAL_MAX);
+            break;
+        case CONFIG_LIMITS:
+            if(!_policy)return CONFIG_UNSUPPORTED;
+            valid = true;
+            break;
+        case CONFIG_DATA_RATE:
+            valid = value <= CONFIG_DATA_RATE_MAX;
+            break;
+        case CONFIG_POWER:
+            valid = (int8_t)value >= CONFIG_POWER_MIN &&
+                    (int8_t)value <= (_lora->getRegion() == EU868 ? CONFIG_POWER_MAX_EU868 : CONFIG_POWER_MAX_EU433);
+            break;
+        case CONFIG_ADR:
+            valid = value <= 1;
+            break;
+        case CONFIG_CLASS:
+            // classB defaults to true until probeCapabilities() has read the firmware
+            if(value == CLASS_B && !classB)return CONFIG_UNSUPPORTED;
+            valid = value <= CLASS_C;
+            break;
+        case CONFIG_PING_SLOT:
+            if(!classB)return CONFIG_UNSUPPORTED;
+            valid = value <= CONFIG_PING_SLOT_MAX;
+            break;
+        case CONFIG_RETRIES:
+            // setConfirmedMessageRetryTime() would apply 0 as 1 and answer OK
+            valid = value >= 1 && value <= CONFIG_RETRIES_MAX;
+            break;
+        default:
+            valid = value >= 1 && value <= CONFIG_REPEAT_MAX;
+            break;
+    }
+
+    return valid ? CONFIG_PENDING : CONFIG_OUT_OF_RANGE;
+}
+
+
+uint8_t LoRaWanConfig::run(command_t *command)
+{
+    uint32_t value = command->value;
+    bool done = true;
+
+    switch(command->type)
+    {
+        case CONFIG_INTERVAL:
+            if(_policy && !_policy->setBase(value))return CONFIG_OUT_OF_RANGE;
+            _interval = value;
+            break;
+        case CONFIG_LIMITS:
+            if(!_policy->setLimits(value >> 16, value & 0xFFFF))return CONFIG_OUT_OF_RANGE;
+            break;
+        case CONFIG_DATA_RATE:
+            done = _lora->setDataRate((_data_rate_t)value);
+            break;
+        case CONFIG_POWER:
+            done = _lora->setPower((int8_t)value);
+            break;
+        case CONFIG_ADR:
+            done = _lora->setAdaptiveDataRate(value);
+            break;
+        case CONFIG_CLASS:
+            done = _lora->setClassType((_class_type_t)value);
+            break;
+        case CONFIG_PING_SLOT:
+            done = _lora->setBeaconAndPingSlot(value);
+            break;
+        case CONFIG_RETRIES:
+            done = _lora->setConfirmedMessageRetryTime(value);
+            break;
+        case CONFIG_REPEAT:
+            done = _lora->setUnconfirmedMessageRepeatTime(value);
+            break;
+    }
+
+    return done ? CONFIG_OK : CONFIG_FAILED;
+}
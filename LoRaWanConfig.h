@@ -0,0 +1,187 @@
+/*
+  LoRaWanConfig.h
+  Remote configuration by downlink, compact binary commands
+
+  The backend sends commands on CONFIG_PORT, the node answers on the same
+  port with its next uplink. A downlink is a transaction id and records of
+  type, length and a big endian value:
+    id (1), type (1), length (1), value (length), type, length, value ...
+
+    type                    length  value
+    CONFIG_INTERVAL         2       base interval in second
+    CONFIG_LIMITS           4       shortest, longest interval in second
+    CONFIG_DATA_RATE        1       DR0 - DR5
+    CONFIG_POWER            1       dBm, signed, up to the limit of the region
+    CONFIG_ADR              1       0 off, 1 on
+    CONFIG_CLASS            1       0 A, 1 B, 2 C
+    CONFIG_PING_SLOT        1       periodicity 0 - 7, ping every 2^n s
+    CONFIG_RETRIES          1       confirmed retries, 1 - 15
+    CONFIG_REPEAT           1       unconfirmed repeats, 1 - 15
+
+  The answer is the id and a status per record:
+    id (1), type (1), status (1), type, status ...
+  Records are applied in the order sent, limits go before an interval that
+  needs them. Records beyond CONFIG_COMMANDS_MAX are left out of the
+  answer and not applied. A downlink that repeats the last id is answered
+  again and not applied twice, the backend may resend until it sees the
+  answer.
+
+  handle() reads the downlink in one pass into a fixed command list, it
+  may run in a downlink handler. apply() calls the setters later, outside
+  the handler, as they talk to the modem and reuse its buffer. Nothing is
+  allocated.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANCONFIG_H_
+#define _LORAWANCONFIG_H_
+
+
+#include "SeeeduinoLoRaWan.h"
+#include "LoRaWanIntervalPolicy.h"
+
+
+#define CONFIG_PORT             200     // reserved for configuration, both ways
+#define CONFIG_COMMANDS_MAX     8       // records taken from one downlink
+#define CONFIG_ACK_LENGTH       (1 + 2 * CONFIG_COMMANDS_MAX)   // bytes of the longest answer
+
+#define CONFIG_DATA_RATE_MAX    5       // DR5, SF7 the fastest LoRa rate
+#define CONFIG_POWER_MIN        0       // dBm
+#define CONFIG_POWER_MAX_EU868  14      // dBm, the EU868 limit
+#define CONFIG_POWER_MAX_EU433  12      // dBm, EU433 allows 12.15 dBm EIRP
+#define CONFIG_PING_SLOT_MAX    7
+#define CONFIG_RETRIES_MAX      15      // more only burns airtime
+#define CONFIG_REPEAT_MAX       15
+
+
+enum _config_type_t
+{
+    CONFIG_INTERVAL = 0x01,
+    CONFIG_LIMITS,
+    CONFIG_DATA_RATE,
+    CONFIG_POWER,
+    CONFIG_ADR,
+    CONFIG_CLASS,
+    CONFIG_PING_SLOT,
+    CONFIG_RETRIES,
+    CONFIG_REPEAT
+};
+
+enum _config_status_t
+{
+    CONFIG_OK = 0,
+    CONFIG_PENDING,                     // read, apply() has not run yet
+    CONFIG_UNKNOWN,                     // type not known, skipped
+    CONFIG_BAD_LENGTH,                  // wrong length, or cut off by the end of the downlink
+    CONFIG_OUT_OF_RANGE,
+    CONFIG_UNSUPPORTED,                 // no policy for the limits, no Class B firmware or not probed
+    CONFIG_FAILED                       // the modem answered ERROR or nothing
+};
+
+
+class LoRaWanConfig
+{
+    public:
+
+        /**
+         *  \brief Create the engine for a modem
+         *
+         *  \param [in] &lora The modem the setters are called on
+         *  \param [in] *policy Takes the interval commands, NULL leaves them to getInterval()
+         */
+        LoRaWanConfig(LoRaWanClass &lora, LoRaWanIntervalPolicy *policy = NULL);
+
+        /**
+         *  \brief Read a downlink
+         *
+         *  \param [in] *payload The downlink, from receivePacket() or a downlink handler
+         *
+         *  \return Return bool. True : it was on CONFIG_PORT and is taken, other ports are left to the caller
+         */
+        bool handle(const LoRaWanPayload *payload);
+
+        /**
+         *  \brief Call the setters of the commands read, outside a downlink handler
+         *
+         *  A switch to Class B waits for a beacon, as setClassType() does.
+         *  A setter that fails leaves CONFIG_FAILED in the answer.
+         *
+         *  \return Return number of commands applied
+         */
+        unsigned char apply(void);
+
+        /**
+         *  \brief Check whether an answer waits to be sent
+         *
+         *  \return Return bool. True : send getAck() on CONFIG_PORT
+         */
+        bool isAckDue(void);
+
+        /**
+         *  \brief Answer to the last downlink
+         *
+         *  \param [out] *buffer The uplink payload
+         *  \param [in] size The buffer size, CONFIG_ACK_LENGTH fits any answer
+         *
+         *  \return Return length in byte, 0 : nothing to answer
+         */
+        unsigned char getAck(uint8_t *buffer, unsigned char size);
+
+        /**
+         *  \brief Report the uplink that carried the answer
+         *
+         *  \param [in] sent The answer went out and is not sent again
+         *
+         *  \return Return null
+         */
+        void ackSent(bool sent);
+
+        /**
+         *  \brief Base interval from the last CONFIG_INTERVAL applied
+         *
+         *  \return Return interval in second, 0 : not set by the backend
+         */
+        unsigned long getInterval(void);
+
+        /**
+         *  \brief Downlinks taken so far, repeats included
+         *
+         *  \return Return downlink count
+         */
+        unsigned long getDownlinks(void);
+
+        /**
+         *  \brief Commands refused so far
+         *
+         *  \return Return command count
+         */
+        unsigned long getRejected(void);
+
+    private:
+        struct command_t
+        {
+            uint8_t type;
+            uint8_t status;
+            uint32_t value;
+        };
+
+        uint8_t check(uint8_t type, uint8_t length, uint32_t value);
+        uint8_t run(command_t *command);
+
+        LoRaWanClass *_lora;
+        LoRaWanIntervalPolicy *_policy;
+        command_t _commands[CONFIG_COMMANDS_MAX];
+        unsigned char _count;
+        uint8_t _id;
+        bool _known;                    // _id is from a downlink
+        bool _ackDue;
+        unsigned long _interval;
+        unsigned long _downlinks;
+        unsigned long _rejected;
+};
+
+
+#endif
@@ -0,0 +1,279 @@
+/*
+  LoRaWanEnergy.cpp
+  Energy ledger and battery life forecast
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanEnergy.h"
+
+
+#define MICROAMP_MS_PER_UAH     3600000ULL
+
+
+LoRaWanEnergy::LoRaWanEnergy(void)
+{
+    _current[MODEM_SLEEP] = 5;
+    _current[MODEM_IDLE] = 3000;
+    _current[MODEM_TX] = 45000;
+    _current[MODEM_RX] = 12000;
+    _current[MCU_ACTIVE] = 7000;
+    _current[MCU_SLEEP] = 100;
+
+    for(unsigned char i = 0; i < ENERGY_STATES; i ++)_time[i] = 0;
+
+    _charge = 0;
+    _cycleStart = 0;
+    _stamp = millis();
+    _uplinks = 0;
+    _airtime = 0;
+    _modemState = MODEM_IDLE;
+    _mcuState = MCU_ACTIVE;
+
+    _capacity = 0;
+    _cutoff = 3300;
+    _voltageCount = 0;
+}
+
+
+void LoRaWanEnergy::setCurrent(_energy_state_t state, unsigned long microAmps)
+{
+    update();
+    _current[state] = microAmps;
+}
+
+
+void LoRaWanEnergy::setModemState(_energy_state_t state)
+{
+    if(state > MODEM_RX)return;
+    update();
+    _modemState = state;
+}
+
+
+void LoRaWanEnergy::setMcuState(_energy_state_t state)
+{
+    if(state < MCU_ACTIVE)return;
+    update();
+    _mcuState = state;
+}
+
+
+void LoRaWanEnergy::addTime(_energy_state_t state, unsigned long ms)
+{
+    update();
+    book(state, ms);
+
+    // Standby outside of millis() means both sides were asleep
+    if(state == MCU_SLEEP)book(MODEM_SLEEP, ms);
+    else if(state == MODEM_SLEEP)book(MCU_SLEEP, ms);
+}
+
+
+void LoRaWanEnergy::addUplink(unsigned long airtime, unsigned long duration)
+{
+    // The command time has already run in the current modem state, move it over
+    update();
+    if(duration > _time[_modemState])duration = _time[_modemState];
+    if(airtime > duration)airtime = duration;
+
+    _time[_modemState] -= duration;
+    _charge -= (uint64_t)_current[_modemState] * duration;
+
+    book(MODEM_TX, airtime);
+    book(MODEM_RX, duration - airtime);
+
+    _uplinks ++;
+    _airtime += airtime;
+}
+
+
+unsigned long LoRaWanEnergy::getTime(_energy_state_t state)
+{
+    update();
+    return _time[state] / 1000;
+}
+
+
+unsigned long LoRaWanEnergy::getUplinks(void)
+{
+    return _uplinks;
+}
+
+
+unsigned long LoRaWanEnergy::getAirtime(void)
+{
+    return _airtime;
+}
+
+
+unsigned long LoRaWanEnergy::getCharge(void)
+{
+    update();
+    return _charge / MICROAMP_MS_PER_UAH;
+}
+
+
+unsigned long LoRaWanEnergy::getAverageCurrent(void)
+{
+    uint64_t elapsed = 0;
+
+    update();
+    for(unsigned char i = MODEM_SLEEP; i <= MODEM_RX; i ++)elapsed += _time[i];
+    if(!elapsed)return 0;
+
+    return _charge / elapsed;
+}
+
+
+unsigned long LoRaWanEnergy::startCycle(void)
+{
+    unsigned long charge = getCycleCharge();
+
+    _cycleStart = _charge;
+    return charge;
+}
+
+
+unsigned long LoRaWanEnergy::getCycleCharge(void)
+{
+    update();
+    return (_charge - _cycleStart) / MICROAMP_MS_PER_UAH;
+}
+
+
+void LoRaWanEnergy::setBattery(unsigned short capacity, unsigned short cutoff)
+{
+    _capacity = capacity;
+    _cutoff = cutoff;
+}
+
+
+void LoRaWanEnergy::addBatteryVoltage(unsigned short millivolts)
+{
+    uint64_t elapsed = 0;
+
+    update();
+    for(unsigned char i = MODEM_SLEEP; i <= MODEM_RX; i ++)elapsed += _time[i];
+
+    if(_voltageCount == ENERGY_VOLTAGE_SAMPLES)
+    {
+        for(unsigned char i = 1; i < ENERGY_VOLTAGE_SAMPLES; i ++)
+        {
+            _voltage[i - 1] = _voltage[i];
+            _voltageTime[i - 1] = _voltageTime[i];
+        }
+        _voltageCount --;
+    }
+
+    _voltage[_voltageCount] = millivolts;
+    _voltageTime[_voltageCount] = elapsed / 1000;
+    _voltageCount ++;
+}
+
+
+unsigned short LoRaWanEnergy::getForecast(void)
+{
+    unsigned long hours = 0xFFFF;
+
+    // Charge based, remaining capacity over the average current
+    unsigned long current = getAverageCurrent();
+    unsigned long used = getCharge();
+
+    if(_capacity && current)
+    {
+        unsigned long capacity = _capacity * 1000UL;
+        unsigned long left = capacity > used ? (capacity - used) / current : 0;
+        if(left < hours)hours = left;
+    }
+
+    // Voltage trend, least squares slope of the last samples
+    if(_voltageCount >= 2 && _voltageTime[_voltageCount - 1] > _voltageTime[0])
+    {
+        int64_t n = _voltageCount, sumT = 0, sumV = 0, sumTT = 0, sumTV = 0;
+
+        for(unsigned char i = 0; i < _voltageCount; i ++)
+        {
+            int64_t t = _voltageTime[i] - _voltageTime[0];
+            sumT += t;
+            sumV += _voltage[i];
+            sumTT += t * t;
+            sumTV += t * _voltage[i];
+        }
+
+        int64_t numerator = n * sumTV - sumT * sumV;      // slope = numerator / denominator mV/s
+        int64_t denominator = n * sumTT - sumT * sumT;
+        unsigned short last = _voltage[_voltageCount - 1];
+
+        if(numerator < 0 && denominator > 0)
+        {
+            int64_t margin = last > _cutoff ? last - _cutoff : 0;
+            int64_t left = margin * denominator / -numerator / 3600;
+            if(left < (int64_t)hours)hours = left;
+        }
+    }
+
+    return hours;
+}
+
+
+unsigned char LoRaWanEnergy::encode(unsigned char *buffer)
+{
+    unsigned long fields[4];
+
+    fields[0] = getAverageCurrent();
+    fields[1] = getCycleCharge();
+    fields[2] = getForecast();
+    fields[3] = _voltageCount ? _voltage[_voltageCount - 1] : 0;
+
+    for(unsigned char i = 0; i < 4; i ++)
+    {
+        unsigned long value = fields[i] > 0xFFFF ? 0xFFFF : fields[i];
+        buffer[i * 2] = value >> 8;
+        buffer[i * 2 + 1] = value & 0xFF;
+    }
+
+    return ENERGY_FORECAST_LENGTH;
+}
+
+
+unsigned long LoRaWanEnergy::getAirtime(unsigned char length, unsigned char dataRate)
+{
+    // FSK 50 kbps: 5 preamble, 3 sync, 1 length and 2 CRC bytes around the payload
+    if(dataRate == 7)return ((length + 11) * 8UL + 49) / 50;
+
+    unsigned char sf = dataRate <= 5 ? 12 - dataRate : 7;
+    unsigned long bandwidth = dataRate == 6 ? 250 : 125;           // kHz
+    unsigned long symbol = (1UL << sf) * 1000 / bandwidth;         // microsecond
+    long lowDataRate = (sf >= 11 && bandwidth == 125) ? 1 : 0;
+
+    // LoRa modem designer's formula, explicit header, CRC on, coding rate 4/5
+    long numerator = 8L * length - 4L * sf + 28 + 16;
+    long denominator = 4L * (sf - 2 * lowDataRate);
+    long payloadSymbols = 8;
+
+    if(numerator > 0)payloadSymbols += (numerator + denominator - 1) / denominator * 5;
+
+    // 12.25 preamble symbols, counted in quarter symbols
+    return ((49 + 4 * payloadSymbols) * symbol / 4 + 999) / 1000;
+}
+
+
+void LoRaWanEnergy::update(void)
+{
+    unsigned long now = millis();
+    unsigned long elapsed = now - _stamp;
+
+    _stamp = now;
+    book(_modemState, elapsed);
+    book(_mcuState, elapsed);
+}
+
+
+void LoRaWanEnergy::book(_energy_state_t state, unsigned long ms)
+{
+    _time[state] += ms;
+    _charge += (uint64_t)_current[state] * ms;
+}
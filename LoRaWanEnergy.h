@@ -0,0 +1,217 @@
+/*
+  LoRaWanEnergy.h
+  Energy ledger and battery life forecast
+
+  Books time spent in every modem and MCU state, multiplies it with the
+  configured current draw and projects the remaining battery life from the
+  consumed charge and the battery voltage trend.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANENERGY_H_
+#define _LORAWANENERGY_H_
+
+
+#include <Arduino.h>
+
+
+#define ENERGY_STATES           6
+#define ENERGY_VOLTAGE_SAMPLES  8
+#define ENERGY_FORECAST_LENGTH  8       // bytes written by encode()
+#define LORAWAN_FRAME_OVERHEAD  13      // MHDR + FHDR + FPort + MIC
+#define LORAWAN_JOIN_LENGTH     23      // Join-request PHY payload
+
+
+enum _energy_state_t { MODEM_SLEEP = 0, MODEM_IDLE, MODEM_TX, MODEM_RX, MCU_ACTIVE, MCU_SLEEP };
+
+/*****************************************************************
+Default current draw, rough figures for a Seeeduino LoRaWAN board.
+Measure your own board and set them with setCurrent().
+  MODEM_SLEEP   5 uA      MCU_ACTIVE   7 mA (48 MHz)
+  MODEM_IDLE    3 mA      MCU_SLEEP    0.1 mA (standby, regulator)
+  MODEM_TX     45 mA (14 dBm)
+  MODEM_RX     12 mA
+******************************************************************/
+
+
+class LoRaWanEnergy
+{
+    public:
+
+        LoRaWanEnergy(void);
+
+        /**
+         *  \brief Set the current draw of a state
+         *
+         *  \param [in] state The modem or MCU state
+         *  \param [in] microAmps The current in microampere
+         *
+         *  \return Return null
+         */
+        void setCurrent(_energy_state_t state, unsigned long microAmps);
+
+        /**
+         *  \brief Switch the modem state, time so far is booked to the old one
+         *
+         *  \param [in] state One of the MODEM_ states
+         *
+         *  \return Return null
+         */
+        void setModemState(_energy_state_t state);
+
+        /**
+         *  \brief Switch the MCU state, time so far is booked to the old one
+         *
+         *  \param [in] state One of the MCU_ states
+         *
+         *  \return Return null
+         */
+        void setMcuState(_energy_state_t state);
+
+        /**
+         *  \brief Book time millis() did not see, e.g. RTC standby
+         *
+         *  \param [in] state The state to book, MCU_SLEEP books MODEM_SLEEP too
+         *  \param [in] ms The time in millisecond
+         *
+         *  \return Return null
+         */
+        void addTime(_energy_state_t state, unsigned long ms);
+
+        /**
+         *  \brief Book one uplink, called by the library
+         *
+         *  \param [in] airtime The time on air in millisecond
+         *  \param [in] duration The whole command time, the rest is booked as receive
+         *
+         *  \return Return null
+         */
+        void addUplink(unsigned long airtime, unsigned long duration);
+
+        /**
+         *  \brief Time spent in a state
+         *
+         *  \param [in] state The modem or MCU state
+         *
+         *  \return Return time in second
+         */
+        unsigned long getTime(_energy_state_t state);
+
+        /**
+         *  \brief Number of uplinks and join requests booked
+         *
+         *  \return Return uplink count
+         */
+        unsigned long getUplinks(void);
+
+        /**
+         *  \brief Total time on air
+         *
+         *  \return Return time in millisecond
+         */
+        unsigned long getAirtime(void);
+
+        /**
+         *  \brief Charge consumed since start
+         *
+         *  \return Return charge in microampere hour
+         */
+        unsigned long getCharge(void);
+
+        /**
+         *  \brief Average current since start
+         *
+         *  \return Return current in microampere
+         */
+        unsigned long getAverageCurrent(void);
+
+        /**
+         *  \brief Mark the start of a reporting cycle
+         *
+         *  \return Return charge of the cycle that just ended in microampere hour
+         */
+        unsigned long startCycle(void);
+
+        /**
+         *  \brief Charge consumed since startCycle()
+         *
+         *  \return Return charge in microampere hour
+         */
+        unsigned long getCycleCharge(void);
+
+        /**
+         *  \brief Describe the battery
+         *
+         *  \param [in] capacity The capacity in milliampere hour
+         *  \param [in] cutoff The voltage the node stops working at, millivolt
+         *
+         *  \return Return null
+         */
+        void setBattery(unsigned short capacity, unsigned short cutoff);
+
+        /**
+         *  \brief Add a battery voltage reading to the trend
+         *
+         *  \param [in] millivolts The battery voltage
+         *
+         *  \return Return null
+         */
+        void addBatteryVoltage(unsigned short millivolts);
+
+        /**
+         *  \brief Project the remaining battery life
+         *
+         *  The smaller of the charge based and the voltage trend based estimate.
+         *
+         *  \return Return hours left, 0xFFFF when unknown or longer
+         */
+        unsigned short getForecast(void);
+
+        /**
+         *  \brief Write the forecast as an uplink record
+         *
+         *  Big endian: average current uA, cycle charge uAh, forecast hours,
+         *  battery millivolts, two bytes each.
+         *
+         *  \param [out] *buffer The output cache, ENERGY_FORECAST_LENGTH bytes
+         *
+         *  \return Return record length
+         */
+        unsigned char encode(unsigned char *buffer);
+
+        /**
+         *  \brief Time on air of an EU433/EU868 frame
+         *
+         *  \param [in] length The PHY payload length in bytes
+         *  \param [in] dataRate The data rate, 0 to 7
+         *
+         *  \return Return time in millisecond
+         */
+        static unsigned long getAirtime(unsigned char length, unsigned char dataRate);
+
+    private:
+        void update(void);
+        void book(_energy_state_t state, unsigned long ms);
+
+        unsigned long _current[ENERGY_STATES];
+        uint64_t _time[ENERGY_STATES];          // millisecond
+        uint64_t _charge;                       // microampere millisecond
+        uint64_t _cycleStart;
+        unsigned long _stamp;
+        unsigned long _uplinks;
+        unsigned long _airtime;
+        _energy_state_t _modemState;
+        _energy_state_t _mcuState;
+
+        unsigned short _capacity;
+        unsigned short _cutoff;
+        unsigned short _voltage[ENERGY_VOLTAGE_SAMPLES];
+        unsigned long _voltageTime[ENERGY_VOLTAGE_SAMPLES];    // second
+        unsigned char _voltageCount;
+};
+
+
+#endif
@@ -0,0 +1,454 @@
+/*
+  LoRaWanFragment.cpp
+  Fragmented data block receiver with forward error correction
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanFragment.h"
+#include <string.h>
+
+
+#define FRAGMENT_PACKAGE_ID         3
+#define FRAGMENT_PACKAGE_VERSION    1
+
+#define CID_PACKAGE_VERSION         0x00
+#define CID_SESSION_STATUS          0x01
+#define CID_SESSION_SETUP           0x02
+#define CID_SESSION_DELETE          0x03
+#define CID_DATA_FRAGMENT           0x08
+
+#define SETUP_ENCODING_UNSUPPORTED  0x01
+#define SETUP_NOT_ENOUGH_MEMORY     0x02
+#define DELETE_NO_SESSION           0x04
+
+
+LoRaWanFragment::LoRaWanFragment(uint8_t *buffer, size_t length)
+{
+    _buffer = buffer;
+    _length = length;
+    _scratch = NULL;
+    _scratchRow = NULL;
+    _known = NULL;
+    _rows = NULL;
+
+    _count = 0;
+    _size = 0;
+    _padding = 0;
+    _rowBytes = 0;
+    _rowsMax = 0;
+    _rowCount = 0;
+    _knownCount = 0;
+    _received = 0;
+    _index = 0;
+    _active = false;
+    _outOfMemory = false;
+}
+
+
+size_t LoRaWanFragment::bufferSize(unsigned short count, unsigned char size, unsigned short lost)
+{
+    size_t rowBytes = (count + 7) / 8;
+
+    return (size_t)count * size + size + 2 * rowBytes + lost * (rowBytes + 2);
+}
+
+
+unsigned char LoRaWanFragment::process(const uint8_t *data, short length, uint8_t *answer)
+{
+    unsigned char n = 0;
+    short i = 0;
+
+    while(i < length)
+    {
+        uint8_t cid = data[i ++];
+
+        if(cid == CID_PACKAGE_VERSION)
+        {
+            if(n + 3 > FRAGMENT_ANSWER_MAX)break;
+            answer[n ++] = CID_PACKAGE_VERSION;
+            answer[n ++] = FRAGMENT_PACKAGE_ID;
+            answer[n ++] = FRAGMENT_PACKAGE_VERSION;
+        }
+        else if(cid == CID_SESSION_STATUS)
+        {
+            if(i + 1 > length || n + 5 > FRAGMENT_ANSWER_MAX)break;
+
+            uint8_t status = data[i ++];
+            unsigned char index = (status >> 1) & 0x03;
+            unsigned short needed = getNeeded();
+
+            // Bit 0 clear asks only receivers still missing fragments to answer
+            if(!_active || index != _index || (!(status & 0x01) && !needed))continue;
+
+            unsigned short received = (_received & 0x3FFF) | (index << 14);
+            answer[n ++] = CID_SESSION_STATUS;
+            answer[n ++] = received & 0xFF;
+            answer[n ++] = received >> 8;
+            answer[n ++] = needed > 255 ? 255 : needed;
+            answer[n ++] = _outOfMemory ? 0x01 : 0x00;
+        }
+        else if(cid == CID_SESSION_SETUP)
+        {
+            if(i + 10 > length || n + 2 > FRAGMENT_ANSWER_MAX)break;
+
+            unsigned char index = (data[i] >> 4) & 0x03;
+            unsigned short count = data[i + 1] | (data[i + 2] << 8);
+            unsigned char size = data[i + 3];
+            unsigned char control = data[i + 4];
+            unsigned char padding = data[i + 5];
+            uint8_t status = index << 6;
+
+            // Only fragmentation matrix 0, the PRBS23 parity rows, is defined
+            if((control >> 3) & 0x07)status |= SETUP_ENCODING_UNSUPPORTED;
+            else if(!begin(count, size, padding))status |= SETUP_NOT_ENOUGH_MEMORY;
+            else _index = index;
+
+            i += 10;
+            answer[n ++] = CID_SESSION_SETUP;
+            answer[n ++] = status;
+        }
+        else if(cid == CID_SESSION_DELETE)
+        {
+            if(i + 1 > length || n + 2 > FRAGMENT_ANSWER_MAX)break;
+
+            unsigned char index = data[i ++] & 0x03;
+            uint8_t status = index;
+
+            if(!_active || index != _index)status |= DELETE_NO_SESSION;
+            else _active = false;
+
+            answer[n ++] = CID_SESSION_DELETE;
+            answer[n ++] = status;
+        }
+        else if(cid == CID_DATA_FRAGMENT)
+        {
+            // A fragment fills the rest of the frame
+            if(i + 2 + _size > length)break;
+
+            unsigned short indexAndN = data[i] | (data[i + 1] << 8);
+
+            if(_active && (indexAndN >> 14) == _index)add(indexAndN & 0x3FFF, data + i + 2);
+            break;
+        }
+        else
+        {
+            break;      // unknown command, the rest of the frame cannot be parsed
+        }
+    }
+
+    return n;
+}
+
+
+bool LoRaWanFragment::begin(unsigned short count, unsigned char size, unsigned char padding)
+{
+    _active = false;
+
+    if(!count || count > FRAGMENT_COUNT_MAX || !size || padding >= (size_t)count * size)return false;
+
+    size_t block = (size_t)count * size;
+    unsigned short rowBytes = (count + 7) / 8;
+    size_t fixed = block + size + 2 * rowBytes;
+
+    if(fixed > _length)return false;
+
+    _count = count;
+    _size = size;
+    _padding = padding;
+    _rowBytes = rowBytes;
+
+    _scratch = _buffer + block;
+    _scratchRow = _scratch + size;
+    _known = _scratchRow + rowBytes;
+    _rows = _known + rowBytes;
+
+    size_t rowsMax = (_length - fixed) / (rowBytes + 2);
+    _rowsMax = rowsMax > count ? count : rowsMax;
+
+    memset(_known, 0, rowBytes);
+    _rowCount = 0;
+    _knownCount = 0;
+    _received = 0;
+    _outOfMemory = false;
+    _active = true;
+
+    return true;
+}
+
+
+bool LoRaWanFragment::add(unsigned short index, const uint8_t *data)
+{
+    if(!_active || !index)return false;
+    if(done())return true;
+
+    _received ++;
+
+    if(index <= _count)
+    {
+        unsigned short p = index - 1;
+
+        if(known(p))return false;
+
+        short r = findRow(p);
+
+        if(r >= 0)
+        {
+            // The slot held a pending coded fragment with this one as its lowest
+            // unknown, take the fragment out of it and reduce the rest again
+            uint8_t *target = slot(p);
+
+            for(unsigned char i = 0; i < _size; i ++)_scratch[i] = target[i] ^ data[i];
+            memcpy(_scratchRow, row(r), _rowBytes);
+            _scratchRow[p >> 3] &= ~(1 << (p & 0x07));
+            removeRow(r);
+
+            memcpy(target, data, _size);
+            setKnown(p);
+            insert();
+        }
+        else
+        {
+            memcpy(slot(p), data, _size);
+            setKnown(p);
+        }
+    }
+    else
+    {
+        matrixRow(index - _count, _scratchRow);
+        memcpy(_scratch, data, _size);
+        insert();
+    }
+
+    if(_knownCount + _rowCount == _count)solve();
+
+    return done();
+}
+
+
+bool LoRaWanFragment::done(void)
+{
+    return _active && _knownCount == _count;
+}
+
+
+const uint8_t *LoRaWanFragment::getData(void)
+{
+    return _buffer;
+}
+
+
+size_t LoRaWanFragment::getLength(void)
+{
+    return _active ? (size_t)_count * _size - _padding : 0;
+}
+
+
+unsigned short LoRaWanFragment::getReceived(void)
+{
+    return _received;
+}
+
+
+unsigned short LoRaWanFragment::getNeeded(void)
+{
+    return _active ? _count - _knownCount - _rowCount : 0;
+}
+
+
+bool LoRaWanFragment::isMissing(unsigned short index)
+{
+    if(!_active || !index || index > _count)return false;
+    return !known(index - 1);
+}
+
+
+unsigned short LoRaWanFragment::getMissingBitmap(uint8_t *bitmap, unsigned short length)
+{
+    if(!_active)return 0;
+    if(length > _rowBytes)length = _rowBytes;
+
+    for(unsigned short i = 0; i < length; i ++)bitmap[i] = ~_known[i];
+
+    // Bits past the last fragment are not missing
+    if(length == _rowBytes && (_count & 0x07))bitmap[length - 1] &= (1 << (_count & 0x07)) - 1;
+
+    return length;
+}
+
+
+bool LoRaWanFragment::outOfMemory(void)
+{
+    return _outOfMemory;
+}
+
+
+uint8_t *LoRaWanFragment::slot(unsigned short index)
+{
+    return _buffer + (size_t)index * _size;
+}
+
+
+uint8_t *LoRaWanFragment::row(unsigned short rowIndex)
+{
+    return _rows + (size_t)rowIndex * (_rowBytes + 2) + 2;
+}
+
+
+unsigned short LoRaWanFragment::pivot(unsigned short rowIndex)
+{
+    // Byte wise, the rows are not aligned and Cortex-M0 faults on unaligned halfwords
+    uint8_t *entry = _rows + (size_t)rowIndex * (_rowBytes + 2);
+    return entry[0] | (entry[1] << 8);
+}
+
+
+short LoRaWanFragment::findRow(unsigned short p)
+{
+    for(unsigned short r = 0; r < _rowCount; r ++)
+    {
+        if(pivot(r) == p)return r;
+    }
+    return -1;
+}
+
+
+void LoRaWanFragment::removeRow(unsigned short rowIndex)
+{
+    size_t entry = _rowBytes + 2;
+
+    // Order does not matter, the last row takes the free place
+    _rowCount --;
+    if(rowIndex != _rowCount)memcpy(_rows + rowIndex * entry, _rows + _rowCount * entry, entry);
+}
+
+
+void LoRaWanFragment::matrixRow(unsigned short n, uint8_t *coefficients)
+{
+    // TS004 fragmentation matrix 0, the reference parity row generator
+    long m = _count;
+    long modulo = m + ((m & (m - 1)) == 0 ? 1 : 0);
+    long x = 1 + 1001L * n;
+
+    memset(coefficients, 0, _rowBytes);
+
+    for(long coefficient = 0; coefficient < m / 2; coefficient ++)
+    {
+        long r = 1L << 16;
+
+        while(r >= m)
+        {
+            x = (x >> 1) + (((x & 0x01) ^ ((x >> 5) & 0x01)) << 22);     // PRBS23
+            r = x % modulo;
+        }
+        coefficients[r >> 3] |= 1 << (r & 0x07);
+    }
+}
+
+
+bool LoRaWanFragment::insert(void)
+{
+    // The equation in _scratchRow and _scratch, reduced until its lowest unknown
+    // has no row yet, then stored there
+    unsigned short start = 0;
+
+    while(true)
+    {
+        unsigned short byte = start >> 3;
+
+        while(byte < _rowBytes && !_scratchRow[byte])byte ++;
+        if(byte == _rowBytes)return false;       // depends on known fragments only
+
+        unsigned short p = byte << 3;
+        while(!(_scratchRow[byte] & (1 << (p & 0x07))))p ++;
+        start = p;
+
+        if(known(p))
+        {
+            uint8_t *source = slot(p);
+            for(unsigned char i = 0; i < _size; i ++)_scratch[i] ^= source[i];
+            _scratchRow[byte] &= ~(1 << (p & 0x07));
+            continue;
+        }
+
+        short r = findRow(p);
+
+        if(r >= 0)
+        {
+            uint8_t *source = slot(p);
+            uint8_t *coefficients = row(r);
+
+            for(unsigned char i = 0; i < _size; i ++)_scratch[i] ^= source[i];
+            for(unsigned short i = byte; i < _rowBytes; i ++)_scratchRow[i] ^= coefficients[i];
+            continue;
+        }
+
+        // p is free, a single unknown left means the fragment is recovered
+        bool single = !(_scratchRow[byte] & ~(1 << (p & 0x07)));
+        for(unsigned short i = byte + 1; single && i < _rowBytes; i ++)single = !_scratchRow[i];
+
+        if(single)
+        {
+            memcpy(slot(p), _scratch, _size);
+            setKnown(p);
+            return true;
+        }
+
+        if(_rowCount >= _rowsMax)
+        {
+            _outOfMemory = true;
+            return false;
+        }
+
+        uint8_t *entry = _rows + (size_t)_rowCount * (_rowBytes + 2);
+        entry[0] = p & 0xFF;
+        entry[1] = p >> 8;
+        memcpy(entry + 2, _scratchRow, _rowBytes);
+        memcpy(slot(p), _scratch, _size);
+        _rowCount ++;
+
+        return true;
+    }
+}
+
+
+void LoRaWanFragment::solve(void)
+{
+    // Every unknown has a row, back substitute from the highest one down
+    for(unsigned short p = _count; p -- > 0;)
+    {
+        if(known(p))continue;
+
+        short r = findRow(p);
+        if(r < 0)return;
+
+        uint8_t *target = slot(p);
+        uint8_t *coefficients = row(r);
+
+        for(unsigned short j = p + 1; j < _count; j ++)
+        {
+            if(!(coefficients[j >> 3] & (1 << (j & 0x07))))continue;
+
+            uint8_t *source = slot(j);
+            for(unsigned char i = 0; i < _size; i ++)target[i] ^= source[i];
+        }
+
+        removeRow(r);
+        setKnown(p);
+    }
+}
+
+
+bool LoRaWanFragment::known(unsigned short index)
+{
+    return _known[index >> 3] & (1 << (index & 0x07));
+}
+
+
+void LoRaWanFragment::setKnown(unsigned short index)
+{
+    _known[index >> 3] |= 1 << (index & 0x07);
+    _knownCount ++;
+}
@@ -0,0 +1,192 @@
+/*
+  LoRaWanFragment.h
+  Fragmented data block receiver with forward error correction
+
+  Receiver side of the LoRaWAN Fragmented Data Block Transport package
+  (TS004). The server splits a block into NbFrag fragments and sends them
+  followed by coded fragments, each the XOR of a pseudo random half of the
+  uncoded ones. Every fragment is folded into the block as it arrives, by
+  on the fly Gaussian elimination over GF(2), so lost fragments are
+  recovered from any NbFrag independent fragments without retransmission.
+
+  All state lives in one caller owned buffer, see bufferSize():
+    block         NbFrag * FragSize, the reassembled data
+    scratch       FragSize + one coefficient row
+    known         one bit per fragment
+    rows          pivot and coefficients of every pending coded fragment
+  A pending coded fragment keeps its data in the block slot of the lowest
+  fragment it still misses, that slot is empty anyway.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANFRAGMENT_H_
+#define _LORAWANFRAGMENT_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define FRAGMENT_PORT               201     // FPort of the package
+#define FRAGMENT_ANSWER_MAX         16      // longest answer process() writes
+#define FRAGMENT_COUNT_MAX          16383   // NbFrag, 14 bit field
+
+
+class LoRaWanFragment
+{
+    public:
+
+        /**
+         *  \brief Create a receiver over a caller owned buffer
+         *
+         *  \param [in] *buffer The storage for the block and the decoder
+         *  \param [in] length The size of storage
+         */
+        LoRaWanFragment(uint8_t *buffer, size_t length);
+
+        /**
+         *  \brief Storage needed for a block
+         *
+         *  \param [in] count The number of uncoded fragments
+         *  \param [in] size The fragment size in bytes
+         *  \param [in] lost The number of lost fragments to recover, count for any loss
+         *
+         *  \return Return size in bytes
+         */
+        static size_t bufferSize(unsigned short count, unsigned char size, unsigned short lost);
+
+        /**
+         *  \brief Handle one downlink received on FRAGMENT_PORT
+         *
+         *  Setup, status, delete, version and data fragment commands. The
+         *  answers are meant to be sent back on FRAGMENT_PORT.
+         *
+         *  \param [in] *data The downlink payload
+         *  \param [in] length The payload length
+         *  \param [out] *answer The answer cache, FRAGMENT_ANSWER_MAX bytes
+         *
+         *  \return Return answer length, 0 : nothing to send
+         */
+        unsigned char process(const uint8_t *data, short length, uint8_t *answer);
+
+        /**
+         *  \brief Start a session without a setup command
+         *
+         *  \param [in] count The number of uncoded fragments
+         *  \param [in] size The fragment size in bytes
+         *  \param [in] padding The bytes added to fill the last fragment
+         *
+         *  \return Return bool. False : the block does not fit the buffer
+         */
+        bool begin(unsigned short count, unsigned char size, unsigned char padding = 0);
+
+        /**
+         *  \brief Add one fragment
+         *
+         *  \param [in] index The fragment number N, 1 to count uncoded, above coded
+         *  \param [in] *data The fragment, size bytes
+         *
+         *  \return Return bool. True : the block is complete
+         */
+        bool add(unsigned short index, const uint8_t *data);
+
+        /**
+         *  \brief Check if the whole block is known
+         *
+         *  \return Return bool. True : getData() holds the block
+         */
+        bool done(void);
+
+        /**
+         *  \brief Get the reassembled block
+         *
+         *  \return Return pointer into the caller buffer
+         */
+        const uint8_t *getData(void);
+
+        /**
+         *  \brief Block length without the padding
+         *
+         *  \return Return length in bytes
+         */
+        size_t getLength(void);
+
+        /**
+         *  \brief Number of fragments received, uncoded and coded
+         *
+         *  \return Return fragment count
+         */
+        unsigned short getReceived(void);
+
+        /**
+         *  \brief Number of further independent fragments needed
+         *
+         *  \return Return fragment count, 0 when done
+         */
+        unsigned short getNeeded(void);
+
+        /**
+         *  \brief Check if an uncoded fragment is still unknown
+         *
+         *  \param [in] index The fragment number N, 1 to count
+         *
+         *  \return Return bool. True : missing
+         */
+        bool isMissing(unsigned short index);
+
+        /**
+         *  \brief Write the missing fragment bitmap
+         *
+         *  Bit i of byte i / 8 is set when fragment i + 1 is missing.
+         *
+         *  \param [out] *bitmap The output cache
+         *  \param [in] length The size of output cache
+         *
+         *  \return Return bytes written
+         */
+        unsigned short getMissingBitmap(uint8_t *bitmap, unsigned short length);
+
+        /**
+         *  \brief Check if a coded fragment was dropped for lack of row storage
+         *
+         *  \return Return bool. True : the buffer was too small
+         */
+        bool outOfMemory(void);
+
+    private:
+        uint8_t *slot(unsigned short index);
+        uint8_t *row(unsigned short rowIndex);
+        unsigned short pivot(unsigned short rowIndex);
+        short findRow(unsigned short pivot);
+        void removeRow(unsigned short rowIndex);
+        void matrixRow(unsigned short n, uint8_t *coefficients);
+        bool insert(void);
+        void solve(void);
+        bool known(unsigned short index);
+        void setKnown(unsigned short index);
+
+        uint8_t *_buffer;
+        size_t _length;
+        uint8_t *_scratch;
+        uint8_t *_scratchRow;
+        uint8_t *_known;
+        uint8_t *_rows;
+
+        unsigned short _count;
+        unsigned char _size;
+        unsigned char _padding;
+        unsigned short _rowBytes;
+        unsigned short _rowsMax;
+        unsigned short _rowCount;
+        unsigned short _knownCount;
+        unsigned short _received;
+        unsigned char _index;
+        bool _active;
+        bool _outOfMemory;
+};
+
+
+#endif
@@ -0,0 +1,224 @@
+/*
+  LoRaWanIntervalPolicy.cpp
+  Reporting interval adapted to the battery, the airtime budget and the link
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanIntervalPolicy.h"
+
+
+static unsigned char countBits(uint8_t value)
+{
+    unsigned char count = 0;
+
+    for(; value; value &= value - 1)count ++;
+
+    return count;
+}
+
+
+LoRaWanIntervalPolicy::LoRaWanIntervalPolicy(unsigned long airtimeBudget)
+{
+    _base = INTERVAL_BASE;
+    _min = INTERVAL_MIN;
+    _max = INTERVAL_MAX;
+    _airtimeBudget = airtimeBudget ? airtimeBudget : 1;
+    _airtime = 0;
+    _tokens = _airtimeBudget;
+    _levels[0] = INTERVAL_BATTERY_GOOD;
+    _levels[1] = INTERVAL_BATTERY_LOW;
+    _levels[2] = INTERVAL_BATTERY_CRITICAL;
+    _battery = BATTERY_NORMAL;
+    _charging = false;
+    _history = 0;
+    _uplinks = 0;
+    _reasons = 0;
+}
+
+
+bool LoRaWanIntervalPolicy::setLimits(unsigned long minimum, unsigned long maximum)
+{
+    if(minimum < INTERVAL_FLOOR || minimum > maximum)return false;
+
+    _min = minimum;
+    _max = maximum;
+
+    if(_base < _min)_base = _min;
+    if(_base > _max)_base = _max;
+
+    return true;
+}
+
+
+bool LoRaWanIntervalPolicy::setBase(unsigned long base)
+{
+    if(base < _min || base > _max)return false;
+
+    _base = base;
+
+    return true;
+}
+
+
+bool LoRaWanIntervalPolicy::setBatteryLevels(unsigned short good, unsigned short low, unsigned short critical)
+{
+    if(good < low || low < critical)return false;
+
+    _levels[0] = good;
+    _levels[1] = low;
+    _levels[2] = critical;
+
+    return true;
+}
+
+
+void LoRaWanIntervalPolicy::setBattery(unsigned short millivolts, bool charging)
+{
+    _battery_level_t level;
+
+    _charging = charging;
+
+    if(millivolts < _levels[2])level = BATTERY_CRITICAL;
+    else if(millivolts < _levels[1])level = BATTERY_LOW;
+    else if(millivolts >= _levels[0])level = BATTERY_GOOD;
+    else level = BATTERY_NORMAL;
+
+    // Falling takes effect at once, rising needs the hysteresis on top
+    if(level < _battery)
+    {
+        unsigned short lowered = millivolts > INTERVAL_BATTERY_HYSTERESIS ? millivolts - INTERVAL_BATTERY_HYSTERESIS : 0;
+
+        if(lowered < _levels[2])level = BATTERY_CRITICAL;
+        else if(lowered < _levels[1])level = BATTERY_LOW;
+        else if(lowered >= _levels[0])level = BATTERY_GOOD;
+        else level = BATTERY_NORMAL;
+
+        if(level > _battery)level = _battery;
+    }
+
+    _battery = level;
+}
+
+
+void LoRaWanIntervalPolicy::addUplink(unsigned long airtime, bool delivered)
+{
+    _tokens -= airtime;
+    if(_tokens < -(long)_airtimeBudget)_tokens = -(long)_airtimeBudget;
+    _airtime = airtime;
+
+    _history = (_history << 1) | (delivered ? 1 : 0);
+    if(_uplinks < INTERVAL_HISTORY)_uplinks ++;
+}
+
+
+unsigned long LoRaWanIntervalPolicy::next(void)
+{
+    unsigned char delivered = countBits(_history & ((1 << _uplinks) - 1));
+    bool judged = _uplinks >= INTERVAL_HISTORY / 2;
+    unsigned char shift = 0;
+    unsigned long interval;
+
+    _reasons = 0;
+
+    if(!_charging && _battery == BATTERY_CRITICAL)
+    {
+        shift += 2;
+        _reasons |= INTERVAL_BATTERY_CRIT_BIT;
+    }
+    else if(!_charging && _battery == BATTERY_LOW)
+    {
+        shift += 1;
+        _reasons |= INTERVAL_BATTERY_LOW_BIT;
+    }
+
+    // Rates compared in eighths so any history length works
+    if(judged && delivered * 8 < 3 * _uplinks)
+    {
+        shift += 2;
+        _reasons |= INTERVAL_LINK_BAD_BIT;
+    }
+    else if(judged && delivered * 8 < 5 * _uplinks)
+    {
+        shift += 1;
+        _reasons |= INTERVAL_LINK_POOR_BIT;
+    }
+
+    if(!shift && judged && delivered * 8 >= 7 * _uplinks && (_charging || _battery == BATTERY_GOOD))
+    {
+        interval = _base / 2;
+        _reasons |= INTERVAL_HEALTHY_BIT;
+    }
+    else interval = _base << shift;
+
+    if(interval < _min || interval > _max)
+    {
+        interval = interval < _min ? _min : _max;
+        _reasons |= INTERVAL_LIMITED_BIT;
+    }
+
+    // Long enough to earn the airtime of one more uplink like the last one
+    long needed = (long)_airtime - _tokens;
+
+    if(needed > 0)
+    {
+        unsigned long duty = ((uint64_t)needed * 3600 + _airtimeBudget - 1) / _airtimeBudget;
+
+        if(duty > interval)
+        {
+            interval = duty;
+            _reasons |= INTERVAL_DUTY_BIT;
+        }
+    }
+
+    int64_t tokens = _tokens + (int64_t)((uint64_t)interval * _airtimeBudget / 3600);
+    _tokens = tokens > (int64_t)_airtimeBudget ? _airtimeBudget : (long)tokens;
+
+    return interval;
+}
+
+
+unsigned char LoRaWanIntervalPolicy::getReasons(void)
+{
+    return _reasons;
+}
+
+
+_battery_level_t LoRaWanIntervalPolicy::getBatteryLevel(void)
+{
+    return _battery;
+}
+
+
+unsigned char LoRaWanIntervalPolicy::getSuccessRate(void)
+{
+    if(!_uplinks)return 100;
+
+    return countBits(_history & ((1 << _uplinks) - 1)) * 100 / _uplinks;
+}
+
+
+long LoRaWanIntervalPolicy::getBudget(void)
+{
+    return _tokens;
+}
+
+
+unsigned long LoRaWanIntervalPolicy::getBase(void)
+{
+    return _base;
+}
+
+
+unsigned long LoRaWanIntervalPolicy::getMin(void)
+{
+    return _min;
+}
+
+
+unsigned long LoRaWanIntervalPolicy::getMax(void)
+{
+    return _max;
+}
@@ -0,0 +1,191 @@
+/*
+  LoRaWanIntervalPolicy.h
+  Reporting interval adapted to the battery, the airtime budget and the link
+
+  The backend sets a base interval and the limits around it by downlink.
+  Before every uplink the node asks for the next interval and the policy
+  scales the base by the state it was fed:
+    battery low          x 2, critical x 4, not while charging
+    uplinks delivered    below 5 of the last 8 x 2, below 3 x 4
+    battery good or charging, and at least 7 of 8 delivered: / 2
+  and clamps the result to the limits. The airtime budget comes last and
+  wins over the upper limit, as the duty cycle is a legal limit: the
+  interval never drops below the time the budget needs to earn the
+  airtime of the last uplink back, plus any debt retransmissions made.
+
+  The budget is a token bucket refilled at the budget rate for every
+  interval handed out, so the node has to keep to the interval it got.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANINTERVALPOLICY_H_
+#define _LORAWANINTERVALPOLICY_H_
+
+
+#include <stdint.h>
+
+
+#define INTERVAL_BASE               300     // second, before the backend sets one
+#define INTERVAL_MIN                60      // second, default lower limit
+#define INTERVAL_MAX                3600    // second, default upper limit
+#define INTERVAL_FLOOR              10      // second, no limit accepted below
+#define INTERVAL_AIRTIME_BUDGET     36000   // millisecond per hour, the 1 % duty cycle
+#define INTERVAL_BATTERY_GOOD       3900    // millivolt
+#define INTERVAL_BATTERY_LOW        3600    // millivolt
+#define INTERVAL_BATTERY_CRITICAL   3400    // millivolt
+#define INTERVAL_BATTERY_HYSTERESIS 50      // millivolt, a level is left only this far above it
+#define INTERVAL_HISTORY            8       // uplinks the success rate looks at
+
+
+// Reasons behind the last interval, bit mask
+#define INTERVAL_BATTERY_LOW_BIT    0x01
+#define INTERVAL_BATTERY_CRIT_BIT   0x02
+#define INTERVAL_LINK_POOR_BIT      0x04
+#define INTERVAL_LINK_BAD_BIT       0x08
+#define INTERVAL_HEALTHY_BIT        0x10
+#define INTERVAL_LIMITED_BIT        0x20    // clamped to the backend limits
+#define INTERVAL_DUTY_BIT           0x40    // stretched by the airtime budget
+
+
+enum _battery_level_t { BATTERY_GOOD = 0, BATTERY_NORMAL, BATTERY_LOW, BATTERY_CRITICAL };
+
+
+class LoRaWanIntervalPolicy
+{
+    public:
+
+        /**
+         *  \brief Create a policy
+         *
+         *  \param [in] airtimeBudget The airtime allowed per hour in millisecond
+         */
+        LoRaWanIntervalPolicy(unsigned long airtimeBudget = INTERVAL_AIRTIME_BUDGET);
+
+        /**
+         *  \brief Set the limits the interval stays in, from a downlink
+         *
+         *  \param [in] minimum The shortest interval in second, INTERVAL_FLOOR at least
+         *  \param [in] maximum The longest interval in second
+         *
+         *  \return Return bool. True : limits taken, the base is moved into them
+         */
+        bool setLimits(unsigned long minimum, unsigned long maximum);
+
+        /**
+         *  \brief Set the interval of a node in normal state, from a downlink
+         *
+         *  \param [in] base The interval in second, within the limits
+         *
+         *  \return Return bool. True : interval taken
+         */
+        bool setBase(unsigned long base);
+
+        /**
+         *  \brief Set the battery voltages the levels start at
+         *
+         *  \param [in] good The voltage from which the battery counts as good, millivolt
+         *  \param [in] low The voltage below which the battery counts as low, millivolt
+         *  \param [in] critical The voltage below which the battery counts as critical, millivolt
+         *
+         *  \return Return bool. True : the levels are in descending order and taken
+         */
+        bool setBatteryLevels(unsigned short good, unsigned short low, unsigned short critical);
+
+        /**
+         *  \brief Feed a battery reading, getBatteryVoltageMilliVolts() and getBatteryStatus()
+         *
+         *  \param [in] millivolts The battery voltage
+         *  \param [in] charging The battery is charging, getBatteryStatus() returned false
+         *
+         *  \return Return null
+         */
+        void setBattery(unsigned short millivolts, bool charging);
+
+        /**
+         *  \brief Book an uplink
+         *
+         *  \param [in] airtime The time on air it took, all retransmissions included, millisecond
+         *  \param [in] delivered The modem reported it sent, or acknowledged when confirmed
+         *
+         *  \return Return null
+         */
+        void addUplink(unsigned long airtime, bool delivered);
+
+        /**
+         *  \brief Interval until the next uplink, call once per uplink
+         *
+         *  The airtime budget is refilled for the interval returned.
+         *
+         *  \return Return interval in second
+         */
+        unsigned long next(void);
+
+        /**
+         *  \brief Reasons behind the last interval
+         *
+         *  \return Return mask of INTERVAL_*_BIT
+         */
+        unsigned char getReasons(void);
+
+        /**
+         *  \brief Battery level from the last reading
+         *
+         *  \return Return level
+         */
+        _battery_level_t getBatteryLevel(void);
+
+        /**
+         *  \brief Uplinks delivered out of the last INTERVAL_HISTORY
+         *
+         *  \return Return percent, 100 without uplinks
+         */
+        unsigned char getSuccessRate(void);
+
+        /**
+         *  \brief Airtime budget left, negative after retransmissions overdrew it
+         *
+         *  \return Return time in millisecond
+         */
+        long getBudget(void);
+
+        /**
+         *  \brief Interval of a node in normal state
+         *
+         *  \return Return interval in second
+         */
+        unsigned long getBase(void);
+
+        /**
+         *  \brief Lower limit
+         *
+         *  \return Return interval in second
+         */
+        unsigned long getMin(void);
+
+        /**
+         *  \brief Upper limit, the airtime budget may still exceed it
+         *
+         *  \return Return interval in second
+         */
+        unsigned long getMax(void);
+
+    private:
+        unsigned long _base;
+        unsigned long _min;
+        unsigned long _max;
+        unsigned long _airtimeBudget;
+        unsigned long _airtime;         // of the last uplink
+        long _tokens;                   // millisecond of airtime
+        unsigned short _levels[3];      // good, low, critical
+        _battery_level_t _battery;
+        bool _charging;
+        uint8_t _history;               // bit 0 the last uplink, 1 delivered
+        unsigned char _uplinks;         // in the history, INTERVAL_HISTORY at most
+        unsigned char _reasons;
+};
+
+
+#endif
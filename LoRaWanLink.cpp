@@ -0,0 +1,175 @@
+/*
+  LoRaWanLink.cpp
+  Rolling statistics of LinkCheck answers
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanLink.h"
+
+
+#define LINK_LOST               0xFF    // margin of an unanswered request, 255 is reserved in LinkCheckAns
+
+
+LoRaWanLink::LoRaWanLink(void)
+{
+    clear();
+}
+
+
+void LoRaWanLink::add(unsigned char margin, unsigned char gateways)
+{
+    if(margin == LINK_LOST)margin = LINK_LOST - 1;
+
+    _margin[_head] = margin;
+    _gateways[_head] = gateways;
+    _head = (_head + 1) % LINK_WINDOW;
+    if(_count < LINK_WINDOW)_count ++;
+}
+
+
+void LoRaWanLink::addLost(void)
+{
+    _margin[_head] = LINK_LOST;
+    _gateways[_head] = 0;
+    _head = (_head + 1) % LINK_WINDOW;
+    if(_count < LINK_WINDOW)_count ++;
+}
+
+
+void LoRaWanLink::clear(void)
+{
+    _head = 0;
+    _count = 0;
+}
+
+
+unsigned char LoRaWanLink::getRequests(void)
+{
+    return _count;
+}
+
+
+unsigned char LoRaWanLink::getAnswers(void)
+{
+    unsigned char answers = 0;
+
+    for(unsigned char i = 0; i < _count; i ++)
+    {
+        if(_margin[i] != LINK_LOST)answers ++;
+    }
+    return answers;
+}
+
+
+unsigned char LoRaWanLink::getAnswerRate(void)
+{
+    if(!_count)return 0;
+    return getAnswers() * 100 / _count;
+}
+
+
+unsigned char LoRaWanLink::getMarginLast(void)
+{
+    // Newest first, skipping unanswered requests
+    for(unsigned char i = 1; i <= _count; i ++)
+    {
+        unsigned char index = (_head + LINK_WINDOW - i) % LINK_WINDOW;
+        if(_margin[index] != LINK_LOST)return _margin[index];
+    }
+    return 0;
+}
+
+
+unsigned char LoRaWanLink::getMarginMin(void)
+{
+    unsigned char margin = LINK_LOST;
+
+    for(unsigned char i = 0; i < _count; i ++)
+    {
+        if(_margin[i] < margin)margin = _margin[i];
+    }
+    return margin == LINK_LOST ? 0 : margin;
+}
+
+
+unsigned char LoRaWanLink::getMarginAverage(void)
+{
+    unsigned short sum = 0;
+    unsigned char answers = 0;
+
+    for(unsigned char i = 0; i < _count; i ++)
+    {
+        if(_margin[i] == LINK_LOST)continue;
+        sum += _margin[i];
+        answers ++;
+    }
+    return answers ? sum / answers : 0;
+}
+
+
+unsigned char LoRaWanLink::getGatewaysMin(void)
+{
+    unsigned char gateways = 0xFF;
+
+    for(unsigned char i = 0; i < _count; i ++)
+    {
+        if(_margin[i] != LINK_LOST && _gateways[i] < gateways)gateways = _gateways[i];
+    }
+    return gateways == 0xFF ? 0 : gateways;
+}
+
+
+unsigned char LoRaWanLink::getGatewaysAverage(void)
+{
+    unsigned short sum = 0;
+    unsigned char answers = 0;
+
+    for(unsigned char i = 0; i < _count; i ++)
+    {
+        if(_margin[i] == LINK_LOST)continue;
+        sum += _gateways[i];
+        answers ++;
+    }
+    return answers ? (sum + answers / 2) / answers : 0;
+}
+
+
+unsigned char LoRaWanLink::suggestDataRate(unsigned char current, unsigned char safety, unsigned char maximum)
+{
+    if(!getAnswers())return current;
+
+    // Margin left over the safety, in data rate steps of 2.5 dB
+    short spare = ((short)getMarginMin() - safety) * 10;
+    short steps = spare >= 0 ? spare / LINK_DR_STEP : -((-spare + LINK_DR_STEP - 1) / LINK_DR_STEP);
+    short dataRate = current + steps;
+
+    if(dataRate < 0)dataRate = 0;
+    if(dataRate > maximum)dataRate = maximum;
+
+    return dataRate;
+}
+
+
+unsigned char LoRaWanLink::suggestTransmissions(unsigned char maximum, unsigned char safety)
+{
+    if(!getAnswers())return maximum;
+
+    unsigned char margin = getMarginMin();
+
+    if(margin >= safety && getAnswers() == _count)return 1;
+    if(margin >= LINK_MARGIN_LOW)return (maximum + 1) / 2;
+
+    return maximum;
+}
+
+
+bool LoRaWanLink::coverageProblem(void)
+{
+    if(!_count)return false;
+    if(getAnswerRate() < LINK_ANSWER_RATE_LOW)return true;
+
+    return getAnswers() && getMarginMin() < LINK_MARGIN_LOW;
+}
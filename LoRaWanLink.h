@@ -0,0 +1,161 @@
+/*
+  LoRaWanLink.h
+  Rolling statistics of LinkCheck answers
+
+  Keeps the demodulation margin and gateway count of the last LINK_WINDOW
+  LinkCheckReq uplinks, unanswered requests included, and derives a data
+  rate suggestion and a coverage alarm from them. A low margin with few
+  gateways points to coverage, a good margin with lost answers to
+  collisions or downlink trouble.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANLINK_H_
+#define _LORAWANLINK_H_
+
+
+#include <stdint.h>
+
+
+#define LINK_WINDOW             8       // requests kept
+#define LINK_MARGIN_SAFETY      10      // dB kept above the demodulation floor, as network ADR does
+#define LINK_MARGIN_LOW         3       // dB, below it the node is at the coverage edge
+#define LINK_ANSWER_RATE_LOW    50      // percent of requests answered
+#define LINK_DR_STEP            25      // tenth dB of margin one data rate step costs
+
+
+class LoRaWanLink
+{
+    public:
+
+        LoRaWanLink(void);
+
+        /**
+         *  \brief Add a LinkCheckAns
+         *
+         *  \param [in] margin The demodulation margin in dB, 0 to 254
+         *  \param [in] gateways The number of gateways that received the request
+         *
+         *  \return Return null
+         */
+        void add(unsigned char margin, unsigned char gateways);
+
+        /**
+         *  \brief Add a request that got no answer
+         *
+         *  \return Return null
+         */
+        void addLost(void);
+
+        /**
+         *  \brief Forget all samples
+         *
+         *  \return Return null
+         */
+        void clear(void);
+
+        /**
+         *  \brief Number of requests in the window
+         *
+         *  \return Return request count
+         */
+        unsigned char getRequests(void);
+
+        /**
+         *  \brief Number of answers in the window
+         *
+         *  \return Return answer count
+         */
+        unsigned char getAnswers(void);
+
+        /**
+         *  \brief Share of requests answered in the window
+         *
+         *  \return Return percent, 0 without requests
+         */
+        unsigned char getAnswerRate(void);
+
+        /**
+         *  \brief Margin of the last answer
+         *
+         *  \return Return margin in dB, 0 without answers
+         */
+        unsigned char getMarginLast(void);
+
+        /**
+         *  \brief Lowest margin in the window
+         *
+         *  \return Return margin in dB, 0 without answers
+         */
+        unsigned char getMarginMin(void);
+
+        /**
+         *  \brief Average margin in the window
+         *
+         *  \return Return margin in dB, 0 without answers
+         */
+        unsigned char getMarginAverage(void);
+
+        /**
+         *  \brief Lowest gateway count in the window
+         *
+         *  \return Return gateway count, 0 without answers
+         */
+        unsigned char getGatewaysMin(void);
+
+        /**
+         *  \brief Average gateway count in the window, rounded
+         *
+         *  \return Return gateway count, 0 without answers
+         */
+        unsigned char getGatewaysAverage(void);
+
+        /**
+         *  \brief Data rate the lowest margin still allows
+         *
+         *  Every step up from the current data rate costs 2.5 dB of margin.
+         *  Steps down when the margin is below the safety.
+         *
+         *  \param [in] current The data rate the margins were measured at
+         *  \param [in] safety The margin to keep in dB
+         *  \param [in] maximum The highest data rate to suggest
+         *
+         *  \return Return data rate, current without answers
+         */
+        unsigned char suggestDataRate(unsigned char current, unsigned char safety = LINK_MARGIN_SAFETY, unsigned char maximum = 5);
+
+        /**
+         *  \brief Transmissions per uplink the window calls for
+         *
+         *  One when every request was answered with the safety margin left,
+         *  half of maximum with a margin above LINK_MARGIN_LOW, else maximum.
+         *
+         *  \param [in] maximum The transmissions used on a poor link
+         *  \param [in] safety The margin to keep in dB
+         *
+         *  \return Return transmission count, maximum without answers
+         */
+        unsigned char suggestTransmissions(unsigned char maximum, unsigned char safety = LINK_MARGIN_SAFETY);
+
+        /**
+         *  \brief Check if the window shows a coverage problem
+         *
+         *  Lowest margin below LINK_MARGIN_LOW, or less than
+         *  LINK_ANSWER_RATE_LOW percent of the requests answered.
+         *
+         *  \return Return bool. True : poor coverage
+         */
+        bool coverageProblem(void);
+
+    private:
+        unsigned char _margin[LINK_WINDOW];     // 0xFF for unanswered requests
+        unsigned char _gateways[LINK_WINDOW];
+        unsigned char _head;
+        unsigned char _count;
+};
+
+
+#endif
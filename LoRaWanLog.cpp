@@ -0,0 +1,467 @@
+/*
+  LoRaWanLog.cpp
+  Store and forward log of uplinks that could not be sent
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanLog.h"
+#include <string.h>
+
+
+#define LOG_DATA        0x01
+#define LOG_CURSOR      0x02
+#define LOG_OPEN        0xFF    // record still being written
+#define LOG_COMMITTED   0x00
+
+
+static uint16_t padded(uint8_t length)
+{
+    return (length + 3) & ~3;
+}
+
+
+static void writeLong(uint8_t *buffer, uint32_t value)
+{
+    for(unsigned char i = 0; i < 4; i ++)buffer[i] = value >> (8 * i);
+}
+
+
+static uint32_t readLong(const uint8_t *buffer)
+{
+    return buffer[0] | (uint32_t)buffer[1] << 8 | (uint32_t)buffer[2] << 16 | (uint32_t)buffer[3] << 24;
+}
+
+
+static uint8_t crc8(uint8_t crc, const uint8_t *data, uint16_t length)
+{
+    while(length --)
+    {
+        crc ^= *data ++;
+        for(unsigned char bit = 0; bit < 8; bit ++)crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+
+    return crc;
+}
+
+
+// Type, length and the id and time words, byte 2 holds the CRC and byte 3 the commit mark
+static uint8_t headerCrc(const uint8_t *header)
+{
+    return crc8(crc8(0, header, 2), header + 4, LOG_RECORD_HEADER - 4);
+}
+
+
+LoRaWanLog::LoRaWanLog(LoRaWanStorage &storage, unsigned long drainInterval)
+{
+    _storage = &storage;
+    _sectorSize = 0;
+    _sectors = 0;
+    _sector = 0;
+    _offset = 0;
+    _sequence = 0;
+    _nextId = 0;
+    _cursor = 0;
+    _inflight = 0;
+    _stored = 0;
+    _pending = 0;
+    _packed = 0;
+    _dropped = 0;
+    _drainInterval = drainInterval;
+    _lastDrain = 0;
+    _drained = false;
+    _erases = 0;
+    _flashBytes = 0;
+    _payloadBytes = 0;
+}
+
+
+bool LoRaWanLog::begin(void)
+{
+    uint8_t header[LOG_RECORD_HEADER];
+    uint32_t newest = 0;
+    uint32_t address, record, end;
+    uint32_t firstId = 0;
+    bool found = false;
+    bool data = false;
+    uint16_t k;
+
+    _dropped = 0;
+    _erases = 0;
+    _flashBytes = 0;
+    _payloadBytes = 0;
+
+    _sectorSize = _storage->getSectorSize();
+    _sectors = _sectorSize ? _storage->getSize() / _sectorSize : 0;
+    if(_sectors < 2 || _sectorSize < LOG_SECTOR_HEADER + 2 * LOG_RECORD_HEADER + 4)return false;
+
+    for(uint16_t s = 0; s < _sectors; s ++)
+    {
+        uint32_t sequence = getSequence(s);
+        if(sequence <= newest)continue;
+
+        newest = sequence;
+        _sector = s;
+    }
+
+    if(!newest)return format();
+    _sequence = newest;
+
+    // Oldest sector first, the newest cursor and the highest id win
+    _nextId = 0;
+    _cursor = 0;
+    for(k = 0, address = 0; walk(&k, &address, &record, header); )
+    {
+        uint32_t id = readLong(header + 4);
+
+        if(header[0] == LOG_CURSOR)
+        {
+            if(!found || id > _cursor)_cursor = id;
+            found = true;
+        }
+        else
+        {
+            if(!data)firstId = id;
+            if(id >= _nextId)_nextId = id + 1;
+            data = true;
+        }
+    }
+
+    if(!found)_cursor = data ? firstId : _nextId;
+    if(_cursor > _nextId)_nextId = _cursor;
+    _inflight = _cursor;
+    _stored = found ? _cursor : _cursor - 1;
+
+    _pending = 0;
+    for(k = 0, address = 0; walk(&k, &address, &record, header); )
+    {
+        if(header[0] == LOG_DATA && readLong(header + 4) >= _cursor)_pending ++;
+    }
+
+    // The end of the newest sector, appends go on behind the last good record
+    address = (uint32_t)_sector * _sectorSize + LOG_SECTOR_HEADER;
+    end = (uint32_t)(_sector + 1) * _sectorSize;
+    while(address + LOG_RECORD_HEADER <= end && readRecord(address, header))address += LOG_RECORD_HEADER + padded(header[1]);
+    _offset = address;
+
+    // Anything programmed behind it is a torn record, the sector is closed
+    for(; address < end; address += 4)
+    {
+        if(!_storage->read(address, header, 4) || readLong(header) != 0xFFFFFFFFUL)
+        {
+            _offset = end;
+            break;
+        }
+    }
+
+    return true;
+}
+
+
+bool LoRaWanLog::format(void)
+{
+    if(_sectors < 2)return false;
+
+    // Old headers would be taken for newer ones at the next begin()
+    for(uint16_t s = 0; s < _sectors; s ++)
+    {
+        if(!getSequence(s))continue;
+        if(!_storage->erase((uint32_t)s * _sectorSize))return false;
+        _erases ++;
+    }
+
+    _sector = _sectors - 1;
+    _sequence = 0;
+    _nextId = 0;
+    _cursor = 0;
+    _inflight = 0;
+    _stored = 0;
+    _pending = 0;
+    _packed = 0;
+
+    return openSector();
+}
+
+
+bool LoRaWanLog::append(const uint8_t *data, unsigned char length, unsigned long time)
+{
+    if(!_sectors || length > getPayloadMax())return false;
+    if(!writeRecord(LOG_DATA, _nextId, time, data, length))return false;
+
+    _nextId ++;
+    _pending ++;
+    _payloadBytes += length;
+
+    return true;
+}
+
+
+bool LoRaWanLog::isDrainDue(unsigned long now)
+{
+    return _pending && (!_drained || now - _lastDrain >= _drainInterval);
+}
+
+
+unsigned char LoRaWanLog::pack(uint8_t *buffer, unsigned char size, unsigned long now)
+{
+    uint8_t header[LOG_RECORD_HEADER];
+    uint32_t address, record;
+    unsigned char length = 0;
+    uint16_t k;
+
+    _packed = 0;
+    _inflight = _cursor;
+
+    for(k = 0, address = 0; walk(&k, &address, &record, header); )
+    {
+        uint32_t id = readLong(header + 4);
+        uint8_t payload = header[1];
+
+        if(header[0] != LOG_DATA || id < _inflight)continue;
+
+        if(LOG_BATCH_HEADER + payload > size - length)
+        {
+            if(length)break;
+
+            // Never fits, it would block the log for good
+            if(LOG_BATCH_HEADER + payload > size)
+            {
+                _dropped ++;
+                _pending --;
+                _cursor = _inflight = id + 1;
+                continue;
+            }
+        }
+
+        uint32_t time = readLong(header + 8);
+        uint32_t age = now >= time && now - time < LOG_AGE_UNKNOWN ? now - time : LOG_AGE_UNKNOWN;
+
+        buffer[length] = payload;
+        buffer[length + 1] = age >> 16;
+        buffer[length + 2] = age >> 8;
+        buffer[length + 3] = age;
+        if(!_storage->read(record + LOG_RECORD_HEADER, buffer + length + LOG_BATCH_HEADER, payload))break;
+
+        length += LOG_BATCH_HEADER + payload;
+        _inflight = id + 1;
+        _packed ++;
+    }
+
+    return length;
+}
+
+
+bool LoRaWanLog::commit(bool sent, unsigned long now)
+{
+    _lastDrain = now;
+    _drained = true;
+
+    if(sent && _packed)
+    {
+        _cursor = _inflight;
+        _pending -= _packed;
+        _packed = 0;
+    }
+
+    // Records pack() dropped move the cursor too
+    if(_cursor == _stored)return false;
+
+    return writeRecord(LOG_CURSOR, _cursor, now, NULL, 0);
+}
+
+
+unsigned char LoRaWanLog::getPayloadMax(void)
+{
+    if(!_sectors)return 0;
+
+    // A new sector takes its header and a cursor before the first record
+    uint16_t room = _sectorSize - LOG_SECTOR_HEADER - 2 * LOG_RECORD_HEADER;
+
+    return room > 255 ? 255 : room & ~3;
+}
+
+
+unsigned long LoRaWanLog::getPending(void)
+{
+    return _pending;
+}
+
+
+unsigned long LoRaWanLog::getDropped(void)
+{
+    return _dropped;
+}
+
+
+unsigned long LoRaWanLog::getErases(void)
+{
+    return _erases;
+}
+
+
+unsigned long LoRaWanLog::getFlashBytes(void)
+{
+    return _flashBytes;
+}
+
+
+unsigned long LoRaWanLog::getPayloadBytes(void)
+{
+    return _payloadBytes;
+}
+
+
+unsigned short LoRaWanLog::getWriteAmplification(void)
+{
+    if(!_payloadBytes)return 0;
+
+    unsigned long ratio = (unsigned long)((uint64_t)_flashBytes * 100 / _payloadBytes);
+    return ratio > 0xFFFF ? 0xFFFF : ratio;
+}
+
+
+bool LoRaWanLog::openSector(void)
+{
+    uint8_t header[LOG_RECORD_HEADER];
+    uint16_t next = (_sector + 1) % _sectors;
+    uint32_t address, record;
+    uint16_t k;
+
+    // The oldest sector goes, with whatever it still had to send
+    for(k = 0, address = 0; walk(&k, &address, &record, header) && !k; )
+    {
+        uint32_t id = readLong(header + 4);
+
+        if(header[0] != LOG_DATA || id < _cursor)continue;
+
+        _dropped ++;
+        _pending --;
+        _cursor = id + 1;
+    }
+    if(_inflight < _cursor)_inflight = _cursor;
+
+    address = (uint32_t)next * _sectorSize;
+    if(!_storage->erase(address))return false;
+    _erases ++;
+
+    writeLong(header, _sequence + 1);
+    header[4] = LOG_MAGIC & 0xFF;
+    header[5] = LOG_MAGIC >> 8;
+    header[6] = ~header[4];
+    header[7] = ~header[5];
+    if(!_storage->write(address, header, LOG_SECTOR_HEADER))return false;
+    _flashBytes += LOG_SECTOR_HEADER;
+
+    _sector = next;
+    _sequence ++;
+    _offset = address + LOG_SECTOR_HEADER;
+
+    return writeRecord(LOG_CURSOR, _cursor, 0, NULL, 0);
+}
+
+
+bool LoRaWanLog::writeRecord(uint8_t type, uint32_t id, uint32_t time, const uint8_t *data, unsigned char length)
+{
+    uint8_t header[LOG_RECORD_HEADER];
+    uint16_t whole = length & ~3;
+
+    if(_offset + LOG_RECORD_HEADER + padded(length) > (uint32_t)(_sector + 1) * _sectorSize && !openSector())return false;
+
+    header[0] = type;
+    header[1] = length;
+    header[3] = LOG_OPEN;
+    writeLong(header + 4, id);
+    writeLong(header + 8, time);
+    header[2] = crc8(headerCrc(header), data, length);
+
+    // Header, payload, then the commit mark over the first word. A record torn
+    // anywhere before the mark is skipped, the CRC alone misses one in 256.
+    if(!_storage->write(_offset, header, LOG_RECORD_HEADER))return false;
+    if(whole && !_storage->write(_offset + LOG_RECORD_HEADER, data, whole))return false;
+
+    if(length > whole)
+    {
+        uint8_t tail[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+
+        memcpy(tail, data + whole, length - whole);
+        if(!_storage->write(_offset + LOG_RECORD_HEADER + whole, tail, 4))return false;
+    }
+
+    header[3] = LOG_COMMITTED;
+    if(!_storage->write(_offset, header, 4))return false;
+
+    _offset += LOG_RECORD_HEADER + padded(length);
+    _flashBytes += LOG_RECORD_HEADER + padded(length) + 4;
+    if(type == LOG_CURSOR)_stored = id;
+
+    return true;
+}
+
+
+bool LoRaWanLog::readRecord(uint32_t address, uint8_t *header)
+{
+    uint8_t chunk[16];
+    uint32_t end = (address / _sectorSize + 1) * _sectorSize;
+
+    if(!_storage->read(address, header, LOG_RECORD_HEADER))return false;
+    if(header[0] != LOG_DATA && header[0] != LOG_CURSOR)return false;
+    if(header[3] != LOG_COMMITTED || address + LOG_RECORD_HEADER + padded(header[1]) > end)return false;
+
+    uint8_t crc = headerCrc(header);
+
+    address += LOG_RECORD_HEADER;
+    for(uint8_t left = header[1]; left; )
+    {
+        uint8_t step = left < sizeof(chunk) ? left : sizeof(chunk);
+
+        if(!_storage->read(address, chunk, step))return false;
+        crc = crc8(crc, chunk, step);
+        address += step;
+        left -= step;
+    }
+
+    return crc == header[2];
+}
+
+
+bool LoRaWanLog::walk(uint16_t *k, uint32_t *address, uint32_t *record, uint8_t *header)
+{
+    while(*k < _sectors)
+    {
+        uint16_t s = (_sector + 1 + *k) % _sectors;
+        uint32_t end = (uint32_t)(s + 1) * _sectorSize;
+
+        // No record starts at 0, it marks the start of sector k
+        if(!*address)
+        {
+            if(getSequence(s))*address = end - _sectorSize + LOG_SECTOR_HEADER;
+        }
+
+        if(*address && *address + LOG_RECORD_HEADER <= end && readRecord(*address, header))
+        {
+            *record = *address;
+            *address += LOG_RECORD_HEADER + padded(header[1]);
+            return true;
+        }
+
+        (*k) ++;
+        *address = 0;
+    }
+
+    return false;
+}
+
+
+uint32_t LoRaWanLog::getSequence(uint16_t sector)
+{
+    uint8_t header[LOG_SECTOR_HEADER];
+
+    if(!_storage->read((uint32_t)sector * _sectorSize, header, LOG_SECTOR_HEADER))return 0;
+    if(header[4] != (LOG_MAGIC & 0xFF) || header[5] != LOG_MAGIC >> 8)return 0;
+    if(header[6] != (uint8_t)~header[4] || header[7] != (uint8_t)~header[5])return 0;
+
+    uint32_t sequence = readLong(header);
+    return sequence == 0xFFFFFFFFUL ? 0 : sequence;
+}
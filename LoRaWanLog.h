@@ -0,0 +1,192 @@
+/*
+  LoRaWanLog.h
+  Store and forward log of uplinks that could not be sent
+
+  An append only log on a LoRaWanStorage. Sectors are written in turn and
+  erased only when the log wraps around, so every sector sees the same
+  number of erases. A full log erases its oldest sector, unsent records
+  in it are counted as dropped.
+
+  Sector: sequence number (4), magic (2), inverted magic (2), then records.
+  Record: type, payload length, CRC-8, commit mark, id (4), time (4),
+  payload padded to 4 bytes. The mark is cleared once the payload is in.
+  Records carry increasing ids. How far the log was sent is kept as a
+  cursor record, the id of the first unsent record. A cursor is written
+  after every delivered batch and at the start of every sector, so the
+  newest one survives any wrap. A record torn by a reset has no mark or
+  fails its CRC, and closes its sector.
+
+  Draining packs the oldest unsent records into one uplink:
+    length (1), age in second (3, big endian, 0xFFFFFF unknown), payload
+  and so on while they fit. Batches are spaced by a drain interval.
+
+  RAM use is the object alone, records are read back from the storage.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANLOG_H_
+#define _LORAWANLOG_H_
+
+
+#include "LoRaWanStorage.h"
+
+
+#define LOG_MAGIC               0x4C57  // "LW"
+#define LOG_SECTOR_HEADER       8       // bytes
+#define LOG_RECORD_HEADER       12      // bytes
+#define LOG_BATCH_HEADER        4       // bytes in front of every record in a batch
+#define LOG_DRAIN_INTERVAL      60      // second between two batches
+#define LOG_AGE_UNKNOWN         0xFFFFFFUL
+
+
+class LoRaWanLog
+{
+    public:
+
+        /**
+         *  \brief Create a log
+         *
+         *  \param [in] &storage The storage, two sectors at least
+         *  \param [in] drainInterval The time between two batches in second
+         */
+        LoRaWanLog(LoRaWanStorage &storage, unsigned long drainInterval = LOG_DRAIN_INTERVAL);
+
+        /**
+         *  \brief Find the log in the storage, or format the storage
+         *
+         *  \return Return bool. True : ready, false : the storage failed or is too small
+         */
+        bool begin(void);
+
+        /**
+         *  \brief Erase the log
+         *
+         *  \return Return bool. True : erased and ready
+         */
+        bool format(void);
+
+        /**
+         *  \brief Keep a record that could not be sent
+         *
+         *  \param [in] *data The payload
+         *  \param [in] length The payload length, getPayloadMax() at most
+         *  \param [in] time The time it was taken, in second of any clock that only goes forward
+         *
+         *  \return Return bool. True : stored
+         */
+        bool append(const uint8_t *data, unsigned char length, unsigned long time);
+
+        /**
+         *  \brief Check whether a batch should be sent
+         *
+         *  \param [in] now The time in second, same clock as append()
+         *
+         *  \return Return bool. True : records wait and the drain interval has passed
+         */
+        bool isDrainDue(unsigned long now);
+
+        /**
+         *  \brief Pack the oldest unsent records into an uplink
+         *
+         *  A record too long for the uplink on its own is dropped.
+         *
+         *  \param [out] *buffer The uplink
+         *  \param [in] size The uplink size limit, the data rate maximum payload
+         *  \param [in] now The time in second, same clock as append()
+         *
+         *  \return Return uplink length, 0 : nothing to send
+         */
+        unsigned char pack(uint8_t *buffer, unsigned char size, unsigned long now);
+
+        /**
+         *  \brief Report the uplink of the last pack()
+         *
+         *  \param [in] sent The uplink went out, its records are marked sent
+         *  \param [in] now The time in second, the drain interval starts here
+         *
+         *  \return Return bool. True : a new cursor was stored
+         */
+        bool commit(bool sent, unsigned long now);
+
+        /**
+         *  \brief Longest payload a record can take
+         *
+         *  \return Return length in byte
+         */
+        unsigned char getPayloadMax(void);
+
+        /**
+         *  \brief Records waiting to be sent
+         *
+         *  \return Return record count
+         */
+        unsigned long getPending(void);
+
+        /**
+         *  \brief Unsent records lost to a wrap or too long for an uplink, since begin()
+         *
+         *  \return Return record count
+         */
+        unsigned long getDropped(void);
+
+        /**
+         *  \brief Sectors erased since begin()
+         *
+         *  \return Return erase count
+         */
+        unsigned long getErases(void);
+
+        /**
+         *  \brief Bytes programmed since begin(), headers, padding and cursors included
+         *
+         *  \return Return byte count
+         */
+        unsigned long getFlashBytes(void);
+
+        /**
+         *  \brief Payload bytes appended since begin()
+         *
+         *  \return Return byte count
+         */
+        unsigned long getPayloadBytes(void);
+
+        /**
+         *  \brief Write amplification, programmed bytes per payload byte
+         *
+         *  \return Return ratio in percent, 0 without payload
+         */
+        unsigned short getWriteAmplification(void);
+
+    private:
+        bool openSector(void);
+        bool writeRecord(uint8_t type, uint32_t id, uint32_t time, const uint8_t *data, unsigned char length);
+        bool readRecord(uint32_t address, uint8_t *header);
+        bool walk(uint16_t *k, uint32_t *address, uint32_t *record, uint8_t *header);
+        uint32_t getSequence(uint16_t sector);
+
+        LoRaWanStorage *_storage;
+        uint16_t _sectorSize;
+        uint16_t _sectors;
+        uint16_t _sector;               // the one written
+        uint32_t _offset;               // next record in it
+        uint32_t _sequence;             // of the sector written
+        uint32_t _nextId;
+        uint32_t _cursor;               // first unsent id
+        uint32_t _inflight;             // first id behind the last pack()
+        uint32_t _stored;               // cursor last written
+        unsigned long _pending;
+        unsigned long _packed;          // records in the last pack()
+        unsigned long _dropped;
+        unsigned long _drainInterval;
+        unsigned long _lastDrain;
+        bool _drained;                  // _lastDrain is valid
+        unsigned long _erases;
+        unsigned long _flashBytes;
+        unsigned long _payloadBytes;
+};
+
+
+#endif
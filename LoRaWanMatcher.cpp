@@ -0,0 +1,183 @@
+/*
+  LoRaWanMatcher.cpp
+  Streaming multi-pattern matcher for modem responses
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanMatcher.h"
+#include <string.h>
+
+
+LoRaWanMatcher::LoRaWanMatcher(void)
+{
+    clear();
+}
+
+
+void LoRaWanMatcher::clear(void)
+{
+    _nodes[0].c = 0;
+    _nodes[0].child = 0;
+    _nodes[0].sibling = 0;
+    _nodes[0].fail = 0;
+    _nodes[0].output = 0;
+    _nodeCount = 1;
+    _patternCount = 0;
+    _stopMask = 0;
+    _built = true;
+    reset();
+}
+
+
+short LoRaWanMatcher::add(const char *pattern, bool stop)
+{
+    uint8_t state = 0;
+    const char *ptr = pattern;
+
+    if(_patternCount >= MATCHER_PATTERNS_MAX || !pattern || !*pattern)return -1;
+
+    // Follow the existing prefix, then check the rest fits before linking anything
+    while(*ptr && child(state, *ptr))state = child(state, *ptr ++);
+    if(_nodeCount + strlen(ptr) > MATCHER_NODES_MAX)return -1;
+
+    for(; *ptr; ptr ++)
+    {
+        uint8_t next = _nodeCount ++;
+
+        _nodes[next].c = *ptr;
+        _nodes[next].child = 0;
+        _nodes[next].sibling = _nodes[state].child;
+        _nodes[next].fail = 0;
+        _nodes[next].output = 0;
+        _nodes[state].child = next;
+        state = next;
+    }
+
+    _nodes[state].output |= 1 << _patternCount;
+    if(stop)_stopMask |= 1 << _patternCount;
+    _built = false;
+
+    return _patternCount ++;
+}
+
+
+void LoRaWanMatcher::reset(void)
+{
+    _state = 0;
+    _matchedMask = 0;
+    _first = -1;
+    _fed = 0;
+}
+
+
+short LoRaWanMatcher::feed(char c)
+{
+    uint8_t next;
+
+    if(!_built)build();
+
+    while(true)
+    {
+        next = child(_state, c);
+        if(next || _state == 0)break;
+        _state = _nodes[_state].fail;
+    }
+    _state = next;
+    _fed ++;
+
+    uint8_t output = _nodes[_state].output;
+    if(!output)return -1;
+
+    short index = 0;
+    while(!(output & (1 << index)))index ++;
+
+    // Only the first occurrence is kept, as strstr would find it
+    for(uint8_t fresh = output & ~_matchedMask, i = 0; fresh; fresh >>= 1, i ++)
+    {
+        if(fresh & 1)_ends[i] = _fed;
+    }
+
+    if(_first < 0)_first = index;
+    _matchedMask |= output;
+
+    return index;
+}
+
+
+short LoRaWanMatcher::feed(const char *buffer)
+{
+    while(*buffer)feed(*buffer ++);
+    return _first;
+}
+
+
+bool LoRaWanMatcher::matched(short index)
+{
+    if(index < 0 || index >= _patternCount)return false;
+    return _matchedMask & (1 << index);
+}
+
+
+bool LoRaWanMatcher::done(void)
+{
+    return _matchedMask & _stopMask;
+}
+
+
+short LoRaWanMatcher::first(void)
+{
+    return _first;
+}
+
+
+short LoRaWanMatcher::end(short index)
+{
+    if(!matched(index))return -1;
+    return _ends[index];
+}
+
+
+uint8_t LoRaWanMatcher::child(uint8_t state, char c)
+{
+    for(uint8_t next = _nodes[state].child; next; next = _nodes[next].sibling)
+    {
+        if(_nodes[next].c == c)return next;
+    }
+    return 0;
+}
+
+
+void LoRaWanMatcher::build(void)
+{
+    uint8_t queue[MATCHER_NODES_MAX];
+    uint8_t head = 0, tail = 0;
+
+    // Breadth first, so a node's fail target is always finished before the node
+    for(uint8_t next = _nodes[0].child; next; next = _nodes[next].sibling)
+    {
+        _nodes[next].fail = 0;
+        queue[tail ++] = next;
+    }
+
+    while(head < tail)
+    {
+        uint8_t state = queue[head ++];
+
+        for(uint8_t next = _nodes[state].child; next; next = _nodes[next].sibling)
+        {
+            uint8_t fail = _nodes[state].fail;
+
+            while(fail && !child(fail, _nodes[next].c))fail = _nodes[fail].fail;
+            fail = child(fail, _nodes[next].c);
+
+            _nodes[next].fail = fail;
+            _nodes[next].output |= _nodes[fail].output;
+            queue[tail ++] = next;
+        }
+    }
+
+    _built = true;
+}
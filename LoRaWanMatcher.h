@@ -0,0 +1,132 @@
+/*
+  LoRaWanMatcher.h
+  Streaming multi-pattern matcher for modem responses
+
+  Aho-Corasick automaton built from the responses a command can produce.
+  Bytes are fed one at a time as they arrive from the modem, every pattern
+  is checked in the same single pass.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANMATCHER_H_
+#define _LORAWANMATCHER_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define MATCHER_PATTERNS_MAX    8       // one bit per pattern in the match masks
+#define MATCHER_NODES_MAX       64      // total pattern length + 1 for the root
+
+
+class LoRaWanMatcher
+{
+    public:
+
+        LoRaWanMatcher(void);
+
+        /**
+         *  \brief Add an expected response
+         *
+         *  \param [in] *pattern The response text, must outlive the matcher
+         *  \param [in] stop True : reading can stop once this pattern is seen
+         *
+         *  \return Return pattern index, -1 when the matcher is full
+         */
+        short add(const char *pattern, bool stop = true);
+
+        /**
+         *  \brief Forget the patterns too, the matcher can be refilled for another scan
+         *
+         *  \return Return null
+         */
+        void clear(void);
+
+        /**
+         *  \brief Forget the stream progress and matches, keep the patterns
+         *
+         *  \return Return null
+         */
+        void reset(void);
+
+        /**
+         *  \brief Consume one received byte
+         *
+         *  \param [in] c The received byte
+         *
+         *  \return Return index of a pattern ending at this byte, -1 if none
+         */
+        short feed(char c);
+
+        /**
+         *  \brief Consume a zero terminated string
+         *
+         *  \param [in] *buffer The received text
+         *
+         *  \return Return index of the first pattern matched, -1 if none
+         */
+        short feed(const char *buffer);
+
+        /**
+         *  \brief Check if a pattern has been seen since the last reset
+         *
+         *  \param [in] index The pattern index returned by add()
+         *
+         *  \return Return bool. True : seen
+         */
+        bool matched(short index);
+
+        /**
+         *  \brief Check if a stop pattern has been seen
+         *
+         *  \return Return bool. True : the response is complete
+         */
+        bool done(void);
+
+        /**
+         *  \brief Get the pattern seen first in the stream
+         *
+         *  \return Return pattern index, -1 if none
+         */
+        short first(void);
+
+        /**
+         *  \brief Locate the text behind a pattern
+         *
+         *  \param [in] index The pattern index returned by add()
+         *
+         *  \return Return count of bytes fed up to the end of its first match, -1 if not seen
+         */
+        short end(short index);
+
+    private:
+        struct node_t
+        {
+            char c;
+            uint8_t child;
+            uint8_t sibling;
+            uint8_t fail;
+            uint8_t output;
+        };
+
+        void build(void);
+        uint8_t child(uint8_t state, char c);
+
+        node_t _nodes[MATCHER_NODES_MAX];
+        uint8_t _nodeCount;
+        uint8_t _patternCount;
+        uint8_t _stopMask;
+        uint8_t _matchedMask;
+        uint8_t _state;
+        int8_t _first;
+        uint16_t _fed;
+        uint16_t _ends[MATCHER_PATTERNS_MAX];
+        bool _built;
+};
+
+
+#endif
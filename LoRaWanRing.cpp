@@ -0,0 +1,82 @@
+/*
+  LoRaWanRing.cpp
+  Receive ring buffer for modem bytes
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanRing.h"
+
+
+LoRaWanRing::LoRaWanRing(uint8_t *buffer, uint16_t size)
+{
+    _buffer = buffer;
+    _size = size;
+    _head = 0;
+    _tail = 0;
+    _overflows = 0;
+    _highWater = 0;
+}
+
+
+bool LoRaWanRing::push(uint8_t c)
+{
+    uint16_t head = _head;
+    uint16_t next = head + 1 < _size ? head + 1 : 0;
+
+    if(next == _tail)
+    {
+        _overflows ++;
+        return false;
+    }
+
+    _buffer[head] = c;
+    _head = next;   // publish only after the byte is stored
+
+    uint16_t level = available();
+    if(level > _highWater)_highWater = level;
+
+    return true;
+}
+
+
+int LoRaWanRing::pop(void)
+{
+    uint16_t tail = _tail;
+
+    if(tail == _head)return -1;
+
+    uint8_t c = _buffer[tail];
+    _tail = tail + 1 < _size ? tail + 1 : 0;
+
+    return c;
+}
+
+
+uint16_t LoRaWanRing::available(void)
+{
+    uint16_t head = _head;
+    uint16_t tail = _tail;
+
+    return head >= tail ? head - tail : _size - tail + head;
+}
+
+
+void LoRaWanRing::clear(void)
+{
+    _tail = _head;
+}
+
+
+uint32_t LoRaWanRing::getOverflowCount(void)
+{
+    return _overflows;
+}
+
+
+uint16_t LoRaWanRing::getHighWater(void)
+{
+    return _highWater;
+}
@@ -0,0 +1,87 @@
+/*
+  LoRaWanRing.h
+  Receive ring buffer for modem bytes
+
+  Single producer, single consumer. push() may run in an interrupt while
+  pop() runs in the main loop, no locking is needed on Cortex-M.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANRING_H_
+#define _LORAWANRING_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+class LoRaWanRing
+{
+    public:
+
+        /**
+         *  \brief Create a ring over a caller owned storage
+         *
+         *  \param [in] *buffer The storage
+         *  \param [in] size The size of storage, one byte stays unused
+         */
+        LoRaWanRing(uint8_t *buffer, uint16_t size);
+
+        /**
+         *  \brief Store a received byte, producer side
+         *
+         *  \param [in] c The received byte
+         *
+         *  \return Return bool. True : stored, false : ring full, byte dropped
+         */
+        bool push(uint8_t c);
+
+        /**
+         *  \brief Take the oldest byte, consumer side
+         *
+         *  \return Return the byte, -1 when empty
+         */
+        int pop(void);
+
+        /**
+         *  \brief Number of bytes waiting
+         *
+         *  \return Return byte count
+         */
+        uint16_t available(void);
+
+        /**
+         *  \brief Drop all waiting bytes, counters are kept
+         *
+         *  \return Return null
+         */
+        void clear(void);
+
+        /**
+         *  \brief Number of bytes dropped because the ring was full
+         *
+         *  \return Return dropped byte count
+         */
+        uint32_t getOverflowCount(void);
+
+        /**
+         *  \brief Highest fill level seen, for sizing LORAWAN_RX_RING_SIZE
+         *
+         *  \return Return byte count
+         */
+        uint16_t getHighWater(void);
+
+    private:
+        uint8_t *_buffer;
+        uint16_t _size;
+        volatile uint16_t _head;
+        volatile uint16_t _tail;
+        volatile uint32_t _overflows;
+        volatile uint16_t _highWater;
+};
+
+
+#endif
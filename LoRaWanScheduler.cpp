@@ -0,0 +1,159 @@
+/*
+  LoRaWanScheduler.cpp
+  Periodic task scheduler on an absolute timebase
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanScheduler.h"
+
+
+#define SCHEDULER_NONE          0xFFFFFFFFUL
+
+
+LoRaWanScheduler::LoRaWanScheduler(void)
+{
+    memset(_tasks, 0, sizeof(_tasks));
+    _sleepCallback = NULL;
+    _sleepMin = SCHEDULER_SLEEP_MIN;
+    _slept = 0;
+}
+
+
+short LoRaWanScheduler::add(_task_callback_t callback, unsigned long period, unsigned long jitter, unsigned long deadline, unsigned long offset)
+{
+    if(!callback || !period)return -1;
+
+    for(short i = 0; i < SCHEDULER_TASKS_MAX; i ++)
+    {
+        task_t *task = &_tasks[i];
+        if(task->callback)continue;
+
+        memset(task, 0, sizeof(task_t));
+        task->callback = callback;
+        task->period = period;
+        task->jitter = jitter < period ? jitter : period;
+        task->deadline = deadline;
+        task->next = now() + offset;
+        advance(task, 0);
+
+        return i;
+    }
+
+    return -1;
+}
+
+
+void LoRaWanScheduler::remove(short task)
+{
+    if(task >= 0 && task < SCHEDULER_TASKS_MAX)_tasks[task].callback = NULL;
+}
+
+
+void LoRaWanScheduler::setSleepCallback(_sleep_callback_t callback, unsigned long minimum)
+{
+    _sleepCallback = callback;
+    _sleepMin = minimum;
+}
+
+
+void LoRaWanScheduler::run(void)
+{
+    while(true)
+    {
+        unsigned long time = now();
+        task_t *task = NULL;
+
+        for(unsigned char i = 0; i < SCHEDULER_TASKS_MAX; i ++)
+        {
+            task_t *ptr = &_tasks[i];
+
+            if(!ptr->callback || (long)(time - ptr->due) < 0)continue;
+            if(!task || (long)(ptr->due - task->due) < 0)task = ptr;
+        }
+        if(!task)break;
+
+        // Periods lost in a blocking call are skipped, only the latest may still run
+        unsigned long lost = (time - task->next) / task->period;
+        if(lost)
+        {
+            task->missed += lost;
+            advance(task, lost);
+            continue;
+        }
+
+        unsigned long late = time - task->due;
+
+        if(task->deadline && late > task->deadline)
+        {
+            task->missed ++;
+            advance(task, 1);
+            continue;
+        }
+
+        if(late > task->lateMax)task->lateMax = late;
+        task->runs ++;
+
+        // Advanced before the call, the task may remove itself
+        _task_callback_t callback = task->callback;
+        advance(task, 1);
+        callback();
+    }
+
+    unsigned long wait = untilNext();
+
+    if(_sleepCallback && wait != SCHEDULER_NONE && wait >= _sleepMin)_slept += _sleepCallback(wait);
+}
+
+
+unsigned long LoRaWanScheduler::now(void)
+{
+    return millis() + _slept;
+}
+
+
+unsigned long LoRaWanScheduler::untilNext(void)
+{
+    unsigned long time = now();
+    unsigned long wait = SCHEDULER_NONE;
+
+    for(unsigned char i = 0; i < SCHEDULER_TASKS_MAX; i ++)
+    {
+        if(!_tasks[i].callback)continue;
+
+        long left = _tasks[i].due - time;
+        if(left <= 0)return 0;
+        if((unsigned long)left < wait)wait = left;
+    }
+
+    return wait;
+}
+
+
+unsigned long LoRaWanScheduler::getRuns(short task)
+{
+    return task >= 0 && task < SCHEDULER_TASKS_MAX ? _tasks[task].runs : 0;
+}
+
+
+unsigned long LoRaWanScheduler::getMissed(short task)
+{
+    return task >= 0 && task < SCHEDULER_TASKS_MAX ? _tasks[task].missed : 0;
+}
+
+
+unsigned long LoRaWanScheduler::getLateMax(short task)
+{
+    return task >= 0 && task < SCHEDULER_TASKS_MAX ? _tasks[task].lateMax : 0;
+}
+
+
+void LoRaWanScheduler::advance(task_t *task, unsigned long periods)
+{
+    task->next += periods * task->period;
+
+    // A fresh draw every run, a fixed offset would keep colliding nodes together
+    task->due = task->next + (task->jitter ? random(task->jitter) : 0);
+}
@@ -0,0 +1,148 @@
+/*
+  LoRaWanScheduler.h
+  Periodic task scheduler on an absolute timebase
+
+  Every task runs on a fixed grid, start + offset + n * period, so a late
+  run never shifts the runs after it. An uplink task can add a random
+  jitter to each run, spreading a fleet that was powered up together over
+  the period. A task that still waits past its deadline is skipped and
+  counted as missed, periods lost in a long blocking call are skipped the
+  same way instead of running in a burst.
+
+  Between tasks run() hands the time left to a sleep callback. Sleep that
+  stops millis(), RTC standby on SAMD21, returns the time slept so the
+  timebase stays right.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANSCHEDULER_H_
+#define _LORAWANSCHEDULER_H_
+
+
+#include <Arduino.h>
+
+
+#define SCHEDULER_TASKS_MAX     4
+#define SCHEDULER_SLEEP_MIN     10      // millisecond, shorter gaps are not worth a sleep
+
+
+typedef void (*_task_callback_t)(void);
+typedef unsigned long (*_sleep_callback_t)(unsigned long ms);
+
+
+class LoRaWanScheduler
+{
+    public:
+
+        LoRaWanScheduler(void);
+
+        /**
+         *  \brief Add a periodic task
+         *
+         *  \param [in] callback The task function
+         *  \param [in] period The period in millisecond
+         *  \param [in] jitter The random delay added to each run stays below it, millisecond, period at most
+         *  \param [in] deadline The lateness that skips a run in millisecond, 0 never skips
+         *  \param [in] offset The first run after now in millisecond
+         *
+         *  \return Return task number, -1 : no free task or period 0
+         */
+        short add(_task_callback_t callback, unsigned long period, unsigned long jitter = 0, unsigned long deadline = 0, unsigned long offset = 0);
+
+        /**
+         *  \brief Remove a task
+         *
+         *  \param [in] task The task number
+         *
+         *  \return Return null
+         */
+        void remove(short task);
+
+        /**
+         *  \brief Set the sleep between tasks
+         *
+         *  The callback sleeps at most ms and returns the time it slept with
+         *  millis() stopped, 0 when millis() kept running.
+         *
+         *  \param [in] callback The sleep function, NULL to return at once
+         *  \param [in] minimum The shortest gap handed to the callback in millisecond
+         *
+         *  \return Return null
+         */
+        void setSleepCallback(_sleep_callback_t callback, unsigned long minimum = SCHEDULER_SLEEP_MIN);
+
+        /**
+         *  \brief Run the due tasks, earliest first, then sleep until the next one, call it from loop()
+         *
+         *  \return Return null
+         */
+        void run(void);
+
+        /**
+         *  \brief Time of the timebase, millis() plus the time slept with millis() stopped
+         *
+         *  \return Return time in millisecond
+         */
+        unsigned long now(void);
+
+        /**
+         *  \brief Time until the next task is due
+         *
+         *  \return Return time in millisecond, 0 : a task is due, 0xFFFFFFFF : no task
+         */
+        unsigned long untilNext(void);
+
+        /**
+         *  \brief Runs of a task so far
+         *
+         *  \param [in] task The task number
+         *
+         *  \return Return run count
+         */
+        unsigned long getRuns(short task);
+
+        /**
+         *  \brief Runs of a task skipped for their deadline or lost in a blocking call
+         *
+         *  \param [in] task The task number
+         *
+         *  \return Return run count
+         */
+        unsigned long getMissed(short task);
+
+        /**
+         *  \brief Largest delay of a run behind its jittered time
+         *
+         *  \param [in] task The task number
+         *
+         *  \return Return delay in millisecond
+         */
+        unsigned long getLateMax(short task);
+
+    private:
+        struct task_t
+        {
+            _task_callback_t callback;
+            unsigned long period;
+            unsigned long jitter;
+            unsigned long deadline;
+            unsigned long next;         // grid point of the next run
+            unsigned long due;          // grid point plus jitter
+            unsigned long runs;
+            unsigned long missed;
+            unsigned long lateMax;
+        };
+
+        void advance(task_t *task, unsigned long periods);
+
+        task_t _tasks[SCHEDULER_TASKS_MAX];
+        _sleep_callback_t _sleepCallback;
+        unsigned long _sleepMin;
+        unsigned long _slept;
+};
+
+
+#endif
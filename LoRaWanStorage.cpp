@@ -0,0 +1,155 @@
+/*
+  LoRaWanStorage.cpp
+  Erasable storage for the uplink log, flash or a RAM stand-in
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanStorage.h"
+#include <string.h>
+
+#if defined(ARDUINO_ARCH_SAMD)
+#include <Arduino.h>
+
+#define SAMD_ROW_SIZE   (FLASH_PAGE_SIZE * 4)   // four pages, the erase unit
+#endif
+
+
+LoRaWanRamStorage::LoRaWanRamStorage(uint8_t *buffer, uint32_t size, uint16_t sectorSize)
+{
+    _buffer = buffer;
+    _sectorSize = sectorSize;
+    _size = size - size % sectorSize;
+}
+
+
+uint32_t LoRaWanRamStorage::getSize(void)
+{
+    return _size;
+}
+
+
+uint16_t LoRaWanRamStorage::getSectorSize(void)
+{
+    return _sectorSize;
+}
+
+
+bool LoRaWanRamStorage::read(uint32_t address, void *buffer, uint16_t length)
+{
+    if(address + length > _size)return false;
+
+    memcpy(buffer, _buffer + address, length);
+    return true;
+}
+
+
+bool LoRaWanRamStorage::write(uint32_t address, const void *buffer, uint16_t length)
+{
+    const uint8_t *data = (const uint8_t *)buffer;
+
+    if(address + length > _size || (address | length) & 3)return false;
+
+    // Like flash, programming only clears bits
+    for(uint16_t i = 0; i < length; i ++)_buffer[address + i] &= data[i];
+
+    return true;
+}
+
+
+bool LoRaWanRamStorage::erase(uint32_t address)
+{
+    if(address >= _size || address % _sectorSize)return false;
+
+    memset(_buffer + address, 0xFF, _sectorSize);
+    return true;
+}
+
+
+#if defined(ARDUINO_ARCH_SAMD)
+
+LoRaWanSamdFlash::LoRaWanSamdFlash(uint32_t size, uint32_t start)
+{
+    _size = size - size % SAMD_ROW_SIZE;
+    _start = start ? start : FLASH_SIZE - _size;
+}
+
+
+uint32_t LoRaWanSamdFlash::getSize(void)
+{
+    return _size;
+}
+
+
+uint16_t LoRaWanSamdFlash::getSectorSize(void)
+{
+    return SAMD_ROW_SIZE;
+}
+
+
+bool LoRaWanSamdFlash::read(uint32_t address, void *buffer, uint16_t length)
+{
+    if(address + length > _size)return false;
+
+    // The flash is mapped into the address space
+    memcpy(buffer, (const void *)(_start + address), length);
+    return true;
+}
+
+
+bool LoRaWanSamdFlash::write(uint32_t address, const void *buffer, uint16_t length)
+{
+    const uint8_t *data = (const uint8_t *)buffer;
+
+    if(address + length > _size || (address | length) & 3)return false;
+
+    // Manual page writes, the page buffer is filled with 32 bit words only
+    NVMCTRL->CTRLB.bit.MANW = 1;
+
+    while(length)
+    {
+        uint32_t target = _start + address;
+        uint16_t chunk = FLASH_PAGE_SIZE - target % FLASH_PAGE_SIZE;
+        if(chunk > length)chunk = length;
+
+        // Words left out stay 0xFF in the buffer and do not touch the page
+        execute(NVMCTRL_CTRLA_CMD_PBC);
+
+        volatile uint32_t *word = (volatile uint32_t *)target;
+        for(uint16_t i = 0; i < chunk; i += 4)
+        {
+            *word ++ = data[i] | (uint32_t)data[i + 1] << 8 | (uint32_t)data[i + 2] << 16 | (uint32_t)data[i + 3] << 24;
+        }
+
+        execute(NVMCTRL_CTRLA_CMD_WP);
+
+        data += chunk;
+        address += chunk;
+        length -= chunk;
+    }
+
+    return true;
+}
+
+
+bool LoRaWanSamdFlash::erase(uint32_t address)
+{
+    if(address >= _size || address % SAMD_ROW_SIZE)return false;
+
+    // The controller takes 16 bit addresses
+    NVMCTRL->ADDR.reg = (_start + address) / 2;
+    execute(NVMCTRL_CTRLA_CMD_ER);
+
+    return true;
+}
+
+
+void LoRaWanSamdFlash::execute(uint32_t command)
+{
+    NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | command;
+    while(!NVMCTRL->INTFLAG.bit.READY);
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+  LoRaWanStorage.h
+  Erasable storage for the uplink log, flash or a RAM stand-in
+
+  The log only needs flash semantics: erase a sector to all 0xFF, program
+  words that clear bits, read anything. A backend derives from
+  LoRaWanStorage and gives these three operations over its own range,
+  addresses are relative to the range start.
+
+  LoRaWanRamStorage keeps the range in a caller owned array and programs
+  it like flash, for hosts and boards without a flash backend. Its content
+  is lost at reset.
+
+  LoRaWanSamdFlash uses the SAMD21 NVM controller on the top of the MCU
+  flash. A sector is one 256 byte row, the unit the controller erases.
+  Keep the sketch below the range, the IDE reports the sketch size.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANSTORAGE_H_
+#define _LORAWANSTORAGE_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define STORAGE_FLASH_SIZE      16384   // bytes LoRaWanSamdFlash takes by default, 64 rows
+
+
+class LoRaWanStorage
+{
+    public:
+
+        /**
+         *  \brief Size of the range
+         *
+         *  \return Return size in byte, a multiple of the sector size
+         */
+        virtual uint32_t getSize(void) = 0;
+
+        /**
+         *  \brief Size of the erase unit
+         *
+         *  \return Return size in byte, a multiple of 4
+         */
+        virtual uint16_t getSectorSize(void) = 0;
+
+        /**
+         *  \brief Read bytes
+         *
+         *  \param [in] address The offset in the range
+         *  \param [out] *buffer The output cache
+         *  \param [in] length The byte count
+         *
+         *  \return Return bool. True : read
+         */
+        virtual bool read(uint32_t address, void *buffer, uint16_t length) = 0;
+
+        /**
+         *  \brief Program bytes, only bits still set can be cleared
+         *
+         *  \param [in] address The offset in the range, a multiple of 4
+         *  \param [in] *buffer The bytes, any alignment
+         *  \param [in] length The byte count, a multiple of 4
+         *
+         *  \return Return bool. True : programmed
+         */
+        virtual bool write(uint32_t address, const void *buffer, uint16_t length) = 0;
+
+        /**
+         *  \brief Erase one sector to 0xFF
+         *
+         *  \param [in] address The offset of the sector start
+         *
+         *  \return Return bool. True : erased
+         */
+        virtual bool erase(uint32_t address) = 0;
+};
+
+
+class LoRaWanRamStorage : public LoRaWanStorage
+{
+    public:
+
+        /**
+         *  \brief Create a storage over a caller owned array
+         *
+         *  \param [in] *buffer The array, it is not erased here
+         *  \param [in] size The size of the array in byte, a multiple of sectorSize
+         *  \param [in] sectorSize The erase unit in byte, a multiple of 4
+         */
+        LoRaWanRamStorage(uint8_t *buffer, uint32_t size, uint16_t sectorSize = 256);
+
+        uint32_t getSize(void);
+        uint16_t getSectorSize(void);
+        bool read(uint32_t address, void *buffer, uint16_t length);
+        bool write(uint32_t address, const void *buffer, uint16_t length);
+        bool erase(uint32_t address);
+
+    private:
+        uint8_t *_buffer;
+        uint32_t _size;
+        uint16_t _sectorSize;
+};
+
+
+#if defined(ARDUINO_ARCH_SAMD)
+
+class LoRaWanSamdFlash : public LoRaWanStorage
+{
+    public:
+
+        /**
+         *  \brief Create a storage on the MCU flash
+         *
+         *  \param [in] size The size of the range in byte, a multiple of the 256 byte row
+         *  \param [in] start The absolute flash address of the range, 0 puts it at the top of the flash
+         */
+        LoRaWanSamdFlash(uint32_t size = STORAGE_FLASH_SIZE, uint32_t start = 0);
+
+        uint32_t getSize(void);
+        uint16_t getSectorSize(void);
+        bool read(uint32_t address, void *buffer, uint16_t length);
+        bool write(uint32_t address, const void *buffer, uint16_t length);
+        bool erase(uint32_t address);
+
+    private:
+        void execute(uint32_t command);
+
+        uint32_t _start;
+        uint32_t _size;
+};
+
+#endif
+
+
+#endif
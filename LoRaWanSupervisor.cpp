@@ -0,0 +1,126 @@
+/*
+  LoRaWanSupervisor.cpp
+  Modem hang detection and recovery statistics
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "LoRaWanSupervisor.h"
+
+
+LoRaWanSupervisor::LoRaWanSupervisor(unsigned char silentLimit, unsigned char readyTimeout)
+{
+    memset(_shadow, 0, sizeof(_shadow));
+    _shadowMask = 0;
+    _silentLimit = silentLimit;
+    _readyTimeout = readyTimeout;
+    _silent = 0;
+    _silentCommands = 0;
+    _incidentStart = 0;
+    _recoveries = 0;
+    _failures = 0;
+    _recoveryTime = 0;
+    _recoveryTimeMax = 0;
+    _downtime = 0;
+}
+
+
+void LoRaWanSupervisor::remember(_shadow_field_t field, short value)
+{
+    if(field >= SHADOW_FIELDS)return;
+
+    _shadow[field] = value;
+    _shadowMask |= 1 << field;
+}
+
+
+unsigned char LoRaWanSupervisor::getShadow(short *values)
+{
+    memcpy(values, _shadow, sizeof(_shadow));
+    return _shadowMask;
+}
+
+
+bool LoRaWanSupervisor::addSilent(void)
+{
+    if(!_silent)_incidentStart = millis();
+    if(_silent < 0xFF)_silent ++;
+    _silentCommands ++;
+
+    return _silentLimit && _silent >= _silentLimit;
+}
+
+
+void LoRaWanSupervisor::addAnswer(void)
+{
+    _silent = 0;
+}
+
+
+void LoRaWanSupervisor::addRecoveryStart(void)
+{
+    if(!_silent)_incidentStart = millis();
+}
+
+
+void LoRaWanSupervisor::addRecovery(bool success)
+{
+    unsigned long time = millis() - _incidentStart;
+
+    _downtime += time;
+    _silent = 0;
+
+    if(!success)
+    {
+        _failures ++;
+        return;
+    }
+
+    _recoveries ++;
+    _recoveryTime += time;
+    if(time > _recoveryTimeMax)_recoveryTimeMax = time;
+}
+
+
+unsigned char LoRaWanSupervisor::getReadyTimeout(void)
+{
+    return _readyTimeout;
+}
+
+
+unsigned long LoRaWanSupervisor::getSilentCommands(void)
+{
+    return _silentCommands;
+}
+
+
+unsigned short LoRaWanSupervisor::getRecoveries(void)
+{
+    return _recoveries;
+}
+
+
+unsigned short LoRaWanSupervisor::getRecoveryFailures(void)
+{
+    return _failures;
+}
+
+
+unsigned long LoRaWanSupervisor::getRecoveryTimeMean(void)
+{
+    return _recoveries ? _recoveryTime / _recoveries : 0;
+}
+
+
+unsigned long LoRaWanSupervisor::getRecoveryTimeMax(void)
+{
+    return _recoveryTimeMax;
+}
+
+
+unsigned long LoRaWanSupervisor::getDowntime(void)
+{
+    return _downtime;
+}
@@ -0,0 +1,163 @@
+/*
+  LoRaWanSupervisor.h
+  Modem hang detection and recovery statistics
+
+  A modem that stops answering makes every command wait out its timeout.
+  The library counts commands that got no byte at all back, and after
+  SUPERVISOR_SILENT_LIMIT of them in a row resets the modem before the next
+  command, pings it until it answers and replays the configuration kept here:
+    activation, region, port, power, data rate, ADR, class, OTAA join
+  Keys are not kept, the modem stores them in its own flash.
+
+  An incident lasts from the first silent command to the end of the
+  replay, its length is booked as the recovery time.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _LORAWANSUPERVISOR_H_
+#define _LORAWANSUPERVISOR_H_
+
+
+#include <Arduino.h>
+
+
+#define SUPERVISOR_SILENT_LIMIT     3       // silent commands in a row that mean a hung modem
+#define SUPERVISOR_READY_TIMEOUT    10      // second, the modem has to answer after a reset
+
+
+enum _shadow_field_t { SHADOW_ACTIVATION = 0, SHADOW_REGION, SHADOW_PORT, SHADOW_POWER, SHADOW_DATA_RATE, SHADOW_ADR, SHADOW_CLASS, SHADOW_JOINED, SHADOW_FIELDS };
+
+
+class LoRaWanSupervisor
+{
+    public:
+
+        /**
+         *  \brief Create a supervisor
+         *
+         *  \param [in] silentLimit The silent commands in a row that start a recovery, 0 only counts
+         *  \param [in] readyTimeout The time the modem has to answer after a reset in second
+         */
+        LoRaWanSupervisor(unsigned char silentLimit = SUPERVISOR_SILENT_LIMIT, unsigned char readyTimeout = SUPERVISOR_READY_TIMEOUT);
+
+        /**
+         *  \brief Keep a configuration value, called by the library setters
+         *
+         *  \param [in] field The setting
+         *  \param [in] value The value applied
+         *
+         *  \return Return null
+         */
+        void remember(_shadow_field_t field, short value);
+
+        /**
+         *  \brief Copy the kept configuration
+         *
+         *  \param [out] *values The values, SHADOW_FIELDS entries
+         *
+         *  \return Return mask of the fields set, bit n for field n
+         */
+        unsigned char getShadow(short *values);
+
+        /**
+         *  \brief Book a command that got no answer, called by the library
+         *
+         *  \return Return bool. True : the modem counts as hung
+         */
+        bool addSilent(void);
+
+        /**
+         *  \brief Book a byte from the modem, called by the library
+         *
+         *  \return Return null
+         */
+        void addAnswer(void);
+
+        /**
+         *  \brief Book the start of a recovery, called by the library
+         *
+         *  A recovery without silent commands before it, started by hand,
+         *  starts its incident here.
+         *
+         *  \return Return null
+         */
+        void addRecoveryStart(void);
+
+        /**
+         *  \brief Book the end of a recovery, called by the library
+         *
+         *  \param [in] success The modem answered and the configuration was replayed
+         *
+         *  \return Return null
+         */
+        void addRecovery(bool success);
+
+        /**
+         *  \brief Time the modem has to answer after a reset
+         *
+         *  \return Return time in second
+         */
+        unsigned char getReadyTimeout(void);
+
+        /**
+         *  \brief Commands without answer so far
+         *
+         *  \return Return command count
+         */
+        unsigned long getSilentCommands(void);
+
+        /**
+         *  \brief Successful recoveries so far
+         *
+         *  \return Return recovery count
+         */
+        unsigned short getRecoveries(void);
+
+        /**
+         *  \brief Recoveries where the modem stayed silent or the replay failed
+         *
+         *  \return Return recovery count
+         */
+        unsigned short getRecoveryFailures(void);
+
+        /**
+         *  \brief Mean time to recovery, first silent command to replayed configuration
+         *
+         *  \return Return time in millisecond, 0 without recoveries
+         */
+        unsigned long getRecoveryTimeMean(void);
+
+        /**
+         *  \brief Longest recovery
+         *
+         *  \return Return time in millisecond
+         */
+        unsigned long getRecoveryTimeMax(void);
+
+        /**
+         *  \brief Time spent in incidents, failed ones included
+         *
+         *  \return Return time in millisecond
+         */
+        unsigned long getDowntime(void);
+
+    private:
+        short _shadow[SHADOW_FIELDS];
+        unsigned char _shadowMask;
+        unsigned char _silentLimit;
+        unsigned char _readyTimeout;
+        unsigned char _silent;          // silent commands in a row
+        unsigned long _silentCommands;
+        unsigned long _incidentStart;
+        unsigned short _recoveries;
+        unsigned short _failures;
+        unsigned long _recoveryTime;    // successful recoveries only
+        unsigned long _recoveryTimeMax;
+        unsigned long _downtime;
+};
+
+
+#endif
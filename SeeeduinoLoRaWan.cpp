@@ -34,35 +34,470 @@
 #include "SeeeduinoLoRaWan.h"
 
 
+static_assert(sizeof(LoRaWanClass) <= LORAWAN_STATIC_RAM_BUDGET, "LoRaWanClass exceeds its static RAM budget");
+
+#if BEFFER_LENGTH_MAX == 0
+// Keeps the response checks harmless until setBuffer() hands in a real buffer
+static char noBuffer[1];
+#endif
+
+
+// Failure responses that end a transmit early instead of waiting out the timeout
+static short expectFailures(LoRaWanMatcher &matcher)
+{
+    short error = matcher.add("ERROR");
+    matcher.add("Please join");
+    matcher.add("No band");
+    matcher.add("busy");
+
+    return error;
+}
+
+
+// Fields printed around an uplink answer, indices of the patterns scanAnswer() adds
+enum _answer_field_t {ANSWER_RSSI = 0, ANSWER_SNR, ANSWER_LINK, ANSWER_UNSUPPORTED};
+
+// Refill the command's matcher with the answer fields and run it over the response.
+// Reusing it keeps a single automaton on the stack while the answer is booked
+static void scanAnswer(LoRaWanMatcher &matcher, const char *buffer)
+{
+    matcher.clear();
+    matcher.add("RSSI ", false);
+    matcher.add("SNR ", false);
+    matcher.add("Link ", false);
+    matcher.add("ERROR(-10)", false);
+    matcher.feed(buffer);
+}
+
+
+static unsigned char hexValue(char c)
+{
+    if((c >= '0') && (c <= '9'))return c - '0';
+    else if((c >= 'A') && (c <= 'F'))return c - 'A' + 10;
+    else if((c >= 'a') && (c <= 'f'))return c - 'a' + 10;
+    return 0xFF;
+}
+
+
+// "23.5", "-4" or "25.25" as tenths, rounded, without sscanf and float
+static short parseDeci(const char *ptr)
+{
+    bool negative = false;
+    long value = 0;
+
+    while(*ptr == ' ')ptr ++;
+    if(*ptr == '-')
+    {
+        negative = true;
+        ptr ++;
+    }
+
+    for(; *ptr >= '0' && *ptr <= '9'; ptr ++)value = value * 10 + *ptr - '0';
+    value *= 10;
+
+    if(*ptr == '.')
+    {
+        ptr ++;
+        if(*ptr >= '0' && *ptr <= '9')value += *ptr ++ - '0';
+        if(*ptr >= '5' && *ptr <= '9')value ++;
+    }
+
+    return negative ? -value : value;
+}
+
+
+// Round a MHz value to the kHz grid the modem accepts and return it in Hz.
+// Taken apart from its IEEE 754 bits, no soft float routine gets linked.
+static unsigned long frequencyToHz(float frequency)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &frequency, sizeof(bits));
+
+    // frequency = mantissa * 2^(exponent - 150), 0 for negative, zero and out of band values
+    short shift = 150 - (short)((bits >> 23) & 0xFF);
+    uint64_t kiloHertz = ((bits & 0x7FFFFFUL) | 0x800000UL) * 1000ULL;
+
+    if((bits & 0x80000000UL) || shift <= 0 || shift > 63)return 0;
+
+    kiloHertz = (kiloHertz + (1ULL << (shift - 1))) >> shift;
+    return kiloHertz <= 0xFFFFFFFFUL / 1000 ? kiloHertz * 1000UL : 0;
+}
+
+
 LoRaWanClass::LoRaWanClass(void)
+    #if LORAWAN_RX_RING_SIZE > 0
+    : _rxRing(_rxStorage, LORAWAN_RX_RING_SIZE)
+    #endif
 {
-    memset(_buffer, 0, 256);
+    #if BEFFER_LENGTH_MAX > 0
+    _buffer = _bufferStorage;
+    _bufferLength = BEFFER_LENGTH_MAX;
+    #else
+    _buffer = noBuffer;
+    _bufferLength = 0;
+    #endif
+    clearBuffer();
+
+    _serial = &SerialLoRa;
+    _capture = NULL;
+    _energy = NULL;
+    _link = NULL;
+    _channels = NULL;
+    _supervisor = NULL;
+    _awaiting = false;
+    _recovering = false;
+    _recoverPending = false;
+    _joined = false;
+    _snr = 0;
+    _rssi = 0;
+    _channel = -1;
+    _dataRate = DR0;
+    _classType = CLASS_A;
+    _region = EU433;
+
+    _capabilities.major = 0;
+    _capabilities.minor = 0;
+    _capabilities.patch = 0;
+    _capabilities.hexFormat = HEX_UNKNOWN;
+    _capabilities.classB = true;
+    _capabilities.unsupported = 0;
+
+    _idleCallback = NULL;
+    _idleMicros = 0;
+    _idleTime = 0;
+    _idleCalls = 0;
+
+    _downlinkHandler = NULL;
+    _pollLength = 0;
+    _pollPending = false;
+    _linkCheckPending = false;
+    _pollStart = 0;
+    _pollStamp = 0;
+    _downlinks = 0;
+    _downlinkLatency = 0;
+    _downlinkLatencyMax = 0;
+
+    #if LORAWAN_RX_RING_SIZE > 0
+    _rxPumping = false;
+    #endif
 }
 
 
 void LoRaWanClass::init(void)
 {
     SerialLoRa.begin(9600);
+    _serial = &SerialLoRa;
+    probeCapabilities();
+}
+
+
+void LoRaWanClass::init(Stream &serial)
+{
+    _serial = &serial;
+    probeCapabilities();
+}
+
+
+void LoRaWanClass::setCapture(LoRaWanCapture *capture)
+{
+    if(_capture)_capture->flush();
+    _capture = capture;
+}
+
+
+void LoRaWanClass::wait(unsigned long ms)
+{
+    unsigned long timerStart = millis();
+    unsigned long elapsed;
+
+    while((elapsed = millis() - timerStart) < ms)
+    {
+        idle(ms - elapsed);
+    }
+}
+
+
+void LoRaWanClass::setIdleCallback(_idle_callback_t callback)
+{
+    _idleCallback = callback;
+}
+
+
+unsigned long LoRaWanClass::getIdleTime(void)
+{
+    return _idleTime;
+}
+
+
+unsigned long LoRaWanClass::getIdleCalls(void)
+{
+    return _idleCalls;
+}
+
+
+void LoRaWanClass::idle(unsigned long remaining)
+{
+    pumpRx();
+
+    if(_idleCallback)
+    {
+        unsigned long timerStart = micros();
+
+        _idleCallback(remaining);
+        _idleMicros += micros() - timerStart;
+        _idleTime += _idleMicros / 1000;
+        _idleMicros %= 1000;
+        _idleCalls ++;
+    }
+}
+
+
+void LoRaWanClass::pumpRx(void)
+{
+    #if LORAWAN_RX_RING_SIZE > 0
+    // An interrupt calling in while the main loop drains must not touch the UART too
+    if(_rxPumping)return;
+    _rxPumping = true;
+
+    while(_serial->available())_rxRing.push(_serial->read());
+
+    _rxPumping = false;
+    #endif
+}
+
+
+LoRaWanRing *LoRaWanClass::getRxRing(void)
+{
+    #if LORAWAN_RX_RING_SIZE > 0
+    return &_rxRing;
+    #else
+    return NULL;
+    #endif
+}
+
+
+void LoRaWanClass::setEnergyLedger(LoRaWanEnergy *ledger)
+{
+    _energy = ledger;
+}
+
+
+void LoRaWanClass::setLinkStats(LoRaWanLink *link)
+{
+    _link = link;
+}
+
+
+void LoRaWanClass::setSupervisor(LoRaWanSupervisor *supervisor)
+{
+    _supervisor = supervisor;
+    _awaiting = false;
+    _recoverPending = false;
+}
+
+
+bool LoRaWanClass::recover(void)
+{
+    if(!_supervisor || _recovering)return false;
+
+    _recovering = true;
+    _recoverPending = false;
+    _supervisor->addRecoveryStart();
+
+    // The replay below leaves the shadow alone, see remember()
+    short values[SHADOW_FIELDS];
+    unsigned char mask = _supervisor->getShadow(values);
+
+    while(rxAvailable())rxRead();
+    sendCommand("AT+RESET\r\n");
+
+    bool recovered = waitBoot("+RESET: OK", 1000UL * _supervisor->getReadyTimeout()) >= 0;
+
+    if(recovered)
+    {
+        if(mask & (1 << SHADOW_ACTIVATION))setActivation((_device_mode_t)values[SHADOW_ACTIVATION]);
+        if(mask & (1 << SHADOW_REGION))
+        {
+            if(values[SHADOW_REGION] == EU868)setEU868();
+            else setEU433();
+        }
+        if(mask & (1 << SHADOW_PORT))setPort(values[SHADOW_PORT]);
+        if(mask & (1 << SHADOW_POWER))setPower(values[SHADOW_POWER]);
+        if(mask & (1 << SHADOW_DATA_RATE))setDataRate((_data_rate_t)values[SHADOW_DATA_RATE]);
+        if(mask & (1 << SHADOW_ADR))setAdaptiveDataRate(values[SHADOW_ADR]);
+
+        if((mask & (1 << SHADOW_CLASS)) && values[SHADOW_CLASS] == CLASS_B)
+        {
+            // The beacon search is not waited for, checkBeaconLost() tells how it went
+            _classType = CLASS_B;
+            sendCommand("AT+BEACON=DMMUL,1,15\r\n");
+            loraPrint(DEFAULT_DEBUGTIME);
+            sendCommand("AT+CLASS=B\r\n");
+            loraPrint(DEFAULT_DEBUGTIME);
+        }
+        else if((mask & (1 << SHADOW_CLASS)) && !setClassType((_class_type_t)values[SHADOW_CLASS]))recovered = false;
+
+        bool otaa = (mask & (1 << SHADOW_ACTIVATION)) && values[SHADOW_ACTIVATION] == LWOTAA;
+        if(otaa && (mask & (1 << SHADOW_JOINED)) && values[SHADOW_JOINED])recovered = setOTAAJoin(JOIN);
+    }
+
+    // The modem starts over with all its channels
+    _channel = -1;
+
+    _supervisor->addRecovery(recovered);
+    _recovering = false;
+
+    return recovered;
+}
+
+
+bool LoRaWanClass::requestLinkCheck(void)
+{
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+LW: LCR");
+    expectFailures(matcher);
+
+    rxFlush();
+    sendCommand("AT+LW=LCR\r\n");
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
+
+    _linkCheckPending = matcher.matched(done);
+    return _linkCheckPending;
+}
+
+
+bool LoRaWanClass::requestDeviceTime(void)
+{
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+LW: DTR");
+    expectFailures(matcher);
+
+    rxFlush();
+    sendCommand("AT+LW=DTR\r\n");
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
+
+    return matcher.matched(done);
+}
+
+
+bool LoRaWanClass::getDeviceTime(LoRaWanDeviceTime *time)
+{
+    LoRaWanMatcher matcher;
+    short answer = matcher.add("DTR, ", false);
+    short window = matcher.add("RXWIN", false);
+    short data = matcher.add("RX: \"", false);
+    char *line, *ptr, *end;
+
+    if(!_bufferLength)return false;
+    matcher.feed(_buffer);
+
+    // "+MSG: DTR, 2024-12-09 10:15:30, 1417774548.250", firmware builds differ in
+    // what surrounds the GPS time, it is the only number of nine digits or more
+    if(!matcher.matched(answer))return false;
+    line = _buffer + matcher.end(answer) - 5;
+
+    time->gpsSeconds = 0;
+    time->milliseconds = 0;
+
+    for(ptr = line + 5; *ptr && *ptr != '\r' && *ptr != '\n'; ptr = end)
+    {
+        end = ptr + 1;
+        if(*ptr < '0' || *ptr > '9')continue;
+
+        unsigned long value = strtoul(ptr, &end, 10);
+        if(end - ptr < 9)continue;
+
+        time->gpsSeconds = value;
+        if(*end == '.')
+        {
+            unsigned short scale = 100;
+            for(ptr = end + 1; *ptr >= '0' && *ptr <= '9' && scale; ptr ++, scale /= 10)time->milliseconds += (*ptr - '0') * scale;
+        }
+        break;
+    }
+
+    if(!time->gpsSeconds)return false;
+
+    time->window = matcher.matched(window) ? _buffer[matcher.end(window)] - '0' : 0;
+    time->dataRate = _dataRate;
+    time->tailBytes = strlen(line);
+
+    // The answer rides in FOpts, 6 bytes, an application payload adds FPort and data
+    time->downlinkLength = LORAWAN_FRAME_OVERHEAD - 1 + 6;
+    if(matcher.matched(data))
+    {
+        unsigned char digits = 0;
+        for(ptr = _buffer + matcher.end(data); *ptr && *ptr != '\"'; ptr ++)if(hexValue(*ptr) != 0xFF)digits ++;
+        time->downlinkLength += 1 + digits / 2;
+    }
+
+    return true;
+}
+
+
+void LoRaWanClass::checkLinkAnswer(bool sent, LoRaWanMatcher &answer)
+{
+    char *ptr;
+
+    if(!_linkCheckPending || !sent)return;
+    _linkCheckPending = false;
+
+    if(!_link)return;
+
+    // "+MSG: Link 20, 1", demodulation margin in dB and gateway count
+    if(answer.matched(ANSWER_LINK))
+    {
+        ptr = _buffer + answer.end(ANSWER_LINK);
+        unsigned char margin = atoi(ptr);
+
+        ptr = strchr(ptr, ',');
+        _link->add(margin, ptr ? atoi(ptr + 1) : 0);
+    }
+    else _link->addLost();
+}
+
+
+void LoRaWanClass::bookUplink(unsigned char length, unsigned long timerStart)
+{
+    if(_energy)_energy->addUplink(LoRaWanEnergy::getAirtime(length, _dataRate), millis() - timerStart);
+}
+
+
+void LoRaWanClass::setBuffer(char *buffer, short length)
+{
+    _buffer = buffer;
+    _bufferLength = length;
+    _pollLength = 0;
+    _pollPending = false;
+    clearBuffer();
 }
 
 
 void LoRaWanClass::setEU433(void)
 {
-    delay(500);
+    _region = EU433;
+    remember(SHADOW_REGION, EU433);
+
+    waitReady(BOOT_SETTLE);
     setDataRate(EU433);
-    delay(500);
+    waitReady(BOOT_SETTLE);
 
-    const float EU_433[8] = {433.175, 433.375, 433.575, 433.775, 433.975, 434.175, 434.375, 434.575};
+    const unsigned long EU_433[8] = {433175000, 433375000, 433575000, 433775000, 433975000, 434175000, 434375000, 434575000};
 
     for(int i = 0; i < 8; i++)
     {
         if(EU_433[i] != 0)
         {
-            setChannel(i, EU_433[i], DR0, DR5);
+            setChannelHz(i, EU_433[i], DR0, DR5);
         }
     }
     
-    setReceiveWindowSecond(434.665, DR0);
+    setReceiveWindowSecondHz(434665000, DR0);
     setPower(0);
     setAdaptiveDataRate(true);
     setDutyCycle(true);
@@ -80,21 +515,24 @@ void LoRaWanClass::setEU433(void)
 
 void LoRaWanClass::setEU868(void)
 {
-    delay(500);
+    _region = EU868;
+    remember(SHADOW_REGION, EU868);
+
+    waitReady(BOOT_SETTLE);
     setDataRate(EU868);
-    delay(500);
+    waitReady(BOOT_SETTLE);
 
-    const float EU_868[8] = {868.1, 868.3, 868.5, 867.1, 867.3, 867.5, 867.7, 867.9};
+    const unsigned long EU_868[8] = {868100000, 868300000, 868500000, 867100000, 867300000, 867500000, 867700000, 867900000};
 
     for(int i = 0; i < 8; i++)
     {
         if(EU_868[i] != 0)
         {
-            setChannel(i, EU_868[i], DR0, DR5);
+            setChannelHz(i, EU_868[i], DR0, DR5);
         }
     }
     
-    setReceiveWindowSecond(869.525, DR0);
+    setReceiveWindowSecondHz(869525000, DR0);
     setPower(0);
     setAdaptiveDataRate(true);
     setDutyCycle(true);
@@ -110,6 +548,12 @@ void LoRaWanClass::setEU868(void)
 }
 
 
+_physical_type_t LoRaWanClass::getRegion(void)
+{
+    return _region;
+}
+
+
 void LoRaWanClass::getVersion(void)
 {
     sendCommand("AT+VER=?\r\n");
@@ -117,9 +561,73 @@ void LoRaWanClass::getVersion(void)
 }
 
 
+bool LoRaWanClass::probeCapabilities(void)
+{
+    LoRaWanMatcher matcher;
+    short version = matcher.add("+VER: ", false);
+    char *ptr;
+
+    matcher.add("\n");
+
+    rxFlush();
+    sendCommand("AT+VER\r\n");
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
+
+    if(!matcher.matched(version))return false;
+
+    ptr = _buffer + matcher.end(version);
+    _capabilities.major = strtoul(ptr, &ptr, 10);
+    if(*ptr == '.')_capabilities.minor = strtoul(ptr + 1, &ptr, 10);
+    if(*ptr == '.')_capabilities.patch = strtoul(ptr + 1, &ptr, 10);
+
+    // 2.0.x prints downlinks as "12 34" and predates Class B
+    bool legacy = _capabilities.major < 2 || (_capabilities.major == 2 && _capabilities.minor == 0);
+
+    _capabilities.hexFormat = legacy ? HEX_SPACED : HEX_COMPACT;
+    _capabilities.classB = !legacy;
+
+    return true;
+}
+
+
+const LoRaWanCapabilities *LoRaWanClass::getCapabilities(void)
+{
+    return &_capabilities;
+}
+
+
+bool LoRaWanClass::isSupported(_at_command_t command)
+{
+    return !(_capabilities.unsupported & (1 << command));
+}
+
+
+void LoRaWanClass::learnSupport(_at_command_t command, LoRaWanMatcher &matcher, short error)
+{
+    bool failed = matcher.matched(error);
+
+    if(!_bufferLength)return;
+
+    // The error code can follow the stop pattern, read the rest of the line
+    if(failed && !strchr(_buffer + matcher.end(error), '\n'))
+    {
+        short length = strlen(_buffer);
+
+        matcher.clear();
+        matcher.add("\n");
+        readBuffer(_buffer + length, _bufferLength - length, 1, &matcher);
+    }
+
+    scanAnswer(matcher, _buffer);
+    if(failed && matcher.matched(ANSWER_UNSUPPORTED))_capabilities.unsupported |= 1 << command;
+}
+
+
 void LoRaWanClass::getId(void)
 {
-    while(SerialLoRa.available())SerialLoRa.read();
+    rxFlush();
     sendCommand("AT+ID=?\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
 }
@@ -127,29 +635,27 @@ void LoRaWanClass::getId(void)
 
 void LoRaWanClass::setKeysOTAA(char *AppEUI, char *DevEUI, char *AppKey )
 {
-    char cmd[64];
-
     if(AppEUI)
     {
-        memset(cmd, 0, 64);
-        sprintf(cmd, "AT+ID=AppEui,\"%s\"\r\n", AppEUI);
-        sendCommand(cmd);
+        sendCommand("AT+ID=AppEui,\"");
+        sendCommand(AppEUI);
+        sendCommand("\"\r\n");
         loraPrint(DEFAULT_DEBUGTIME);
     }
 
     if(DevEUI)
     {
-        memset(cmd, 0, 64);
-        sprintf(cmd, "AT+ID=DevEui,\"%s\"\r\n", DevEUI);
-        sendCommand(cmd);
+        sendCommand("AT+ID=DevEui,\"");
+        sendCommand(DevEUI);
+        sendCommand("\"\r\n");
         loraPrint(DEFAULT_DEBUGTIME);
     }
 
     if(AppKey)
     {
-        memset(cmd, 0, 64);
-        sprintf(cmd, "AT+KEY= APPKEY,\"%s\"\r\n", AppKey);
-        sendCommand(cmd);
+        sendCommand("AT+KEY= APPKEY,\"");
+        sendCommand(AppKey);
+        sendCommand("\"\r\n");
         loraPrint(DEFAULT_DEBUGTIME);
     }
 }
@@ -157,32 +663,30 @@ void LoRaWanClass::setKeysOTAA(char *AppEUI, char *DevEUI, char *AppKey )
 
 void LoRaWanClass::setKeysABP(char *DevAddr, char *NwkSKey, char *AppSKey)
 {
-    char cmd[64];
-
     if(DevAddr)
     {
-        memset(cmd, 0, 64);
-        sprintf(cmd, "AT+ID=DevAddr,\"%s\"\r\n", DevAddr);
-        sendCommand(cmd);
-        delay(DEFAULT_TIMEWAIT);
+        sendCommand("AT+ID=DevAddr,\"");
+        sendCommand(DevAddr);
+        sendCommand("\"\r\n");
+        wait(DEFAULT_TIMEWAIT);
         loraPrint(DEFAULT_DEBUGTIME);
     }
 
     if(NwkSKey)
     {
-        memset(cmd, 0, 64);
-        sprintf(cmd, "AT+KEY=NWKSKEY,\"%s\"\r\n", NwkSKey);
-        sendCommand(cmd);
-        delay(DEFAULT_TIMEWAIT);
+        sendCommand("AT+KEY=NWKSKEY,\"");
+        sendCommand(NwkSKey);
+        sendCommand("\"\r\n");
+        wait(DEFAULT_TIMEWAIT);
         loraPrint(DEFAULT_DEBUGTIME);
     }
     
     if(AppSKey)
     {
-        memset(cmd, 0, 64);
-        sprintf(cmd, "AT+KEY=APPSKEY,\"%s\"\r\n", AppSKey);
-        sendCommand(cmd);
-        delay(DEFAULT_TIMEWAIT);
+        sendCommand("AT+KEY=APPSKEY,\"");
+        sendCommand(AppSKey);
+        sendCommand("\"\r\n");
+        wait(DEFAULT_TIMEWAIT);
         loraPrint(DEFAULT_DEBUGTIME);
     }
 }
@@ -190,62 +694,283 @@ void LoRaWanClass::setKeysABP(char *DevAddr, char *NwkSKey, char *AppSKey)
 
 void LoRaWanClass::setDataRate(_physical_type_t physicalType)
 {
-    char cmd[32];
-    memset(cmd, 0, 32);
-    
     if(physicalType == EU433)
     {
-        sprintf(cmd, "AT+DR=%s\r\n", "EU433");
-        sendCommand(cmd);
-        delay(DEFAULT_TIMEWAIT);
+        sendCommand("AT+DR=EU433\r\n");
+        wait(DEFAULT_TIMEWAIT);
         loraPrint(DEFAULT_DEBUGTIME);
     } else if(physicalType == EU868) {
-        sprintf(cmd, "AT+DR=%s\r\n", "EU868");
-        sendCommand(cmd);
-        delay(DEFAULT_TIMEWAIT);
+        sendCommand("AT+DR=EU868\r\n");
+        wait(DEFAULT_TIMEWAIT);
         loraPrint(DEFAULT_DEBUGTIME);
     }
 }
 
 
-void LoRaWanClass::setPower(short power)
+bool LoRaWanClass::setDataRate(_data_rate_t dataRate)
 {
-    char cmd[32];
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+POWER=%d\r\n", power);
-    sendCommand(cmd);
-    loraPrint(DEFAULT_DEBUGTIME);
+    _dataRate = dataRate;
+    remember(SHADOW_DATA_RATE, dataRate);
+
+    rxFlush();
+    sendCommand("AT+DR=");
+    sendNumber(dataRate);
+    sendCommand("\r\n");
+    return readAnswer("+DR");
+}
+
+
+_data_rate_t LoRaWanClass::getDataRate(void)
+{
+    return _dataRate;
+}
+
+
+bool LoRaWanClass::setPower(short power)
+{
+    remember(SHADOW_POWER, power);
+
+    rxFlush();
+    sendCommand("AT+POWER=");
+    sendNumber(power);
+    sendCommand("\r\n");
+    return readAnswer("+POWER");
 }
 
 
 void LoRaWanClass::setPort(unsigned char port)
 {
-    char cmd[32];
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+PORT=%d\r\n", port);
-    sendCommand(cmd);
+    remember(SHADOW_PORT, port);
+
+    sendCommand("AT+PORT=");
+    sendNumber(port);
+    sendCommand("\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
 }
 
 
-void LoRaWanClass::setAdaptiveDataRate(bool command)
+bool LoRaWanClass::setAdaptiveDataRate(bool command)
 {
+    remember(SHADOW_ADR, command);
+
+    rxFlush();
     if(command)sendCommand("AT+ADR=ON\r\n");
     else sendCommand("AT+ADR=OFF\r\n");
-    loraPrint(DEFAULT_DEBUGTIME);
+    return readAnswer("+ADR");
 }
 
 
 void LoRaWanClass::setChannel(unsigned char channel, float frequency, _data_rate_t dataRataMin, _data_rate_t dataRataMax)
 {
-    char cmd[32];
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+CH=%d,%.3f,%d,%d\r\n", channel, frequency, dataRataMin, dataRataMax);
-    sendCommand(cmd);
+    setChannelHz(channel, frequencyToHz(frequency), dataRataMin, dataRataMax);
+}
+
+
+void LoRaWanClass::setChannelHz(unsigned char channel, unsigned long frequency, _data_rate_t dataRataMin, _data_rate_t dataRataMax)
+{
+    sendChannel(channel, frequency, dataRataMin, dataRataMax);
+
+    if(_channels)
+    {
+        _channels->setChannel(channel, frequency, dataRataMin, dataRataMax);
+        _channel = -1;          // more than one channel may be enabled now
+    }
+}
+
+
+void LoRaWanClass::setChannelOff(unsigned char channel)
+{
+    sendCommand("AT+CH=");
+    sendNumber(channel);
+    sendCommand(",0\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
+
+    if(_channels)
+    {
+        _channels->setChannel(channel, 0, 0, 0);
+        if(_channel == channel)_channel = -1;
+    }
+}
+
+
+void LoRaWanClass::setChannelStats(LoRaWanChannels *channels)
+{
+    // Leaving steering, give the modem all known channels back
+    if(_channels && !channels && _channel >= 0)
+    {
+        for(unsigned char i = 0; i < CHANNELS_MAX; i ++)
+        {
+            unsigned long frequency = _channels->getFrequency(i);
+            if(frequency)sendChannel(i, frequency, _channels->getDataRateMin(i), _channels->getDataRateMax(i));
+        }
+    }
+
+    _channels = channels;
+    _channel = -1;
+}
+
+
+bool LoRaWanClass::sendChannel(unsigned char channel, unsigned long frequency, unsigned char dataRateMin, unsigned char dataRateMax)
+{
+    rxFlush();
+    sendCommand("AT+CH=");
+    sendNumber(channel);
+    sendCommand(",");
+    sendFrequency(frequency);
+    sendCommand(",");
+    sendNumber(dataRateMin);
+    sendCommand(",");
+    sendNumber(dataRateMax);
+    sendCommand("\r\n");
+    return readAnswer("+CH");
+}
+
+
+bool LoRaWanClass::readAnswer(const char *answer)
+{
+    LoRaWanMatcher matcher;
+    short ok = matcher.add(answer, false);
+    short error = matcher.add("ERROR", false);
+
+    // Stop at the end of the first line instead of a fixed wait
+    matcher.add("\n");
+
+    clearBuffer();
+    short length = readBuffer(_buffer, _bufferLength, 1, &matcher);
+
+    // AT+DR= answers "+DR: DR3" and then "+DR: EU868 DR3 SF9 BW125K", the
+    // rest is read here or the next command takes it for its own answer
+    unsigned long timerStart = millis();
+    while(1)
+    {
+        unsigned long elapsed = millis() - timerStart;
+        if(elapsed >= ANSWER_QUIET)break;
+
+        if(!rxAvailable())
+        {
+            idle(ANSWER_QUIET - elapsed);
+            continue;
+        }
+
+        char c = rxRead();
+        if(length < _bufferLength - 1)_buffer[length ++] = c;
+        timerStart = millis();
+    }
+
+    return matcher.matched(ok) && !matcher.matched(error);
+}
+
+
+void LoRaWanClass::steerUplink(void)
+{
+    if(!_channels)return;
+
+    short channel = _channels->next();
+    if(channel < 0 || channel == _channel)return;
+
+    // Enable the new channel first so the modem never runs without one
+    if(!sendChannel(channel, _channels->getFrequency(channel), _channels->getDataRateMin(channel), _channels->getDataRateMax(channel)))return;
+
+    for(unsigned char i = 0; i < CHANNELS_MAX; i ++)
+    {
+        if(i == channel || !_channels->getFrequency(i))continue;
+        if(_channel >= 0 && i != _channel)continue;         // the others are off already
+
+        sendCommand("AT+CH=");
+        sendNumber(i);
+        sendCommand(",0\r\n");
+        readAnswer("+CH");
+    }
+
+    _channel = channel;
+}
+
+
+void LoRaWanClass::remember(_shadow_field_t field, short value)
+{
+    // setEU868() alone sets power and ADR, a replay must not record that over the user's values
+    if(_supervisor && !_recovering)_supervisor->remember(field, value);
+}
+
+
+long LoRaWanClass::waitReady(unsigned long timeout)
+{
+    LoRaWanMatcher matcher;
+    short ready = matcher.add("+AT: OK");
+    unsigned long timerStart = millis();
+    unsigned long pingStart, elapsed;
+    short i = 0;
+
+    // The modem ignores commands while it boots, ping until it answers
+    while(millis() - timerStart < timeout)
+    {
+        sendCommand("AT\r\n");
+        pingStart = millis();
+
+        while((elapsed = millis() - pingStart) < BOOT_PROBE_INTERVAL)
+        {
+            while(rxAvailable())
+            {
+                char c = rxRead();
+                if(i < _bufferLength - 1)_buffer[i ++] = c;
+                matcher.feed(c);
+            }
+
+            if(!matcher.matched(ready))
+            {
+                idle(BOOT_PROBE_INTERVAL - elapsed);
+                continue;
+            }
+
+            #ifdef PRINT_TO_SERIAL_MONITOR
+            if(_bufferLength)
+            {
+                _buffer[i] = '\0';
+                SerialUSB.print(_buffer);
+            }
+            #endif
+            return millis() - timerStart;
+        }
+    }
+
+    return -1;
+}
+
+
+long LoRaWanClass::waitBoot(const char *answer, unsigned long timeout)
+{
+    LoRaWanMatcher matcher;
+    unsigned long timerStart = millis();
+
+    // The modem answers before it restarts, a ping sent earlier would find the old one
+    matcher.add(answer);
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
+
+    unsigned long elapsed = millis() - timerStart;
+    if(elapsed >= timeout || waitReady(timeout - elapsed) < 0)return -1;
+
+    return millis() - timerStart;
+}
+
+
+void LoRaWanClass::bookSignal(LoRaWanMatcher &answer)
+{
+    // "+MSG: RXWIN1, RSSI -106, SNR 4.5" behind every downlink
+    if(!answer.matched(ANSWER_RSSI))return;
+
+    _rssi = atoi(_buffer + answer.end(ANSWER_RSSI));
+    _snr = answer.matched(ANSWER_SNR) ? atoi(_buffer + answer.end(ANSWER_SNR)) : 0;
+}
+
+
+void LoRaWanClass::bookChannel(bool sent, bool acked, LoRaWanMatcher &answer)
+{
+    if(!_channels || _channel < 0 || !sent)return;
+
+    // Confirmed uplinks only, a downlink heard after one is no proof of delivery
+    short rssi = answer.matched(ANSWER_RSSI) ? atoi(_buffer + answer.end(ANSWER_RSSI)) : 0;
+    _channels->addResult(_channel, acked ? CHANNEL_ACKED : CHANNEL_FAILED, rssi);
 }
 
 
@@ -253,39 +978,55 @@ bool LoRaWanClass::transmitPacket(char *buffer, unsigned char timeout)
 {
     unsigned char length = strlen(buffer);
     
-    while(SerialLoRa.available())SerialLoRa.read();
+    if(!isSupported(AT_MSG))return false;
+
+    rxFlush();
+    unsigned long timerStart = millis();
     
     sendCommand("AT+MSG=\"");
-    for(unsigned char i = 0; i < length; i ++)SerialLoRa.write(buffer[i]);
+    sendData(buffer, length);
     sendCommand("\"\r\n");
     
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, timeout);
-
-    if(strstr(_buffer, "+MSG: Done"))return true;
-    return false;
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+MSG: Done");
+    short error = expectFailures(matcher);
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+    bool sent = matcher.matched(done);
+    learnSupport(AT_MSG, matcher, error);
+    checkLinkAnswer(sent, matcher);
+    bookSignal(matcher);
+    bookUplink(length + LORAWAN_FRAME_OVERHEAD, timerStart);
+
+    return sent;
 }
 
 
 bool LoRaWanClass::transmitPacket(unsigned char *buffer, unsigned char length, unsigned char timeout)
 {
-    char temp[2] = {0};
-    
-    while(SerialLoRa.available())SerialLoRa.read();
+    if(!isSupported(AT_MSGHEX))return false;
+
+    rxFlush();
+    unsigned long timerStart = millis();
     
     sendCommand("AT+MSGHEX=\"");
-    for(unsigned char i = 0; i < length; i ++)
-    {
-        sprintf(temp,"%02x", buffer[i]);
-        SerialLoRa.write(temp); 
-    }
+    sendHex(buffer, length);
     sendCommand("\"\r\n");
     
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, timeout);
-    
-    if(strstr(_buffer, "+MSGHEX: Done"))return true;
-    return false;
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+MSGHEX: Done");
+    short error = expectFailures(matcher);
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+    bool sent = matcher.matched(done);
+    learnSupport(AT_MSGHEX, matcher, error);
+    checkLinkAnswer(sent, matcher);
+    bookSignal(matcher);
+    bookUplink(length + LORAWAN_FRAME_OVERHEAD, timerStart);
+
+    return sent;
 }
 
 
@@ -293,93 +1034,257 @@ bool LoRaWanClass::transmitPacketWithConfirmed(char *buffer, unsigned char timeo
 {
     unsigned char length = strlen(buffer);
     
-    while(SerialLoRa.available())SerialLoRa.read();
+    if(!isSupported(AT_CMSG))return false;
+
+    steerUplink();
+    rxFlush();
+    unsigned long timerStart = millis();
     
     sendCommand("AT+CMSG=\"");
-    for(unsigned char i = 0; i < length; i ++)SerialLoRa.write(buffer[i]);
+    sendData(buffer, length);
     sendCommand("\"\r\n");
     
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, timeout);
-     
-    if(strstr(_buffer, "+CMSG: ACK Received"))return true;
-    return false;
+    LoRaWanMatcher matcher;
+    short ack = matcher.add("+CMSG: ACK Received", false);
+    short done = matcher.add("+CMSG: Done");
+    short error = expectFailures(matcher);
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+    bool sent = matcher.matched(done);
+    bool acked = matcher.matched(ack);
+    learnSupport(AT_CMSG, matcher, error);
+    checkLinkAnswer(sent, matcher);
+    bookSignal(matcher);
+    bookChannel(sent, acked, matcher);
+    bookUplink(length + LORAWAN_FRAME_OVERHEAD, timerStart);
+
+    return acked;
 }
 
 
 bool LoRaWanClass::transmitPacketWithConfirmed(unsigned char *buffer, unsigned char length, unsigned char timeout)
 {
-    char temp[2] = {0};
-    
-    while(SerialLoRa.available())SerialLoRa.read();
+    if(!isSupported(AT_CMSGHEX))return false;
+
+    steerUplink();
+    rxFlush();
+    unsigned long timerStart = millis();
     
     sendCommand("AT+CMSGHEX=\"");
-    for(unsigned char i = 0; i < length; i ++)
-    {
-        sprintf(temp,"%02x", buffer[i]);
-        SerialLoRa.write(temp); 
-    }
+    sendHex(buffer, length);
     sendCommand("\"\r\n");
  
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, timeout);
-    
-    if(strstr(_buffer, "+CMSGHEX: ACK Received"))return true;
-    return false;
+    LoRaWanMatcher matcher;
+    short ack = matcher.add("+CMSGHEX: ACK Received", false);
+    short done = matcher.add("+CMSGHEX: Done");
+    short error = expectFailures(matcher);
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+    bool sent = matcher.matched(done);
+    bool acked = matcher.matched(ack);
+    learnSupport(AT_CMSGHEX, matcher, error);
+    checkLinkAnswer(sent, matcher);
+    bookSignal(matcher);
+    bookChannel(sent, acked, matcher);
+    bookUplink(length + LORAWAN_FRAME_OVERHEAD, timerStart);
+
+    return acked;
 }
 
 
 short LoRaWanClass::receivePacket(char *buffer, short length, short *rssi)
 {
-    char *ptr;
+    LoRaWanPayload payload;
     short number = 0;
+
+    if(receivePacket(&payload))
+    {
+        number = payload.length;
+        memcpy(buffer, payload.data, number < length ? number : length);
+    }
+    *rssi = payload.rssi;
+
+    return number;
+}
+
+
+// Decode quoted hex in place, byte i is written behind the digits still to be read.
+// Return the byte count, -1 when the closing quote is missing
+static short decodeHex(char *ptr, uint8_t step)
+{
+    unsigned char *data = (unsigned char *)ptr;
+    short number = 0;
+
+    while(true)
+    {
+        unsigned char high = hexValue(*(ptr + number * step));
+        unsigned char low = hexValue(*(ptr + number * step + 1));
+
+        if(high == 0xFF || low == 0xFF)break;
+        data[number ++] = (high << 4) | low;
+    }
+
+    if(*(ptr + number * step) == '\"' || *(ptr + number * step - 1) == '\"')return number;
+    return -1;
+}
+
+
+uint8_t LoRaWanClass::hexStep(const char *ptr)
+{
+    if(_capabilities.hexFormat == HEX_SPACED)return 3;
+    else if(_capabilities.hexFormat == HEX_COMPACT)return 2;
+    else if(*(ptr + 2) == ' ')return 3;     // Firmware version 2.0.10
+    else return 2;                          // Firmware version 2.1.15
+}
+
+
+bool LoRaWanClass::receivePacket(LoRaWanPayload *payload)
+{
+    char *ptr;
     
-    ptr = strstr(_buffer, "RSSI ");
-    if(ptr)*rssi = atoi(ptr + 5);
-    else *rssi = -255;
+    payload->data = NULL;
+    payload->length = 0;
+    payload->port = 0;
+
+    if(!_bufferLength)
+    {
+        payload->rssi = -255;
+        return false;
+    }
+
+    // One pass over the response finds all four fields
+    LoRaWanMatcher matcher;
+    char *found[4] = {NULL, NULL, NULL, NULL};
+
+    matcher.add("RSSI ");
+    matcher.add("PORT: ");
+    matcher.add("RX: \"");
+    matcher.add("SNR ");
+
+    for(ptr = _buffer; *ptr; ptr ++)
+    {
+        short index = matcher.feed(*ptr);
+        if(index >= 0 && !found[index])found[index] = ptr + 1;
+    }
+
+    if(found[0])payload->rssi = atoi(found[0]);
+    else payload->rssi = -255;
+
+    // A downlink books the signal it was heard with
+    if(found[0])
+    {
+        _rssi = payload->rssi;
+        _snr = found[3] ? atoi(found[3]) : 0;
+    }
+
+    if(found[1])payload->port = atoi(found[1]);
     
-    ptr = strstr(_buffer, "RX: \"");
+    ptr = found[2];
     if(ptr)
     {        
-        ptr += 5;
         
-        uint8_t bitStep = 0;
-        if(*(ptr + 2) == ' ')bitStep = 3; // Firmware version 2.0.10
-        else bitStep = 2;                   // Firmware version 2.1.15
-        
-        for(short i = 0; ; i ++)
-        {
-            char temp[2] = {0};
-            unsigned char tmp, result = 0;
-            
-            temp[0] = *(ptr + i * bitStep);
-            temp[1] = *(ptr + i * bitStep + 1);
-           
-            for(unsigned char j = 0; j < 2; j ++)
-            {
-                if((temp[j] >= '0') && (temp[j] <= '9'))
-                tmp = temp[j] - '0';
-                else if((temp[j] >= 'A') && (temp[j] <= 'F'))
-                tmp = temp[j] - 'A' + 10;
-                else if((temp[j] >= 'a') && (temp[j] <= 'f'))
-                tmp = temp[j] - 'a' + 10;
-
-                result = result * 16 + tmp;
-            }
-            
-            if(i < length)buffer[i] = result;
+        short number = decodeHex(ptr, hexStep(ptr));
 
-            if(*(ptr + (i + 1) * bitStep) == '\"' && *(ptr + (i + 1) * bitStep + 1) == '\r' && *(ptr + (i + 1) * bitStep + 2) == '\n')
-            {
-                number = i + 1;
-                break;
-            }
-        }        
+        if(number >= 0)
+        {
+            payload->data = (unsigned char *)ptr;
+            payload->length = number;
+        }
     }
-       
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
+
+    // Consume the response, the decoded payload behind it stays readable
+    _buffer[0] = '\0';
     
-    return number;
+    return payload->length > 0;
+}
+
+
+void LoRaWanClass::setDownlinkHandler(_downlink_handler_t handler)
+{
+    _downlinkHandler = handler;
+}
+
+
+bool LoRaWanClass::poll(void)
+{
+    bool delivered = false;
+
+    if(_bufferLength < 2)return false;
+
+    // Lines are collected in the response buffer, commands reset it when they start
+    while(rxAvailable())
+    {
+        char c = rxRead();
+
+        if(_pollLength == 0)_pollStart = millis();
+        _pollStamp = millis();
+        if(_pollLength < _bufferLength - 1)_buffer[_pollLength ++] = c;
+        if(c != '\n')continue;
+
+        _buffer[_pollLength] = '\0';
+
+        // The line behind the payload carries its RSSI
+        if(_pollPending)delivered |= deliverDownlink();
+        // One fixed needle per line, strstr keeps a matcher off the stack the handler runs on
+        else if(strstr(_buffer, "RX: \""))_pollPending = true;
+        else _pollLength = 0;
+    }
+
+    if(_pollPending && millis() - _pollStamp >= LORAWAN_RSSI_WAIT)delivered |= deliverDownlink();
+
+    return delivered;
+}
+
+
+void LoRaWanClass::listen(unsigned long ms)
+{
+    unsigned long timerStart = millis();
+    unsigned long elapsed;
+
+    while((elapsed = millis() - timerStart) < ms)
+    {
+        poll();
+        idle(ms - elapsed);
+    }
+}
+
+
+unsigned long LoRaWanClass::getDownlinks(void)
+{
+    return _downlinks;
+}
+
+
+unsigned long LoRaWanClass::getDownlinkLatency(void)
+{
+    return _downlinkLatency;
+}
+
+
+unsigned long LoRaWanClass::getDownlinkLatencyMax(void)
+{
+    return _downlinkLatencyMax;
+}
+
+
+bool LoRaWanClass::deliverDownlink(void)
+{
+    LoRaWanPayload payload;
+
+    _buffer[_pollLength] = '\0';
+    _pollLength = 0;
+    _pollPending = false;
+
+    if(!receivePacket(&payload))return false;
+
+    _downlinks ++;
+    _downlinkLatency = millis() - _pollStart;
+    if(_downlinkLatency > _downlinkLatencyMax)_downlinkLatencyMax = _downlinkLatency;
+
+    if(_downlinkHandler)_downlinkHandler(&payload);
+    return true;
 }
 
 
@@ -387,67 +1292,77 @@ bool LoRaWanClass::transmitProprietaryPacket(char *buffer, unsigned char timeout
 {
     unsigned char length = strlen(buffer);
     
-    while(SerialLoRa.available())SerialLoRa.read();
+    if(!isSupported(AT_PMSG))return false;
+
+    rxFlush();
+    unsigned long timerStart = millis();
     
     sendCommand("AT+PMSG=\"");
-    for(unsigned char i = 0; i < length; i ++)SerialLoRa.write(buffer[i]);
+    sendData(buffer, length);
     sendCommand("\"\r\n");
     
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, timeout);
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+PMSG: Done");
+    short error = expectFailures(matcher);
 
-    if(strstr(_buffer, "+PMSG: Done"))return true;
-    return false;
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+    bool sent = matcher.matched(done);
+    learnSupport(AT_PMSG, matcher, error);
+    bookUplink(length + LORAWAN_FRAME_OVERHEAD, timerStart);
+
+    return sent;
 }
 
 
 bool LoRaWanClass::transmitProprietaryPacket(unsigned char *buffer, unsigned char length, unsigned char timeout)
 {
-    char temp[2] = {0};
-    
-    while(SerialLoRa.available())SerialLoRa.read();
+    if(!isSupported(AT_PMSGHEX))return false;
+
+    rxFlush();
+    unsigned long timerStart = millis();
     
     sendCommand("AT+PMSGHEX=\"");
-    for(unsigned char i = 0; i < length; i ++)
-    {
-        sprintf(temp,"%02x", buffer[i]);
-        SerialLoRa.write(temp); 
-    }
+    sendHex(buffer, length);
     sendCommand("\"\r\n");
     
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, timeout);
-   
-    if(strstr(_buffer, "+PMSGHEX: Done"))return true;
-    return false;
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+PMSGHEX: Done");
+    short error = expectFailures(matcher);
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+    bool sent = matcher.matched(done);
+    learnSupport(AT_PMSGHEX, matcher, error);
+    bookUplink(length + LORAWAN_FRAME_OVERHEAD, timerStart);
+
+    return sent;
 }
 
 
-void LoRaWanClass::setUnconfirmedMessageRepeatTime(unsigned char time)
+bool LoRaWanClass::setUnconfirmedMessageRepeatTime(unsigned char time)
 {
-    char cmd[32];
-    
     if(time > 15) time = 15;
     else if(time == 0) time = 1;
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+REPT=%d\r\n", time);
-    sendCommand(cmd);
-    loraPrint(DEFAULT_DEBUGTIME);
+
+    rxFlush();
+    sendCommand("AT+REPT=");
+    sendNumber(time);
+    sendCommand("\r\n");
+    return readAnswer("+REPT");
 }
 
 
-void LoRaWanClass::setConfirmedMessageRetryTime(unsigned char time)
+bool LoRaWanClass::setConfirmedMessageRetryTime(unsigned char time)
 {
-    char cmd[32];
-    
     if(time > 15) time = 15;
     else if(time == 0) time = 1;
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+RETRY=%d\r\n", time);
-    sendCommand(cmd);
-    loraPrint(DEFAULT_DEBUGTIME);   
+
+    rxFlush();
+    sendCommand("AT+RETRY=");
+    sendNumber(time);
+    sendCommand("\r\n");
+    return readAnswer("+RETRY");
 }
 
 
@@ -461,33 +1376,53 @@ void LoRaWanClass::setReceiveWindowFirst(bool command)
 
 void LoRaWanClass::setReceiveWindowFirst(unsigned char channel, float frequency)
 {
-    char cmd[32];
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+RXWIN1=%d,%.3f\r\n", channel, frequency);
-    sendCommand(cmd);
+    setReceiveWindowFirstHz(channel, frequencyToHz(frequency));
+}
+
+
+void LoRaWanClass::setReceiveWindowFirstHz(unsigned char channel, unsigned long frequency)
+{
+    sendCommand("AT+RXWIN1=");
+    sendNumber(channel);
+    sendCommand(",");
+    sendFrequency(frequency);
+    sendCommand("\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
 }
 
 
 void LoRaWanClass::setReceiveWindowSecond(float frequency, _data_rate_t dataRate)
 {
-    char cmd[32];
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+RXWIN2=%.3f,%d\r\n", frequency, dataRate);
-    sendCommand(cmd);
+    setReceiveWindowSecondHz(frequencyToHz(frequency), dataRate);
+}
+
+
+void LoRaWanClass::setReceiveWindowSecondHz(unsigned long frequency, _data_rate_t dataRate)
+{
+    sendCommand("AT+RXWIN2=");
+    sendFrequency(frequency);
+    sendCommand(",");
+    sendNumber(dataRate);
+    sendCommand("\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
 }
 
 
 void LoRaWanClass::setReceiveWindowSecond(float frequency, _spreading_factor_t spreadingFactor, _band_width_t bandwidth)
 {
-    char cmd[32];
-    
-    memset(cmd, 0, 32);
-    sprintf(cmd, "AT+RXWIN2=%.3f,%d,%d\r\n", frequency, spreadingFactor, bandwidth);
-    sendCommand(cmd);
+    setReceiveWindowSecondHz(frequencyToHz(frequency), spreadingFactor, bandwidth);
+}
+
+
+void LoRaWanClass::setReceiveWindowSecondHz(unsigned long frequency, _spreading_factor_t spreadingFactor, _band_width_t bandwidth)
+{
+    sendCommand("AT+RXWIN2=");
+    sendFrequency(frequency);
+    sendCommand(",");
+    sendNumber(spreadingFactor);
+    sendCommand(",");
+    sendNumber(bandwidth);
+    sendCommand("\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
 }
 
@@ -510,36 +1445,44 @@ void LoRaWanClass::setJoinDutyCycle(bool command)
 
 void LoRaWanClass::setReceiveWindowDelay(_window_delay_t command, unsigned short _delay)
 {
-    char cmd[32];
-    
-    memset(cmd, 0, 32);
-    if(command == RECEIVE_DELAY1) sprintf(cmd, "AT+DELAY=RX1,%d\r\n", _delay);
-    else if(command == RECEIVE_DELAY2) sprintf(cmd, "AT+DELAY=RX2,%d\r\n", _delay);
-    else if(command == JOIN_ACCEPT_DELAY1) sprintf(cmd, "AT+DELAY=JRX1,%d\r\n", _delay);
-    else if(command == JOIN_ACCEPT_DELAY2) sprintf(cmd, "AT+DELAY=JRX2,%d\r\n", _delay); 
-    sendCommand(cmd);
+    if(command == RECEIVE_DELAY1) sendCommand("AT+DELAY=RX1,");
+    else if(command == RECEIVE_DELAY2) sendCommand("AT+DELAY=RX2,");
+    else if(command == JOIN_ACCEPT_DELAY1) sendCommand("AT+DELAY=JRX1,");
+    else if(command == JOIN_ACCEPT_DELAY2) sendCommand("AT+DELAY=JRX2,");
+    else return;
+    sendNumber(_delay);
+    sendCommand("\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
 }
 
 
-void LoRaWanClass::setBeaconAndPingSlot(int periodicity)
+bool LoRaWanClass::setBeaconAndPingSlot(int periodicity)
 {
-    char cmd[32];
-    memset(cmd, 0, 32);
-
-    sprintf(cmd, "AT+BEACON=%d\r\n", periodicity);
-
-    sendCommand(cmd);
-    loraPrint(DEFAULT_DEBUGTIME);
+    rxFlush();
+    sendCommand("AT+BEACON=");
+    sendNumber(periodicity);
+    sendCommand("\r\n");
+    return readAnswer("+BEACON");
 }
 
 
-void LoRaWanClass::setClassType(_class_type_t type)
+bool LoRaWanClass::setClassType(_class_type_t type)
 {
-    if(type == CLASS_A)sendCommand("AT+CLASS=A\r\n");
+    bool done = false;
+
+    // Without Class B firmware the beacon search below would never finish,
+    // a modem that never answered AT+VER is not trusted with it either
+    if(type == CLASS_B && (_capabilities.major == 0 || !_capabilities.classB))return false;
+
+    rxFlush();
+    if(type == CLASS_A)
+    {
+        sendCommand("AT+CLASS=A\r\n");
+        done = readAnswer("+CLASS: A");
+    }
     else if(type == CLASS_B)
     {
-        while (true)
+        for(unsigned char i = 0; i < CLASS_B_ATTEMPTS && !done; i ++)
         {
             sendCommand("AT+BEACON=DMMUL,1,15\r\n");
             loraPrint(DEFAULT_DEBUGTIME);
@@ -547,113 +1490,294 @@ void LoRaWanClass::setClassType(_class_type_t type)
             sendCommand("AT+CLASS=B\r\n");
             loraPrint(DEFAULT_DEBUGTIME);
 
-            if (checkClassBDone()) 
-            {
-                break;
-            }
+            done = checkClassBDone();
         }
     }
-    else if(type == CLASS_C)sendCommand("AT+CLASS=C\r\n");
-    loraPrint(DEFAULT_DEBUGTIME);
+    else if(type == CLASS_C)
+    {
+        sendCommand("AT+CLASS=C\r\n");
+        done = readAnswer("+CLASS: C");
+    }
+
+    if(!done)return false;
+
+    _classType = type;
+    remember(SHADOW_CLASS, type);
+
+    if(_energy)_energy->setModemState(type == CLASS_C ? MODEM_RX : MODEM_IDLE);
+
+    return true;
 }
 
 
 bool LoRaWanClass::checkClassBDone()
 {
-    char *ptr_locked = nullptr;
-    char *ptr_done = nullptr;
-    char *ptr_failed = nullptr;
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+BEACON: DONE");
+    short failed = matcher.add("+BEACON: FAILED");
 
-    while (true)
+    matcher.add("+BEACON: LOCKED", false);
+
+    for (unsigned short i = 0; i < CLASS_B_TIMEOUT; i ++)
     {
-        memset(_buffer, 0, BEFFER_LENGTH_MAX);
-        readBuffer(_buffer, BEFFER_LENGTH_MAX, 1);
+        // A modem that never answered AT+CLASS=B is not searching for a beacon
+        bool unanswered = _supervisor && _awaiting;
 
-        ptr_locked = strstr(_buffer, "+BEACON: LOCKED");
-        if (ptr_locked)
+        clearBuffer();
+        if (!readBuffer(_buffer, _bufferLength, 1, &matcher) && unanswered)
         {
-            break;
+            return false;
         }
 
-        ptr_failed = strstr(_buffer, "+BEACON: FAILED");
-        if (ptr_failed)
+        if (matcher.matched(failed))
         {
             return false;
         }
 
-        delay(1);
-    }
-
-    while (true)
-    {
-        memset(_buffer, 0, BEFFER_LENGTH_MAX);
-        readBuffer(_buffer, BEFFER_LENGTH_MAX, 1);
-
-        ptr_done = strstr(_buffer, "+BEACON: DONE");
-        if (ptr_done)
+        if (matcher.matched(done))
         {
             return true;
         }
-
-        ptr_failed = strstr(_buffer, "+BEACON: FAILED");
-        if (ptr_failed)
-        {
-            return false;
-        }
-
-        delay(1);
     }
+
+    // Still searching, the modem stays in Class A
+    return false;
 }
 
 
 bool LoRaWanClass::checkBeaconLost()
 {
-    char *ptr_class = nullptr;
+    LoRaWanMatcher matcher;
+    short classA = matcher.add("+CLASS: A");
+
+    matcher.add("+CLASS: B");
+    matcher.add("+CLASS: C");
 
+    rxFlush();
     sendCommand("AT+CLASS\r\n");
-    loraPrint(DEFAULT_DEBUGTIME);
 
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, 1);
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
 
-    ptr_class = strstr(_buffer, "+CLASS: A");
-    if (ptr_class)
-    {
-        return true;
-    }
-    return false;
+    return matcher.matched(classA);
 }
 
 
 void LoRaWanClass::setActivation(_device_mode_t mode)
 {
+    remember(SHADOW_ACTIVATION, mode);
+    _joined = mode == LWABP;
+
     if(mode == LWABP)sendCommand("AT+MODE=LWABP\r\n");
     else if(mode == LWOTAA)sendCommand("AT+MODE=LWOTAA\r\n");
+    else if(mode == TEST)sendCommand("AT+MODE=TEST\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
 }
 
 
-bool LoRaWanClass::setOTAAJoin(_otaa_join_cmd_t command, unsigned char timeout)
+bool LoRaWanClass::setTestConfig(unsigned long frequency, _spreading_factor_t spreadingFactor, _band_width_t bandwidth, short power, unsigned short preamble)
+{
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+TEST: RFCFG");
+    expectFailures(matcher);
+
+    rxFlush();
+    sendCommand("AT+TEST=RFCFG,");
+    sendFrequency(frequency);
+    sendCommand(",SF");
+    sendNumber(spreadingFactor);
+    sendCommand(",");
+    sendNumber(bandwidth);
+    sendCommand(",");
+    sendNumber(preamble);
+    sendCommand(",");
+    sendNumber(preamble);
+    sendCommand(",");
+    sendNumber(power);
+    sendCommand(",ON,OFF,OFF\r\n");
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
+
+    return matcher.matched(done);
+}
+
+
+bool LoRaWanClass::transmitTestPacket(const unsigned char *buffer, unsigned char length, unsigned char timeout)
 {
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+TEST: TX DONE");
+    expectFailures(matcher);
+
+    rxFlush();
+    sendCommand("AT+TEST=TXLRPKT,\"");
+    sendHex(buffer, length);
+    sendCommand("\"\r\n");
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+
+    return matcher.matched(done);
+}
+
+
+bool LoRaWanClass::setTestReceive(void)
+{
+    LoRaWanMatcher matcher;
+    short done = matcher.add("+TEST: RXLRPKT");
+    expectFailures(matcher);
+
+    rxFlush();
+    sendCommand("AT+TEST=RXLRPKT\r\n");
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
+
+    return matcher.matched(done);
+}
+
+
+bool LoRaWanClass::receiveTestPacket(LoRaWanTestPacket *packet, unsigned char timeout)
+{
+    LoRaWanMatcher matcher;
     char *ptr;
+
+    packet->data = NULL;
+    packet->length = 0;
+    packet->rssi = -255;
+    packet->snr = 0;
+
+    // "+TEST: LEN:3, RSSI:-40, SNR:10" then "+TEST: RX "010203"", only the data line ends in a quote
+    matcher.add("\"\r\n");
+    short rssi = matcher.add("RSSI:", false);
+    short snr = matcher.add("SNR:", false);
+    short data = matcher.add("RX \"", false);
+
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout, &matcher);
+    if(!matcher.done())return false;
+
+    if(matcher.matched(rssi))packet->rssi = atoi(_buffer + matcher.end(rssi));
+    if(matcher.matched(snr))packet->snr = atoi(_buffer + matcher.end(snr));
+    if(!matcher.matched(data))return false;
+
+    ptr = _buffer + matcher.end(data);
+    short number = decodeHex(ptr, hexStep(ptr));
+    if(number < 0)return false;
+
+    packet->data = (unsigned char *)ptr;
+    packet->length = number;
+
+    return number > 0;
+}
+
+
+bool LoRaWanClass::pingTest(unsigned char length, unsigned short count, LoRaWanPingStats *stats, unsigned char timeout)
+{
+    unsigned char packet[TEST_PACKET_MAX];
+    unsigned long rttTotal = 0;
+
+    if(length < 2)length = 2;
+    if(length > TEST_PACKET_MAX)length = TEST_PACKET_MAX;
+
+    memset(stats, 0, sizeof(LoRaWanPingStats));
+    stats->rttMin = 0xFFFFFFFF;
+
+    unsigned long timerStart = millis();
+
+    for(unsigned short sequence = 0; sequence < count; sequence ++)
+    {
+        LoRaWanTestPacket reply;
+
+        // A sequence number up front tells a late echo of an earlier ping apart
+        packet[0] = sequence >> 8;
+        packet[1] = sequence & 0xFF;
+        for(unsigned char i = 2; i < length; i ++)packet[i] = i;
+
+        unsigned long pingStart = millis();
+
+        if(!transmitTestPacket(packet, length, timeout))continue;
+        stats->sent ++;
+
+        if(!setTestReceive())continue;
+        if(!receiveTestPacket(&reply, timeout))continue;
+        if(reply.length != length || memcmp(reply.data, packet, 2))continue;
+
+        unsigned long rtt = millis() - pingStart;
+
+        stats->received ++;
+        rttTotal += rtt;
+        if(rtt < stats->rttMin)stats->rttMin = rtt;
+        if(rtt > stats->rttMax)stats->rttMax = rtt;
+    }
+
+    stats->elapsed = millis() - timerStart;
+
+    if(!stats->received)
+    {
+        stats->rttMin = 0;
+        return false;
+    }
+
+    stats->rttAverage = rttTotal / stats->received;
+    if(stats->elapsed)
+    {
+        // 64 bit, 65535 round trips would overflow the products
+        stats->packetsPerSecondCenti = 100000ULL * stats->received / stats->elapsed;
+        stats->bytesPerSecond = 2000ULL * stats->received * length / stats->elapsed;
+    }
+
+    return true;
+}
+
+
+unsigned short LoRaWanClass::pongTest(unsigned short count, unsigned char timeout)
+{
+    unsigned char packet[TEST_PACKET_MAX];
+    unsigned short echoed = 0;
+
+    while(echoed < count)
+    {
+        LoRaWanTestPacket received;
+
+        if(!setTestReceive())break;
+        if(!receiveTestPacket(&received, timeout))break;
+
+        // The packet points into the response buffer the reply overwrites
+        unsigned char length = received.length < TEST_PACKET_MAX ? received.length : TEST_PACKET_MAX;
+        memcpy(packet, received.data, length);
+
+        wait(TEST_TURNAROUND);
+        if(transmitTestPacket(packet, length))echoed ++;
+    }
+
+    return echoed;
+}
+
+
+bool LoRaWanClass::setOTAAJoin(_otaa_join_cmd_t command, unsigned char timeout)
+{
+    LoRaWanMatcher matcher;
+    short joinedAlready = matcher.add("+JOIN: Joined already");
+    short joined = matcher.add("+JOIN: Network joined", false);
+
+    matcher.add("+JOIN: Done");
     
+    rxFlush();
+    unsigned long timerStart = millis();
+
     if(command == JOIN)sendCommand("AT+JOIN\r\n");
     else if(command == FORCE)sendCommand("AT+JOIN=FORCE\r\n"); 
-    delay(DEFAULT_TIMEWAIT);
     
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, 1);
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, timeout + 1, &matcher);
+    bookUplink(LORAWAN_JOIN_LENGTH, timerStart);
 
-    ptr = strstr(_buffer, "+JOIN: Joined already");
-    if(ptr)return true;
+    bool result = matcher.matched(joinedAlready) || matcher.matched(joined);
+    remember(SHADOW_JOINED, result);
+    _joined = result;
 
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, timeout);
-
-    ptr = strstr(_buffer, "+JOIN: Network joined");
-    if(ptr)return true;
-    
-    return false;
+    return result;
 }
 
 
@@ -661,6 +1785,8 @@ void LoRaWanClass::setDeviceLowPower(void)
 {
     sendCommand("AT+LOWPOWER\r\n");
     loraPrint(DEFAULT_DEBUGTIME);
+
+    if(_energy)_energy->setModemState(MODEM_SLEEP);
 }
 
 
@@ -668,22 +1794,22 @@ void LoRaWanClass::setDeviceLowPowerWakeUp(void)
 {
     sendCommand("A");
     loraPrint(DEFAULT_DEBUGTIME);
+
+    if(_energy)_energy->setModemState(_classType == CLASS_C ? MODEM_RX : MODEM_IDLE);
 }
 
 
-void LoRaWanClass::setDeviceReset()
+long LoRaWanClass::setDeviceReset()
 {
     sendCommand("AT+RESET\r\n");
-    delay(1000);
-    loraPrint(DEFAULT_DEBUGTIME);
+    return waitBoot("+RESET: OK", BOOT_TIMEOUT);
 }
 
 
-void LoRaWanClass::setDeviceDefault(void)
+long LoRaWanClass::setDeviceDefault(void)
 {
     sendCommand("AT+FDEFAULT=RISINGHF\r\n");
-    delay(1000);
-    loraPrint(DEFAULT_DEBUGTIME);
+    return waitBoot("+FDEFAULT: OK", BOOT_TIMEOUT);
 }
 
 
@@ -700,10 +1826,17 @@ float LoRaWanClass::getBatteryVoltage(void)
 }
 
 
+unsigned short LoRaWanClass::getBatteryVoltageMilliVolts(void)
+{
+    // Same scaling as getBatteryVoltage(), 11:1 divider on a 3.3 V reference
+    return analogRead(BATTERY_POWER_PIN) * 11UL * 3300 / 1024;
+}
+
+
 bool LoRaWanClass::getBatteryStatus(void)
 {
     pinMode(CHARGE_STATUS_PIN, INPUT);
-    delay(DEFAULT_TIMEWAIT);
+    wait(DEFAULT_TIMEWAIT);
     bool batteryStatus = digitalRead(CHARGE_STATUS_PIN);
 
     return batteryStatus;
@@ -712,88 +1845,331 @@ bool LoRaWanClass::getBatteryStatus(void)
 
 float LoRaWanClass::getModuleTemperatureC(void)
 {
-    float moduleTemperatureC = 0.0;
+    // Parsed in tenths, sscanf with %f would link the float scanf support
+    return getModuleTemperatureDeciC() / 10.0f;
+}
+
+
+short LoRaWanClass::getModuleTemperatureDeciC(void)
+{
+    LoRaWanMatcher matcher;
+    short temp = matcher.add("+TEMP:", false);
+
+    matcher.add("\n");
 
+    rxFlush();
     sendCommand("AT+TEMP\r\n");
 
-    memset(_buffer, 0, BEFFER_LENGTH_MAX);
-    readBuffer(_buffer, BEFFER_LENGTH_MAX, 1);
+    clearBuffer();
+    readBuffer(_buffer, _bufferLength, 1, &matcher);
 
-    if (containsSubstring(_buffer, "+TEMP:")) {
-        // Find the colon and parse the temperature
-        int colonIndex = -1;
-        for(int i = 0; _buffer[i] != '\0' && i < sizeof(_buffer); i++) {
-            if(_buffer[i] == ':') {
-                colonIndex = i;
+    return matcher.matched(temp) ? parseDeci(_buffer + matcher.end(temp)) : 0;
+}
+
+
+bool LoRaWanClass::getHealthSnapshot(LoRaWanHealth *health)
+{
+    const char *commands[5] = {"AT+DR\r\n", "AT+POWER\r\n", "AT+LW=ULDL\r\n", "AT+CLASS\r\n", "AT+TEMP\r\n"};
+    const char *patterns[5] = {"+DR: DR", "+POWER: ", "+LW: ULDL, ", "+CLASS: ", "+TEMP: "};
+    char *found[5] = {NULL, NULL, NULL, NULL, NULL};
+    unsigned long timerStart = millis();
+
+    memset(health, 0, sizeof(LoRaWanHealth));
+
+    // The charge pin settles while the modem answers
+    pinMode(CHARGE_STATUS_PIN, INPUT);
+
+    // One query at a time, the modem is not known to queue commands
+    for(unsigned char i = 0; i < 5; i ++)
+    {
+        LoRaWanMatcher matcher;
+        short answer = matcher.add(patterns[i], false);
+
+        matcher.add("\n");
+
+        rxFlush();
+        sendCommand(commands[i]);
+
+        clearBuffer();
+        readBuffer(_buffer, _bufferLength, HEALTH_TIMEOUT, &matcher);
+        if(!matcher.matched(answer))continue;
+
+        matcher.reset();
+        for(char *ptr = _buffer; *ptr; ptr ++)
+        {
+            if(matcher.feed(*ptr) == answer)
+            {
+                found[i] = ptr + 1;
                 break;
             }
         }
+        if(!found[i])continue;
 
-        if (colonIndex != -1) {
-            sscanf(&_buffer[colonIndex + 1], "%f", &moduleTemperatureC);
+        // The next query reuses the buffer, read the value now
+        switch(i)
+        {
+            case 0:
+                health->dataRate = atoi(found[i]);
+                health->answered |= HEALTH_DATA_RATE;
+                break;
+            case 1:
+                health->power = atoi(found[i]);
+                health->answered |= HEALTH_POWER;
+                break;
+            case 2:
+            {
+                char *ptr = found[i];
+                health->uplinkCounter = strtoul(ptr, &ptr, 10);
+                if(*ptr == ',')health->downlinkCounter = strtoul(ptr + 1, NULL, 10);
+                health->answered |= HEALTH_COUNTERS;
+                break;
+            }
+            case 3:
+                if(*found[i] < 'A' || *found[i] > 'C')break;
+                health->classType = *found[i] - 'A';
+                health->answered |= HEALTH_CLASS;
+                break;
+            case 4:
+                health->temperatureDeciC = parseDeci(found[i]);
+                health->answered |= HEALTH_TEMPERATURE;
+                break;
         }
     }
-   return moduleTemperatureC;
+
+    health->batteryMilliVolts = getBatteryVoltageMilliVolts();
+    health->charging = !digitalRead(CHARGE_STATUS_PIN);
+    health->joined = _joined;
+    health->rssi = _rssi;
+    health->snr = _snr;
+    health->queryTime = millis() - timerStart;
+
+    return health->answered == (HEALTH_DATA_RATE | HEALTH_POWER | HEALTH_COUNTERS | HEALTH_CLASS | HEALTH_TEMPERATURE);
+}
+
+
+unsigned char LoRaWanClass::encodeHealth(const LoRaWanHealth *health, unsigned char *buffer)
+{
+    unsigned long fields[5];
+    unsigned char widths[5] = {2, 2, 4, 4, 2};
+    unsigned char length = 0;
+
+    fields[0] = health->batteryMilliVolts;
+    fields[1] = (unsigned short)health->temperatureDeciC;
+    fields[2] = health->uplinkCounter;
+    fields[3] = health->downlinkCounter;
+    fields[4] = (unsigned short)health->rssi;
+
+    for(unsigned char i = 0; i < 5; i ++)
+    {
+        for(unsigned char j = widths[i]; j; j --)buffer[length ++] = fields[i] >> (8 * (j - 1));
+    }
+
+    buffer[length ++] = health->snr;
+    buffer[length ++] = health->power;
+    buffer[length ++] = (health->dataRate & 0x0F) | ((health->classType & 0x03) << 4) | (health->joined ? 0x40 : 0) | (health->charging ? 0x80 : 0);
+    buffer[length ++] = health->answered;
+
+    return length;
 }
 
 
 bool LoRaWanClass::containsSubstring(const char* buffer, const char* substring)
 {
-    const char* temp = buffer;
+    LoRaWanMatcher matcher;
 
-    while (*temp) {
-        bool matches = true;
-        for (int i = 0; substring[i]; i++) {
-            if (temp[i] != substring[i]) {
-                matches = false;
-                break;
-            }
-        }
-        if (matches) {
-            return true;
-        }
-        temp++;
+    if (matcher.add(substring) < 0) {
+        return strstr(buffer, substring) != NULL;   // longer than the matcher holds
     }
-    return false;
+    return matcher.feed(buffer) >= 0;
+}
+
+
+char *LoRaWanClass::formatNumber(char *buffer, long value)
+{
+    char digits[NUMBER_TEXT_MAX];
+    unsigned char count = 0;
+    unsigned long magnitude = value;
+
+    if(value < 0)
+    {
+        *buffer++ = '-';
+        magnitude = 0UL - magnitude;
+    }
+
+    do
+    {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude);
+
+    while(count)*buffer++ = digits[--count];
+    *buffer = '\0';
+
+    return buffer;
+}
+
+
+char *LoRaWanClass::formatFrequency(char *buffer, unsigned long frequency)
+{
+    unsigned short kiloHertz = (frequency / 1000) % 1000;
+
+    buffer = formatNumber(buffer, frequency / 1000000);
+    *buffer++ = '.';
+    *buffer++ = '0' + kiloHertz / 100;
+    *buffer++ = '0' + kiloHertz / 10 % 10;
+    *buffer++ = '0' + kiloHertz % 10;
+    *buffer = '\0';
+
+    return buffer;
+}
+
+
+void LoRaWanClass::sendCommand(const char *command)
+{
+    sendData(command, strlen(command));
+}
+
+
+void LoRaWanClass::sendData(const char *data, size_t length)
+{
+    // The command that found the modem silent has returned by now
+    if(_recoverPending && !_recovering)recover();
+
+    // From here on the modem answers the command, poll() starts over afterwards
+    _pollLength = 0;
+    _pollPending = false;
+
+    _serial->write((const uint8_t *)data, length);
+    if(_capture)_capture->tx(data, length);
+    _awaiting = true;
+}
+
+
+void LoRaWanClass::sendNumber(long value)
+{
+    char temp[NUMBER_TEXT_MAX];
+
+    formatNumber(temp, value);
+    sendCommand(temp);
+}
+
+
+void LoRaWanClass::sendFrequency(unsigned long frequency)
+{
+    char temp[NUMBER_TEXT_MAX];
+
+    formatFrequency(temp, frequency);
+    sendCommand(temp);
 }
 
 
-void LoRaWanClass::sendCommand(char *command)
+void LoRaWanClass::sendHex(const unsigned char *buffer, unsigned char length)
 {
-    SerialLoRa.print(command);
+    static const char hexDigits[] = "0123456789abcdef";
+    char text[HEX_TEXT_MAX];
+    char *ptr = text;
+
+    // One write, the serial driver and the capture see the payload at once
+    for(unsigned char i = 0; i < length; i ++)
+    {
+        *ptr ++ = hexDigits[buffer[i] >> 4];
+        *ptr ++ = hexDigits[buffer[i] & 0x0F];
+    }
+    sendData(text, ptr - text);
 }
 
 
-short LoRaWanClass::readBuffer(char *buffer, short length, unsigned char timeout)
+short LoRaWanClass::readBuffer(char *buffer, short length, unsigned char timeout, LoRaWanMatcher *matcher)
 {
     short i = 0;
     unsigned long timerStart, timerEnd;
 
     timerStart = millis();
 
+    if(length <= 0)return 0;
+    length --; // keep the terminating zero
+
     while(1)
     {
-        if(i < length)
+        while(i < length && rxAvailable())
         {
-            while(SerialLoRa.available())
-            {
-                char c = SerialLoRa.read();  
-                buffer[i ++] = c;
-            }  
+            char c = rxRead();  
+            buffer[i ++] = c;
+            if(matcher)matcher->feed(c);
         }
+
+        if(matcher && matcher->done())break;
         
         timerEnd = millis();
-        if(timerEnd - timerStart > 1000 * timeout)break;
+        if(timerEnd - timerStart > 1000UL * timeout)break;
+        idle(1000UL * timeout - (timerEnd - timerStart));
     }
 
     #ifdef PRINT_TO_SERIAL_MONITOR
     SerialUSB.print(buffer);
     #endif
 
+    // Counted once per command, a hung modem is reset before the next command.
+    // Recovering here would overwrite the response the caller is still reading
+    if(_supervisor && _awaiting && !i)
+    {
+        _awaiting = false;
+        if(!_recovering && _supervisor->addSilent())_recoverPending = true;
+    }
+
     return i;
 }
 
 
+int LoRaWanClass::rxAvailable(void)
+{
+    #if LORAWAN_RX_RING_SIZE > 0
+    pumpRx();
+    return _rxRing.available();
+    #else
+    return _serial->available();
+    #endif
+}
+
+
+int LoRaWanClass::rxRead(void)
+{
+    #if LORAWAN_RX_RING_SIZE > 0
+    pumpRx();
+    int c = _rxRing.pop();
+    #else
+    int c = _serial->read();
+    #endif
+
+    if(_capture && c >= 0)_capture->rx(c);
+    if(_supervisor && c >= 0)
+    {
+        _awaiting = false;
+        _supervisor->addAnswer();
+    }
+    return c;
+}
+
+
+void LoRaWanClass::rxFlush(void)
+{
+    // A downlink that arrived since the last poll() must not be thrown away
+    if(_downlinkHandler)
+    {
+        poll();
+        if(_pollPending)deliverDownlink();
+    }
+
+    while(rxAvailable())rxRead();
+}
+
+
+void LoRaWanClass::clearBuffer(void)
+{
+    if(_bufferLength)memset(_buffer, 0, _bufferLength);
+}
+
+
 void LoRaWanClass::loraPrint(unsigned char timeout)
 {
     unsigned long timerStart, timerEnd;
@@ -802,16 +2178,17 @@ void LoRaWanClass::loraPrint(unsigned char timeout)
     
     while(1)
     {
-        while(SerialLoRa.available())
+        while(rxAvailable())
         {
             #ifdef PRINT_TO_SERIAL_MONITOR
-            SerialUSB.write(SerialLoRa.read());
+            SerialUSB.write(rxRead());
             #else
-            SerialLoRa.read();
+            rxRead();
             #endif
         }
         
         timerEnd = millis();
         if(timerEnd - timerStart > timeout)break;
+        idle(timeout - (timerEnd - timerStart));
     }
 }
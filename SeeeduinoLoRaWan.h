@@ -35,6 +35,13 @@
 
 
 #include <Arduino.h>
+#include "LoRaWanMatcher.h"
+#include "LoRaWanRing.h"
+#include "LoRaWanEnergy.h"
+#include "LoRaWanCapture.h"
+#include "LoRaWanLink.h"
+#include "LoRaWanChannels.h"
+#include "LoRaWanSupervisor.h"
 
 
 #define SerialLoRa          Serial1
@@ -45,11 +52,89 @@
 #define DEFAULT_TIMEOUT     5 // second
 #define DEFAULT_TIMEWAIT    100 // millisecond
 #define DEFAULT_DEBUGTIME   100 // millisecond
+#define ANSWER_QUIET        20  // millisecond without a byte that ends a setter's answer
 
 #define BATTERY_POWER_PIN    A4
 #define CHARGE_STATUS_PIN    A5
 
+// BEFFER_LENGTH_MAX and LORAWAN_RX_RING_SIZE change the size of LoRaWanClass.
+// Set them only as build flags, -D... in build_flags or platform.local.txt, so
+// the library and the sketch are compiled alike. A #define in the sketch
+// before the #include changes the class for the sketch alone, the two then
+// disagree on its layout and corrupt each other's memory.
+
+// Response buffer size, override with -DBEFFER_LENGTH_MAX=... in the build flags.
+// Set it to 0 to drop the internal buffer and hand one in with setBuffer().
+#ifndef BEFFER_LENGTH_MAX
 #define BEFFER_LENGTH_MAX    256
+#endif
+
+// Modem receive ring in bytes, 0 reads the UART directly.
+// With a ring, every library wait keeps draining the UART so output such as
+// Class C downlinks or +BEACON events survives long blocking calls.
+// Size it above the longest burst between two waits, 512 is a safe start.
+#ifndef LORAWAN_RX_RING_SIZE
+#define LORAWAN_RX_RING_SIZE    0
+#endif
+
+// How long poll() holds a downlink for the RSSI line behind it, millisecond.
+// The line is about 40 bytes, 42 ms at 9600 baud.
+#ifndef LORAWAN_RSSI_WAIT
+#define LORAWAN_RSSI_WAIT       60
+#endif
+
+// TEST mode, the longest raw packet pingTest() sends and the pause the echo
+// node leaves so the pinging node can switch to receive
+#define TEST_PACKET_MAX         64
+#define TEST_TURNAROUND         50      // millisecond
+
+// Reset and region setup ping the modem instead of fixed delays and go on
+// the moment it answers. An AT ping and its answer take about 15 ms at 9600 baud.
+#define BOOT_PROBE_INTERVAL     50      // millisecond between pings
+#define BOOT_TIMEOUT            3000    // millisecond, the modem has to answer after a reset
+#define BOOT_SETTLE             500     // millisecond, the longest wait around the region switch
+
+// setClassType(CLASS_B) gives up after this many beacon searches of at most
+// CLASS_B_TIMEOUT each, a beacon is sent every 128 s
+#define CLASS_B_ATTEMPTS        3
+#define CLASS_B_TIMEOUT         150     // second
+
+// Text of a long, sign, digits and the terminating zero, 14 bytes on the SAMD21
+#define NUMBER_TEXT_MAX         (3 * sizeof(long) + 2)
+
+// Hex text of the longest payload, on the stack only while the command is sent
+#define HEX_TEXT_MAX            (2 * 255)
+
+// getHealthSnapshot(), the bound on each query and the uplink record
+#define HEALTH_TIMEOUT          1       // second
+#define HEALTH_RECORD_LENGTH    18      // bytes written by encodeHealth()
+
+/*****************************************************************
+RAM budget (SAMD21, 32 KB)
+  static  LoRaWanClass          BEFFER_LENGTH_MAX + 116 bytes
+  static  receive ring          LORAWAN_RX_RING_SIZE + 24 bytes
+  stack   setters               NUMBER_TEXT_MAX bytes number cache + call frames
+  stack   transmitPacket*       no payload copy, hex is streamed
+  stack   receivePacket view    no copy, payload decoded in place
+  stack   response matcher      ~350 bytes while a command waits, one at a time
+LORAWAN_STATIC_RAM_BUDGET is a fixed limit, it is not raised to fit a
+new feature. extras/test/test_ram_budget.cpp checks it on the host, the
+library checks it again at compile time on the target.
+******************************************************************/
+
+#if UINTPTR_MAX > 0xFFFFFFFFUL
+#define LORAWAN_STATIC_RAM_FIXED    224     // bytes besides the buffers, 64-bit hosts
+#define LORAWAN_RX_RING_FIXED       32      // bytes of the ring besides its storage
+#else
+#define LORAWAN_STATIC_RAM_FIXED    128     // bytes besides the buffers, SAMD21
+#define LORAWAN_RX_RING_FIXED       24
+#endif
+
+#if LORAWAN_RX_RING_SIZE > 0
+#define LORAWAN_STATIC_RAM_BUDGET   (BEFFER_LENGTH_MAX + LORAWAN_STATIC_RAM_FIXED + LORAWAN_RX_RING_SIZE + LORAWAN_RX_RING_FIXED)
+#else
+#define LORAWAN_STATIC_RAM_BUDGET   (BEFFER_LENGTH_MAX + LORAWAN_STATIC_RAM_FIXED)
+#endif
 
 
 enum _class_type_t { CLASS_A = 0, CLASS_B, CLASS_C };
@@ -60,6 +145,92 @@ enum _window_delay_t { RECEIVE_DELAY1 = 0, RECEIVE_DELAY2, JOIN_ACCEPT_DELAY1, J
 enum _band_width_t { BW125 = 125, BW250 = 250, BW500 = 500 };
 enum _spreading_factor_t { SF12 = 12, SF11 = 11, SF10 = 10, SF9 = 9, SF8 = 8, SF7 = 7 };
 enum _data_rate_t { DR0 = 0, DR1, DR2, DR3, DR4, DR5, DR6, DR7 };
+enum _hex_format_t { HEX_UNKNOWN = 0, HEX_COMPACT, HEX_SPACED };
+enum _at_command_t { AT_MSG = 0, AT_MSGHEX, AT_CMSG, AT_CMSGHEX, AT_PMSG, AT_PMSGHEX };
+enum _health_field_t { HEALTH_DATA_RATE = 0x01, HEALTH_POWER = 0x02, HEALTH_COUNTERS = 0x04, HEALTH_CLASS = 0x08, HEALTH_TEMPERATURE = 0x10 };
+
+// Called on every library wait iteration, remaining is the time in millisecond
+// until the wait runs out. Waits for a modem answer can end sooner.
+typedef void (*_idle_callback_t)(unsigned long remaining);
+
+
+// View of a received downlink, points into the library response buffer.
+// Valid until the next library call that talks to the modem.
+struct LoRaWanPayload
+{
+    const unsigned char *data;
+    short length;
+    short rssi;
+    unsigned char port;
+};
+
+// What the attached modem firmware can do, filled by probeCapabilities().
+// A modem that did not answer AT+VER reads 0.0.0 and keeps every fallback.
+struct LoRaWanCapabilities
+{
+    unsigned char major;
+    unsigned char minor;
+    unsigned char patch;
+    _hex_format_t hexFormat;        // downlink "RX:" format, HEX_SPACED on 2.0.x
+    bool classB;                    // AT+BEACON and AT+CLASS=B, setClassType(CLASS_B) fails without
+    unsigned short unsupported;     // 1 << _at_command_t, learned from ERROR(-10)
+};
+
+// Raw LoRa packet received in TEST mode, points into the library response buffer
+struct LoRaWanTestPacket
+{
+    const unsigned char *data;
+    short length;
+    short rssi;
+    short snr;
+};
+
+// Result of pingTest(), times in millisecond
+struct LoRaWanPingStats
+{
+    unsigned short sent;
+    unsigned short received;
+    unsigned long elapsed;
+    unsigned long rttMin;
+    unsigned long rttAverage;
+    unsigned long rttMax;
+    unsigned long packetsPerSecondCenti;    // round trips completed, hundredth packet per second
+    unsigned long bytesPerSecond;       // payload delivered, both directions
+};
+
+// Device state filled by getHealthSnapshot(). Modem fields that were not
+// answered read 0, answered tells which were.
+struct LoRaWanHealth
+{
+    unsigned long uplinkCounter;
+    unsigned long downlinkCounter;
+    unsigned short batteryMilliVolts;
+    short temperatureDeciC;             // module, tenth degree Celsius
+    short rssi;                         // last downlink heard, 0 : none yet
+    signed char snr;
+    signed char power;                  // dBm
+    unsigned char dataRate;
+    unsigned char classType;            // _class_type_t
+    bool joined;                        // ABP counts as joined
+    bool charging;
+    unsigned char answered;             // _health_field_t bits
+    unsigned short queryTime;           // millisecond the queries took
+};
+
+// DeviceTimeAns found by getDeviceTime(). The time is the GPS time at the
+// end of the uplink, the other fields tell how late the answer was read.
+struct LoRaWanDeviceTime
+{
+    unsigned long gpsSeconds;           // since 6. 1. 1980, no leap seconds
+    unsigned short milliseconds;
+    unsigned char window;               // receive window of the answer, 1 or 2, 0 : not reported
+    unsigned char dataRate;             // of the uplink, RX1 answers at the same rate
+    unsigned char downlinkLength;       // PHY payload of the answer in bytes
+    unsigned short tailBytes;           // modem output from the answer to the end of the response
+};
+
+// Called by poll() for every downlink the modem reports outside a command
+typedef void (*_downlink_handler_t)(const LoRaWanPayload *payload);
 
 /*****************************************************************
 Type    DataRate    Configuration   BitRate| TxPower Configuration 
@@ -93,12 +264,168 @@ class LoRaWanClass
         LoRaWanClass(void);
 
         /**
-         *  \brief Initialize the conmunication interface
+         *  \brief Wait without losing modem output, use instead of delay()
+         *  
+         *  \param [in] ms The wait time in millisecond
+         *  
+         *  \return Return null
+         */
+        void wait(unsigned long ms);
+
+        /**
+         *  \brief Move waiting modem bytes into the receive ring
+         *  
+         *  Called from every library wait. Can also be called from a timer
+         *  interrupt so bytes are captured while the sketch blocks elsewhere.
+         *  
+         *  \return Return null
+         */
+        void pumpRx(void);
+
+        /**
+         *  \brief Get the receive ring, for overflow counters or to feed bytes on a host
+         *  
+         *  \return Return the ring, NULL when LORAWAN_RX_RING_SIZE is 0
+         */
+        LoRaWanRing *getRxRing(void);
+
+        /**
+         *  \brief Register a function the library calls while it waits
+         *  
+         *  Use it to sample sensors, feed the watchdog or enter light sleep.
+         *  Keep each call shorter than the remaining time it is given.
+         *  
+         *  \param [in] callback The idle function, NULL to remove it
+         *  
+         *  \return Return null
+         */
+        void setIdleCallback(_idle_callback_t callback);
+
+        /**
+         *  \brief Time handed to the idle callback so far
+         *  
+         *  \return Return time in millisecond
+         */
+        unsigned long getIdleTime(void);
+
+        /**
+         *  \brief Number of idle callback calls so far
+         *  
+         *  \return Return call count
+         */
+        unsigned long getIdleCalls(void);
+
+        /**
+         *  \brief Book modem states and uplink airtime into an energy ledger
+         *  
+         *  Airtime assumes the data rate last set with setDataRate(), DR0 by
+         *  default, ADR changes made by the network are not seen.
+         *  
+         *  \param [in] *ledger The ledger, NULL to stop booking
+         *  
+         *  \return Return null
+         */
+        void setEnergyLedger(LoRaWanEnergy *ledger);
+
+        /**
+         *  \brief Collect LinkCheck answers into a statistics window
+         *  
+         *  \param [in] *link The statistics, NULL to stop collecting
+         *  
+         *  \return Return null
+         */
+        void setLinkStats(LoRaWanLink *link);
+
+        /**
+         *  \brief Watch the modem for hangs and recover it on its own
+         *  
+         *  Set it before the configuration calls, the supervisor keeps what
+         *  they apply and replays it after a reset.
+         *  
+         *  \param [in] *supervisor The supervisor, NULL to stop watching
+         *  
+         *  \return Return null
+         */
+        void setSupervisor(LoRaWanSupervisor *supervisor);
+
+        /**
+         *  \brief Reset the modem, wait until it answers and replay the configuration
+         *  
+         *  Called on its own before the next command once SUPERVISOR_SILENT_LIMIT
+         *  commands in a row went unanswered.
+         *  An OTAA node joins again, which takes a few seconds.
+         *  
+         *  \return Return bool. True : modem answered and configuration replayed
+         */
+        bool recover(void);
+
+        /**
+         *  \brief Piggyback a LinkCheckReq on the next uplink
+         *  
+         *  The answer, or its absence, is added to the statistics set with
+         *  setLinkStats() when the next transmitPacket* call completes.
+         *  
+         *  \return Return bool. True : the modem queued the request
+         */
+        bool requestLinkCheck(void);
+
+        /**
+         *  \brief Piggyback a DeviceTimeReq on the next uplink
+         *  
+         *  Read the answer with getDeviceTime() once the transmitPacket* call
+         *  returned, before receivePacket() consumes the response.
+         *  
+         *  \return Return bool. True : the modem queued the request
+         */
+        bool requestDeviceTime(void);
+
+        /**
+         *  \brief Find the DeviceTimeAns in the response of the last uplink
+         *  
+         *  \param [out] *time The network time and what delayed it, see LoRaWanClock
+         *  
+         *  \return Return bool. True : the answer came with the uplink
+         */
+        bool getDeviceTime(LoRaWanDeviceTime *time);
+
+        /**
+         *  \brief Initialize the conmunication interface and probe the modem
          *  
          *  \return Return null
          */
         void init(void);
 
+        /**
+         *  \brief Talk to the modem over another stream
+         *  
+         *  For a modem on a different port, or a LoRaWanReplay on a host.
+         *  The modem is probed like init() does.
+         *  
+         *  \param [in] &serial The stream, already started
+         *  
+         *  \return Return null
+         */
+        void init(Stream &serial);
+
+        /**
+         *  \brief Record all modem traffic into a capture log
+         *  
+         *  \param [in] *capture The capture, NULL to stop recording
+         *  
+         *  \return Return null
+         */
+        void setCapture(LoRaWanCapture *capture);
+
+        /**
+         *  \brief Use a caller owned response buffer instead of the internal one
+         *  
+         *  \param [in] *buffer The response cache, must outlive the library use
+         *  \param [in] length The length of response cache
+         *  
+         *  \return Return null
+         */
+        void setBuffer(char *buffer, short length);
+
         /**
          *  \brief Set frequency plan Europe 433 MHz (ITU region 1)
          *  
@@ -113,6 +440,13 @@ class LoRaWanClass
          */
         void setEU868(void);
 
+        /**
+         *  \brief Get the frequency plan
+         *  
+         *  \return Return the plan last set with setEU433() or setEU868(), EU433 until then
+         */
+        _physical_type_t getRegion(void);
+
         /**
          *  \brief Read the version from device
          *  
@@ -124,6 +458,32 @@ class LoRaWanClass
          */
         void getVersion(void);
 
+        /**
+         *  \brief Query AT+VER and rebuild the capability record
+         *  
+         *  Called by init(). Call it again after the modem was powered up late
+         *  or its firmware was updated, learned unsupported commands are kept.
+         *  
+         *  \return Return bool. True : the modem answered
+         */
+        bool probeCapabilities(void);
+
+        /**
+         *  \brief Get the capability record of the attached modem
+         *  
+         *  \return Return the record, valid for the library lifetime
+         */
+        const LoRaWanCapabilities *getCapabilities(void);
+
+        /**
+         *  \brief Check if a command can be sent, commands known to fail return at once
+         *  
+         *  \param [in] command The command
+         *  
+         *  \return Return bool. True : supported or not known otherwise
+         */
+        bool isSupported(_at_command_t command);
+
         /**
          *  \brief Read the ID from device
          *  
@@ -166,14 +526,33 @@ class LoRaWanClass
          */      
         void setDataRate(_physical_type_t physicalType = EU433); 
 
+        /**
+         *  \brief Set the uplink data rate
+         *  
+         *  \param [in] dataRate The data rate, also used for airtime accounting
+         *  
+         *  \return Return bool. True : the modem took the rate, false : ERROR or no answer
+         */
+        bool setDataRate(_data_rate_t dataRate);
+
+        /**
+         *  \brief Get the uplink data rate
+         *  
+         *  The rate last set with setDataRate(), DR0 until then. ADR may have
+         *  moved the modem since.
+         *  
+         *  \return Return the data rate
+         */
+        _data_rate_t getDataRate(void);
+
         /**
          *  \brief Set the output power
          *  
          *  \param [in] power The output power value
          *  
-         *  \return Return null.
+         *  \return Return bool. True : the modem took the power, false : ERROR or no answer
          */
-        void setPower(short power);
+        bool setPower(short power);
 
         /**
          *  \brief Set the port number
@@ -189,30 +568,59 @@ class LoRaWanClass
          *  
          *  \param [in] command The date rate of encoding
          *  
-         *  \return Return null.
+         *  \return Return bool. True : the modem took the mode, false : ERROR or no answer
          */ 
-        void setAdaptiveDataRate(bool command);
+        bool setAdaptiveDataRate(bool command);
         
         /**
          *  \brief Set the channel parameter
          *  
          *  \param [in] channel The channel number, range from 0 to 71
          *  \param [in] frequency The frequency value
+         *  \param [in] dataRataMin The minimum date rate of channel
+         *  \param [in] dataRataMax The maximum date rate of channel
          *  
          *  \return Return null.
          */
-        
+        void setChannel(unsigned char channel, float frequency, _data_rate_t dataRataMin, _data_rate_t dataRataMax);
+
         /**
          *  \brief Set the channel parameter
          *  
          *  \param [in] channel The channel number, range from 0 to 71
-         *  \param [in] frequency The frequency value
+         *  \param [in] frequency The frequency value in Hz
          *  \param [in] dataRataMin The minimum date rate of channel
          *  \param [in] dataRataMax The maximum date rate of channel
          *  
          *  \return Return null.
          */
-        void setChannel(unsigned char channel, float frequency, _data_rate_t dataRataMin, _data_rate_t dataRataMax);
+        void setChannelHz(unsigned char channel, unsigned long frequency, _data_rate_t dataRataMin, _data_rate_t dataRataMax);
+
+        /**
+         *  \brief Disable a channel
+         *  
+         *  \param [in] channel The channel number
+         *  
+         *  \return Return null
+         */
+        void setChannelOff(unsigned char channel);
+
+        /**
+         *  \brief Steer confirmed uplinks to one channel and book their outcome per channel
+         *  
+         *  Set it before setEU868(), setEU433() or setChannel*(), the channels
+         *  are learned from them. Each transmitPacketWithConfirmed() call then
+         *  leaves only the channel picked by the statistics enabled, which costs
+         *  two AT+CH commands of about 30 ms each when the channel changes.
+         *  Only an acknowledge tells if an uplink arrived, so unconfirmed uplinks
+         *  are neither steered nor booked and go out on the channel the last
+         *  confirmed uplink left enabled. NULL enables all channels again.
+         *  
+         *  \param [in] *channels The statistics and masking policy, NULL to stop
+         *  
+         *  \return Return null
+         */
+        void setChannelStats(LoRaWanChannels *channels);
         
         /**
          *  \brief Transmit the data
@@ -266,6 +674,67 @@ class LoRaWanClass
          *  \return Return Receive data number
          */
         short receivePacket(char *buffer, short length, short *rssi);
+
+        /**
+         *  \brief Receive the data without copying it
+         *  
+         *  \param [out] *payload The view of received data, RSSI and port
+         *  
+         *  \return Return bool. True : data received, false : no data
+         */
+        bool receivePacket(LoRaWanPayload *payload);
+
+        /**
+         *  \brief Register the function poll() hands Class C downlinks to
+         *  
+         *  \param [in] handler The downlink function, NULL to remove it
+         *  
+         *  \return Return null
+         */
+        void setDownlinkHandler(_downlink_handler_t handler);
+
+        /**
+         *  \brief Drain the modem and deliver complete downlinks to the handler
+         *  
+         *  Call it from loop() as often as possible, or use listen(). A downlink
+         *  is delivered once the RSSI line behind it has arrived, or
+         *  LORAWAN_RSSI_WAIT millisecond later with RSSI -255.
+         *  
+         *  \return Return bool. True : a downlink was delivered
+         */
+        bool poll(void);
+
+        /**
+         *  \brief Wait while delivering downlinks, use instead of wait() in Class C
+         *  
+         *  \param [in] ms The wait time in millisecond
+         *  
+         *  \return Return null
+         */
+        void listen(unsigned long ms);
+
+        /**
+         *  \brief Number of downlinks delivered by poll()
+         *  
+         *  \return Return downlink count
+         */
+        unsigned long getDownlinks(void);
+
+        /**
+         *  \brief Time from the first byte of the last downlink to its handler call
+         *  
+         *  Counted from when the library drained the byte from the UART.
+         *  
+         *  \return Return time in millisecond
+         */
+        unsigned long getDownlinkLatency(void);
+
+        /**
+         *  \brief Longest downlink to handler time seen so far
+         *  
+         *  \return Return time in millisecond
+         */
+        unsigned long getDownlinkLatencyMax(void);
         
         /**
          *  \brief Transmit the proprietary data
@@ -296,6 +765,72 @@ class LoRaWanClass
          *  \return Return null
          */
         void setActivation(_device_mode_t mode);
+
+        /**
+         *  \brief Set the radio of TEST mode, call setActivation(TEST) first
+         *  
+         *  The modem always uses coding rate 4/5 and CRC on, IQ and network
+         *  sync word are left at their defaults.
+         *  
+         *  \param [in] frequency The frequency in Hz
+         *  \param [in] spreadingFactor The spreading factor
+         *  \param [in] bandwidth The band width
+         *  \param [in] power The TX power in dBm
+         *  \param [in] preamble The preamble length in symbols, TX and RX
+         *  
+         *  \return Return bool. True : accepted
+         */
+        bool setTestConfig(unsigned long frequency, _spreading_factor_t spreadingFactor, _band_width_t bandwidth, short power, unsigned short preamble = 8);
+
+        /**
+         *  \brief Send a raw LoRa packet in TEST mode
+         *  
+         *  \param [in] *buffer The packet data
+         *  \param [in] length The packet length
+         *  \param [in] timeout The over time of transmit
+         *  
+         *  \return Return bool. True : sent
+         */
+        bool transmitTestPacket(const unsigned char *buffer, unsigned char length, unsigned char timeout = DEFAULT_TIMEOUT);
+
+        /**
+         *  \brief Start continuous receive in TEST mode, ends with the next command
+         *  
+         *  \return Return bool. True : receiving
+         */
+        bool setTestReceive(void);
+
+        /**
+         *  \brief Wait for the next raw packet, after setTestReceive()
+         *  
+         *  \param [out] *packet The view of received data, RSSI and SNR
+         *  \param [in] timeout The over time of receive
+         *  
+         *  \return Return bool. True : packet received
+         */
+        bool receiveTestPacket(LoRaWanTestPacket *packet, unsigned char timeout = DEFAULT_TIMEOUT);
+
+        /**
+         *  \brief Ping-pong benchmark, the other node runs pongTest()
+         *  
+         *  \param [in] length The packet length, 2 to TEST_PACKET_MAX
+         *  \param [in] count The number of pings
+         *  \param [out] *stats The packet rate, throughput and round trip time
+         *  \param [in] timeout The over time of one round trip
+         *  
+         *  \return Return bool. True : at least one echo came back
+         */
+        bool pingTest(unsigned char length, unsigned short count, LoRaWanPingStats *stats, unsigned char timeout = 2);
+
+        /**
+         *  \brief Echo node of the ping-pong benchmark
+         *  
+         *  \param [in] count The number of packets to echo
+         *  \param [in] timeout The over time to wait for each packet
+         *  
+         *  \return Return number of packets echoed, stops at the first timeout
+         */
+        unsigned short pongTest(unsigned short count, unsigned char timeout = DEFAULT_TIMEOUT);
         
         /**
          *  \brief Set device join a network
@@ -312,18 +847,18 @@ class LoRaWanClass
          *  
          *  \param [in] time The repeat time, range from 1 to 15
          *  
-         *  \return Return null
+         *  \return Return bool. True : the modem took the repeat time, false : ERROR or no answer
          */
-        void setUnconfirmedMessageRepeatTime(unsigned char time);
+        bool setUnconfirmedMessageRepeatTime(unsigned char time);
         
         /**
          *  \brief Set message retry times time
          *  
-         *  \param [in] time The retry time, range from 0 to 254
+         *  \param [in] time The retry time, range from 1 to 15, clamped to it
          *  
-         *  \return Return null
+         *  \return Return bool. True : the modem took the retry time, false : ERROR or no answer
          */
-        void setConfirmedMessageRetryTime(unsigned char time);
+        bool setConfirmedMessageRetryTime(unsigned char time);
         
         /**
          *  \brief ON/OFF receice window 1
@@ -343,6 +878,16 @@ class LoRaWanClass
          *  \return Return null
          */
         void setReceiveWindowFirst(unsigned char channel, float frequency);
+
+        /**
+         *  \brief Set receice window 1 channel mapping
+         *  
+         *  \param [in] channel The channel number, range from 0 to 71
+         *  \param [in] frequency The frequency value of channel in Hz
+         *  
+         *  \return Return null
+         */
+        void setReceiveWindowFirstHz(unsigned char channel, unsigned long frequency);
         
         /**
          *  \brief Set receice window 2 channel mapping
@@ -353,6 +898,16 @@ class LoRaWanClass
          *  \return Return null
          */
         void setReceiveWindowSecond(float frequency, _data_rate_t dataRate);
+
+        /**
+         *  \brief Set receice window 2 channel mapping
+         *  
+         *  \param [in] frequency The frequency value of channel in Hz
+         *  \param [in] dataRate The date rate value
+         *  
+         *  \return Return null
+         */
+        void setReceiveWindowSecondHz(unsigned long frequency, _data_rate_t dataRate);
         
         /**
          *  \brief Set receice window 2 channel mapping
@@ -364,6 +919,17 @@ class LoRaWanClass
          *  \return Return null
          */
         void setReceiveWindowSecond(float frequency, _spreading_factor_t spreadingFactor, _band_width_t bandwidth);
+
+        /**
+         *  \brief Set receice window 2 channel mapping
+         *  
+         *  \param [in] frequency The frequency value of channel in Hz
+         *  \param [in] spreadingFactor The spreading factor value
+         *  \param [in] bandwidth The band width value
+         *  
+         *  \return Return null
+         */
+        void setReceiveWindowSecondHz(unsigned long frequency, _spreading_factor_t spreadingFactor, _band_width_t bandwidth);
         
         /**
          *  \brief ON/OFF duty cycle limitation
@@ -396,23 +962,26 @@ class LoRaWanClass
         /**
          *  \brief Set LoRaWAN class type
          *  
+         *  Class B waits for the beacon, CLASS_B_ATTEMPTS searches at most.
+         *  It is refused unless probeCapabilities() found Class B firmware.
+         *  
          *  \param [in] type The class type
          *  
-         *  \return Return null
+         *  \return Return bool. True : the modem switched, false : it stays in its class
          */
-        void setClassType(_class_type_t type);
+        bool setClassType(_class_type_t type);
 
         /**
          *  \brief Set beacon and ping slot configuration
          * 
          *  \param periodicity The ping slot period factor (2^periodicity seconds)
          *  
-         *  \return Return null
+         *  \return Return bool. True : the modem took the periodicity, false : ERROR or no answer
          */
-        void setBeaconAndPingSlot(int periodicity);
+        bool setBeaconAndPingSlot(int periodicity);
 
         /**
-         *  \brief Wait for Class B setup
+         *  \brief Wait for Class B setup, CLASS_B_TIMEOUT at most
          *  
          *  \return True if successful
          */
@@ -440,18 +1009,18 @@ class LoRaWanClass
         void setDeviceLowPowerWakeUp(void);
         
         /**
-         *  \brief Reset device
+         *  \brief Reset device, returns as soon as it answers again
          *  
-         *  \return Return null
+         *  \return Return boot latency in millisecond, -1 : no answer within BOOT_TIMEOUT
          */
-        void setDeviceReset();
+        long setDeviceReset();
         
         /**
-         *  \brief Setup device default
+         *  \brief Setup device default, returns as soon as it answers again
          *  
-         *  \return Return null
+         *  \return Return latency in millisecond, -1 : no answer within BOOT_TIMEOUT
          */
-        void setDeviceDefault(void);
+        long setDeviceDefault(void);
         
         /**
          *  \brief Read battery voltage
@@ -460,6 +1029,13 @@ class LoRaWanClass
          */
         float getBatteryVoltage(void);
 
+        /**
+         *  \brief Read battery voltage without floating point
+         *  
+         *  \return Return battery voltage in millivolt
+         */
+        unsigned short getBatteryVoltageMilliVolts(void);
+
         /**
          *  \brief Read battery status
          *  
@@ -470,18 +1046,139 @@ class LoRaWanClass
         /**
          *  \brief Read module temperature
          *  
-         *  \return Return module temperature
+         *  \return Return module temperature, resolution 0.1 degree, 0 without answer
          */
         float getModuleTemperatureC(void);
 
+        /**
+         *  \brief Read module temperature without floating point
+         *  
+         *  \return Return module temperature in tenth degree Celsius, 0 without answer
+         */
+        short getModuleTemperatureDeciC(void);
+
+        /**
+         *  \brief Collect the device state in one call
+         *  
+         *  AT+DR, AT+POWER, AT+LW=ULDL, AT+CLASS and AT+TEMP are sent one
+         *  after another, each waits for its answer at most HEALTH_TIMEOUT.
+         *  Battery, join state and the last downlink RSSI and SNR need no query.
+         *  
+         *  \param [out] *health The snapshot
+         *  
+         *  \return Return bool. True : every query answered
+         */
+        bool getHealthSnapshot(LoRaWanHealth *health);
+
+        /**
+         *  \brief Write a snapshot as an uplink record
+         *  
+         *  Big endian: battery millivolts and temperature tenth degree, two
+         *  bytes each, uplink and downlink counter, four bytes each, RSSI, two
+         *  bytes. Then SNR, power, a byte of data rate bits 0-3, class bits
+         *  4-5, joined bit 6, charging bit 7, and the answered mask.
+         *  
+         *  \param [in] *health The snapshot
+         *  \param [out] *buffer The output cache, HEALTH_RECORD_LENGTH bytes
+         *  
+         *  \return Return record length
+         */
+        static unsigned char encodeHealth(const LoRaWanHealth *health, unsigned char *buffer);
+
         bool containsSubstring(const char* buffer, const char* substring);
         
         void loraPrint(unsigned char timeout);
 
+        /**
+         *  \brief Format a decimal number, no printf involved
+         *  
+         *  \param [in] *buffer The output cache, at least NUMBER_TEXT_MAX bytes
+         *  \param [in] value The number to format
+         *  
+         *  \return Return pointer to the terminating zero
+         */
+        static char *formatNumber(char *buffer, long value);
+
+        /**
+         *  \brief Format a frequency in Hz as MHz with three decimals, e.g. 868.100
+         *  
+         *  \param [in] *buffer The output cache, at least NUMBER_TEXT_MAX bytes
+         *  \param [in] frequency The frequency value in Hz
+         *  
+         *  \return Return pointer to the terminating zero
+         */
+        static char *formatFrequency(char *buffer, unsigned long frequency);
+
     private:
-        void sendCommand(char *command);
-        short readBuffer(char* buffer, short length, unsigned char timeout = DEFAULT_TIMEOUT);
-        char _buffer[256];
+        void sendCommand(const char *command);
+        void sendData(const char *data, size_t length);
+        void sendNumber(long value);
+        void sendFrequency(unsigned long frequency);
+        void sendHex(const unsigned char *buffer, unsigned char length);
+        short readBuffer(char* buffer, short length, unsigned char timeout = DEFAULT_TIMEOUT, LoRaWanMatcher *matcher = NULL);
+        void clearBuffer(void);
+        int rxAvailable(void);
+        int rxRead(void);
+        void rxFlush(void);
+        void idle(unsigned long remaining);
+        void bookUplink(unsigned char length, unsigned long timerStart);
+        bool deliverDownlink(void);
+        void learnSupport(_at_command_t command, LoRaWanMatcher &matcher, short error);
+        uint8_t hexStep(const char *ptr);
+        void checkLinkAnswer(bool sent, LoRaWanMatcher &answer);
+        bool sendChannel(unsigned char channel, unsigned long frequency, unsigned char dataRateMin, unsigned char dataRateMax);
+        void steerUplink(void);
+        void bookChannel(bool sent, bool acked, LoRaWanMatcher &answer);
+        bool readAnswer(const char *answer);
+        void remember(_shadow_field_t field, short value);
+        void bookSignal(LoRaWanMatcher &answer);
+        long waitReady(unsigned long timeout);
+        long waitBoot(const char *answer, unsigned long timeout);
+
+        char *_buffer;
+        short _bufferLength;
+        #if BEFFER_LENGTH_MAX > 0
+        char _bufferStorage[BEFFER_LENGTH_MAX];
+        #endif
+
+        Stream *_serial;
+        LoRaWanCapture *_capture;
+        LoRaWanEnergy *_energy;
+        LoRaWanLink *_link;
+        LoRaWanChannels *_channels;
+        LoRaWanSupervisor *_supervisor;
+        bool _awaiting;                 // a command was sent and nothing came back yet
+        bool _recovering;
+        bool _recoverPending;           // a hang was seen, recover() runs before the next command
+        bool _joined;
+        signed char _snr;               // last downlink heard
+        short _rssi;
+        signed char _channel;           // the only enabled channel, -1 when not steered
+        _data_rate_t _dataRate;
+        _class_type_t _classType;
+        _physical_type_t _region;
+        LoRaWanCapabilities _capabilities;
+
+        _idle_callback_t _idleCallback;
+        unsigned long _idleMicros;
+        unsigned long _idleTime;
+        unsigned long _idleCalls;
+
+        _downlink_handler_t _downlinkHandler;
+        short _pollLength;
+        bool _pollPending;
+        bool _linkCheckPending;
+        unsigned long _pollStart;
+        unsigned long _pollStamp;
+        unsigned long _downlinks;
+        unsigned long _downlinkLatency;
+        unsigned long _downlinkLatencyMax;
+
+        #if LORAWAN_RX_RING_SIZE > 0
+        LoRaWanRing _rxRing;
+        uint8_t _rxStorage[LORAWAN_RX_RING_SIZE];
+        volatile bool _rxPumping;
+        #endif
 
 };
 
@@ -79,5 +79,5 @@ void loop(void) {
     
     sendAndReceiveData();
 
-    delay(TX_INTERVAL*1000);
+    lora.wait(TX_INTERVAL*1000);
 }
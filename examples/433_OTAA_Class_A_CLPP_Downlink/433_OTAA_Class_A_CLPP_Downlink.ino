@@ -18,6 +18,13 @@ LoRaWanClass lora;
 #include <CayenneLPP.h>               // Cayenne Low Power Payload (LPP)
 CayenneLPP lpp(51);                   // https://lora.vsb.cz/index.php/cayenne-lpp/
 
+#include <LoRaWanIntervalPolicy.h>    // Interval adapted to the battery, airtime budget and link
+#include <LoRaWanEnergy.h>            // Time on air of a frame
+LoRaWanIntervalPolicy policy;
+
+#include <LoRaWanConfig.h>            // Remote configuration by downlink on CONFIG_PORT
+LoRaWanConfig config(lora, &policy);  // Interval commands go to the policy
+
 
 // Comment out the line #define PRINT_TO_SERIAL_MONITOR
 // in "C:\Users\User\Documents\Arduino\libraries\SeeeduinoLoRaWan\SeeeduinoLoRaWan.h"
@@ -29,7 +36,7 @@ CayenneLPP lpp(51);                   // https://lora.vsb.cz/index.php/cayenne-l
 #define APP_KEY "00000000000000000000000000000000"
 //---------------------------------------------------
 
-unsigned TX_INTERVAL = 300;                                       // Transmission interval in seconds
+unsigned TX_INTERVAL = 300;                                       // Transmission interval in seconds, chosen by the policy
 
 // Timer
 unsigned long previousMillis = 0;                                 // Previous time
@@ -43,61 +50,30 @@ float moduleTemp = 0.0;                                           // Variable fo
 float numberOfSamples = 0.0;                                      // Variable for number of measured samples
 
 bool isDelay = true;
+const unsigned char JOIN_ATTEMPTS = 5;                            // Join requests per checkJoin() call
 //------------------------------------------------------------------------------
 
-void printDebugData2(JsonObject root){
-    serializeJsonPretty(root, Serial);
-    Serial.println();
-    Serial.println(root.size());
-}
-
-
-void downlinkSetSendTime(JsonObject root){                              // Downlink - Send data every
-    if(root.containsKey("time_1")){                                     // If JsonObject contains "time_1"
-        uint32_t time_1 = root["time_1"];                               // Get value of the key "time_1" and store it to the variable time_1
-        if(time_1 >= 60 && time_1 <= 300){                              // 60 - 300 seconds
-            TX_INTERVAL = time_1;                                       // Setting the time_1 value to the TX_INTERVAL variable used in the program
-        }else{                                                          // If value is not in range => Error
-            Serial.println("Time Error!!!");
-        }
-    }
-}
-
-
 void receiveData() {
-    short length;
-    char buffer[256];
-    short rssi;
-
-    memset(buffer, 0, 256);
-    length = lora.receivePacket(buffer, 256, &rssi);
-    
-    if(length) {
+    LoRaWanPayload payload;                                           // View into the library buffer, no copy
+
+    if(lora.receivePacket(&payload)) {
         SerialUSB.print("Length: ");
-        SerialUSB.println(length);
+        SerialUSB.println(payload.length);
         SerialUSB.print("RSSI: ");
-        SerialUSB.println(rssi);
+        SerialUSB.println(payload.rssi);
         SerialUSB.print("Data: ");
-        for(unsigned char i = 0; i < length; i ++) {
+        for(unsigned char i = 0; i < payload.length; i ++) {
             SerialUSB.print("0x");
-            SerialUSB.print((buffer[i] >> 4) & 0x0F, HEX);
-            SerialUSB.print(buffer[i] & 0x0F, HEX);
+            SerialUSB.print((payload.data[i] >> 4) & 0x0F, HEX);
+            SerialUSB.print(payload.data[i] & 0x0F, HEX);
             SerialUSB.print(" ");
         }
         SerialUSB.println();
       
 
-        DynamicJsonDocument jsonBuffer(1024);                                 // A DynamicJsonDocument and JsonObject
-        JsonObject root = jsonBuffer.to<JsonObject>();
-
-        lpp.decodeTTN(reinterpret_cast<uint8_t*>(buffer), length, root);      // Decoding data from Cayenne LPP format to JSON root object using lpp.decodeTTN() function
-        printDebugData2(root);
-
-        if(root.size() != 0){
-            downlinkSetSendTime(root);
+        if(config.handle(&payload)) {                                 // Commands on CONFIG_PORT, answered with the next uplink
+            config.apply();
         }
-
-        jsonBuffer.clear();                                                   // Finally, the jsonBuffer memory is freed.
     }
 }
 
@@ -119,32 +95,66 @@ void measureValues() {
 }
 
 
+bool sendAnswer(unsigned char *size) {                             // Status of every configuration command, on CONFIG_PORT
+    uint8_t ack[CONFIG_ACK_LENGTH];
+
+    *size = config.getAck(ack, sizeof(ack));
+
+    lora.setPort(CONFIG_PORT);
+    bool result = lora.transmitPacketWithConfirmed(ack, *size);     // Only an acknowledge tells it arrived
+    lora.setPort(1);
+
+    config.ackSent(result);                                         // Sent again with the next uplink otherwise
+    return result;
+}
+
+
 void sendAndReceiveData() {
-    lpp.reset();
-    lpp.addTemperature(1, moduleTemp / numberOfSamples);                // Add the average module temperature into channel 1
-    lpp.addVoltage(2, batVoltage / numberOfSamples);                    // Add the average battery voltage into channel 2
-    lpp.addDigitalInput(3, (uint8_t)batStatus);                         // Add the battery status into channel 3
+    bool answer = config.isAckDue();                                    // A configuration downlink is answered first, the measurements wait
+    unsigned char size;
+    bool result;
+
+    if(answer) {
+        result = sendAnswer(&size);
+    } else {
+        lpp.reset();
+        lpp.addTemperature(1, moduleTemp / numberOfSamples);            // Add the average module temperature into channel 1
+        lpp.addVoltage(2, batVoltage / numberOfSamples);                // Add the average battery voltage into channel 2
+        lpp.addDigitalInput(3, (uint8_t)batStatus);                     // Add the battery status into channel 3
+
+        size = lpp.getSize();
+        result = lora.transmitPacketWithConfirmed(lpp.getBuffer(), size);   // Acknowledged, the policy learns the link from it
+    }
 
-    bool result = lora.transmitPacket(lpp.getBuffer(), lpp.getSize());  // Prepare upstream data transmission at the next possible time
+    policy.setBattery(batVoltage / numberOfSamples * 1000, !batStatus);   // Average battery voltage in mV, charging
+    policy.addUplink(LoRaWanEnergy::getAirtime(size + LORAWAN_FRAME_OVERHEAD, lora.getDataRate()), result);
 
-    resetValues();                                                      // Reset values
+    if(!answer) {
+        resetValues();                                                  // Reset values
+    }
 
     receiveData();
+
+    TX_INTERVAL = policy.next();                                        // Longer on a low battery or a lossy link, shorter on a healthy node
+    SerialUSB.print("Next uplink in ");
+    SerialUSB.print(TX_INTERVAL);
+    SerialUSB.print(" s, reasons 0x");
+    SerialUSB.println(policy.getReasons(), HEX);
 }
 
 
-void checkJoin(unsigned char timeout) {
-    while(true) {
+bool checkJoin(unsigned char timeout) {
+    for(unsigned char attempt = 0; attempt < JOIN_ATTEMPTS; attempt ++) {
         if(lora.setOTAAJoin(JOIN, timeout)) {
             if(isDelay) {
-                delay(15000);
+                lora.wait(15000);
             }
             isDelay = false;
-            break;
-        } else {
-            isDelay = true;
+            return true;
         }
+        isDelay = true;
     }
+    return false;                                                       // The next call tries again
 }
 
 
@@ -179,7 +189,7 @@ void loop(void) {
             measureValues();                                      // Call measureValues
         }
         
-        if(countSeconds % TX_INTERVAL == 0){                      // Every 300 seconds
+        if(countSeconds % TX_INTERVAL == 0){                      // Every TX_INTERVAL seconds
             sendAndReceiveData();                                 // Call sendAndReceiveData
             countSeconds = 0;                                     // Zero seconds counter
         }
@@ -36,6 +36,7 @@ const byte seconds = 0;
 static uint8_t mydata[] = "Hello, LoRa!";
 
 bool isDelay = true;
+const unsigned char JOIN_ATTEMPTS = 5;                            // Join requests per checkJoin() call
 
 
 void setSleepAndWakeUp(){
@@ -61,18 +62,18 @@ void sendAndReceiveData() {
 }
 
 
-void checkJoin(unsigned char timeout) {
-    while(true) {
+bool checkJoin(unsigned char timeout) {
+    for(unsigned char attempt = 0; attempt < JOIN_ATTEMPTS; attempt ++) {
         if(lora.setOTAAJoin(JOIN, timeout)) {
             if(isDelay) {
-                delay(15000);
+                lora.wait(15000);
             }
             isDelay = false;
-            break;
-        } else {
-            isDelay = true;
+            return true;
         }
+        isDelay = true;
     }
+    return false;                                                       // The next call tries again
 }
 
 
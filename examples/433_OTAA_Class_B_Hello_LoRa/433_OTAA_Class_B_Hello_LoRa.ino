@@ -34,6 +34,7 @@ const long interval = 1000;                                       // Interval 10
 unsigned int countSeconds = 0;                                    // Counting seconds
 
 bool isDelay = true;
+const unsigned char JOIN_ATTEMPTS = 5;                            // Join requests per checkJoin() call
 
 
 void receiveData() {
@@ -73,25 +74,27 @@ void sendAndReceiveData() {
 }
 
 
-void checkJoin(unsigned char timeout) {
-    while(true) {
+bool checkJoin(unsigned char timeout) {
+    for(unsigned char attempt = 0; attempt < JOIN_ATTEMPTS; attempt ++) {
         if(lora.setOTAAJoin(JOIN, timeout)) {
             if(isDelay) {
-                delay(15000);
+                lora.wait(15000);
             }
             isDelay = false;
-            break;
-        } else {
-            isDelay = true;
+            return true;
         }
+        isDelay = true;
     }
+    return false;                                                       // The next call tries again
 }
 
 
 void checkBeaconLost() {
     if(lora.checkBeaconLost()) {
         SerialUSB.println("Device has switched back to Class A due to beacon loss!");
-        lora.setClassType(CLASS_B);
+        if(!lora.setClassType(CLASS_B)) {
+            SerialUSB.println("No beacon found, staying in Class A");
+        }
     }
 }
 
@@ -104,6 +107,7 @@ void setup(void) {
 
     lora.setDeviceDefault();
     lora.getVersion();
+    lora.probeCapabilities();                                     // The modem is up after the reset, Class B needs its firmware version
     lora.setActivation(LWOTAA);
     lora.setKeysOTAA(APP_EUI, DEV_EUI, APP_KEY);
     lora.setEU433();
@@ -113,7 +117,9 @@ void setup(void) {
     checkJoin(10);
 
     lora.setBeaconAndPingSlot(4);                                 // 2^periodicity, 2^4 = 16 seconds
-    lora.setClassType(CLASS_B);
+    if(!lora.setClassType(CLASS_B)) {
+        SerialUSB.println("No beacon found, staying in Class A");
+    }
 }
 
 
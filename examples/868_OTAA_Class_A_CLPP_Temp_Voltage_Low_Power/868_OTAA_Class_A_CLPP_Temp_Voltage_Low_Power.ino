@@ -9,7 +9,7 @@
  * including, but not limited to, copying, modification and redistribution.
  * NO WARRANTY OF ANY KIND IS PROVIDED.
  * 
- * Average module internal temperature, average battery voltage, battery status and CayenneLPP, 20. 12. 2023
+ * Average module internal temperature, average, lowest and highest battery voltage, battery status and CayenneLPP, 20. 12. 2023
  *******************************************************************************/
 #include <SeeeduinoLoRaWan.h>
 LoRaWanClass lora;
@@ -20,16 +20,34 @@ RTCZero rtc;
 #include <CayenneLPP.h>               // Cayenne Low Power Payload (LPP)
 CayenneLPP lpp(51);                   // https://lora.vsb.cz/index.php/cayenne-lpp/
 
+#include <LoRaWanScheduler.h>         // Periodic tasks on an absolute timebase
+LoRaWanScheduler scheduler;
+
+#include <LoRaWanAccumulator.h>       // Count, min, max, mean and variance without float
+
+#include <LoRaWanLog.h>               // Store and forward log of uplinks that could not be sent
+LoRaWanSamdFlash storage;             // Top 16 kB of the MCU flash
+LoRaWanLog uplinkLog(storage);
+
+#include <LoRaWanClock.h>             // GPS time from the network
+LoRaWanClock networkClock;
+
+#include <LoRaWanCompress.h>          // LZSS, the batches repeat the LPP channel and type bytes
+
 
 // Comment out the line #define PRINT_TO_SERIAL_MONITOR
 // in "C:\Users\User\Documents\Arduino\libraries\SeeeduinoLoRaWan\SeeeduinoLoRaWan.h"
 // to disable printing to Serial Monitor.
 
 
-//------------------- Sleep time -------------------
-const byte hours = 0;
-const byte minutes = 1;
-const byte seconds = 0;
+//------------------- Task periods -----------------
+const unsigned long MEASURE_PERIOD = 60000;   // Measure every minute
+const unsigned long SEND_PERIOD = 300000;     // Send every 5 minutes
+const unsigned long SEND_JITTER = 30000;      // Random delay of every uplink, spreads nodes started together
+const unsigned long SEND_DEADLINE = 60000;    // Skip an uplink later than this
+const unsigned char LOG_PORT = 2;             // Port of the batches of logged uplinks, LoRaWanCompress coded
+const unsigned long TIME_SYNC_PERIOD = 86400000;  // Ask the network for the time once a day
+const unsigned short SEND_SLOTS = 30;         // Slots of the send period, nodes of a fleet pick theirs by DevEUI
 //---------------------------------------------------
 
 //-------------- Here change your keys --------------
@@ -39,56 +57,142 @@ const byte seconds = 0;
 //---------------------------------------------------
 
 
-// Sleep counter
-unsigned int countSleeps = 1;                 // Counting sleeps
-unsigned int sendDataEvery = 5;               // Send data every 5 sleep
-
 // Seeeduino
-float batVoltage = 0.0;                       // Variable for battery voltage
+LoRaWanAccumulator batVoltage;                // Battery voltage in millivolt
+LoRaWanAccumulator moduleTemp;                // Module temperature in tenth degree Celsius
 bool batStatus = false;                       // Variable for battery status
-float moduleTemp = 0.0;                       // Variable for module temperature
-float numberOfSamples = 0.0;                  // Variable for number of measured samples
 
 bool isDelay = true;
+const unsigned char JOIN_ATTEMPTS = 5;        // Join requests per checkJoin() call
+short sendTask = -1;
+unsigned long lastTimeSync = 0;
+unsigned long driftRejects = 0;               // Rate measurements the network clock refused
 //------------------------------------------------------------------------------
 
 
 void resetValues() {              // Reset values
-    batVoltage = 0.0;
-    moduleTemp = 0.0;
-    numberOfSamples = 0.0;
+    batVoltage.clear();
+    moduleTemp.clear();
     batStatus = false;
 }
 
 
 void measureValues() {
-    batVoltage += lora.getBatteryVoltage();                 // Add the current battery voltage to all measured battery voltages
-    moduleTemp += lora.getModuleTemperatureC();             // Add the current module temperature to all measured module temperatures
-    numberOfSamples++;                                      // Add measured sample
+    batVoltage.add(lora.getBatteryVoltageMilliVolts());     // Add the current battery voltage to the statistics
+    moduleTemp.add(lora.getModuleTemperatureDeciC());       // Add the current module temperature to the statistics
 
     batStatus = lora.getBatteryStatus();                    // Get battery status. Return false while charging, return true while charge done or no battery insert.
 }
 
 
-void setSleepAndWakeUp() {
+unsigned long setSleepAndWakeUp(unsigned long ms) {      // Called by the scheduler with the time to the next task
+    if(ms < 2000) {
+        return 0;                                           // Below the RTC resolution, millis() keeps counting
+    }
+
     lora.setDeviceLowPower();
-    rtc.setTime(0, 0, 0);
-    rtc.setAlarmTime(hours, minutes, seconds);
-    rtc.standbyMode();                                      // Standby
+
+    // The RTC counts whole seconds, the sleep starts on the next second edge so
+    // the seconds it counts are the time slept. millis() counts the wait for it
+    unsigned long waitStart = millis();
+    unsigned long start = rtc.getEpoch();                   // The RTC keeps the network time across sleeps
+    while(rtc.getEpoch() == start);
+    start ++;
+
+    unsigned long sleepSeconds = (ms - (millis() - waitStart)) / 1000;
+    if(sleepSeconds > 86399) {
+        sleepSeconds = 86399;                               // The alarm matches hours, minutes and seconds
+    }
+
+    rtc.setAlarmEpoch(start + sleepSeconds);
+    rtc.standbyMode();                                      // Standby, millis() stops
     lora.setDeviceLowPowerWakeUp();
+
+    return (rtc.getEpoch() - start) * 1000;                 // Time slept, the wake up is on the alarm second edge
+}
+
+
+void syncTime() {                                           // Right after the uplink that asked for the time
+    LoRaWanDeviceTime answer;
+    unsigned long now = scheduler.now();
+
+    if(!lora.getDeviceTime(&answer) || !networkClock.sync(&answer, now)) {
+        return;
+    }
+
+    if(networkClock.getDriftRejects() != driftRejects) {    // Beyond a crystal, the timebase misses or adds sleep
+        driftRejects = networkClock.getDriftRejects();
+        #ifdef PRINT_TO_SERIAL_MONITOR
+        SerialUSB.println("Drift out of bounds, sleep time reported wrong?");
+        #endif
+    }
+
+    lastTimeSync = now;
+    rtc.setEpoch(networkClock.getUnixTime(now));            // Discipline the RTC
+
+    // Move the uplinks to the slot of this node, the slots of a fleet line up on the GPS time
+    unsigned short slot = LoRaWanClock::getSlot(DEV_EUI, SEND_SLOTS);
+    unsigned long offset = networkClock.getSlotDelay(now, SEND_PERIOD, slot, SEND_SLOTS);
+
+    scheduler.remove(sendTask);
+    sendTask = scheduler.add(sendAndReceiveData, SEND_PERIOD, SEND_PERIOD / SEND_SLOTS / 2, SEND_DEADLINE, offset);
+}
+
+
+unsigned long logTime() {                                   // Log time in second
+    unsigned long now = scheduler.now();
+
+    // The GPS time once known, it goes on across resets and the logged ages stay right.
+    // Records taken before it read as age unknown, the pack() clock is far ahead of them.
+    return networkClock.isSynced() ? networkClock.getGpsTime(now) : now / 1000;
 }
 
 
 void sendAndReceiveData() {
+    unsigned long now = logTime();
+    bool joined = tryJoin(10);                                          // One attempt, the measurements are logged on failure
+
+    if(batVoltage.getCount() == 0) {
+        return;                                                         // Nothing measured yet
+    }
+
     lpp.reset();
-    lpp.addTemperature(1, moduleTemp / numberOfSamples);                // Add the average module temperature into channel 1
-    lpp.addVoltage(2, batVoltage / numberOfSamples);                    // Add the average battery voltage into channel 2
+    lpp.addTemperature(1, moduleTemp.getMean() / 10.0);                 // Add the average module temperature into channel 1
+    lpp.addVoltage(2, batVoltage.getMean() / 1000.0);                   // Add the average battery voltage into channel 2
     lpp.addDigitalInput(3, (uint8_t)batStatus);                         // Add the battery status into channel 3
+    lpp.addVoltage(4, batVoltage.getMin() / 1000.0);                    // Add the lowest battery voltage into channel 4, sags under load
+    lpp.addVoltage(5, batVoltage.getMax() / 1000.0);                    // Add the highest battery voltage into channel 5
 
-    bool result = lora.transmitPacket(lpp.getBuffer(), lpp.getSize());  // Prepare upstream data transmission at the next possible time
+    bool timeDue = !networkClock.isSynced() || scheduler.now() - lastTimeSync >= TIME_SYNC_PERIOD;
+    if(joined && timeDue) {
+        lora.requestDeviceTime();                                       // DeviceTimeReq rides on the uplink
+    }
+
+    bool result = joined && lora.transmitPacket(lpp.getBuffer(), lpp.getSize());   // Prepare upstream data transmission at the next possible time
+
+    if(result && timeDue) {
+        syncTime();                                                     // Before receivePacket() consumes the response
+    }
+
+    if(!result) {
+        uplinkLog.append(lpp.getBuffer(), lpp.getSize(), now);          // Keep it for later
+    }
 
     resetValues();                                                      // Reset values
 
+    if(result && uplinkLog.isDrainDue(now)) {
+        uint8_t batch[50];
+        uint8_t coded[51];
+        unsigned char size = uplinkLog.pack(batch, sizeof(batch), now); // Oldest logged uplinks with their age
+
+        if(size) {
+            size = LoRaWanCompress::compress(batch, size, coded, sizeof(coded));   // One byte longer at worst, stored
+            lora.setPort(LOG_PORT);
+            uplinkLog.commit(lora.transmitPacket(coded, size), now);
+            lora.setPort(1);
+        }
+    }
+
 
     if(result) {
         short length;
@@ -101,18 +205,27 @@ void sendAndReceiveData() {
 }
 
 
-void checkJoin(unsigned char timeout) {
-    while(true) {
-        if(lora.setOTAAJoin(JOIN, timeout)) {
-            if(isDelay) {
-                delay(15000);
-            }
-            isDelay = false;
-            break;
-        } else {
-            isDelay = true;
+bool tryJoin(unsigned char timeout) {
+    if(lora.setOTAAJoin(JOIN, timeout)) {
+        if(isDelay) {
+            lora.wait(15000);
+        }
+        isDelay = false;
+        return true;
+    }
+
+    isDelay = true;
+    return false;
+}
+
+
+bool checkJoin(unsigned char timeout) {
+    for(unsigned char attempt = 0; attempt < JOIN_ATTEMPTS; attempt ++) {
+        if(tryJoin(timeout)) {
+            return true;
         }
     }
+    return false;                                                       // sendAndReceiveData() tries again
 }
 
 
@@ -127,23 +240,20 @@ void setup(void) {
     lora.setClassType(CLASS_A);
     lora.setPort(1);
 
+    uplinkLog.begin();                  // Finds the uplinks logged before the reset
+
     checkJoin(10);
 
     rtc.begin();                        // RTCZero
-    rtc.enableAlarm(rtc.MATCH_MMSS);
+    rtc.enableAlarm(rtc.MATCH_HHMMSS);
+
+    scheduler.add(measureValues, MEASURE_PERIOD);
+    sendTask = scheduler.add(sendAndReceiveData, SEND_PERIOD, SEND_JITTER, SEND_DEADLINE, SEND_PERIOD - SEND_JITTER);
+    scheduler.setSleepCallback(setSleepAndWakeUp, 2000);   // Shorter waits stay awake, see setSleepAndWakeUp()
 }
 
 
 void loop(void) {
 
-    setSleepAndWakeUp();
-
-    measureValues();
-
-    if(countSleeps % sendDataEvery == 0){             // Every 5 sleep
-        checkJoin(10);
-        sendAndReceiveData();
-        countSleeps = 0;                              // Zero sleep counter
-    }
-    countSleeps++; 
+    scheduler.run();                    // Runs the due tasks and sleeps until the next one
 }
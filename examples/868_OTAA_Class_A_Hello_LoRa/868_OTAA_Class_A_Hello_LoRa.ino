@@ -14,6 +14,7 @@
 
 #include <SeeeduinoLoRaWan.h>
 LoRaWanClass lora;
+LoRaWanSupervisor supervisor;                                    // Resets a hung modem and restores its setup
 
 // Comment out the line #define PRINT_TO_SERIAL_MONITOR
 // in "C:\Users\User\Documents\Arduino\libraries\SeeeduinoLoRaWan\SeeeduinoLoRaWan.h"
@@ -29,6 +30,7 @@ const unsigned TX_INTERVAL = 300;                                // Transmission
 static uint8_t mydata[] = "Hello, LoRa!";
 
 bool isDelay = true;
+const unsigned char JOIN_ATTEMPTS = 5;                           // Join requests per checkJoin() call
 
 void sendAndReceiveData() {
   
@@ -62,18 +64,18 @@ void sendAndReceiveData() {
 }
 
 
-void checkJoin(unsigned char timeout) {
-    while(true) {
+bool checkJoin(unsigned char timeout) {
+    for(unsigned char attempt = 0; attempt < JOIN_ATTEMPTS; attempt ++) {
         if(lora.setOTAAJoin(JOIN, timeout)) {
             if(isDelay) {
-                delay(15000);
+                lora.wait(15000);
             }
             isDelay = false;
-            break;
-        } else {
-            isDelay = true;
+            return true;
         }
+        isDelay = true;
     }
+    return false;                                                       // The next call tries again
 }
 
 
@@ -85,6 +87,7 @@ void setup(void) {
 
     lora.setDeviceDefault();
     lora.getVersion();
+    lora.setSupervisor(&supervisor);                            // Before the setup calls, it keeps what they apply
     lora.setActivation(LWOTAA);
     lora.setKeysOTAA(APP_EUI, DEV_EUI, APP_KEY);
     lora.setEU868();
@@ -100,5 +103,13 @@ void loop(void) {
 
     sendAndReceiveData();
 
-    delay(TX_INTERVAL*1000);
+    if(supervisor.getRecoveries()) {
+        SerialUSB.print("Modem recoveries: ");
+        SerialUSB.print(supervisor.getRecoveries());
+        SerialUSB.print(", mean time to recovery: ");
+        SerialUSB.print(supervisor.getRecoveryTimeMean());
+        SerialUSB.println(" ms");
+    }
+
+    lora.wait(TX_INTERVAL*1000);
 }
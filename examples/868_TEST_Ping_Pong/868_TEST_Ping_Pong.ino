@@ -0,0 +1,71 @@
+/*******************************************************************************
+ * Seeeduino LoRaWAN - EU868, TEST mode, raw LoRa ping-pong
+ *
+ * Copyright (c) 2024 Ondřej Knebl, LoRa@VSB
+ *
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Two boards, no LoRaWAN network. Flash one with PING_NODE true and
+ * the other with PING_NODE false, results are printed to Serial Monitor.
+ *******************************************************************************/
+
+#include <SeeeduinoLoRaWan.h>
+LoRaWanClass lora;
+
+
+#define PING_NODE       true                                      // true : sends pings, false : echoes them
+
+#define FREQUENCY       869525000                                 // Hz, g3 sub-band allows 10 % duty cycle
+#define PACKET_LENGTH   16                                        // Bytes per ping
+#define PINGS           20                                        // Pings per measurement
+//------------------------------------------------------------------------------
+
+
+void printStats(LoRaWanPingStats &stats) {
+    SerialUSB.print("Sent: ");
+    SerialUSB.print(stats.sent);
+    SerialUSB.print(", received: ");
+    SerialUSB.println(stats.received);
+    SerialUSB.print("Round trip min / avg / max: ");
+    SerialUSB.print(stats.rttMin);
+    SerialUSB.print(" / ");
+    SerialUSB.print(stats.rttAverage);
+    SerialUSB.print(" / ");
+    SerialUSB.print(stats.rttMax);
+    SerialUSB.println(" ms");
+    SerialUSB.print("Packets per second: ");
+    SerialUSB.print(stats.packetsPerSecondCenti / 100);
+    SerialUSB.print(stats.packetsPerSecondCenti % 100 < 10 ? ".0" : ".");
+    SerialUSB.println(stats.packetsPerSecondCenti % 100);
+    SerialUSB.print("Payload throughput: ");
+    SerialUSB.print(stats.bytesPerSecond);
+    SerialUSB.println(" B/s");
+}
+
+
+void setup(void) {
+    lora.init();
+
+    SerialUSB.begin(9600);
+    //while(!SerialUSB);
+
+    lora.setActivation(TEST);
+    lora.setTestConfig(FREQUENCY, SF7, BW125, 14);
+}
+
+
+void loop(void) {
+    if(PING_NODE) {
+        LoRaWanPingStats stats;
+
+        lora.pingTest(PACKET_LENGTH, PINGS, &stats);
+        printStats(stats);
+        lora.wait(10000);                                         // Keep the duty cycle
+    } else {
+        lora.pongTest(PINGS, 30);                                 // Echo until the pings stop for 30 s
+    }
+}
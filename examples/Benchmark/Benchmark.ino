@@ -0,0 +1,360 @@
+/*******************************************************************************
+ * Seeeduino LoRaWAN - Library hot path benchmark
+ *
+ * Copyright (c) 2024 Ondřej Knebl, LoRa@VSB
+ *
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Runs without a LoRaWAN network, results are printed to Serial Monitor.
+ * The boot benchmark resets the modem and sends one ABP uplink.
+ *
+ * The parser and encoder paths of the library are gated against baselines
+ * on the host, run make bench in extras/test.
+ *******************************************************************************/
+
+#include <SeeeduinoLoRaWan.h>
+#include <LoRaWanFragment.h>
+#include <LoRaWanCompress.h>
+#include <LoRaWanAccumulator.h>
+#include <LoRaWanLog.h>
+LoRaWanClass lora;
+
+
+#define ROUNDS 100                                                // Repeat every measurement ROUNDS times
+
+// EU868 region setup, the numbers setEU868() puts into AT commands
+const unsigned long EU_868[8] = {868100000, 868300000, 868500000, 867100000, 867300000, 867500000, 867700000, 867900000};
+const float EU_868_MHZ[8] = {868.1, 868.3, 868.5, 867.1, 867.3, 867.5, 867.7, 867.9};
+
+char cmd[32];
+
+// Class B join, the longest response the library scans for several results
+const char BEACON_RESPONSE[] = "+CLASS: B\r\n+BEACON: ING\r\n+BEACON: PING, 128s\r\n+BEACON: RXWIN, 869525000, DR3\r\n"
+                               "+BEACON: LOCKED\r\n+BEACON: PING, 869525000, DR3\r\n+BEACON: DONE\r\n";
+
+// Fragmented block, every FRAGMENT_LOSS-th uncoded fragment is lost and rebuilt from coded ones
+#define FRAGMENT_COUNT  32
+#define FRAGMENT_SIZE   16
+#define FRAGMENT_LOSS   8
+uint8_t fragmentBuffer[FRAGMENT_COUNT * FRAGMENT_SIZE + FRAGMENT_SIZE + 8 + (FRAGMENT_COUNT / FRAGMENT_LOSS + 4) * 6];
+uint8_t coded[FRAGMENT_COUNT][FRAGMENT_SIZE];
+
+// Uplinks to compress, a text status line, CayenneLPP history of one sensor and noise
+const char TEXT_PAYLOAD[] = "temp=23.5,volt=3.71;temp=23.6,volt=3.70;temp=23.4,volt=3.71;temp=23.5,volt=3.69";
+const uint8_t LPP_PAYLOAD[] = {1, 0x67, 0x00, 0xEB, 2, 0x02, 0x01, 0x73, 1, 0x67, 0x00, 0xEC, 2, 0x02, 0x01, 0x72,
+                               1, 0x67, 0x00, 0xEB, 2, 0x02, 0x01, 0x72, 1, 0x67, 0x00, 0xEA, 2, 0x02, 0x01, 0x71};
+uint8_t noisePayload[48];
+
+// Store and forward log on a RAM stand-in of eight flash rows, an outage logs LOG_RECORDS uplinks
+#define LOG_RECORDS     48
+uint8_t logArea[8 * 256];
+//------------------------------------------------------------------------------
+
+
+void printResult(const char *name, unsigned long totalMicros) {
+    SerialUSB.print(name);
+    SerialUSB.print(": ");
+    SerialUSB.print(totalMicros / ROUNDS);
+    SerialUSB.println(" us");
+}
+
+
+void benchmarkRegionFormat() {                                    // Format all numeric fields of a full EU868 setup
+    unsigned long start = micros();
+
+    for(int round = 0; round < ROUNDS; round++) {
+        for(int i = 0; i < 8; i++) {
+            char *ptr = LoRaWanClass::formatNumber(cmd, i);
+            ptr = LoRaWanClass::formatFrequency(ptr, EU_868[i]);
+            ptr = LoRaWanClass::formatNumber(ptr, DR0);
+            LoRaWanClass::formatNumber(ptr, DR5);
+        }
+        LoRaWanClass::formatFrequency(cmd, 869525000);
+        LoRaWanClass::formatNumber(cmd, 0);
+        for(int i = 0; i < 4; i++) {
+            LoRaWanClass::formatNumber(cmd, i + 1);
+        }
+    }
+    printResult("Region setup, integer formatter", micros() - start);
+
+    start = micros();
+
+    for(int round = 0; round < ROUNDS; round++) {
+        for(int i = 0; i < 8; i++) {
+            sprintf(cmd, "AT+CH=%d,%.3f,%d,%d\r\n", i, EU_868_MHZ[i], DR0, DR5);
+        }
+        sprintf(cmd, "AT+RXWIN2=%.3f,%d\r\n", 869.525, DR0);
+        sprintf(cmd, "AT+POWER=%d\r\n", 0);
+        for(int i = 0; i < 4; i++) {
+            sprintf(cmd, "AT+DELAY=RX1,%d\r\n", i + 1);
+        }
+    }
+    printResult("Region setup, sprintf", micros() - start);
+}
+
+
+void benchmarkResponseMatch() {                                   // Three expected results, one response
+    volatile bool found = false;                                  // Keeps the compiler from dropping the loops
+    unsigned long start = micros();
+
+    for(int round = 0; round < ROUNDS; round++) {
+        LoRaWanMatcher matcher;
+        matcher.add("+BEACON: LOCKED", false);
+        matcher.add("+BEACON: FAILED");
+        matcher.add("+BEACON: DONE");
+
+        for(const char *ptr = BEACON_RESPONSE; *ptr; ptr++) {     // Byte by byte, as it arrives from the modem
+            matcher.feed(*ptr);
+        }
+        found = matcher.done();
+    }
+    printResult("Response check, streaming matcher", micros() - start);
+
+    start = micros();
+
+    for(int round = 0; round < ROUNDS; round++) {
+        found = strstr(BEACON_RESPONSE, "+BEACON: LOCKED") != NULL;
+        found = strstr(BEACON_RESPONSE, "+BEACON: FAILED") != NULL;
+        found = strstr(BEACON_RESPONSE, "+BEACON: DONE") != NULL;
+    }
+    printResult("Response check, strstr", micros() - start);
+
+    start = micros();
+
+    for(int round = 0; round < ROUNDS; round++) {
+        found = lora.containsSubstring(BEACON_RESPONSE, "+BEACON: DONE");
+    }
+    printResult("Response check, containsSubstring", micros() - start);
+}
+
+
+// Server side of TS004 fragmentation matrix 0, builds coded fragment n
+void codedFragment(unsigned short n, uint8_t *fragment) {
+    bool row[FRAGMENT_COUNT] = {false};
+    long x = 1 + 1001L * n;
+    long r;
+
+    for(int coefficient = 0; coefficient < FRAGMENT_COUNT / 2; coefficient++) {
+        do {
+            x = (x >> 1) + (((x & 0x01) ^ ((x >> 5) & 0x01)) << 22);
+            r = x % (FRAGMENT_COUNT + 1);                             // FRAGMENT_COUNT is a power of two
+        } while(r >= FRAGMENT_COUNT);
+        row[r] = true;                                                // A fragment drawn twice is still added once
+    }
+
+    memset(fragment, 0, FRAGMENT_SIZE);
+    for(int j = 0; j < FRAGMENT_COUNT; j++) {
+        for(int i = 0; row[j] && i < FRAGMENT_SIZE; i++) {
+            fragment[i] ^= (uint8_t)(j * FRAGMENT_SIZE + i);          // uncoded fragment j holds its own offsets
+        }
+    }
+}
+
+
+void benchmarkFragment() {                                        // Reassemble a block with lost fragments
+    uint8_t fragment[FRAGMENT_SIZE];
+    unsigned long total = 0;
+    unsigned short codedUsed = 0;
+    bool correct = true;
+
+    for(int n = 0; n < FRAGMENT_COUNT; n++) {                     // Coded fragments are built outside the measurement
+        codedFragment(n + 1, coded[n]);
+    }
+
+    for(int round = 0; round < ROUNDS; round++) {
+        LoRaWanFragment receiver(fragmentBuffer, sizeof(fragmentBuffer));
+        receiver.begin(FRAGMENT_COUNT, FRAGMENT_SIZE);
+
+        unsigned long start = micros();
+
+        for(int n = 1; n <= FRAGMENT_COUNT; n++) {
+            if(n % FRAGMENT_LOSS == 0)continue;
+            for(int i = 0; i < FRAGMENT_SIZE; i++) {
+                fragment[i] = (n - 1) * FRAGMENT_SIZE + i;
+            }
+            receiver.add(n, fragment);
+        }
+        for(codedUsed = 0; codedUsed < FRAGMENT_COUNT && !receiver.done(); codedUsed++) {
+            receiver.add(FRAGMENT_COUNT + codedUsed + 1, coded[codedUsed]);
+        }
+
+        total += micros() - start;
+
+        for(int i = 0; i < FRAGMENT_COUNT * FRAGMENT_SIZE; i++) {
+            if(receiver.getData()[i] != (uint8_t)i)correct = false;
+        }
+    }
+
+    printResult("Fragment block, 32 x 16 bytes, 4 lost", total);
+    SerialUSB.print("Coded fragments used: ");
+    SerialUSB.print(codedUsed);
+    SerialUSB.println(correct ? ", block correct" : ", block WRONG");
+}
+
+
+void benchmarkCompressPayload(const char *name, const uint8_t *payload, unsigned char length) {
+    uint8_t packed[COMPRESS_INPUT_MAX + 1];
+    uint8_t unpacked[COMPRESS_INPUT_MAX];
+    unsigned char packedLength = 0;
+    short unpackedLength = 0;
+
+    unsigned long start = micros();
+    for(int round = 0; round < ROUNDS; round++) {
+        packedLength = LoRaWanCompress::compress(payload, length, packed, sizeof(packed));
+    }
+    unsigned long packTime = micros() - start;
+
+    start = micros();
+    for(int round = 0; round < ROUNDS; round++) {
+        unpackedLength = LoRaWanCompress::decompress(packed, packedLength, unpacked, sizeof(unpacked));
+    }
+    unsigned long unpackTime = micros() - start;
+
+    SerialUSB.print(name);
+    SerialUSB.print(": ");
+    SerialUSB.print(length);
+    SerialUSB.print(" -> ");
+    SerialUSB.print(packedLength);
+    SerialUSB.print(" bytes, ");
+    SerialUSB.print(packed[0] == COMPRESS_LZSS ? "compressed" : "stored");
+    SerialUSB.println(unpackedLength == length && !memcmp(unpacked, payload, length) ? "" : ", WRONG");
+    SerialUSB.print("  compress ");
+    SerialUSB.print((float)packTime / ROUNDS / length);
+    SerialUSB.print(" us/byte, decompress ");
+    SerialUSB.print((float)unpackTime / ROUNDS / length);
+    SerialUSB.println(" us/byte");
+}
+
+
+void benchmarkCompress() {                                        // Ratio and speed on typical uplinks
+    unsigned long x = 1;
+
+    for(unsigned int i = 0; i < sizeof(noisePayload); i++) {
+        x = x * 1103515245UL + 12345;
+        noisePayload[i] = x >> 16;
+    }
+
+    benchmarkCompressPayload("Compress text status", (const uint8_t *)TEXT_PAYLOAD, sizeof(TEXT_PAYLOAD) - 1);
+    benchmarkCompressPayload("Compress CayenneLPP history", LPP_PAYLOAD, sizeof(LPP_PAYLOAD));
+    benchmarkCompressPayload("Compress random bytes", noisePayload, sizeof(noisePayload));
+}
+
+
+void benchmarkAccumulator() {                                     // One measurement tick, fixed point against float sums
+    volatile long sink = 0;                                       // Keeps the compiler from dropping the loops
+    LoRaWanAccumulator voltage;
+    unsigned long start = micros();
+
+    for(int round = 0; round < ROUNDS; round++) {
+        voltage.add(3700 + (round & 0x0F));
+    }
+    printResult("Accumulator tick, fixed point Welford", micros() - start);
+    sink = voltage.getStdDev();
+
+    float sum = 0.0;
+    float sumSquares = 0.0;
+    float samples = 0.0;
+    start = micros();
+
+    for(int round = 0; round < ROUNDS; round++) {
+        float value = (3700 + (round & 0x0F)) / 1000.0;
+        sum += value;
+        sumSquares += value * value;
+        samples++;
+    }
+    printResult("Accumulator tick, float sums", micros() - start);
+    sink = sum + sumSquares + samples;
+}
+
+
+void benchmarkLog() {                                             // Log an outage, then drain it in uplinks
+    LoRaWanRamStorage storage(logArea, sizeof(logArea));
+    LoRaWanLog log(storage, 0);
+    uint8_t batch[51];
+    unsigned int batches = 0;
+
+    memset(logArea, 0xFF, sizeof(logArea));
+    log.begin();                                                  // Blank storage, formats it
+
+    unsigned long start = micros();
+    for(int record = 0; record < LOG_RECORDS; record++) {
+        log.append(LPP_PAYLOAD, 11, record * 300UL);              // Three channels every 5 minutes
+    }
+    unsigned long appendTime = micros() - start;
+
+    start = micros();
+    unsigned char size;
+    while((size = log.pack(batch, sizeof(batch), LOG_RECORDS * 300UL)) != 0) {
+        log.commit(true, LOG_RECORDS * 300UL);
+        batches++;
+    }
+    unsigned long drainTime = micros() - start;
+
+    SerialUSB.print("Log append: ");
+    SerialUSB.print(appendTime / LOG_RECORDS);
+    SerialUSB.print(" us, write amplification ");
+    SerialUSB.print(log.getWriteAmplification());
+    SerialUSB.print(" %, ");
+    SerialUSB.print(log.getErases());
+    SerialUSB.print(" erases, ");
+    SerialUSB.print(log.getDropped());
+    SerialUSB.println(" dropped");
+    SerialUSB.print("Log drain: ");
+    SerialUSB.print(batches);
+    SerialUSB.print(" uplinks of 51 bytes, ");
+    SerialUSB.print(batches ? drainTime / batches : 0);
+    SerialUSB.println(" us each");
+}
+
+
+void benchmarkBoot() {                                            // Cold boot to the first uplink, with the modem
+    unsigned char payload[] = {0x01};
+
+    lora.init();
+
+    unsigned long start = millis();
+    long boot = lora.setDeviceReset();                            // Returns as soon as the modem answers a ping
+    unsigned long reset = millis() - start;
+
+    lora.setActivation(LWABP);                                    // No join, the uplink goes out with the keys the modem holds
+    lora.setEU868();
+    unsigned long setup = millis() - start;
+
+    bool sent = lora.transmitPacket(payload, sizeof(payload));
+    unsigned long firstUplink = millis() - start;
+
+    SerialUSB.print("Boot latency: ");
+    SerialUSB.print(boot);
+    SerialUSB.print(" ms, reset returned after ");
+    SerialUSB.print(reset);
+    SerialUSB.println(" ms");
+    SerialUSB.print("Region setup done: ");
+    SerialUSB.print(setup);
+    SerialUSB.println(" ms");
+    SerialUSB.print("Time to first uplink: ");
+    SerialUSB.print(firstUplink);
+    SerialUSB.println(sent ? " ms" : " ms, not sent");
+}
+
+
+void setup(void) {
+    SerialUSB.begin(9600);
+    while(!SerialUSB);
+
+    benchmarkBoot();
+
+    benchmarkRegionFormat();
+    benchmarkResponseMatch();
+    benchmarkFragment();
+    benchmarkCompress();
+    benchmarkAccumulator();
+    benchmarkLog();
+}
+
+
+void loop(void) {
+}
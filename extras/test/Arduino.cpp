@@ -0,0 +1,241 @@
+/*
+  Arduino.cpp
+  Host stand-in for the parts of the Arduino core the library uses
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include "Arduino.h"
+#include "HostModem.h"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+
+static const std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+
+// Serial1 is read by the owner task while test threads queue replies
+static std::recursive_mutex modemLock;
+static HostModem::answer_t modemAnswer;
+static std::string modemLine;
+static std::string modemSent;
+static std::string modemOutput;
+static size_t modemRead = 0;
+
+struct pending_t
+{
+    unsigned long at;
+    std::string text;
+};
+static std::vector<pending_t> modemPending;
+
+HardwareSerial Serial1;
+HardwareSerial SerialUSB;
+HardwareSerial Serial;
+
+
+unsigned long millis(void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - timeStart).count();
+}
+
+
+unsigned long micros(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - timeStart).count();
+}
+
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+
+void pinMode(int, int)
+{
+}
+
+
+int digitalRead(int)
+{
+    return HIGH;
+}
+
+
+int analogRead(int)
+{
+    return 105;                         // 3.73 V through the 11:1 divider
+}
+
+
+long random(long high)
+{
+    return high > 0 ? rand() % high : 0;
+}
+
+
+long random(long low, long high)
+{
+    return high > low ? low + rand() % (high - low) : low;
+}
+
+
+void randomSeed(unsigned long seed)
+{
+    srand(seed);
+}
+
+
+void noInterrupts(void)
+{
+}
+
+
+void interrupts(void)
+{
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t length)
+{
+    for(size_t i = 0; i < length; i ++)write(buffer[i]);
+    return length;
+}
+
+
+size_t Print::print(long value, int base)
+{
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lx" : "%ld", value);
+    return write(text);
+}
+
+
+size_t Print::print(unsigned long value, int base)
+{
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lx" : "%lu", value);
+    return write(text);
+}
+
+
+size_t Print::print(double value, int digits)
+{
+    char text[40];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write(text);
+}
+
+
+static void release(void)
+{
+    unsigned long now = millis();
+
+    for(size_t i = 0; i < modemPending.size();)
+    {
+        if((long)(now - modemPending[i].at) >= 0)
+        {
+            modemOutput += modemPending[i].text;
+            modemPending.erase(modemPending.begin() + i);
+        }
+        else i ++;
+    }
+}
+
+
+void HardwareSerial::begin(unsigned long)
+{
+}
+
+
+void HardwareSerial::end(void)
+{
+}
+
+
+int HardwareSerial::available(void)
+{
+    if(this != &Serial1)return 0;
+
+    std::lock_guard<std::recursive_mutex> guard(modemLock);
+    release();
+    return modemOutput.size() - modemRead;
+}
+
+
+int HardwareSerial::read(void)
+{
+    std::lock_guard<std::recursive_mutex> guard(modemLock);
+
+    if(this != &Serial1 || modemRead >= modemOutput.size())return -1;
+    return (uint8_t)modemOutput[modemRead ++];
+}
+
+
+int HardwareSerial::peek(void)
+{
+    std::lock_guard<std::recursive_mutex> guard(modemLock);
+
+    if(this != &Serial1 || modemRead >= modemOutput.size())return -1;
+    return (uint8_t)modemOutput[modemRead];
+}
+
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    if(this != &Serial1)
+    {
+        if(getenv("HOST_VERBOSE"))putchar(c);
+        return 1;
+    }
+
+    std::lock_guard<std::recursive_mutex> guard(modemLock);
+
+    modemSent += (char)c;
+    modemLine += (char)c;
+    if(c == '\n')
+    {
+        std::string line = modemLine;
+
+        modemLine.clear();
+        if(modemAnswer)modemAnswer(line);
+    }
+    return 1;
+}
+
+
+void HostModem::setAnswer(answer_t answer)
+{
+    std::lock_guard<std::recursive_mutex> guard(modemLock);
+    modemAnswer = answer;
+}
+
+
+void HostModem::reply(unsigned long delay, const std::string &text)
+{
+    std::lock_guard<std::recursive_mutex> guard(modemLock);
+    modemPending.push_back({millis() + delay, text});
+}
+
+
+const std::string &HostModem::sent(void)
+{
+    return modemSent;
+}
+
+
+void HostModem::reset(void)
+{
+    std::lock_guard<std::recursive_mutex> guard(modemLock);
+
+    modemAnswer = NULL;
+    modemLine.clear();
+    modemSent.clear();
+    modemOutput.clear();
+    modemRead = 0;
+    modemPending.clear();
+}
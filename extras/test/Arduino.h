@@ -0,0 +1,101 @@
+/*
+  Arduino.h
+  Host stand-in for the parts of the Arduino core the library uses
+
+  Time is the host clock. Serial1 is a scripted modem, see HostModem.h,
+  SerialUSB prints to stdout when HOST_VERBOSE is set in the environment.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+
+#define INPUT   0
+#define OUTPUT  1
+#define LOW     0
+#define HIGH    1
+#define DEC     10
+#define HEX     16
+#define A4      18
+#define A5      19
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+int analogRead(int pin);
+long random(long high);
+long random(long low, long high);
+void randomSeed(unsigned long seed);
+void noInterrupts(void);
+void interrupts(void);
+
+
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t length);
+        size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+        size_t write(const char *buffer, size_t length) { return write((const uint8_t *)buffer, length); }
+        virtual void flush(void) {}
+
+        size_t print(const char *text) { return write(text); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(int value, int base = DEC) { return print((long)value, base); }
+        size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+        size_t print(long value, int base = DEC);
+        size_t print(unsigned long value, int base = DEC);
+        size_t print(double value, int digits = 2);
+
+        size_t println(void) { return write("\r\n"); }
+        template<class T> size_t println(T value) { return print(value) + println(); }
+        template<class T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+
+class Stream : public Print
+{
+    public:
+        virtual int available(void) = 0;
+        virtual int read(void) = 0;
+        virtual int peek(void) = 0;
+};
+
+
+class HardwareSerial : public Stream
+{
+    public:
+        void begin(unsigned long baud);
+        void end(void);
+        int available(void);
+        int read(void);
+        int peek(void);
+        size_t write(uint8_t c);
+        using Print::write;
+        operator bool(void) { return true; }
+};
+
+extern HardwareSerial Serial1;
+extern HardwareSerial SerialUSB;
+extern HardwareSerial Serial;
+
+
+#endif
@@ -0,0 +1,30 @@
+/*
+  HostCheck.h
+  Minimal checks for the host tests, a failed check is printed and counted
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _HOSTCHECK_H_
+#define _HOSTCHECK_H_
+
+
+#include <stdio.h>
+
+
+static int hostFailures = 0;
+
+#define CHECK(condition) \
+    do { if(!(condition)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); hostFailures ++; } } while(0)
+
+// Exit code of a test, 0 : every check passed
+static inline int hostReport(const char *name)
+{
+    printf("%s: %s\n", name, hostFailures ? "FAIL" : "pass");
+    return hostFailures ? 1 : 0;
+}
+
+
+#endif
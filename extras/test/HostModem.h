@@ -0,0 +1,40 @@
+/*
+  HostModem.h
+  Scripted RHF76-052 behind the host Serial1
+
+  Every command line the library writes is handed to the answer callback,
+  which queues the modem output with reply(). Replies become readable
+  after their delay, as bytes arriving on the UART.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#ifndef _HOSTMODEM_H_
+#define _HOSTMODEM_H_
+
+
+#include <functional>
+#include <string>
+
+
+namespace HostModem
+{
+    typedef std::function<void(const std::string &line)> answer_t;
+
+    // Called with every line written to Serial1, "\r\n" included
+    void setAnswer(answer_t answer);
+
+    // Queue modem output, readable delay millisecond from now
+    void reply(unsigned long delay, const std::string &text);
+
+    // Everything written to Serial1 so far
+    const std::string &sent(void);
+
+    // Drop queued output, the written log and the answer callback
+    void reset(void);
+}
+
+
+#endif
@@ -0,0 +1,472 @@
+/*
+  benchmark.cpp
+  Parser and encoder paths of the library against baselines, run by make bench
+
+  Every path runs on payloads of 1 to 242 bytes against a modem stand-in
+  that answers at once, only the CPU time of encoding and parsing is left.
+  A result is the fastest of BENCH_RUNS runs, printed in ns per byte and
+  gated as a cost in reference loops per byte: a fixed hex decode measured
+  next to it takes out the speed of the machine and of its clock of the
+  moment. Each path is gated at every size. A cost above its baseline by
+  more than GATE_TOLERANCE percent in every one of BENCH_ATTEMPTS attempts
+  fails the run, a wrong result or a heap allocation fails it at once.
+
+  The code size gate takes the text and data of the library objects built
+  with -Os, the Makefile passes the sum. The host compiler only stands in
+  for the board one, the gate watches for growth, not for the flash left.
+
+  Baselines are the median of twelve reference runs, gcc 12 -O2 on x86-64.
+  After a change that is meant to cost time or flash, put the printed
+  values in.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <chrono>
+#include <stdlib.h>
+#include "HostCheck.h"
+
+
+#define BENCH_RUNS      51          // the fastest run is taken, the others met the scheduler
+#define PATH_ROUNDS     50          // calls in one run
+#define WARM_UP         300         // millisecond of spinning before the first run, the clock ramps up
+#define BENCH_ATTEMPTS  3           // a gate fails when it misses its baseline in every attempt
+#define GATES_MAX       32
+#define SIZES           6
+
+#ifndef GATE_TOLERANCE
+#define GATE_TOLERANCE  25          // percent, make bench GATE_TOLERANCE=50 on a loaded machine
+#endif
+#define SIZE_TOLERANCE  2           // percent, the code size does not vary from run to run
+
+// One byte, the DR0 limits of US915 and EU868, DR3 and DR4 of EU868, the largest
+static const unsigned char PAYLOAD_SIZES[SIZES] = {1, 11, 51, 115, 222, 242};
+
+// Baselines in reference loops a byte, at each size of PAYLOAD_SIZES
+static const double BASELINE_HEX_ENCODE[SIZES]   = {1987.4, 182.7, 44.9, 23.9, 14.3, 14.6};
+static const double BASELINE_HEX_COMPACT[SIZES]  = {768.0, 82.8, 27.9, 20.6, 17.4, 16.9};
+static const double BASELINE_HEX_SPACED[SIZES]   = {749.0, 87.9, 34.9, 26.2, 22.8, 22.1};
+
+// Baselines in reference loops a byte of response
+#define BASELINE_MATCHER            4.9
+#define BASELINE_CONTAINS           4.4
+#define BASELINE_TEMPERATURE        46.2
+#define BASELINE_TEMPERATURE_DECI   47.6
+
+#define BASELINE_CODE_SIZE          47219   // bytes of text and data, library objects at -Os
+
+// Class B join, the longest response the library scans for several results
+static const char BEACON_RESPONSE[] = "+CLASS: B\r\n+BEACON: ING\r\n+BEACON: PING, 128s\r\n+BEACON: RXWIN, 869525000, DR3\r\n"
+                                      "+BEACON: LOCKED\r\n+BEACON: PING, 869525000, DR3\r\n+BEACON: DONE\r\n";
+static const char TEMP_RESPONSE[] = "+TEMP: 26.5\r\n";
+
+static uint8_t benchPayload[242];
+static char benchBuffer[1024];      // takes a spaced downlink of 242 bytes
+static char downlinkAnswer[1024];
+static unsigned int failures = 0;          // wrong results and allocations, never measured again
+static unsigned int gate = 0;               // the next gate of this attempt
+static unsigned char gateMisses[GATES_MAX];
+static unsigned long allocations = 0;
+
+
+// Every allocation on the heap is counted, operator new included
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    allocations ++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations ++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocations ++;
+    return __libc_realloc(ptr, size);
+}
+
+
+// Modem stand-in, answers every command line at once with the text set last
+class BenchModem : public Stream
+{
+    public:
+        void setAnswer(const char *answer)
+        {
+            _answer = answer;
+            _length = strlen(answer);
+            _left = 0;
+        }
+
+        size_t getWritten(void)
+        {
+            return _written;
+        }
+
+        virtual int available(void)
+        {
+            return _left;
+        }
+
+        virtual int read(void)
+        {
+            if(!_left)return -1;
+            _left --;
+            return (uint8_t)*_next ++;
+        }
+
+        virtual int peek(void)
+        {
+            return _left ? (uint8_t)*_next : -1;
+        }
+
+        virtual size_t write(uint8_t c)
+        {
+            _written ++;
+            if(c == '\n')
+            {
+                // End of a command, the answer follows
+                _next = _answer;
+                _left = _length;
+            }
+            return 1;
+        }
+        using Print::write;
+
+    private:
+        const char *_answer = "";
+        const char *_next = "";
+        size_t _length = 0;
+        size_t _left = 0;
+        size_t _written = 0;
+};
+
+static BenchModem modem;
+LoRaWanClass lora;
+
+
+static uint64_t now(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// A hex decode and a scan outside the library, the yardstick for the machine and its state of the moment.
+// It branches and loads like the paths do, a loop of arithmetic alone is slowed differently.
+static double reference(void)
+{
+    static char text[1024];
+    static uint8_t bytes[sizeof(text) / 2];
+    static const char pattern[] = "DONE";
+    uint64_t fastest = ~0ULL;
+    volatile unsigned int sink;
+
+    if(!text[0])for(unsigned int i = 0; i < sizeof(text); i ++)text[i] = "0123456789ABCDEF"[(i * 7 + i / 16) & 0x0F];
+
+    for(int run = 0; run < BENCH_RUNS; run ++)
+    {
+        uint64_t timerStart = now();
+        unsigned int matched = 0, found = 0;
+        uint8_t byte = 0;
+
+        for(unsigned int i = 0; i < sizeof(text); i ++)
+        {
+            char c = text[i];
+            uint8_t nibble = c <= '9' ? c - '0' : c - 'A' + 10;
+
+            if(i & 1)bytes[i / 2] = byte | nibble;
+            else byte = nibble << 4;
+
+            if(c == pattern[matched])
+            {
+                if(!pattern[++ matched])found ++, matched = 0;
+            }
+            else matched = c == pattern[0];
+        }
+        sink = found + bytes[found & 0xFF];
+
+        uint64_t elapsed = now() - timerStart;
+        if(elapsed < fastest)fastest = elapsed;
+    }
+    (void)sink;
+
+    return (double)fastest / sizeof(text);
+}
+
+
+static bool checkGate(const char *name, double value, double baseline, unsigned int tolerance = GATE_TOLERANCE)
+{
+    bool pass = baseline && value <= baseline * (100 + tolerance) / 100;
+
+    printf("  gate %s: %.1f", name, value);
+    if(!baseline)printf(", FAIL, no baseline recorded\n");
+    else printf(", %s, baseline %.1f\n", pass ? "pass" : "FAIL", baseline);
+
+    return pass;
+}
+
+
+// A gate of the paths, the attempts add up its misses
+static void checkPathGate(const char *name, double value, double baseline)
+{
+    if(!checkGate(name, value, baseline) && gate < GATES_MAX)gateMisses[gate] ++;
+    gate ++;
+}
+
+
+// One size of a path, a wrong result or an allocation fails the run.
+// Returns the cost per byte in reference loops, the machine and its clock cancel out.
+static double printPath(const char *name, unsigned int bytes, uint64_t fastest, unsigned long allocated, bool correct)
+{
+    double nsPerByte = (double)fastest / PATH_ROUNDS / bytes;
+    double cost = nsPerByte / reference();
+
+    printf("%s, %u bytes: %lu ns, %.1f ns/byte, %.1f x reference, %lu allocations%s\n", name, bytes,
+           (unsigned long)(fastest / PATH_ROUNDS), nsPerByte, cost, allocated, correct ? "" : ", WRONG");
+
+    if(allocated || !correct)failures ++;
+    return cost;
+}
+
+
+static void benchmarkHexEncode(void)
+{
+    modem.setAnswer("+VER: 2.1.15\r\n");
+    lora.init(modem);
+    modem.setAnswer("+MSGHEX: Start\r\n+MSGHEX: Done\r\n");
+
+    for(int n = 0; n < SIZES; n ++)
+    {
+        unsigned char size = PAYLOAD_SIZES[n];
+        uint64_t fastest = ~0ULL;
+        bool correct = lora.transmitPacket(benchPayload, size);     // warm up
+        unsigned long allocated = allocations;
+        size_t written = modem.getWritten();
+
+        for(int run = 0; run < BENCH_RUNS; run ++)
+        {
+            uint64_t timerStart = now();
+            for(int round = 0; round < PATH_ROUNDS; round ++)correct &= lora.transmitPacket(benchPayload, size);
+            uint64_t elapsed = now() - timerStart;
+            if(elapsed < fastest)fastest = elapsed;
+        }
+
+        // AT+MSGHEX=" and "\r\n around two digits a byte
+        correct &= modem.getWritten() - written == BENCH_RUNS * PATH_ROUNDS * (14UL + 2 * size);
+        double nsPerByte = printPath("Uplink hex encode", size, fastest, allocations - allocated, correct);
+        checkPathGate("hex encode ns/byte", nsPerByte, BASELINE_HEX_ENCODE[n]);
+    }
+}
+
+
+// Uplink answer with a downlink, as the modem prints it, "0102" on 2.1.x or "01 02" on 2.0.x
+static void buildDownlink(unsigned char size, bool spaced)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    char *ptr = downlinkAnswer;
+
+    strcpy(ptr, "+MSGHEX: Start\r\n+MSGHEX: PORT: 1; RX: \"");
+    ptr += strlen(ptr);
+
+    for(unsigned char i = 0; i < size; i ++)
+    {
+        if(spaced && i)*ptr ++ = ' ';
+        *ptr ++ = hexDigits[benchPayload[i] >> 4];
+        *ptr ++ = hexDigits[benchPayload[i] & 0x0F];
+    }
+
+    strcpy(ptr, "\"\r\n+MSGHEX: RXWIN1, RSSI -106, SNR 4.5\r\n+MSGHEX: Done\r\n");
+}
+
+
+static void benchmarkHexDecode(const char *name, const char *version, bool spaced, const double *baselines)
+{
+    LoRaWanPayload payload;
+
+    // The version picks the downlink format
+    modem.setAnswer(version);
+    lora.init(modem);
+    lora.setBuffer(benchBuffer, sizeof(benchBuffer));
+
+    for(int n = 0; n < SIZES; n ++)
+    {
+        unsigned char size = PAYLOAD_SIZES[n];
+        uint64_t fastest = ~0ULL;
+        bool correct = true;
+
+        buildDownlink(size, spaced);
+        modem.setAnswer(downlinkAnswer);
+        lora.transmitPacket(benchPayload, 1);                       // warm up
+        lora.receivePacket(&payload);
+        unsigned long allocated = allocations;
+
+        for(int run = 0; run < BENCH_RUNS; run ++)
+        {
+            uint64_t total = 0;
+
+            for(int round = 0; round < PATH_ROUNDS; round ++)
+            {
+                // Outside the measurement, fills the response buffer
+                lora.transmitPacket(benchPayload, 1);
+                uint64_t timerStart = now();
+                lora.receivePacket(&payload);
+                total += now() - timerStart;
+
+                if(payload.length != size || payload.rssi != -106 || memcmp(payload.data, benchPayload, size))correct = false;
+            }
+            if(total < fastest)fastest = total;
+        }
+
+        double nsPerByte = printPath(name, size, fastest, allocations - allocated, correct);
+        checkPathGate(spaced ? "hex decode 2.0.x ns/byte" : "hex decode 2.1.x ns/byte", nsPerByte, baselines[n]);
+    }
+}
+
+
+// Three ways to find a result in the longest response, one of them as the bytes arrive
+static void benchmarkResponseMatch(void)
+{
+    unsigned int bytes = strlen(BEACON_RESPONSE);
+    uint64_t fastest[3] = {~0ULL, ~0ULL, ~0ULL};
+    bool correct[3] = {true, true, true};
+    unsigned long allocated[3] = {0, 0, 0};
+
+    for(int run = 0; run < BENCH_RUNS; run ++)
+    {
+        unsigned long allocatedStart = allocations;
+        uint64_t timerStart = now();
+        for(int round = 0; round < PATH_ROUNDS; round ++)
+        {
+            LoRaWanMatcher matcher;
+            short locked = matcher.add("+BEACON: LOCKED", false);
+            matcher.add("+BEACON: FAILED");
+            matcher.add("+BEACON: DONE");
+
+            for(const char *ptr = BEACON_RESPONSE; *ptr; ptr ++)matcher.feed(*ptr);
+            correct[0] &= matcher.done() && matcher.matched(locked);
+        }
+        uint64_t elapsed = now() - timerStart;
+        if(elapsed < fastest[0])fastest[0] = elapsed;
+        allocated[0] += allocations - allocatedStart;
+
+        allocatedStart = allocations;
+        timerStart = now();
+        for(int round = 0; round < PATH_ROUNDS; round ++)correct[1] &= lora.containsSubstring(BEACON_RESPONSE, "+BEACON: DONE");
+        elapsed = now() - timerStart;
+        if(elapsed < fastest[1])fastest[1] = elapsed;
+        allocated[1] += allocations - allocatedStart;
+
+        // volatile keeps the compiler from folding the search of a constant
+        allocatedStart = allocations;
+        timerStart = now();
+        for(int round = 0; round < PATH_ROUNDS; round ++)
+        {
+            const char *volatile response = BEACON_RESPONSE;
+            correct[2] &= strstr(response, "+BEACON: LOCKED") != NULL && strstr(response, "+BEACON: FAILED") == NULL &&
+                          strstr(response, "+BEACON: DONE") != NULL;
+        }
+        elapsed = now() - timerStart;
+        if(elapsed < fastest[2])fastest[2] = elapsed;
+        allocated[2] += allocations - allocatedStart;
+    }
+
+    checkPathGate("matcher ns/byte", printPath("Response check, streaming matcher", bytes, fastest[0], allocated[0], correct[0]),
+              BASELINE_MATCHER);
+    checkPathGate("containsSubstring ns/byte", printPath("Response check, containsSubstring", bytes, fastest[1], allocated[1], correct[1]),
+              BASELINE_CONTAINS);
+    // The C library search, for comparison only, it is not the library's code to gate
+    printPath("Response check, strstr", bytes, fastest[2], allocated[2], correct[2]);
+}
+
+
+// sscanf against the fixed point parser
+static void benchmarkTemperature(void)
+{
+    unsigned int bytes = strlen(TEMP_RESPONSE);
+    uint64_t fastest[2] = {~0ULL, ~0ULL};
+    bool correct[2] = {true, true};
+
+    modem.setAnswer("+VER: 2.1.15\r\n");
+    lora.init(modem);
+    modem.setAnswer(TEMP_RESPONSE);
+
+    lora.getModuleTemperatureC();                                   // warm up
+    lora.getModuleTemperatureDeciC();
+    unsigned long allocated[2] = {allocations, 0};
+
+    for(int run = 0; run < BENCH_RUNS; run ++)
+    {
+        uint64_t timerStart = now();
+        for(int round = 0; round < PATH_ROUNDS; round ++)correct[0] &= lora.getModuleTemperatureC() == 26.5f;
+        uint64_t elapsed = now() - timerStart;
+        if(elapsed < fastest[0])fastest[0] = elapsed;
+    }
+    allocated[0] = allocations - allocated[0];
+
+    allocated[1] = allocations;
+    for(int run = 0; run < BENCH_RUNS; run ++)
+    {
+        uint64_t timerStart = now();
+        for(int round = 0; round < PATH_ROUNDS; round ++)correct[1] &= lora.getModuleTemperatureDeciC() == 265;
+        uint64_t elapsed = now() - timerStart;
+        if(elapsed < fastest[1])fastest[1] = elapsed;
+    }
+    allocated[1] = allocations - allocated[1];
+
+    checkPathGate("temperature ns/byte", printPath("Temperature, sscanf", bytes, fastest[0], allocated[0], correct[0]),
+              BASELINE_TEMPERATURE);
+    checkPathGate("temperature deci ns/byte", printPath("Temperature, fixed point", bytes, fastest[1], allocated[1], correct[1]),
+              BASELINE_TEMPERATURE_DECI);
+}
+
+
+int main(int argc, char **argv)
+{
+    for(unsigned int i = 0; i < sizeof(benchPayload); i ++)benchPayload[i] = i * 37 + 11;
+
+    for(uint64_t timerStart = now(); now() - timerStart < WARM_UP * 1000000ULL; );
+
+    // A gate missed once may have met a busy machine, it is measured again
+    unsigned int missed = 0;
+    for(int attempt = 1; attempt <= BENCH_ATTEMPTS; attempt ++)
+    {
+        if(attempt > 1)printf("\nAttempt %d of %d, %u gates missed every attempt so far\n", attempt, BENCH_ATTEMPTS, missed);
+        gate = 0;
+
+        benchmarkHexEncode();
+        benchmarkHexDecode("Downlink hex decode, 2.1.x", "+VER: 2.1.15\r\n", false, BASELINE_HEX_COMPACT);
+        benchmarkHexDecode("Downlink hex decode, 2.0.x", "+VER: 2.0.10\r\n", true, BASELINE_HEX_SPACED);
+        benchmarkResponseMatch();
+        benchmarkTemperature();
+
+        missed = 0;
+        for(unsigned int i = 0; i < gate && i < GATES_MAX; i ++)if(gateMisses[i] == attempt)missed ++;
+        if(!missed)break;
+    }
+
+    if(argc > 1)
+    {
+        unsigned long size = strtoul(argv[1], NULL, 10);
+        printf("Code size: %lu bytes\n", size);
+        if(!checkGate("code size", size, BASELINE_CODE_SIZE, SIZE_TOLERANCE))failures ++;
+    }
+    else
+    {
+        printf("Code size: not given, run by make bench\n");
+        failures ++;
+    }
+
+    printf("Gates failed: %u, wrong or allocating paths and code size: %u\n", missed, failures);
+    CHECK(missed == 0 && failures == 0);
+
+    return hostReport("benchmark");
+}
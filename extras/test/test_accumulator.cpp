@@ -0,0 +1,125 @@
+/*
+  test_accumulator.cpp
+  Fixed point Welford statistics against a two pass reference in double
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <LoRaWanAccumulator.h>
+#include "HostCheck.h"
+#include <math.h>
+#include <stdlib.h>
+
+
+struct reference_t
+{
+    double mean;
+    double variance;
+    long minimum;
+    long maximum;
+};
+
+
+static reference_t reference(const long *values, unsigned long count)
+{
+    reference_t result = {0, 0, values[0], values[0]};
+
+    for(unsigned long i = 0; i < count; i ++)
+    {
+        result.mean += values[i];
+        if(values[i] < result.minimum)result.minimum = values[i];
+        if(values[i] > result.maximum)result.maximum = values[i];
+    }
+    result.mean /= count;
+
+    for(unsigned long i = 0; i < count; i ++)result.variance += (values[i] - result.mean) * (values[i] - result.mean);
+    result.variance /= count - 1;
+
+    return result;
+}
+
+
+static void compare(const char *name, const long *values, unsigned long count)
+{
+    LoRaWanAccumulator accumulator;
+    reference_t expected = reference(values, count);
+
+    for(unsigned long i = 0; i < count; i ++)accumulator.add(values[i]);
+
+    printf("%s: mean %ld (%.2f), variance %lu (%.2f), deviation %lu (%.2f)\n", name, accumulator.getMean(), expected.mean,
+           accumulator.getVariance(), expected.variance, accumulator.getStdDev(), sqrt(expected.variance));
+
+    CHECK(accumulator.getCount() == count && accumulator.getSamples() == count);
+    CHECK(accumulator.getMin() == expected.minimum && accumulator.getMax() == expected.maximum);
+    CHECK(fabs(accumulator.getMean() - expected.mean) <= 1);
+
+    // Rounding of the mean on every step stays within a part in a thousand, or one unit
+    double tolerance = expected.variance / 1000 + 1;
+    CHECK(fabs(accumulator.getVariance() - expected.variance) <= tolerance);
+    CHECK(fabs(accumulator.getStdDev() - sqrt(expected.variance)) <= 1);
+}
+
+
+static void testReference(void)
+{
+    static long values[5000];
+
+    // Battery voltage in millivolt, a slow sag and noise
+    srand(3);
+    for(unsigned long i = 0; i < 5000; i ++)values[i] = 4100 - i / 20 + rand() % 41 - 20;
+    compare("battery", values, 5000);
+
+    // Temperature in tenth degree around zero, the mean goes negative
+    for(unsigned long i = 0; i < 1000; i ++)values[i] = -35 + rand() % 61;
+    compare("temperature", values, 1000);
+
+    // A large offset with a tiny spread, where sum of squares loses it
+    for(unsigned long i = 0; i < 1000; i ++)values[i] = 1000000 + (i & 1 ? 3 : -3);
+    compare("offset", values, 1000);
+
+    // Known textbook values, mean 5, sample variance 32 / 7
+    const long textbook[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    compare("textbook", textbook, 8);
+}
+
+
+static void testDecimation(void)
+{
+    LoRaWanAccumulator average(4, DECIMATE_AVERAGE);
+    LoRaWanAccumulator pick(4, DECIMATE_PICK);
+
+    for(long i = 0; i < 16; i ++)
+    {
+        long value = i == 9 ? 1000 : i;     // one spike
+        average.add(value);
+        pick.add(value);
+    }
+
+    // Four statistics samples each, the spike still in the extremes
+    CHECK(average.getSamples() == 16 && average.getCount() == 4);
+    CHECK(pick.getCount() == 4);
+    CHECK(average.getMax() == 1000 && pick.getMax() == 1000);
+
+    // Blocks averaged to 2, 6, 257 and 14, picks of 0, 4, 8 and 12
+    CHECK(average.getMean() == 70);
+    CHECK(pick.getMean() == 6);
+
+    uint8_t record[ACCUMULATOR_RECORD_LENGTH];
+    CHECK(pick.encode(record) == ACCUMULATOR_RECORD_LENGTH);
+    CHECK(record[0] == 0 && record[1] == 4);
+    CHECK(record[4] == (1000 >> 8) && record[5] == (1000 & 0xFF));
+
+    pick.clear();
+    CHECK(pick.getCount() == 0 && pick.getVariance() == 0 && pick.getStdDev() == 0);
+}
+
+
+int main(void)
+{
+    testReference();
+    testDecimation();
+
+    return hostReport("test_accumulator");
+}
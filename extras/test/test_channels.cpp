@@ -0,0 +1,85 @@
+/*
+  test_channels.cpp
+  Channel steering of confirmed uplinks and the outcome booked per channel
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+LoRaWanClass lora;
+LoRaWanChannels channels;
+static bool ackNext = true;
+
+
+static size_t count(const std::string &text, const char *needle)
+{
+    size_t number = 0;
+    for(size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1))number ++;
+    return number;
+}
+
+
+int main(void)
+{
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+CH=") == 0)HostModem::reply(15, "+CH: " + line.substr(6));
+        else if(line.find("AT+MSGHEX") == 0)
+        {
+            // A downlink heard after an unconfirmed uplink
+            HostModem::reply(5, "+MSGHEX: Start\r\n+MSGHEX: RXWIN1, RSSI -70, SNR 5.0\r\n+MSGHEX: Done\r\n");
+        }
+        else if(line.find("AT+CMSGHEX") == 0)
+        {
+            HostModem::reply(5, ackNext ? "+CMSGHEX: Start\r\n+CMSGHEX: ACK Received\r\n+CMSGHEX: RXWIN1, RSSI -80, SNR 5.0\r\n+CMSGHEX: Done\r\n"
+                                        : "+CMSGHEX: Start\r\n+CMSGHEX: RXWIN1, RSSI -95, SNR 1.0\r\n+CMSGHEX: Done\r\n");
+        }
+    });
+    lora.init();
+
+    lora.setChannelStats(&channels);
+    lora.setChannelHz(0, 868100000UL, DR0, DR5);
+    lora.setChannelHz(1, 868300000UL, DR0, DR5);
+    lora.setChannelHz(2, 868500000UL, DR0, DR5);
+
+    unsigned char data[1] = {0x01};
+    size_t sent = HostModem::sent().size();
+
+    // Unconfirmed uplinks are not steered and book nothing
+    CHECK(lora.transmitPacket(data, sizeof(data)));
+    CHECK(count(HostModem::sent().substr(sent), "AT+CH=") == 0);
+    for(unsigned char i = 0; i < 3; i ++)CHECK(channels.getSent(i) == 0);
+
+    // A confirmed uplink enables one channel, the AT+CH answers end each wait early
+    sent = HostModem::sent().size();
+    unsigned long timerStart = millis();
+    CHECK(lora.transmitPacketWithConfirmed(data, sizeof(data)));
+    unsigned long elapsed = millis() - timerStart;
+
+    CHECK(count(HostModem::sent().substr(sent), "AT+CH=") == 3);
+    CHECK(elapsed < 3 * DEFAULT_DEBUGTIME);
+
+    short first = -1;
+    for(unsigned char i = 0; i < 3; i ++)if(channels.getAcked(i))first = i;
+    CHECK(first >= 0 && channels.getRssi(first) == -80);
+
+    // A downlink without acknowledge is a failure, not a delivery
+    ackNext = false;
+    CHECK(!lora.transmitPacketWithConfirmed(data, sizeof(data)));
+
+    unsigned short acked = 0, failed = 0;
+    for(unsigned char i = 0; i < 3; i ++)
+    {
+        acked += channels.getAcked(i);
+        failed += channels.getFailed(i);
+    }
+    CHECK(acked == 1 && failed == 1);
+
+    return hostReport("test_channels");
+}
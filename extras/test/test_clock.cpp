@@ -0,0 +1,218 @@
+/*
+  test_clock.cpp
+  Network time against a simulated local timebase that runs slow
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <LoRaWanClock.h>
+#include <stdlib.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+#define LOCAL_SLOW_PPM  100                 // the simulated local clock loses 100 us a second
+#define GPS_START       1417774548000ULL    // millisecond, 9. 12. 2024
+
+LoRaWanClass lora;
+
+
+// Local clock reading at a true time, both in millisecond from the start
+static unsigned long localAt(uint64_t trueTime)
+{
+    return 5000 + trueTime - trueTime * LOCAL_SLOW_PPM / 1000000;
+}
+
+
+// A DeviceTimeAns for an uplink ending at a true time, and the local time the call returned
+static LoRaWanDeviceTime answerAt(uint64_t trueTime, unsigned long *now)
+{
+    LoRaWanDeviceTime answer;
+    uint64_t gps = GPS_START + trueTime;
+
+    answer.gpsSeconds = gps / 1000;
+    answer.milliseconds = gps % 1000;
+    answer.window = 1;
+    answer.dataRate = 5;
+    answer.downlinkLength = LORAWAN_FRAME_OVERHEAD - 1 + 6;
+    answer.tailBytes = 60;
+
+    unsigned long delay = CLOCK_RX1_DELAY + LoRaWanEnergy::getAirtime(answer.downlinkLength, answer.dataRate) + 60 * CLOCK_UART_BYTE / 1000;
+    *now = localAt(trueTime + delay);
+
+    return answer;
+}
+
+
+static void testSync(LoRaWanClock &clock)
+{
+    unsigned long now;
+    LoRaWanDeviceTime answer;
+
+    CHECK(!clock.isSynced() && clock.getGpsTime(1000) == 0);
+
+    answer = answerAt(0, &now);
+    CHECK(clock.sync(&answer, now));
+    CHECK(clock.getGpsTime(now) == (GPS_START + now - localAt(0)) / 1000);
+    CHECK(clock.getUnixTime(now) == clock.getGpsTime(now) + CLOCK_GPS_UNIX - CLOCK_LEAP_SECONDS);
+
+    // Two hours later the slow clock is 720 ms behind, the rate comes out of it
+    answer = answerAt(7200000ULL, &now);
+    CHECK(clock.sync(&answer, now));
+    printf("after 2 h: error %ld ms, drift %ld ppm\n", clock.getLastError(), clock.getDrift());
+    CHECK(labs(clock.getLastError() - 720) <= 2);
+    CHECK(labs(clock.getDrift() - LOCAL_SLOW_PPM) <= 1);
+    CHECK(clock.getDriftRejects() == 0);
+
+    // Corrected by the rate, the next sync finds it nearly right
+    answer = answerAt(14400000ULL, &now);
+    CHECK(clock.sync(&answer, now));
+    printf("after 4 h: error %ld ms\n", clock.getLastError());
+    CHECK(labs(clock.getLastError()) <= 2);
+    CHECK(clock.getSyncs() == 3);
+}
+
+
+// A scheduler timebase through minute sleeps on a one second RTC. The old
+// sleep callback armed the alarm from the truncated epoch and reported the
+// part of a second already gone as slept, the fixed one starts on the edge.
+struct timebase_t
+{
+    uint64_t trueTime;
+    unsigned long local;
+};
+
+static void sleepCycle(timebase_t &time, bool onEdge)
+{
+    unsigned long awake = 480;      // a measurement and an uplink, millis() counts it
+    unsigned long ms = 60000 - awake;
+
+    time.trueTime += awake;
+    time.local += awake;
+
+    uint64_t start = time.trueTime / 1000;
+    if(onEdge)
+    {
+        unsigned long wait = (start + 1) * 1000 - time.trueTime;
+        time.trueTime += wait;
+        time.local += wait;
+        ms -= wait;
+        start ++;
+    }
+
+    unsigned long seconds = ms / 1000;
+    time.trueTime = (start + seconds) * 1000;   // the alarm wakes on its second edge
+    time.local += seconds * 1000;               // what the callback reports
+}
+
+
+static bool syncAt(LoRaWanClock &clock, const timebase_t &time)
+{
+    unsigned long now;
+    LoRaWanDeviceTime answer = answerAt(time.trueTime, &now);
+
+    // The delay behind the uplink passes on the timebase as it is
+    now = time.local + (now - localAt(time.trueTime));
+    return clock.sync(&answer, now);
+}
+
+
+static void testTimebase(bool onEdge)
+{
+    LoRaWanClock clock;
+    timebase_t time = {0, 5000};
+
+    CHECK(syncAt(clock, time));
+    while(time.trueTime < 7200000ULL)sleepCycle(time, onEdge);
+    CHECK(syncAt(clock, time));
+
+    printf("sleep %s: error %ld ms, drift %ld ppm, %lu rejected\n", onEdge ? "on the second edge" : "from the truncated epoch",
+           clock.getLastError(), clock.getDrift(), clock.getDriftRejects());
+
+    // Over-reported sleep runs the timebase 8000 ppm fast, beyond any crystal, the rate is not taken
+    if(!onEdge)CHECK(clock.getDriftRejects() == 1 && clock.getDrift() == 0);
+    else CHECK(clock.getDriftRejects() == 0 && labs(clock.getDrift()) <= 1 && labs(clock.getLastError()) <= 2);
+}
+
+
+static void testBeacon(LoRaWanClock &clock)
+{
+    // The next beacon starts on a multiple of 128 s of GPS time
+    uint64_t gpsNow = GPS_START + 14400000ULL;
+    uint64_t beacon = gpsNow - gpsNow % CLOCK_BEACON_PERIOD + CLOCK_BEACON_PERIOD;
+    unsigned long heard = localAt(beacon - GPS_START) + CLOCK_BEACON_DELAY;
+
+    CHECK(clock.syncBeacon(heard));
+    CHECK(labs(clock.getLastError()) <= 2);
+    CHECK(clock.getGpsTime(heard - CLOCK_BEACON_DELAY) == beacon / 1000);
+
+    LoRaWanClock fresh;
+    CHECK(!fresh.syncBeacon(heard));
+}
+
+
+static void testSlots(LoRaWanClock &clock)
+{
+    unsigned long now = localAt(15000000ULL);
+    unsigned long period = 60000;
+
+    // Every node starts at its slot of the shared GPS period
+    for(unsigned short slot = 0; slot < 10; slot ++)
+    {
+        unsigned long delay = clock.getSlotDelay(now, period, slot, 10);
+        uint64_t start = (GPS_START + 15000000ULL) + delay;
+        long offset = (long)(start % period) - (long)(period * slot / 10);
+
+        CHECK(delay < period);
+        CHECK(labs(offset) <= 2);
+    }
+
+    CHECK(LoRaWanClock::getSlot("0004A30B001C0530", 16) < 16);
+    CHECK(LoRaWanClock::getSlot("0004A30B001C0530", 16) == LoRaWanClock::getSlot("0004A30B001C0530", 16));
+    CHECK(LoRaWanClock::getSlot("0004A30B001C0530", 1000) != LoRaWanClock::getSlot("0004A30B001C0531", 1000));
+}
+
+
+static void testAnswer(void)
+{
+    LoRaWanClock clock;
+    LoRaWanDeviceTime time;
+    unsigned char data[1] = {0x01};
+
+    // The answer as the modem prints it, read back through the library
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+LW=DTR") == 0)HostModem::reply(5, "+LW: DTR\r\n");
+        else if(line.find("AT+MSGHEX") == 0)
+        {
+            HostModem::reply(50, "+MSGHEX: Start\r\n+MSGHEX: DTR, 2024-12-09 10:15:30, 1417774548.250\r\n"
+                                 "+MSGHEX: RXWIN1, RSSI -80, SNR 9.0\r\n+MSGHEX: Done\r\n");
+        }
+    });
+    lora.init();
+
+    CHECK(lora.requestDeviceTime());
+    CHECK(lora.transmitPacket(data, sizeof(data)));
+    unsigned long now = millis();
+    CHECK(lora.getDeviceTime(&time));
+    CHECK(clock.sync(&time, now));
+    CHECK(clock.getGpsTime(now) >= 1417774549UL && clock.getGpsTime(now) <= 1417774550UL);
+}
+
+
+int main(void)
+{
+    LoRaWanClock clock;
+
+    testSync(clock);
+    testTimebase(false);
+    testTimebase(true);
+    testBeacon(clock);
+    testSlots(clock);
+    testAnswer();
+
+    return hostReport("test_clock");
+}
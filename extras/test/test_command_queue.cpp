@@ -0,0 +1,142 @@
+/*
+  test_command_queue.cpp
+  Command queue with an owner thread and several client threads
+
+  Built with LORAWAN_RTOS=LORAWAN_RTOS_STD, see the Makefile.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <LoRaWanCommandQueue.h>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+#define CLIENTS         4
+#define CALLS           10
+
+LoRaWanClass lora;
+LoRaWanCommandQueue queue(lora);
+static std::atomic<bool> serving(true);
+static std::atomic<int> downlinks(0);
+static std::atomic<int> running(0);
+static std::atomic<int> overlaps(0);
+
+
+static long readTemp(LoRaWanClass *modem, void *context)
+{
+    (void)context;
+
+    // Jobs never run side by side, the owner thread runs them one after another
+    if(running.fetch_add(1) != 0)overlaps ++;
+    long temp = modem->getModuleTemperatureDeciC();
+    running --;
+
+    return temp;
+}
+
+
+static void onDownlink(const LoRaWanPayload *payload)
+{
+    if(payload->port == 7)downlinks ++;
+}
+
+
+static void owner(void)
+{
+    while(serving)queue.serve(10);
+}
+
+
+static void testFullQueue(void)
+{
+    LoRaWanTicket tickets[LORAWAN_QUEUE_DEPTH + 1];
+
+    // No owner yet, the slots fill up and the next submit fails at once
+    for(unsigned char i = 0; i < LORAWAN_QUEUE_DEPTH; i ++)CHECK(queue.submit(&tickets[i], readTemp, NULL));
+    CHECK(!queue.submit(&tickets[LORAWAN_QUEUE_DEPTH], readTemp, NULL));
+    CHECK(queue.getRejected() == 1 && queue.getDepth() == LORAWAN_QUEUE_DEPTH);
+
+    CHECK(queue.cancel(&tickets[0]));
+    CHECK(queue.getDepth() == LORAWAN_QUEUE_DEPTH - 1);
+
+    std::thread task(owner);
+    for(unsigned char i = 1; i < LORAWAN_QUEUE_DEPTH; i ++)
+    {
+        CHECK(queue.await(&tickets[i], 2000));
+        CHECK(tickets[i].result == 215);
+    }
+    serving = false;
+    task.join();
+    serving = true;
+}
+
+
+static void testClients(void)
+{
+    std::vector<std::thread> clients;
+    std::atomic<int> correct(0);
+    unsigned long served = queue.getServed();
+
+    std::thread task(owner);
+
+    for(int c = 0; c < CLIENTS; c ++)
+    {
+        clients.push_back(std::thread([&correct]()
+        {
+            for(int i = 0; i < CALLS; i ++)
+            {
+                long result = 0;
+                if(queue.call(readTemp, NULL, &result, 5000) && result == 215)correct ++;
+            }
+        }));
+    }
+
+    for(size_t c = 0; c < clients.size(); c ++)clients[c].join();
+
+    // A downlink the modem reports on its own reaches the subscriber, polled by the owner
+    HostModem::reply(5, "+MSG: PORT: 7; RX: \"01\"\r\n+MSG: RXWIN0, RSSI -50, SNR 3\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(LORAWAN_RSSI_WAIT + 100));
+
+    serving = false;
+    task.join();
+
+    CHECK(correct == CLIENTS * CALLS);
+    CHECK(queue.getServed() - served == CLIENTS * CALLS);
+    CHECK(overlaps == 0);
+    CHECK(downlinks == 1);
+    CHECK(queue.getDepthMax() <= LORAWAN_QUEUE_DEPTH);
+
+    // Commands reached the modem whole, one after another
+    std::istringstream lines(HostModem::sent());
+    std::string line;
+    while(std::getline(lines, line))CHECK(line == "AT+TEMP\r" || line == "AT+VER\r");
+
+    printf("queue wait mean %lu ms, max %lu ms, lock wait max %lu us\n",
+           queue.getQueueWaitMean(), queue.getQueueWaitMax(), queue.getLockWaitMax());
+}
+
+
+int main(void)
+{
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+TEMP") == 0)HostModem::reply(2, "+TEMP: 21.5\r\n");
+    });
+    lora.init();
+
+    CHECK(queue.begin());
+    CHECK(queue.subscribe(onDownlink));
+
+    testFullQueue();
+    testClients();
+
+    return hostReport("test_command_queue");
+}
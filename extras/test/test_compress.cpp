@@ -0,0 +1,105 @@
+/*
+  test_compress.cpp
+  LZSS round trip of uplink payloads, incompressible ones stored
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <LoRaWanCompress.h>
+#include "HostCheck.h"
+#include <string.h>
+#include <stdlib.h>
+
+
+// Compressed and back, the coded length returned
+static unsigned char roundTrip(const uint8_t *data, unsigned char length)
+{
+    uint8_t coded[COMPRESS_INPUT_MAX + 1];
+    uint8_t plain[COMPRESS_INPUT_MAX];
+
+    unsigned char size = LoRaWanCompress::compress(data, length, coded, sizeof(coded));
+    CHECK(size > 0 && size <= length + 1);
+
+    short restored = LoRaWanCompress::decompress(coded, size, plain, sizeof(plain));
+    CHECK(restored == length);
+    CHECK(restored == length && memcmp(plain, data, length) == 0);
+
+    return size;
+}
+
+
+static void testText(void)
+{
+    const char *text = "{\"temperature\":21.5,\"humidity\":45,\"temperature2\":21.7,\"humidity2\":44}";
+    unsigned char length = strlen(text);
+
+    unsigned char size = roundTrip((const uint8_t *)text, length);
+    printf("text: %u of %u bytes\n", size, length);
+    CHECK(size < length);
+
+    // A long run is a chain of back references into itself
+    uint8_t run[COMPRESS_INPUT_MAX];
+    memset(run, 0x55, sizeof(run));
+    size = roundTrip(run, sizeof(run));
+    CHECK(size < sizeof(run) / 4);
+}
+
+
+static void testLpp(void)
+{
+    // Cayenne LPP, channel and type in front of every value
+    const uint8_t frame[] = {0x01, 0x67, 0x00, 0xD7, 0x02, 0x02, 0x01, 0x86, 0x03, 0x00, 0x01,
+                             0x04, 0x02, 0x01, 0x80, 0x05, 0x02, 0x01, 0x8A, 0x01, 0x67, 0x00, 0xD9};
+
+    roundTrip(frame, sizeof(frame));
+}
+
+
+static void testIncompressible(void)
+{
+    uint8_t data[COMPRESS_INPUT_MAX];
+    uint8_t coded[COMPRESS_INPUT_MAX + 1];
+
+    srand(7);
+    for(unsigned char i = 0; i < sizeof(data); i ++)data[i] = rand();
+
+    // Stored with its header, one byte over the plain payload
+    unsigned char size = roundTrip(data, sizeof(data));
+    CHECK(size == sizeof(data) + 1);
+    CHECK(LoRaWanCompress::compress(data, sizeof(data), coded, sizeof(coded)) && coded[0] == COMPRESS_STORED);
+
+    // Short payloads, down to none
+    for(unsigned char length = 0; length < 4; length ++)roundTrip(data, length);
+
+    // Output too small for the stored form, or a payload too long
+    CHECK(LoRaWanCompress::compress(data, 40, coded, 40) == 0);
+    CHECK(LoRaWanCompress::compress(data, COMPRESS_INPUT_MAX + 1, coded, sizeof(coded)) == 0);
+}
+
+
+static void testBroken(void)
+{
+    const uint8_t unknown[] = {0x7F, 0x01, 0x02};
+    const uint8_t reference[] = {COMPRESS_LZSS, 0x01, 0x00, 0x00};   // back reference before the start
+    uint8_t plain[16];
+
+    CHECK(LoRaWanCompress::decompress(unknown, sizeof(unknown), plain, sizeof(plain)) == -1);
+    CHECK(LoRaWanCompress::decompress(reference, sizeof(reference), plain, sizeof(plain)) == -1);
+
+    // The output too small for the payload
+    const uint8_t stored[] = {COMPRESS_STORED, 1, 2, 3, 4};
+    CHECK(LoRaWanCompress::decompress(stored, sizeof(stored), plain, 3) == -1);
+}
+
+
+int main(void)
+{
+    testText();
+    testLpp();
+    testIncompressible();
+    testBroken();
+
+    return hostReport("test_compress");
+}
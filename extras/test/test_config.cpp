@@ -0,0 +1,168 @@
+/*
+  test_config.cpp
+  Remote configuration, the status each command gets from the modem answer
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <LoRaWanConfig.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+static bool probed = true;
+
+
+static size_t count(const std::string &text, const char *needle)
+{
+    size_t number = 0;
+    for(size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1))number ++;
+    return number;
+}
+
+
+// The modem takes the rate and the power, refuses ADR and never answers AT+RETRY
+static void answer(const std::string &line)
+{
+    if(line.find("AT+VER") == 0 && probed)HostModem::reply(5, "+VER: 2.1.19\r\n");
+    else if(line.find("AT+DR=") == 0)
+    {
+        // Two lines, the second a little later, as the RHF76 prints them
+        HostModem::reply(5, "+DR: DR3\r\n");
+        HostModem::reply(10, "+DR: EU868 DR3 SF9 BW125K\r\n");
+    }
+    else if(line.find("AT+POWER=") == 0)HostModem::reply(30, "+POWER: 10\r\n");
+    else if(line.find("AT+ADR=") == 0)HostModem::reply(5, "+ADR: ERROR(-1)\r\n");
+    else if(line.find("AT+REPT=") == 0)HostModem::reply(5, "+REPT: 3\r\n");
+    else if(line.find("AT+BEACON=") == 0)HostModem::reply(5, "+BEACON: DMMUL, 4, 15\r\n");
+    else if(line.find("AT+CLASS=C") == 0)HostModem::reply(5, "+CLASS: C\r\n");
+}
+
+
+static LoRaWanPayload downlink(const uint8_t *data, short length)
+{
+    LoRaWanPayload payload;
+
+    payload.data = data;
+    payload.length = length;
+    payload.rssi = -80;
+    payload.port = CONFIG_PORT;
+
+    return payload;
+}
+
+
+static void testTwoLines(LoRaWanClass &lora)
+{
+    // The second line of the AT+DR answer is not taken for the answer to AT+POWER
+    CHECK(lora.setDataRate(DR3));
+    CHECK(lora.setPower(10));
+    CHECK(lora.setDataRate(DR3));
+    CHECK(lora.setAdaptiveDataRate(false) == false);
+}
+
+
+static void testSetters(LoRaWanClass &lora)
+{
+    LoRaWanConfig config(lora);
+    const uint8_t data[] = {0x21, CONFIG_DATA_RATE, 1, 3, CONFIG_POWER, 1, 10, CONFIG_ADR, 1, 1,
+                            CONFIG_RETRIES, 1, 2, CONFIG_REPEAT, 1, 3, CONFIG_CLASS, 1, CLASS_C};
+    LoRaWanPayload payload = downlink(data, sizeof(data));
+    uint8_t ack[CONFIG_ACK_LENGTH];
+
+    CHECK(config.handle(&payload));
+    CHECK(config.apply() == 4);
+
+    // A setter the modem refused or left unanswered shows up in the answer
+    const uint8_t expected[] = {0x21, CONFIG_DATA_RATE, CONFIG_OK, CONFIG_POWER, CONFIG_OK, CONFIG_ADR, CONFIG_FAILED,
+                                CONFIG_RETRIES, CONFIG_FAILED, CONFIG_REPEAT, CONFIG_OK, CONFIG_CLASS, CONFIG_OK};
+    CHECK(config.isAckDue());
+    CHECK(config.getAck(ack, sizeof(ack)) == sizeof(expected));
+    CHECK(memcmp(ack, expected, sizeof(expected)) == 0);
+    CHECK(config.getRejected() == 2);
+
+    // A resend of the same id is answered again and not applied twice
+    size_t sent = HostModem::sent().size();
+    config.ackSent(true);
+    CHECK(config.handle(&payload));
+    CHECK(config.apply() == 0);
+    CHECK(config.isAckDue());
+    CHECK(HostModem::sent().size() == sent);
+}
+
+
+static void testChecks(LoRaWanClass &lora)
+{
+    LoRaWanConfig config(lora);
+    const uint8_t data[] = {0x22, CONFIG_POWER, 1, 20, CONFIG_POWER, 1, 13, CONFIG_RETRIES, 1, 0, 0x7F, 1, 0, CONFIG_LIMITS, 4, 0, 60, 1, 0, CONFIG_INTERVAL, 2, 1};
+    LoRaWanPayload payload = downlink(data, sizeof(data));
+    uint8_t ack[CONFIG_ACK_LENGTH];
+
+    CHECK(config.handle(&payload));
+    CHECK(config.apply() == 0);
+
+    // Out of range, above the EU433 limit, no retry at all, unknown, no policy for limits, and an interval cut off by the end
+    const uint8_t expected[] = {0x22, CONFIG_POWER, CONFIG_OUT_OF_RANGE, CONFIG_POWER, CONFIG_OUT_OF_RANGE, CONFIG_RETRIES, CONFIG_OUT_OF_RANGE, 0x7F, CONFIG_UNKNOWN,
+                                CONFIG_LIMITS, CONFIG_UNSUPPORTED, CONFIG_INTERVAL, CONFIG_BAD_LENGTH};
+    CHECK(config.getAck(ack, sizeof(ack)) == sizeof(expected));
+    CHECK(memcmp(ack, expected, sizeof(expected)) == 0);
+
+    // Other ports are left to the caller
+    payload.port = 1;
+    CHECK(!config.handle(&payload));
+}
+
+
+static void testClassB(LoRaWanClass &probedModem)
+{
+    const uint8_t data[] = {0x23, CONFIG_PING_SLOT, 1, 4, CONFIG_CLASS, 1, CLASS_B};
+    LoRaWanPayload payload = downlink(data, sizeof(data));
+    uint8_t ack[CONFIG_ACK_LENGTH];
+
+    // A modem that never told its version may lack Class B, the switch would wait for nothing
+    LoRaWanClass unprobed;
+    LoRaWanConfig blind(unprobed);
+    probed = false;
+    unprobed.init();
+    probed = true;
+
+    size_t sent = HostModem::sent().size();
+    CHECK(blind.handle(&payload));
+    CHECK(blind.apply() == 0);
+    CHECK(count(HostModem::sent().substr(sent), "AT+CLASS=B") == 0);
+    CHECK(count(HostModem::sent().substr(sent), "AT+BEACON=") == 0);
+
+    const uint8_t refused[] = {0x23, CONFIG_PING_SLOT, CONFIG_UNSUPPORTED, CONFIG_CLASS, CONFIG_UNSUPPORTED};
+    CHECK(blind.getAck(ack, sizeof(ack)) == sizeof(refused));
+    CHECK(memcmp(ack, refused, sizeof(refused)) == 0);
+
+    // The setter itself refuses it the same way
+    CHECK(!unprobed.setClassType(CLASS_B));
+    CHECK(count(HostModem::sent().substr(sent), "AT+CLASS=B") == 0);
+
+    // With Class B firmware probed the commands reach the modem
+    LoRaWanConfig config(probedModem);
+    CHECK(config.handle(&payload));
+    CHECK(config.getAck(ack, sizeof(ack)) == sizeof(refused));
+    CHECK(ack[2] == CONFIG_PENDING && ack[4] == CONFIG_PENDING);
+}
+
+
+int main(void)
+{
+    LoRaWanClass lora;
+
+    HostModem::setAnswer(answer);
+    lora.init();
+    CHECK(lora.getCapabilities()->major == 2 && lora.getCapabilities()->classB);
+
+    testTwoLines(lora);
+    testSetters(lora);
+    testChecks(lora);
+    testClassB(lora);
+
+    return hostReport("test_config");
+}
@@ -0,0 +1,106 @@
+/*
+  test_energy.cpp
+  Airtime of a frame, charge booked per state and the battery forecast
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <LoRaWanEnergy.h>
+#include "HostCheck.h"
+
+
+#define HOUR    3600000UL
+
+
+static void testAirtime(void)
+{
+    // Semtech calculator, 13 byte frame, coding rate 4/5, explicit header, CRC on
+    CHECK(LoRaWanEnergy::getAirtime(13, 5) == 47);      // SF7, 46.3 ms
+    CHECK(LoRaWanEnergy::getAirtime(13, 0) == 1156);    // SF12, 1155.1 ms, low data rate optimization
+    CHECK(LoRaWanEnergy::getAirtime(13, 6) == 24);      // SF7 at 250 kHz, 23.2 ms
+    CHECK(LoRaWanEnergy::getAirtime(13, 7) == 4);       // FSK 50 kbps, 3.8 ms
+
+    // 51 byte application payload at SF9, 390.1 ms
+    CHECK(LoRaWanEnergy::getAirtime(51 + LORAWAN_FRAME_OVERHEAD, 3) == 391);
+
+    // Longer frames never take less time
+    for(unsigned char dataRate = 0; dataRate <= 7; dataRate ++)
+    {
+        for(unsigned char length = 1; length < 255; length ++)
+        {
+            CHECK(LoRaWanEnergy::getAirtime(length, dataRate) >= LoRaWanEnergy::getAirtime(length - 1, dataRate));
+        }
+    }
+}
+
+
+static void testLedger(void)
+{
+    LoRaWanEnergy energy;
+
+    // An hour of standby books both sides asleep, 105 uAh with the default draw
+    energy.addTime(MCU_SLEEP, HOUR);
+    CHECK(energy.getTime(MCU_SLEEP) == 3600 && energy.getTime(MODEM_SLEEP) == 3600);
+    CHECK(energy.getCharge() == 105);
+
+    // An uplink moves its command time from idle to TX and RX
+    energy.addTime(MODEM_IDLE, 5000);
+    energy.startCycle();
+    energy.addUplink(LoRaWanEnergy::getAirtime(13, 0), 3000);
+
+    CHECK(energy.getUplinks() == 1 && energy.getAirtime() == 1156);
+    CHECK(energy.getTime(MODEM_TX) == 1 && energy.getTime(MODEM_RX) == 1);
+    CHECK(energy.getTime(MODEM_IDLE) == 2);
+
+    // 1156 ms at 45 mA and 1844 ms at 12 mA instead of 3000 ms at 3 mA, 18.1 uAh
+    CHECK(energy.getCycleCharge() == 18);
+    CHECK(energy.startCycle() == 18 && energy.getCycleCharge() == 0);
+
+    // Airtime never beyond the command time
+    energy.addUplink(5000, 1000);
+    CHECK(energy.getAirtime() == 1156 + 1000);
+
+    // The average over the modem states, standby dominates
+    CHECK(energy.getAverageCurrent() > 5 && energy.getAverageCurrent() < 200);
+}
+
+
+static void testForecast(void)
+{
+    LoRaWanEnergy energy;
+    uint8_t record[ENERGY_FORECAST_LENGTH];
+
+    // Nothing known yet
+    CHECK(energy.getForecast() == 0xFFFF);
+
+    // 10 mV an hour down to 3680 mV, 380 mV above the cutoff
+    energy.setBattery(2000, 3300);
+    for(unsigned char i = 0; i < 3; i ++)
+    {
+        energy.addBatteryVoltage(3700 - 10 * i);
+        if(i < 2)energy.addTime(MCU_SLEEP, HOUR);
+    }
+    CHECK(energy.getForecast() == 38);
+
+    // 100 hours at 3 mA took 300 of 400 mAh, the rest lasts about 34 hours at the average draw
+    energy.setBattery(400, 3300);
+    energy.addTime(MODEM_IDLE, HOUR * 100);
+    unsigned short hours = energy.getForecast();
+    CHECK(hours == 33 || hours == 34);
+
+    CHECK(energy.encode(record) == ENERGY_FORECAST_LENGTH);
+    CHECK((record[4] << 8 | record[5]) == hours);
+    CHECK((record[6] << 8 | record[7]) == 3680);
+}
+
+
+int main(void)
+{
+    testAirtime();
+    testLedger();
+    testForecast();
+
+    return hostReport("test_energy");
+}
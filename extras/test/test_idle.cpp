@@ -0,0 +1,76 @@
+/*
+  test_idle.cpp
+  CPU time the idle callback gets back while the library waits for the modem
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+#define IDLE_SLICE      2           // millisecond of sketch work per callback, a sensor read
+#define IDLE_SHARE      80          // percent of a wait the callback must get at least
+
+LoRaWanClass lora;
+static unsigned long workTime = 0;
+static unsigned long remainingMax = 0;
+static unsigned long samples = 0;
+
+
+// Sketch work done inside the waits, never longer than the time left
+static void onIdle(unsigned long remaining)
+{
+    unsigned long timerStart = millis();
+    unsigned long slice = remaining < IDLE_SLICE ? remaining : IDLE_SLICE;
+
+    if(remaining > remainingMax)remainingMax = remaining;
+    while(millis() - timerStart < slice)samples ++;
+    workTime += millis() - timerStart;
+}
+
+
+int main(void)
+{
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+TEMP") == 0)HostModem::reply(200, "+TEMP: 24.5\r\n");
+    });
+    lora.init();
+    lora.setIdleCallback(onIdle);
+
+    // A plain wait hands over nearly all of its time
+    unsigned long timerStart = millis();
+    lora.wait(100);
+    unsigned long waited = millis() - timerStart;
+
+    printf("wait(100): %lu of %lu ms to the callback, %lu calls\n", lora.getIdleTime(), waited, lora.getIdleCalls());
+    CHECK(lora.getIdleTime() * 100 >= waited * IDLE_SHARE);
+    CHECK(remainingMax <= 100);
+
+    // So does the wait for a slow answer, and the answer is still read
+    unsigned long idleBefore = lora.getIdleTime();
+    remainingMax = 0;
+    timerStart = millis();
+    short temp = lora.getModuleTemperatureDeciC();
+    waited = millis() - timerStart;
+    unsigned long given = lora.getIdleTime() - idleBefore;
+
+    printf("AT+TEMP: %lu of %lu ms to the callback\n", given, waited);
+    CHECK(temp == 245);
+    CHECK(given * 100 >= waited * IDLE_SHARE);
+    CHECK(remainingMax <= 1000);
+    CHECK(workTime <= lora.getIdleTime() + 1);
+    CHECK(samples > 0);
+
+    // Without a callback nothing is booked
+    lora.setIdleCallback(NULL);
+    idleBefore = lora.getIdleTime();
+    lora.wait(20);
+    CHECK(lora.getIdleTime() == idleBefore);
+
+    return hostReport("test_idle");
+}
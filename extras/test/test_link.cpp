@@ -0,0 +1,116 @@
+/*
+  test_link.cpp
+  LinkCheck answers parsed from the uplink response and their statistics
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <LoRaWanLink.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+LoRaWanClass lora;
+LoRaWanLink link;
+static std::string answer;      // what the next uplink prints between Start and Done
+
+
+static bool uplink(const char *text)
+{
+    unsigned char data[2] = {0x01, 0x02};
+
+    answer = text;
+    return lora.transmitPacket(data, sizeof(data));
+}
+
+
+static void testParser(void)
+{
+    // Margin and gateway count, the answer printed before the downlink window
+    CHECK(lora.requestLinkCheck());
+    CHECK(uplink("+MSGHEX: Link 20, 2\r\n+MSGHEX: RXWIN1, RSSI -97, SNR 7.0\r\n"));
+    CHECK(link.getRequests() == 1 && link.getAnswers() == 1);
+    CHECK(link.getMarginLast() == 20 && link.getGatewaysMin() == 2);
+
+    // No answer in the response, the request counts as lost
+    CHECK(lora.requestLinkCheck());
+    CHECK(uplink("+MSGHEX: RXWIN2, RSSI -110, SNR -3.0\r\n"));
+    CHECK(link.getRequests() == 2 && link.getAnswers() == 1);
+
+    // Nothing requested, nothing booked
+    CHECK(uplink("+MSGHEX: Link 5, 1\r\n"));
+    CHECK(link.getRequests() == 2);
+
+    // An uplink that failed keeps the request for the next one
+    CHECK(lora.requestLinkCheck());
+    CHECK(!uplink("+MSGHEX: No band in 2400ms\r\n"));
+    CHECK(link.getRequests() == 2);
+    CHECK(uplink("+MSGHEX: Link 0, 12\r\n"));
+    CHECK(link.getRequests() == 3 && link.getMarginLast() == 0 && link.getMarginMin() == 0);
+    CHECK(link.getGatewaysAverage() == 7);
+
+    // Without statistics the answer is read and dropped
+    lora.setLinkStats(NULL);
+    CHECK(lora.requestLinkCheck());
+    CHECK(uplink("+MSGHEX: Link 30, 1\r\n"));
+    lora.setLinkStats(&link);
+    CHECK(link.getRequests() == 3);
+}
+
+
+static void testWindow(void)
+{
+    link.clear();
+    CHECK(link.getRequests() == 0 && !link.coverageProblem());
+    CHECK(link.suggestDataRate(2) == 2 && link.suggestTransmissions(3) == 3);
+
+    // The oldest fall out of the window
+    for(unsigned char i = 0; i < LINK_WINDOW + 2; i ++)link.add(i < 2 ? 1 : 25, 3);
+    CHECK(link.getRequests() == LINK_WINDOW && link.getAnswerRate() == 100);
+    CHECK(link.getMarginMin() == 25 && link.getMarginAverage() == 25);
+
+    // 15 dB over the safety, six steps of 2.5 dB, capped at the maximum
+    CHECK(link.suggestDataRate(0) == 5);
+    CHECK(link.suggestDataRate(0, LINK_MARGIN_SAFETY, 3) == 3);
+    CHECK(link.suggestTransmissions(3) == 1);
+    CHECK(!link.coverageProblem());
+
+    // A margin below the safety steps down, below LINK_MARGIN_LOW is coverage
+    link.add(6, 1);
+    CHECK(link.suggestDataRate(5) == 3);
+    CHECK(link.suggestTransmissions(3) == 2);
+    link.add(2, 1);
+    CHECK(link.suggestDataRate(5) == 1 && link.suggestTransmissions(3) == 3);
+    CHECK(link.coverageProblem());
+
+    // Lost answers alone are a problem too
+    link.clear();
+    for(unsigned char i = 0; i < 4; i ++)link.addLost();
+    link.add(30, 2);
+    CHECK(link.getAnswerRate() == 20 && link.coverageProblem());
+}
+
+
+int main(void)
+{
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+VER") == 0)HostModem::reply(5, "+VER: 2.1.19\r\n");
+        else if(line.find("AT+LW=LCR") == 0)HostModem::reply(5, "+LW: LCR\r\n");
+        else if(line.find("AT+MSGHEX") == 0)
+        {
+            bool failed = answer.find("No band") != std::string::npos;
+            HostModem::reply(5, "+MSGHEX: Start\r\n" + answer + (failed ? "" : "+MSGHEX: Done\r\n"));
+        }
+    });
+    lora.init();
+    lora.setLinkStats(&link);
+
+    testParser();
+    testWindow();
+
+    return hostReport("test_link");
+}
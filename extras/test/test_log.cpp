@@ -0,0 +1,188 @@
+/*
+  test_log.cpp
+  Store and forward log on a RAM storage, wraparound and a record torn by a reset
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <LoRaWanLog.h>
+#include "HostCheck.h"
+#include <string.h>
+
+
+#define SECTORS         4
+#define SECTOR_SIZE     256
+
+
+// A reset in the middle of an append, writes fail from the given one on
+class TornStorage : public LoRaWanRamStorage
+{
+    public:
+        TornStorage(uint8_t *buffer) : LoRaWanRamStorage(buffer, SECTORS * SECTOR_SIZE, SECTOR_SIZE), writesLeft(-1) {}
+
+        bool write(uint32_t address, const void *buffer, uint16_t length)
+        {
+            if(writesLeft == 0)return false;
+            if(writesLeft > 0)writesLeft --;
+            return LoRaWanRamStorage::write(address, buffer, length);
+        }
+
+        int writesLeft;
+};
+
+
+static uint8_t flash[SECTORS * SECTOR_SIZE];
+
+
+static void fill(uint8_t *data, unsigned char length, uint8_t index)
+{
+    for(unsigned char i = 0; i < length; i ++)data[i] = index + i;
+}
+
+
+// Record index of batch entry n, its length and age checked on the way
+static int entry(const uint8_t *batch, unsigned char size, unsigned char n, unsigned char length, unsigned long age)
+{
+    unsigned char at = 0;
+
+    for(; n; n --)at += LOG_BATCH_HEADER + batch[at];
+    if(at + LOG_BATCH_HEADER + length > size || batch[at] != length)return -1;
+    if(((unsigned long)batch[at + 1] << 16 | batch[at + 2] << 8 | batch[at + 3]) != age)return -1;
+
+    uint8_t expected[64];
+    fill(expected, length, batch[at + LOG_BATCH_HEADER]);
+    return memcmp(batch + at + LOG_BATCH_HEADER, expected, length) == 0 ? batch[at + LOG_BATCH_HEADER] : -1;
+}
+
+
+static void testAppend(TornStorage &storage)
+{
+    LoRaWanLog log(storage);
+    uint8_t data[10];
+    uint8_t batch[51];
+
+    CHECK(log.begin() && log.format());           // begin() learns the geometry format() needs
+    for(uint8_t i = 0; i < 3; i ++)
+    {
+        fill(data, sizeof(data), i);
+        CHECK(log.append(data, sizeof(data), 100 + i));
+    }
+    CHECK(log.getPending() == 3);
+    CHECK(log.isDrainDue(103));
+
+    // Oldest first, each with its age
+    unsigned char size = log.pack(batch, sizeof(batch), 110);
+    CHECK(size == 3 * (LOG_BATCH_HEADER + sizeof(data)));
+    for(unsigned char n = 0; n < 3; n ++)CHECK(entry(batch, size, n, sizeof(data), 10 - n) == n);
+
+    // Lost uplink, the same records again
+    CHECK(!log.commit(false, 110));
+    CHECK(log.pack(batch, sizeof(batch), 120) == size);
+    CHECK(log.commit(true, 120));
+    CHECK(log.getPending() == 0);
+    CHECK(!log.isDrainDue(200));
+
+    // The cursor survives a reset
+    fill(data, sizeof(data), 3);
+    CHECK(log.append(data, sizeof(data), 130));
+
+    LoRaWanLog again(storage);
+    CHECK(again.begin());
+    CHECK(again.getPending() == 1);
+    CHECK(again.pack(batch, sizeof(batch), 131) == LOG_BATCH_HEADER + sizeof(data));
+    CHECK(entry(batch, sizeof(batch), 0, sizeof(data), 1) == 3);
+}
+
+
+static void testWrap(TornStorage &storage)
+{
+    LoRaWanLog log(storage);
+    uint8_t data[40];
+    uint8_t batch[51];
+    const unsigned char total = 30;
+
+    CHECK(log.begin() && log.format());
+    for(uint8_t i = 0; i < total; i ++)
+    {
+        fill(data, sizeof(data), i);
+        CHECK(log.append(data, sizeof(data), i));
+    }
+
+    // Four records fit a sector, the oldest sectors went with what they held
+    printf("wrap: %lu pending, %lu dropped, %lu erases, write amplification %u%%\n",
+           log.getPending(), log.getDropped(), log.getErases(), log.getWriteAmplification());
+    CHECK(log.getDropped() > 0);
+    CHECK(log.getPending() + log.getDropped() == total);
+    CHECK(log.getPending() <= SECTORS * 4);
+
+    // Draining goes on with the oldest record kept
+    unsigned char first = total - log.getPending();
+    for(unsigned char n = 0; log.getPending(); n ++)
+    {
+        unsigned char size = log.pack(batch, sizeof(batch), 100);
+        CHECK(size == LOG_BATCH_HEADER + sizeof(data));
+        CHECK(entry(batch, size, 0, sizeof(data), 100 - first - n) == first + n);
+        log.commit(true, 100);
+    }
+
+    // The counters start again with begin()
+    CHECK(log.begin());
+    CHECK(log.getDropped() == 0);
+    CHECK(log.getErases() == 0);
+    CHECK(log.getPending() == 0);
+}
+
+
+static void testTorn(TornStorage &storage)
+{
+    LoRaWanLog log(storage);
+    uint8_t data[10];
+    uint8_t batch[51];
+
+    CHECK(log.begin() && log.format());
+    for(uint8_t i = 0; i < 2; i ++)
+    {
+        fill(data, sizeof(data), i);
+        CHECK(log.append(data, sizeof(data), 10));
+    }
+
+    // Header in, payload and commit mark not
+    storage.writesLeft = 1;
+    fill(data, sizeof(data), 2);
+    CHECK(!log.append(data, sizeof(data), 10));
+    storage.writesLeft = -1;
+
+    LoRaWanLog again(storage);
+    CHECK(again.begin());
+    CHECK(again.getPending() == 2);
+
+    // The torn sector is closed, the next record goes to a fresh one
+    fill(data, sizeof(data), 3);
+    CHECK(again.append(data, sizeof(data), 10));
+
+    LoRaWanLog third(storage);
+    CHECK(third.begin());
+    CHECK(third.getPending() == 3);
+
+    unsigned char size = third.pack(batch, sizeof(batch), 10);
+    CHECK(size == 3 * (LOG_BATCH_HEADER + sizeof(data)));
+    CHECK(entry(batch, size, 0, sizeof(data), 0) == 0);
+    CHECK(entry(batch, size, 1, sizeof(data), 0) == 1);
+    CHECK(entry(batch, size, 2, sizeof(data), 0) == 3);
+}
+
+
+int main(void)
+{
+    TornStorage storage(flash);
+
+    memset(flash, 0xFF, sizeof(flash));
+
+    testAppend(storage);
+    testWrap(storage);
+    testTorn(storage);
+
+    return hostReport("test_log");
+}
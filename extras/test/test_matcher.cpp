@@ -0,0 +1,114 @@
+/*
+  test_matcher.cpp
+  Response matcher and the answer fields located with it
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <LoRaWanLink.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+LoRaWanClass lora;
+LoRaWanLink link;
+
+
+static void testOffsets(void)
+{
+    LoRaWanMatcher matcher;
+    const char *text = "+MSG: RXWIN1, RSSI -106, SNR 4.5, RSSI -1";
+
+    short rssi = matcher.add("RSSI ", false);
+    short snr = matcher.add("SNR ", false);
+    short done = matcher.add("Done");
+
+    CHECK(matcher.feed(text) == rssi);
+    CHECK(matcher.end(rssi) == 19);             // the first occurrence, as strstr
+    CHECK(matcher.end(snr) == 29);
+    CHECK(matcher.end(done) == -1 && !matcher.done());
+
+    matcher.reset();
+    CHECK(matcher.end(rssi) == -1);
+    matcher.feed("Done");
+    CHECK(matcher.done() && matcher.end(done) == 4);
+
+    // Refilled, the old patterns are gone
+    matcher.clear();
+    short ver = matcher.add("+VER: ", false);
+    CHECK(ver == 0);
+    matcher.feed("+VER: 2.1.19\r\n");
+    CHECK(matcher.end(ver) == 6 && !matcher.done());
+}
+
+
+static void testAnswers(void)
+{
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+TEMP") == 0)HostModem::reply(5, "+TEMP: -3.5\r\n");
+        else if(line.find("AT+LW=LCR") == 0)HostModem::reply(5, "+LW: LCR\r\n");
+        else if(line.find("AT+CMSGHEX") == 0)
+        {
+            HostModem::reply(5, "+CMSGHEX: Start\r\n+CMSGHEX: Link 20, 2\r\n+CMSGHEX: ACK Received\r\n"
+                                "+CMSGHEX: RXWIN1, RSSI -97, SNR 7.0\r\n+CMSGHEX: Done\r\n");
+        }
+        // The error code arrives after the stop pattern ended the read
+        else if(line.find("AT+PMSGHEX") == 0)
+        {
+            HostModem::reply(5, "+PMSGHEX: ERROR");
+            HostModem::reply(30, "(-10)\r\n");
+        }
+        else if(line.find("AT+TEST=RXLRPKT") == 0)HostModem::reply(5, "+TEST: RXLRPKT\r\n");
+    });
+    lora.init();
+
+    CHECK(lora.getModuleTemperatureDeciC() == -35);
+
+    unsigned char data[2] = {0x01, 0x02};
+
+    lora.setLinkStats(&link);
+    CHECK(lora.requestLinkCheck());
+    CHECK(lora.transmitPacketWithConfirmed(data, sizeof(data)));
+    CHECK(link.getAnswers() == 1 && link.getMarginLast() == 20);
+
+    CHECK(lora.isSupported(AT_PMSGHEX));
+    CHECK(!lora.transmitProprietaryPacket(data, sizeof(data)));
+    CHECK(!lora.isSupported(AT_PMSGHEX));
+
+    // Network time behind an uplink, read from the response it left
+    LoRaWanDeviceTime time;
+
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+MSGHEX") == 0)
+        {
+            HostModem::reply(5, "+MSGHEX: Start\r\n+MSGHEX: DTR, 2024-12-09 10:15:30, 1417774548.250\r\n"
+                                "+MSGHEX: RXWIN2, RSSI -80, SNR 9.0\r\n+MSGHEX: Done\r\n");
+        }
+    });
+    CHECK(lora.transmitPacket(data, sizeof(data)));
+    CHECK(lora.getDeviceTime(&time));
+    CHECK(time.gpsSeconds == 1417774548UL && time.milliseconds == 250 && time.window == 2);
+
+    // Raw LoRa reception, every field read from the single matcher
+    LoRaWanTestPacket packet;
+
+    HostModem::setAnswer(NULL);
+    HostModem::reply(5, "+TEST: LEN:3, RSSI:-40, SNR:10\r\n+TEST: RX \"0A0B0C\"\r\n");
+    CHECK(lora.receiveTestPacket(&packet, 1));
+    CHECK(packet.length == 3 && packet.rssi == -40 && packet.snr == 10);
+    CHECK(packet.data && packet.data[0] == 0x0A && packet.data[2] == 0x0C);
+}
+
+
+int main(void)
+{
+    testOffsets();
+    testAnswers();
+
+    return hostReport("test_matcher");
+}
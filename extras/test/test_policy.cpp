@@ -0,0 +1,158 @@
+/*
+  test_policy.cpp
+  Interval policy, battery hysteresis, link history and the airtime budget
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <LoRaWanIntervalPolicy.h>
+#include "HostCheck.h"
+
+
+static void testHysteresis(void)
+{
+    LoRaWanIntervalPolicy policy;
+
+    // Falling takes effect at once
+    policy.setBattery(3950, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_GOOD);
+    policy.setBattery(3890, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_NORMAL);
+    policy.setBattery(3590, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_LOW);
+    policy.setBattery(3390, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_CRITICAL);
+
+    // Rising needs INTERVAL_BATTERY_HYSTERESIS above the level, a voltage
+    // that sags and recovers under load does not flap the interval
+    policy.setBattery(3420, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_CRITICAL);
+    policy.setBattery(3449, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_CRITICAL);
+    policy.setBattery(3450, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_LOW);
+    policy.setBattery(3640, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_LOW);
+    policy.setBattery(3650, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_NORMAL);
+
+    // A jump skips levels, only as far as the hysteresis allows
+    policy.setBattery(3390, false);
+    policy.setBattery(3920, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_NORMAL);
+    policy.setBattery(3950, false);
+    CHECK(policy.getBatteryLevel() == BATTERY_GOOD);
+
+    CHECK(!policy.setBatteryLevels(3500, 3600, 3400));
+}
+
+
+static void testBattery(void)
+{
+    LoRaWanIntervalPolicy policy;
+
+    policy.setBattery(3500, false);
+    CHECK(policy.next() == INTERVAL_BASE * 2);
+    CHECK(policy.getReasons() == INTERVAL_BATTERY_LOW_BIT);
+
+    policy.setBattery(3300, false);
+    CHECK(policy.next() == INTERVAL_BASE * 4);
+    CHECK(policy.getReasons() == INTERVAL_BATTERY_CRIT_BIT);
+
+    // Not stretched while charging
+    policy.setBattery(3300, true);
+    CHECK(policy.next() == INTERVAL_BASE);
+    CHECK(policy.getReasons() == 0);
+}
+
+
+static void testLink(void)
+{
+    LoRaWanIntervalPolicy policy;
+
+    policy.setBattery(4000, false);
+
+    // Too few uplinks to judge the link
+    policy.addUplink(50, false);
+    policy.addUplink(50, false);
+    CHECK(policy.next() == INTERVAL_BASE);
+
+    // 8 of the last 8, halved on a good battery
+    for(unsigned char i = 0; i < 8; i ++)policy.addUplink(50, true);
+    CHECK(policy.getSuccessRate() == 100);
+    CHECK(policy.next() == INTERVAL_BASE / 2);
+    CHECK(policy.getReasons() == INTERVAL_HEALTHY_BIT);
+
+    // 4 of 8 is poor, 2 of 8 bad
+    for(unsigned char i = 0; i < 4; i ++)policy.addUplink(50, false);
+    CHECK(policy.next() == INTERVAL_BASE * 2);
+    CHECK(policy.getReasons() == INTERVAL_LINK_POOR_BIT);
+
+    policy.addUplink(50, false);
+    policy.addUplink(50, false);
+    CHECK(policy.getSuccessRate() == 25);
+    CHECK(policy.next() == INTERVAL_BASE * 4);
+    CHECK(policy.getReasons() == INTERVAL_LINK_BAD_BIT);
+
+    // A bad link on a critical battery hits the upper limit
+    policy.setBattery(3300, false);
+    CHECK(policy.next() == INTERVAL_MAX);
+    CHECK(policy.getReasons() == (INTERVAL_BATTERY_CRIT_BIT | INTERVAL_LINK_BAD_BIT | INTERVAL_LIMITED_BIT));
+}
+
+
+static void testLimits(void)
+{
+    LoRaWanIntervalPolicy policy;
+
+    CHECK(!policy.setLimits(INTERVAL_FLOOR - 1, 600));
+    CHECK(!policy.setLimits(600, 300));
+    CHECK(policy.setLimits(400, 900));
+    CHECK(policy.getBase() == 400);
+    CHECK(!policy.setBase(1000));
+    CHECK(policy.setBase(900));
+
+    policy.setBattery(3500, false);
+    CHECK(policy.next() == 900);
+    CHECK(policy.getReasons() & INTERVAL_LIMITED_BIT);
+}
+
+
+static void testBudget(void)
+{
+    LoRaWanIntervalPolicy policy;
+
+    // An uplink longer than the hourly budget, the debt is earned back first
+    policy.addUplink(40000, true);
+    CHECK(policy.getBudget() == INTERVAL_AIRTIME_BUDGET - 40000);
+    CHECK(policy.next() == 4400);
+    CHECK(policy.getReasons() == INTERVAL_DUTY_BIT);
+
+    // The interval handed out refilled the bucket, up to the budget, which
+    // is still short of what the last uplink took
+    CHECK(policy.getBudget() == INTERVAL_AIRTIME_BUDGET);
+    CHECK(policy.next() == 400);
+    CHECK(policy.getReasons() == INTERVAL_DUTY_BIT);
+
+    // Short uplinks at the base interval never touch the duty cycle
+    for(unsigned char i = 0; i < 50; i ++)
+    {
+        policy.addUplink(1500, true);
+        CHECK(policy.next() == INTERVAL_BASE);
+        CHECK(policy.getBudget() == INTERVAL_AIRTIME_BUDGET);
+    }
+}
+
+
+int main(void)
+{
+    testHysteresis();
+    testBattery();
+    testLink();
+    testLimits();
+    testBudget();
+
+    return hostReport("test_policy");
+}
@@ -0,0 +1,70 @@
+/*
+  test_ram_budget.cpp
+  Static and stack RAM of the library against the budget in SeeeduinoLoRaWan.h
+
+  Built three times, with the default buffer, with a receive ring and with
+  a caller owned buffer, see the Makefile.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <limits.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+#define MATCHER_STACK_MAX   352         // "~350 bytes" of the table
+
+LoRaWanClass lora;
+char callerBuffer[128];
+
+
+int main(void)
+{
+    printf("LoRaWanClass %u of %u bytes, buffer %u, ring %u\n", (unsigned)sizeof(LoRaWanClass),
+           (unsigned)LORAWAN_STATIC_RAM_BUDGET, (unsigned)BEFFER_LENGTH_MAX, (unsigned)LORAWAN_RX_RING_SIZE);
+
+    CHECK(sizeof(LoRaWanClass) <= LORAWAN_STATIC_RAM_BUDGET);
+    CHECK(sizeof(LoRaWanMatcher) <= MATCHER_STACK_MAX);
+
+    // The number cache holds the longest long
+    char number[NUMBER_TEXT_MAX + 1];
+    memset(number, 'x', sizeof(number));
+    LoRaWanClass::formatNumber(number, LONG_MIN);
+    CHECK(strlen(number) < NUMBER_TEXT_MAX);
+    CHECK(number[NUMBER_TEXT_MAX] == 'x');
+
+    // A received payload is a view into the response buffer, not a copy
+    #if BEFFER_LENGTH_MAX == 0
+    lora.setBuffer(callerBuffer, sizeof(callerBuffer));
+    #endif
+
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+MSGHEX") == 0)
+        {
+            HostModem::reply(5, "+MSGHEX: Start\r\n+MSGHEX: PORT: 3; RX: \"0102A0\"\r\n+MSGHEX: RXWIN1, RSSI -97, SNR 7.0\r\n+MSGHEX: Done\r\n");
+        }
+    });
+    lora.init();
+
+    unsigned char data[1] = {0x42};
+    LoRaWanPayload payload;
+
+    CHECK(lora.transmitPacket(data, sizeof(data)));
+    CHECK(lora.receivePacket(&payload));
+    CHECK(payload.length == 3 && payload.port == 3 && payload.rssi == -97);
+    CHECK(payload.data && payload.data[2] == 0xA0);
+
+    const char *buffer = (const char *)payload.data;
+    #if BEFFER_LENGTH_MAX == 0
+    CHECK(buffer > callerBuffer && buffer < callerBuffer + sizeof(callerBuffer));
+    #else
+    CHECK(buffer > (const char *)&lora && buffer < (const char *)&lora + sizeof(lora));
+    #endif
+
+    return hostReport("test_ram_budget");
+}
@@ -0,0 +1,125 @@
+/*
+  test_replay.cpp
+  Capture of a modem session and its replay without the modem
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <LoRaWanCapture.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+// Collects a log or a report in memory
+class StringSink : public Print
+{
+    public:
+        std::string text;
+
+        virtual size_t write(uint8_t c)
+        {
+            text += (char)c;
+            return 1;
+        }
+        using Print::write;
+};
+
+
+struct session_t
+{
+    short temp;
+    bool sent;
+    short length;
+    unsigned char port;
+    unsigned char first;
+};
+
+
+// The same commands are run against the live modem and against the replay
+static session_t runSession(LoRaWanClass &lora)
+{
+    session_t session;
+    unsigned char data[3] = {0x01, 0x02, 0x03};
+    LoRaWanPayload payload;
+
+    session.temp = lora.getModuleTemperatureDeciC();
+    session.sent = lora.transmitPacket(data, sizeof(data));
+    lora.receivePacket(&payload);
+    session.length = payload.length;
+    session.port = payload.port;
+    session.first = payload.length ? payload.data[0] : 0;
+
+    return session;
+}
+
+
+int main(void)
+{
+    StringSink log;
+    LoRaWanCapture capture(&log);
+    LoRaWanClass live;
+
+    HostModem::setAnswer([](const std::string &line)
+    {
+        if(line.find("AT+VER") == 0)HostModem::reply(10, "+VER: 2.1.19\r\n");
+        else if(line.find("AT+TEMP") == 0)HostModem::reply(30, "+TEMP: 21.5\r\n");
+        else if(line.find("AT+MSGHEX") == 0)
+        {
+            HostModem::reply(20, "+MSGHEX: Start\r\n");
+            HostModem::reply(300, "+MSGHEX: PORT: 5; RX: \"C0FFEE\"\r\n+MSGHEX: RXWIN1, RSSI -90, SNR 6.0\r\n+MSGHEX: Done\r\n");
+        }
+    });
+
+    capture.begin();
+    live.setCapture(&capture);
+    live.init();
+    session_t recorded = runSession(live);
+    live.setCapture(NULL);
+
+    CHECK(recorded.temp == 215 && recorded.sent);
+    CHECK(recorded.length == 3 && recorded.port == 5 && recorded.first == 0xC0);
+    CHECK(log.text.compare(0, 4, "LWR1") == 0);
+    CHECK(log.text.find("AT+MSGHEX=\"010203\"") != std::string::npos);
+
+    // Ten times faster, no modem behind Serial1 any more
+    HostModem::reset();
+
+    LoRaWanReplay replay((const uint8_t *)log.text.data(), log.text.size());
+    LoRaWanClass played;
+    StringSink report;
+
+    CHECK(replay.valid());
+    replay.setSpeed(10);
+
+    unsigned long timerStart = millis();
+    played.init(replay);
+    session_t replayed = runSession(played);
+    unsigned long elapsed = millis() - timerStart;
+
+    CHECK(replay.finished());
+    CHECK(replay.getMismatches() == 0);
+    CHECK(replayed.temp == recorded.temp && replayed.sent == recorded.sent);
+    CHECK(replayed.length == recorded.length && replayed.port == recorded.port && replayed.first == recorded.first);
+    CHECK(elapsed < 300);
+
+    replay.report(report);
+    printf("%s", report.text.c_str());
+    CHECK(report.text.find("AT+TEMP") != std::string::npos);
+    CHECK(report.text.find("AT+MSGHEX") != std::string::npos);
+
+    // A library change that alters a command shows up as mismatches
+    LoRaWanReplay changed((const uint8_t *)log.text.data(), log.text.size());
+    LoRaWanClass other;
+    unsigned char data[3] = {0x01, 0x02, 0x04};
+
+    changed.setSpeed(10);
+    other.init(changed);
+    other.getModuleTemperatureDeciC();
+    other.transmitPacket(data, sizeof(data));
+    CHECK(changed.getMismatches() > 0);
+
+    return hostReport("test_replay");
+}
@@ -0,0 +1,117 @@
+/*
+  test_rx_ring.cpp
+  Receive ring, fed by the UART during waits and by a simulated byte source
+
+  Built with LORAWAN_RX_RING_SIZE=256, see the Makefile.
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include <thread>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+LoRaWanClass lora;
+static LoRaWanPayload delivered;
+static int deliveries = 0;
+
+
+static void onDownlink(const LoRaWanPayload *payload)
+{
+    delivered = *payload;
+    deliveries ++;
+}
+
+
+static void testRing(void)
+{
+    uint8_t storage[8];
+    LoRaWanRing ring(storage, sizeof(storage));
+
+    // One byte stays unused, the eighth is dropped and counted
+    for(uint8_t i = 0; i < 7; i ++)CHECK(ring.push(i));
+    CHECK(!ring.push(7));
+    CHECK(ring.available() == 7 && ring.getOverflowCount() == 1 && ring.getHighWater() == 7);
+
+    for(int i = 0; i < 7; i ++)CHECK(ring.pop() == i);
+    CHECK(ring.pop() == -1);
+
+    // Wrapping around the storage keeps the order
+    for(int round = 0; round < 5; round ++)
+    {
+        for(uint8_t i = 0; i < 5; i ++)ring.push(round * 5 + i);
+        for(int i = 0; i < 5; i ++)CHECK(ring.pop() == round * 5 + i);
+    }
+
+    ring.push(1);
+    ring.clear();
+    CHECK(ring.available() == 0 && ring.getOverflowCount() == 1);
+}
+
+
+static void testWaitCaptures(void)
+{
+    LoRaWanRing *ring = lora.getRxRing();
+    std::string burst(300, 'x');
+
+    // A burst longer than the ring while the sketch waits, the excess is counted
+    ring->clear();
+    HostModem::reply(5, burst);
+    lora.wait(50);
+    CHECK(ring->available() == LORAWAN_RX_RING_SIZE - 1);
+    CHECK(ring->getOverflowCount() == 300 - (LORAWAN_RX_RING_SIZE - 1));
+    CHECK(Serial1.available() == 0);
+    ring->clear();
+
+    // A Class C downlink arriving during a wait is delivered afterwards
+    lora.setDownlinkHandler(onDownlink);
+    HostModem::reply(5, "+MSG: PORT: 2; RX: \"AB\"\r\n+MSG: RXWIN0, RSSI -60, SNR 8\r\n");
+    lora.wait(50);
+    CHECK(Serial1.available() == 0 && ring->available() > 0);
+
+    lora.listen(LORAWAN_RSSI_WAIT + 50);
+    CHECK(deliveries == 1);
+    CHECK(delivered.port == 2 && delivered.length == 1 && delivered.rssi == -60);
+}
+
+
+static void testByteSource(void)
+{
+    LoRaWanRing *ring = lora.getRxRing();
+    const char *answer = "+TEST: LEN:2, RSSI:-41, SNR:9\r\n+TEST: RX \"BEEF\"\r\n";
+    LoRaWanTestPacket packet;
+
+    // The producer stands in for the UART interrupt, one byte per 200 us
+    ring->clear();
+    std::thread source([ring, answer]()
+    {
+        for(const char *ptr = answer; *ptr; ptr ++)
+        {
+            while(!ring->push(*ptr))std::this_thread::yield();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    CHECK(lora.receiveTestPacket(&packet, 2));
+    source.join();
+
+    CHECK(packet.length == 2 && packet.rssi == -41 && packet.snr == 9);
+    CHECK(packet.data && packet.data[0] == 0xBE && packet.data[1] == 0xEF);
+    CHECK(ring->getHighWater() < LORAWAN_RX_RING_SIZE);
+}
+
+
+int main(void)
+{
+    lora.init();
+
+    testRing();
+    testWaitCaptures();
+    testByteSource();
+
+    return hostReport("test_rx_ring");
+}
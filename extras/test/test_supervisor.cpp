@@ -0,0 +1,106 @@
+/*
+  test_supervisor.cpp
+  Recovery of a silent modem and the bounded Class B switch
+
+  The MIT License (MIT)
+
+  Modified for LoRa@VSB by Ondřej Knebl, 9. 12. 2024
+*/
+
+#include <SeeeduinoLoRaWan.h>
+#include "HostModem.h"
+#include "HostCheck.h"
+
+
+LoRaWanClass lora;
+LoRaWanSupervisor supervisor(1);
+static bool silent = true;
+static bool beaconFound = false;
+
+
+static size_t count(const std::string &text, const char *needle)
+{
+    size_t number = 0;
+    for(size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1))number ++;
+    return number;
+}
+
+
+static void answer(const std::string &line)
+{
+    if(line.find("AT+RESET") == 0)
+    {
+        silent = false;
+        HostModem::reply(5, "+RESET: OK\r\n");
+        return;
+    }
+    if(silent)return;
+
+    if(line == "AT\r\n")HostModem::reply(5, "+AT: OK\r\n");
+    else if(line.find("AT+VER") == 0)HostModem::reply(5, "+VER: 2.1.19\r\n");
+    else if(line.find("AT+TEMP") == 0)HostModem::reply(5, "+TEMP: 22.0\r\n");
+    else if(line.find("AT+POWER=") == 0)HostModem::reply(5, "+POWER: 14\r\n");
+    else if(line.find("AT+BEACON") == 0)HostModem::reply(5, "+BEACON: DMMUL, 1, 15\r\n");
+    else if(line.find("AT+CLASS=A") == 0)HostModem::reply(5, "+CLASS: A\r\n");
+    else if(line.find("AT+CLASS=C") == 0)HostModem::reply(5, "+CLASS: C\r\n");
+    else if(line.find("AT+CLASS=B") == 0)
+    {
+        HostModem::reply(5, "+CLASS: B\r\n");
+        HostModem::reply(150, beaconFound ? "+BEACON: LOCKED\r\n+BEACON: DONE\r\n" : "+BEACON: FAILED\r\n");
+    }
+}
+
+
+static void testDeferredRecovery(void)
+{
+    lora.setSupervisor(&supervisor);
+
+    // The silent command returns first, its buffer untouched by a reset
+    CHECK(!lora.setPower(14));
+    CHECK(count(HostModem::sent(), "AT+RESET") == 0);
+    CHECK(supervisor.getRecoveries() == 0);
+
+    // The next command starts on a recovered modem with the power replayed
+    size_t sent = HostModem::sent().size();
+    CHECK(lora.getModuleTemperatureDeciC() == 220);
+
+    std::string after = HostModem::sent().substr(sent);
+    CHECK(after.find("AT+RESET") < after.find("AT+POWER=14"));
+    CHECK(after.find("AT+POWER=14") < after.find("AT+TEMP"));
+    CHECK(supervisor.getRecoveries() == 1);
+}
+
+
+static void testClassB(void)
+{
+    size_t sent = HostModem::sent().size();
+
+    // No beacon, the switch gives up instead of searching forever
+    CHECK(!lora.setClassType(CLASS_B));
+    CHECK(count(HostModem::sent().substr(sent), "AT+CLASS=B") == CLASS_B_ATTEMPTS);
+
+    beaconFound = true;
+    CHECK(lora.setClassType(CLASS_B));
+    CHECK(lora.setClassType(CLASS_C));
+    CHECK(lora.setClassType(CLASS_A));
+
+    // A modem that never answers fails the switch
+    LoRaWanClass quiet;
+    HostModem::setAnswer(NULL);
+    quiet.init();
+    CHECK(!quiet.setClassType(CLASS_C));
+}
+
+
+int main(void)
+{
+    HostModem::setAnswer(answer);
+    silent = false;
+    lora.init();
+    silent = true;
+
+    testDeferredRecovery();
+    testClassB();
+
+    return hostReport("test_supervisor");
+}